@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "blktune"
+
+#include "BlockTuner.h"
+
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace android {
+namespace blktune {
+
+using ::android::base::SetProperty;
+using ::android::base::StartsWith;
+using ::android::base::StringPrintf;
+using ::android::base::unique_fd;
+
+static constexpr std::chrono::milliseconds kSamplePeriod(1000);
+
+/* idle, random, sequential; the idle values match what init used to leave behind */
+static constexpr std::array<QueueTunables, static_cast<size_t>(Phase::COUNT)> kDiskTunables = {{
+        {512, 128},
+        {128, 256},
+        {2048, 256},
+}};
+static constexpr std::array<QueueTunables, static_cast<size_t>(Phase::COUNT)> kDmTunables = {{
+        {128, 0},
+        {128, 0},
+        {2048, 0},
+}};
+
+/* Below this many requests per second a device counts as idle. */
+static constexpr uint64_t kIdleIops = 20;
+
+/*
+ * Average request sizes on either side of the dead band. Streaming readers
+ * and writers end up with large or merged requests, app launches fault in
+ * small scattered ones.
+ */
+static constexpr uint64_t kSequentialKb = 64;
+static constexpr uint64_t kRandomKb = 32;
+
+/*
+ * Consecutive samples needed to enter a phase. Launches are short so random
+ * is entered right away, installs and media scans last long enough to wait
+ * for, and idle is only entered once a device has really settled.
+ */
+static constexpr std::array<int, static_cast<size_t>(Phase::COUNT)> kEnterSamples = {10, 1, 3};
+
+static const char* phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::IDLE:
+            return "idle";
+        case Phase::RANDOM:
+            return "random";
+        case Phase::SEQUENTIAL:
+            return "sequential";
+        default:
+            return "unknown";
+    }
+}
+
+static unique_fd openQueueNode(const std::string& path, int flags) {
+    unique_fd fd(open(path.c_str(), flags | O_CLOEXEC));
+
+    if (fd.get() < 0) {
+        PLOG(WARNING) << "failed to open " << path;
+    }
+    return fd;
+}
+
+static bool writeNode(int fd, int value) {
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%d", value);
+
+    return fd >= 0 && pwrite(fd, buf, len, 0) == len;
+}
+
+BlockTuner::BlockTuner(const std::string& blockDir) : mBlockDir(blockDir) {}
+
+bool BlockTuner::init() {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(mBlockDir.c_str()), closedir);
+    if (!dir) {
+        PLOG(ERROR) << "failed to open " << mBlockDir;
+        return false;
+    }
+
+    /*
+     * The UFS userdata LUN and the dm devices on top of it. The SD card keeps
+     * the static values from init.mt6785.rc.
+     */
+    struct dirent* dp;
+    while ((dp = readdir(dir.get())) != nullptr) {
+        std::string name = dp->d_name;
+        if (name == "sdc" || StartsWith(name, "dm-")) {
+            addDevice(name);
+        }
+    }
+
+    if (mDevices.empty()) {
+        LOG(ERROR) << "no block devices to tune";
+        return false;
+    }
+    return true;
+}
+
+bool BlockTuner::addDevice(const std::string& name) {
+    BlockDevice device;
+
+    device.name = name;
+    device.tunables = StartsWith(name, "dm-") ? &kDmTunables : &kDiskTunables;
+    device.statFd = openQueueNode(mBlockDir + name + "/stat", O_RDONLY);
+    device.readAheadFd = openQueueNode(mBlockDir + name + "/queue/read_ahead_kb", O_WRONLY);
+    if ((*device.tunables)[0].nrRequests > 0) {
+        device.nrRequestsFd = openQueueNode(mBlockDir + name + "/queue/nr_requests", O_WRONLY);
+    }
+
+    /* Only the queues labeled sysfs_block_queue are writable */
+    if (device.readAheadFd.get() < 0) {
+        return false;
+    }
+
+    if (device.statFd.get() < 0 || !readStat(device, &device.last)) {
+        return false;
+    }
+
+    apply(device);
+    mDevices.push_back(std::move(device));
+    return true;
+}
+
+bool BlockTuner::readStat(BlockDevice& device, BlockStat* stat) {
+    char buf[256];
+    ssize_t len = pread(device.statFd.get(), buf, sizeof(buf) - 1, 0);
+    if (len <= 0) {
+        PLOG(WARNING) << "failed to read " << device.name << " stat";
+        return false;
+    }
+    buf[len] = '\0';
+
+    uint64_t readIos, readMerges, readSectors, readTicks;
+    uint64_t writeIos, writeMerges, writeSectors;
+    if (sscanf(buf, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+               " %" SCNu64, &readIos, &readMerges, &readSectors, &readTicks, &writeIos,
+               &writeMerges, &writeSectors) != 7) {
+        LOG(WARNING) << "malformed " << device.name << " stat: " << buf;
+        return false;
+    }
+
+    stat->ios = readIos + writeIos;
+    stat->merges = readMerges + writeMerges;
+    stat->sectors = readSectors + writeSectors;
+    return true;
+}
+
+/*
+ * Requests in the dead band between kRandomKb and kSequentialKb that are not
+ * mostly merged keep the device in its current phase.
+ */
+Phase BlockTuner::classify(const BlockStat& delta, std::chrono::milliseconds period) const {
+    if (delta.ios * 1000 < kIdleIops * period.count()) {
+        return Phase::IDLE;
+    }
+
+    uint64_t averageKb = delta.sectors / 2 / delta.ios;
+    if (averageKb >= kSequentialKb || delta.merges >= delta.ios) {
+        return Phase::SEQUENTIAL;
+    }
+    if (averageKb <= kRandomKb && delta.merges * 4 < delta.ios) {
+        return Phase::RANDOM;
+    }
+    return Phase::COUNT;
+}
+
+void BlockTuner::update(BlockDevice& device, Phase sample, const BlockStat& delta) {
+    if (sample == Phase::COUNT || sample == device.phase) {
+        device.streak = 0;
+        return;
+    }
+
+    if (sample != device.candidate) {
+        device.candidate = sample;
+        device.streak = 0;
+    }
+    if (++device.streak < kEnterSamples[static_cast<size_t>(sample)]) {
+        return;
+    }
+
+    LOG(INFO) << device.name << ": " << phaseName(device.phase) << " -> " << phaseName(sample)
+              << " (" << delta.ios << " requests, " << delta.merges << " merges, "
+              << delta.sectors / 2 << " KB)";
+    device.phase = sample;
+    device.streak = 0;
+    device.transitions++;
+    apply(device);
+}
+
+void BlockTuner::apply(BlockDevice& device) {
+    const QueueTunables& tunables = (*device.tunables)[static_cast<size_t>(device.phase)];
+
+    if (!writeNode(device.readAheadFd.get(), tunables.readAheadKb)) {
+        PLOG(WARNING) << "failed to set " << device.name << " read_ahead_kb";
+    }
+    if (tunables.nrRequests > 0 && !writeNode(device.nrRequestsFd.get(), tunables.nrRequests)) {
+        PLOG(WARNING) << "failed to set " << device.name << " nr_requests";
+    }
+
+    SetProperty("vendor.blktune." + device.name,
+                StringPrintf("%s,%d,%d,%" PRIu64, phaseName(device.phase), tunables.readAheadKb,
+                             tunables.nrRequests, device.transitions));
+}
+
+void BlockTuner::run() {
+    auto last = std::chrono::steady_clock::now();
+
+    while (true) {
+        std::this_thread::sleep_for(kSamplePeriod);
+
+        auto now = std::chrono::steady_clock::now();
+        sample(std::chrono::duration_cast<std::chrono::milliseconds>(now - last));
+        last = now;
+    }
+}
+
+void BlockTuner::sample(std::chrono::milliseconds period) {
+    for (auto& device : mDevices) {
+        BlockStat stat;
+        if (!readStat(device, &stat)) {
+            continue;
+        }
+
+        BlockStat delta = {stat.ios - device.last.ios, stat.merges - device.last.merges,
+                           stat.sectors - device.last.sectors};
+        device.last = stat;
+        update(device, classify(delta, period), delta);
+    }
+}
+
+}  // namespace blktune
+}  // namespace android
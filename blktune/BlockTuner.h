@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace blktune {
+
+enum class Phase { IDLE, RANDOM, SEQUENTIAL, COUNT };
+
+/* Counters of /sys/block/<dev>/stat that the classification looks at */
+struct BlockStat {
+    uint64_t ios = 0;
+    uint64_t merges = 0;
+    uint64_t sectors = 0;
+};
+
+struct QueueTunables {
+    int readAheadKb;
+    int nrRequests;  // 0 for bio based devices without a request queue
+};
+
+struct BlockDevice {
+    std::string name;
+    const std::array<QueueTunables, static_cast<size_t>(Phase::COUNT)>* tunables;
+
+    ::android::base::unique_fd statFd;
+    ::android::base::unique_fd readAheadFd;
+    ::android::base::unique_fd nrRequestsFd;
+
+    BlockStat last;
+    Phase phase = Phase::IDLE;
+    Phase candidate = Phase::IDLE;
+    int streak = 0;
+    uint64_t transitions = 0;
+};
+
+/*
+ * Samples the block devices behind userdata and the dm targets once a second
+ * and moves each of them between idle, random and sequential queue settings.
+ * Decisions are published as vendor.blktune.<dev> properties.
+ */
+class BlockTuner {
+  public:
+    /* blockDir is the block class directory with a trailing slash, the host tests use a fake one */
+    explicit BlockTuner(const std::string& blockDir = "/sys/block/");
+
+    bool init();
+    void run();
+
+    /* Take one sample of every device, period after the previous one */
+    void sample(std::chrono::milliseconds period);
+
+    const std::vector<BlockDevice>& devices() const { return mDevices; }
+
+  private:
+    bool addDevice(const std::string& name);
+    bool readStat(BlockDevice& device, BlockStat* stat);
+    Phase classify(const BlockStat& delta, std::chrono::milliseconds period) const;
+    void update(BlockDevice& device, Phase sample, const BlockStat& delta);
+    void apply(BlockDevice& device);
+
+    const std::string mBlockDir;
+    std::vector<BlockDevice> mDevices;
+};
+
+}  // namespace blktune
+}  // namespace android
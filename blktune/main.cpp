@@ -0,0 +1,21 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cstdlib>
+
+#include "BlockTuner.h"
+
+using ::android::blktune::BlockTuner;
+
+int main() {
+    BlockTuner tuner;
+    if (!tuner.init()) {
+        return EXIT_FAILURE;
+    }
+
+    tuner.run();
+    return EXIT_FAILURE;  // should not reach
+}
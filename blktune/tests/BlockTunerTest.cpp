@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "BlockTuner.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <map>
+#include <string>
+
+using ::android::base::ReadFileToString;
+using ::android::base::StringPrintf;
+using ::android::base::WriteStringToFile;
+using ::android::blktune::BlockDevice;
+using ::android::blktune::BlockTuner;
+using ::android::blktune::Phase;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/* One second of requests, each of kb KB with merges of them merged */
+struct Load {
+    uint64_t ios;
+    uint64_t merges;
+    uint64_t kb;
+};
+
+constexpr Load kIdle = {5, 0, 4};
+constexpr Load kRandom = {400, 10, 8};
+constexpr Load kSequential = {200, 50, 256};
+/* Between kRandomKb and kSequentialKb, not merged enough to decide */
+constexpr Load kDeadBand = {300, 10, 48};
+
+/* A directory standing in for /sys/block, with the UFS LUN, a dm device and the SD card */
+class BlockTunerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        for (const char* dev : {"sdc", "dm-0", "mmcblk0"}) {
+            ASSERT_EQ(0, mkdir(path(dev).c_str(), 0700));
+            std::string queue = std::string(dev) + "/queue";
+            ASSERT_EQ(0, mkdir(path(queue).c_str(), 0700));
+            ASSERT_TRUE(WriteStringToFile("", path(queue + "/read_ahead_kb")));
+            mStat[dev] = {};
+            writeStat(dev);
+        }
+        ASSERT_TRUE(WriteStringToFile("", path("sdc/queue/nr_requests")));
+        ASSERT_TRUE(WriteStringToFile("", path("mmcblk0/queue/nr_requests")));
+
+        ASSERT_TRUE(mTuner.init());
+    }
+
+    std::string path(const std::string& node) { return std::string(mDir.path) + "/" + node; }
+
+    /*
+     * The stat line of the kernel, requests split evenly between reads and
+     * writes. Both halves carry kb sectors, which add up to kb KB.
+     */
+    void writeStat(const std::string& dev) {
+        const Load& s = mStat[dev];
+        ASSERT_TRUE(WriteStringToFile(
+                StringPrintf("%8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8u %8" PRIu64 " %8" PRIu64
+                             " %8" PRIu64 " %8u %8u %8u %8u\n",
+                             s.ios / 2, s.merges / 2, s.kb, 100u, s.ios - s.ios / 2,
+                             s.merges - s.merges / 2, s.kb, 100u, 0u, 200u, 200u),
+                path(dev + "/stat")));
+    }
+
+    /* Add a second of load to a device and sample it, stat keeps cumulative counters */
+    void replay(const std::string& dev, const Load& load, int seconds = 1) {
+        for (int i = 0; i < seconds; i++) {
+            mStat[dev].ios += load.ios;
+            mStat[dev].merges += load.merges;
+            mStat[dev].kb += load.ios * load.kb;
+            writeStat(dev);
+            mTuner.sample(1000ms);
+        }
+    }
+
+    /* What was written to a queue node since the last call, nodes are written at offset 0 */
+    std::string take(const std::string& node) {
+        std::string value;
+        ReadFileToString(path(node), &value);
+        truncate(path(node).c_str(), 0);
+        return value;
+    }
+
+    const BlockDevice& device(const std::string& name) {
+        for (const BlockDevice& device : mTuner.devices()) {
+            if (device.name == name) {
+                return device;
+            }
+        }
+        ADD_FAILURE() << "no device " << name;
+        return mTuner.devices()[0];
+    }
+
+    TemporaryDir mDir;
+    BlockTuner mTuner{std::string(mDir.path) + "/"};
+    std::map<std::string, Load> mStat;
+};
+
+TEST_F(BlockTunerTest, OnlyUserdataDevicesAreTuned) {
+    ASSERT_EQ(2u, mTuner.devices().size());
+    EXPECT_EQ(Phase::IDLE, device("sdc").phase);
+    EXPECT_EQ(Phase::IDLE, device("dm-0").phase);
+
+    /* Both start out on the idle values, the SD card keeps what init set */
+    EXPECT_EQ("512", take("sdc/queue/read_ahead_kb"));
+    EXPECT_EQ("128", take("sdc/queue/nr_requests"));
+    EXPECT_EQ("128", take("dm-0/queue/read_ahead_kb"));
+    EXPECT_EQ("", take("mmcblk0/queue/read_ahead_kb"));
+    EXPECT_EQ("", take("mmcblk0/queue/nr_requests"));
+}
+
+TEST_F(BlockTunerTest, RandomIsEnteredAfterOneSample) {
+    take("sdc/queue/read_ahead_kb");
+
+    replay("sdc", kRandom);
+    EXPECT_EQ(Phase::RANDOM, device("sdc").phase);
+    EXPECT_EQ("128", take("sdc/queue/read_ahead_kb"));
+    EXPECT_EQ("256", take("sdc/queue/nr_requests"));
+}
+
+TEST_F(BlockTunerTest, SequentialIsEnteredAfterThreeSamples) {
+    replay("sdc", kSequential, 2);
+    EXPECT_EQ(Phase::IDLE, device("sdc").phase);
+    take("sdc/queue/read_ahead_kb");
+
+    replay("sdc", kSequential);
+    EXPECT_EQ(Phase::SEQUENTIAL, device("sdc").phase);
+    EXPECT_EQ("2048", take("sdc/queue/read_ahead_kb"));
+    EXPECT_EQ(1u, device("sdc").transitions);
+}
+
+TEST_F(BlockTunerTest, IdleIsEnteredAfterTenSamples) {
+    replay("sdc", kRandom);
+    ASSERT_EQ(Phase::RANDOM, device("sdc").phase);
+    take("sdc/queue/read_ahead_kb");
+
+    replay("sdc", kIdle, 9);
+    EXPECT_EQ(Phase::RANDOM, device("sdc").phase);
+    EXPECT_EQ("", take("sdc/queue/read_ahead_kb")) << "nothing written while settling";
+
+    replay("sdc", kIdle);
+    EXPECT_EQ(Phase::IDLE, device("sdc").phase);
+    EXPECT_EQ("512", take("sdc/queue/read_ahead_kb"));
+    EXPECT_EQ("128", take("sdc/queue/nr_requests"));
+}
+
+TEST_F(BlockTunerTest, InterruptedStreakStartsOver) {
+    replay("sdc", kRandom);
+
+    /* A burst between idle samples restarts the count */
+    replay("sdc", kIdle, 9);
+    replay("sdc", kRandom);
+    replay("sdc", kIdle, 9);
+    EXPECT_EQ(Phase::RANDOM, device("sdc").phase);
+
+    /* So does the dead band, without counting as either phase */
+    replay("sdc", kSequential, 2);
+    replay("sdc", kDeadBand);
+    replay("sdc", kSequential, 2);
+    EXPECT_EQ(Phase::RANDOM, device("sdc").phase);
+    replay("sdc", kSequential);
+    EXPECT_EQ(Phase::SEQUENTIAL, device("sdc").phase);
+    EXPECT_EQ(2u, device("sdc").transitions);
+}
+
+TEST_F(BlockTunerTest, MergedRequestsCountAsSequential) {
+    /* Small requests that are mostly merged come from a streaming writer */
+    replay("sdc", {400, 400, 16}, 3);
+    EXPECT_EQ(Phase::SEQUENTIAL, device("sdc").phase);
+}
+
+TEST_F(BlockTunerTest, DevicesAreTrackedSeparately) {
+    take("dm-0/queue/read_ahead_kb");
+    take("sdc/queue/read_ahead_kb");
+
+    replay("dm-0", kSequential, 3);
+    EXPECT_EQ(Phase::SEQUENTIAL, device("dm-0").phase);
+    EXPECT_EQ(Phase::IDLE, device("sdc").phase);
+
+    /* dm targets are bio based and only get their read ahead changed */
+    EXPECT_EQ("2048", take("dm-0/queue/read_ahead_kb"));
+    EXPECT_EQ("", take("sdc/queue/read_ahead_kb"));
+}
+
+}  // namespace
@@ -0,0 +1,2 @@
+[AID_VENDOR_SENSORS_STATE]
+value:2950
@@ -7,17 +7,23 @@
 #ifndef LIBINIT_DALVIK_HEAP_H
 #define LIBINIT_DALVIK_HEAP_H
 
-#include <string>
+#include <cstdint>
 
+#include <libinit_utils.h>
+
+/* Sizes are in KiB */
 typedef struct dalvik_heap_info {
-    std::string heapstartsize;
-    std::string heapgrowthlimit;
-    std::string heapsize;
-    std::string heapminfree;
-    std::string heapmaxfree;
-    std::string heaptargetutilization;
+    uint64_t heapstartsize;
+    uint64_t heapgrowthlimit;
+    uint64_t heapsize;
+    uint64_t heapminfree;
+    uint64_t heapmaxfree;
+    float heaptargetutilization;
 } dalvik_heap_info_t;
 
-void set_dalvik_heap(void);
+void compute_dalvik_heap(uint64_t total_ram, uint64_t zram_size, dalvik_heap_info_t *dhi);
+
+/* Queues the dalvik.vm heap properties on batch, the caller commits it */
+void set_dalvik_heap(property_batch &batch);
 
 #endif // LIBINIT_DALVIK_HEAP_H
@@ -7,12 +7,89 @@
 #ifndef LIBINIT_UTILS_H
 #define LIBINIT_UTILS_H
 
+#include <cstddef>
+#include <initializer_list>
 #include <string>
+#include <string_view>
+
+#ifndef PROP_VALUE_MAX
+#define PROP_VALUE_MAX 92
+#endif
+
+/*
+ * Where properties are read from and written to. init goes through the
+ * system property area, host tests and benchmarks install a stub.
+ */
+typedef struct property_area {
+    /* Like __system_property_get, returns the length of the value or 0 */
+    int (*get)(const char *prop, char *value);
+    /* Updates prop, or adds it when it does not exist yet and add is set */
+    void (*set)(const char *prop, size_t prop_len, const char *value, size_t value_len, bool add);
+} property_area_t;
+
+/* nullptr goes back to the system property area, there is none on the host */
+void set_property_area(const property_area_t *area);
+
+int property_get(const char *prop, char *value);
+
+/*
+ * Collects property writes and applies them together. Keys and values are
+ * copied into a fixed arena so that no heap allocation happens per property.
+ * The arena takes about 12 KiB, so callers keep one batch for all of their
+ * properties rather than one per property.
+ */
+class property_batch {
+  public:
+    void add(std::string_view prop, std::string_view value, bool add = true);
+    void add_ro_build_prop(std::string_view prop, std::string_view value, bool product = false);
+    void commit();
+
+  private:
+    static constexpr size_t kArenaSize = 8192;
+    static constexpr size_t kMaxEntries = 96;
+
+    typedef struct entry {
+        const char *prop;
+        size_t prop_len;
+        const char *value;
+        size_t value_len;
+        bool add;
+    } entry_t;
+
+    const char *store(std::initializer_list<std::string_view> parts, size_t *len);
+    bool push(std::initializer_list<std::string_view> prop, std::string_view value, bool add);
+
+    char arena_[kArenaSize];
+    size_t arena_used_ = 0;
+    entry_t entries_[kMaxEntries];
+    size_t num_entries_ = 0;
+};
 
 void property_override(std::string prop, std::string value, bool add = true);
 
+/* Sets a single ro.* property in every partition, without a batch */
 void set_ro_build_prop(const std::string &prop, const std::string &value, bool product = false);
 
-std::string fingerprint_to_description(std::string fingerprint);
+/* Fields of brand/product/device:platform_version/build_id/build_number:build_variant/tags */
+typedef struct fingerprint_info {
+    std::string_view brand;
+    std::string_view product;
+    std::string_view device;
+    std::string_view platform_version;
+    std::string_view build_id;
+    std::string_view build_number;
+    std::string_view build_variant;
+    std::string_view tags;
+} fingerprint_info_t;
+
+/* Large enough for the description of any well formed fingerprint we ship */
+#define PROP_DESCRIPTION_MAX 256
+
+bool parse_fingerprint(std::string_view fingerprint, fingerprint_info_t *info);
+
+/* Returns the description length, or 0 if it does not fit in buf. */
+size_t fingerprint_to_description(const fingerprint_info_t &info, char *buf, size_t size);
+
+std::string fingerprint_to_description(std::string_view fingerprint);
 
 #endif // LIBINIT_UTILS_H
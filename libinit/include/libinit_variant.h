@@ -7,25 +7,58 @@
 #ifndef LIBINIT_VARIANT_H
 #define LIBINIT_VARIANT_H
 
-#include <string>
-#include <vector>
+#include <cstddef>
+#include <string_view>
 
+#include <libinit_utils.h>
+
+/*
+ * Empty match values act as wildcards. The first entry of a table matching
+ * the hwc, sku and vendor sku of the device wins.
+ */
 typedef struct variant_info {
-    std::string hwc_value;
-    std::string sku_value;
-    std::string vendor_sku_value;
+    std::string_view hwc_value;
+    std::string_view sku_value;
+    std::string_view vendor_sku_value;
 
-    std::string brand;
-    std::string device;
-    std::string marketname;
-    std::string model;
-    std::string build_fingerprint;
+    std::string_view brand;
+    std::string_view device;
+    std::string_view marketname;
+    std::string_view model;
+    std::string_view build_fingerprint;
 
     bool nfc;
 } variant_info_t;
 
-void search_variant(const std::vector<variant_info_t> variants);
+constexpr bool variant_matches(std::string_view expected, std::string_view value) {
+    return expected.empty() || expected == value;
+}
+
+/* constexpr so that a table can be checked with static_assert where it is defined. */
+constexpr const variant_info_t *find_variant(const variant_info_t *variants, size_t count,
+                                             std::string_view hwc_value,
+                                             std::string_view sku_value,
+                                             std::string_view vendor_sku_value) {
+    for (size_t i = 0; i < count; i++) {
+        const variant_info_t &variant = variants[i];
+
+        if (variant_matches(variant.hwc_value, hwc_value) &&
+            variant_matches(variant.sku_value, sku_value) &&
+            variant_matches(variant.vendor_sku_value, vendor_sku_value))
+            return &variant;
+    }
+
+    return nullptr;
+}
+
+/* The properties of the matching variant are queued on batch, the caller commits it */
+void search_variant(const variant_info_t *variants, size_t count, property_batch &batch);
+
+template <size_t N>
+inline void search_variant(const variant_info_t (&variants)[N], property_batch &batch) {
+    search_variant(variants, N, batch);
+}
 
-void set_variant_props(const variant_info_t variant);
+void set_variant_props(const variant_info_t &variant, property_batch &batch);
 
 #endif // LIBINIT_VARIANT_H
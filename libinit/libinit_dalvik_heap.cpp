@@ -7,6 +7,12 @@
 #include <sys/sysinfo.h>
 #include <libinit_utils.h>
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
 #include <libinit_dalvik_heap.h>
 
 #define HEAPSTARTSIZE_PROP "dalvik.vm.heapstartsize"
@@ -16,52 +22,86 @@
 #define HEAPMAXFREE_PROP "dalvik.vm.heapmaxfree"
 #define HEAPTARGETUTILIZATION_PROP "dalvik.vm.heaptargetutilization"
 
-#define GB(b) (b * 1024ull * 1024 * 1024)
-
-static const dalvik_heap_info_t dalvik_heap_info_6144 = {
-    .heapstartsize = "16m",
-    .heapgrowthlimit = "256m",
-    .heapsize = "512m",
-    .heapminfree = "8m",
-    .heapmaxfree = "32m",
-    .heaptargetutilization = "0.5",
-};
-
-static const dalvik_heap_info_t dalvik_heap_info_4096 = {
-    .heapstartsize = "8m",
-    .heapgrowthlimit = "256m",
-    .heapsize = "512m",
-    .heapminfree = "8m",
-    .heapmaxfree = "16m",
-    .heaptargetutilization = "0.6",
-};
-
-static const dalvik_heap_info_t dalvik_heap_info_2048 = {
-    .heapstartsize = "8m",
-    .heapgrowthlimit = "192m",
-    .heapsize = "512m",
-    .heapminfree = "512k",
-    .heapmaxfree = "8m",
-    .heaptargetutilization = "0.75",
-};
-
-void set_dalvik_heap() {
+#define ZRAM_FSTAB "/vendor/etc/fstab.mt6785"
+#define DALVIK_HEAP_OVERRIDE "/vendor/etc/dalvik_heap.conf"
+
+/*
+ * Parse the zramsize= option of the swap entry, either a percentage of RAM
+ * or an absolute size in bytes.
+ */
+static uint64_t get_zram_size(uint64_t total_ram) {
+    std::ifstream fstab(ZRAM_FSTAB);
+    std::string line;
+
+    while (std::getline(fstab, line)) {
+        size_t pos = line.find("zramsize=");
+        if (line[0] == '#' || pos == std::string::npos)
+            continue;
+
+        const char *value = line.c_str() + pos + strlen("zramsize=");
+        char *end;
+        uint64_t size = strtoull(value, &end, 10);
+
+        return *end == '%' ? total_ram * size / 100 : size;
+    }
+
+    return 0;
+}
+
+/*
+ * Format a size in KiB the way the dalvik.vm properties expect it, rounding
+ * anything of a few MiB or more down to whole MiB.
+ */
+static std::string heap_size_string(uint64_t kb) {
+    char buf[32];
+
+    if (kb >= 4096)
+        kb -= kb % 1024;
+
+    if (kb % 1024 == 0)
+        snprintf(buf, sizeof(buf), "%llum", (unsigned long long) (kb / 1024));
+    else
+        snprintf(buf, sizeof(buf), "%lluk", (unsigned long long) kb);
+
+    return buf;
+}
+
+void set_dalvik_heap(property_batch &batch) {
     struct sysinfo sys;
-    const dalvik_heap_info_t *dhi;
+    dalvik_heap_info_t dhi;
 
     sysinfo(&sys);
 
-    if (sys.totalram > GB(5))
-        dhi = &dalvik_heap_info_6144;
-    else if (sys.totalram > GB(3))
-        dhi = &dalvik_heap_info_4096;
-    else
-        dhi = &dalvik_heap_info_2048;
-
-    property_override(HEAPSTARTSIZE_PROP, dhi->heapstartsize);
-    property_override(HEAPGROWTHLIMIT_PROP, dhi->heapgrowthlimit);
-    property_override(HEAPSIZE_PROP, dhi->heapsize);
-    property_override(HEAPTARGETUTILIZATION_PROP, dhi->heaptargetutilization);
-    property_override(HEAPMINFREE_PROP, dhi->heapminfree);
-    property_override(HEAPMAXFREE_PROP, dhi->heapmaxfree);
+    uint64_t total_ram = (uint64_t) sys.totalram * sys.mem_unit;
+    compute_dalvik_heap(total_ram, get_zram_size(total_ram), &dhi);
+
+    char utilization[16];
+    snprintf(utilization, sizeof(utilization), "%.2f", dhi.heaptargetutilization);
+
+    std::pair<const char *, std::string> props[] = {
+        { HEAPSTARTSIZE_PROP, heap_size_string(dhi.heapstartsize) },
+        { HEAPGROWTHLIMIT_PROP, heap_size_string(dhi.heapgrowthlimit) },
+        { HEAPSIZE_PROP, heap_size_string(dhi.heapsize) },
+        { HEAPTARGETUTILIZATION_PROP, utilization },
+        { HEAPMINFREE_PROP, heap_size_string(dhi.heapminfree) },
+        { HEAPMAXFREE_PROP, heap_size_string(dhi.heapmaxfree) },
+    };
+
+    /* prop=value lines in the override file take precedence over the formula. */
+    std::ifstream overrides(DALVIK_HEAP_OVERRIDE);
+    std::string line;
+
+    while (std::getline(overrides, line)) {
+        size_t pos = line.find('=');
+        if (line.empty() || line[0] == '#' || pos == std::string::npos)
+            continue;
+
+        for (auto &prop : props) {
+            if (line.compare(0, pos, prop.first) == 0)
+                prop.second = line.substr(pos + 1);
+        }
+    }
+
+    for (const auto &prop : props)
+        batch.add(prop.first, prop.second);
 }
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iterator>
+
+#include <libinit_dalvik_heap.h>
+
+#define MB(b) (b * 1024ull * 1024)
+
+/*
+ * A byte of zram holds roughly three bytes of anonymous memory, but the
+ * compressed copy still lives in RAM. Count it as a quarter of a RAM byte.
+ */
+#define ZRAM_WEIGHT 4
+
+typedef struct dalvik_heap_anchor {
+    uint64_t memory_mb;
+    dalvik_heap_info_t info;
+} dalvik_heap_anchor_t;
+
+/*
+ * Heap configuration at a given amount of effective memory. Values in
+ * between are linearly interpolated, so every field must be monotonic
+ * along the table.
+ */
+static const dalvik_heap_anchor_t dalvik_heap_anchors[] = {
+    { 2048, {
+        .heapstartsize = 8192,
+        .heapgrowthlimit = 196608,
+        .heapsize = 524288,
+        .heapminfree = 512,
+        .heapmaxfree = 8192,
+        .heaptargetutilization = 0.75f,
+    }},
+    { 4096, {
+        .heapstartsize = 8192,
+        .heapgrowthlimit = 262144,
+        .heapsize = 524288,
+        /* phone-xhdpi-4096-dalvik-heap.mk, less makes the GC run more often */
+        .heapminfree = 8192,
+        .heapmaxfree = 16384,
+        .heaptargetutilization = 0.55f,
+    }},
+    { 6144, {
+        .heapstartsize = 16384,
+        .heapgrowthlimit = 327680,
+        .heapsize = 524288,
+        .heapminfree = 8192,
+        .heapmaxfree = 32768,
+        .heaptargetutilization = 0.5f,
+    }},
+    { 8192, {
+        .heapstartsize = 16384,
+        .heapgrowthlimit = 393216,
+        .heapsize = 786432,
+        .heapminfree = 8192,
+        .heapmaxfree = 49152,
+        .heaptargetutilization = 0.5f,
+    }},
+};
+
+static uint64_t lerp(uint64_t a, uint64_t b, uint64_t num, uint64_t den) {
+    return b >= a ? a + (b - a) * num / den : a - (a - b) * num / den;
+}
+
+void compute_dalvik_heap(uint64_t total_ram, uint64_t zram_size, dalvik_heap_info_t *dhi) {
+    uint64_t memory_mb = (total_ram + zram_size / ZRAM_WEIGHT) / MB(1);
+    const dalvik_heap_anchor_t *lo = &dalvik_heap_anchors[0];
+    const dalvik_heap_anchor_t *hi = &dalvik_heap_anchors[std::size(dalvik_heap_anchors) - 1];
+
+    if (memory_mb <= lo->memory_mb) {
+        *dhi = lo->info;
+        return;
+    }
+    if (memory_mb >= hi->memory_mb) {
+        *dhi = hi->info;
+        return;
+    }
+
+    hi = lo + 1;
+    while (hi->memory_mb < memory_mb) {
+        lo++;
+        hi++;
+    }
+
+    uint64_t num = memory_mb - lo->memory_mb;
+    uint64_t den = hi->memory_mb - lo->memory_mb;
+
+    dhi->heapstartsize = lerp(lo->info.heapstartsize, hi->info.heapstartsize, num, den);
+    dhi->heapgrowthlimit = lerp(lo->info.heapgrowthlimit, hi->info.heapgrowthlimit, num, den);
+    dhi->heapsize = lerp(lo->info.heapsize, hi->info.heapsize, num, den);
+    dhi->heapminfree = lerp(lo->info.heapminfree, hi->info.heapminfree, num, den);
+    dhi->heapmaxfree = lerp(lo->info.heapmaxfree, hi->info.heapmaxfree, num, den);
+    dhi->heaptargetutilization = lo->info.heaptargetutilization +
+            (hi->info.heaptargetutilization - lo->info.heaptargetutilization) * num / den;
+}
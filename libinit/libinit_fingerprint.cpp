@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cstring>
+
+#include <libinit_utils.h>
+
+static inline bool is_separator(char c) {
+    return c == '/' || c == ':';
+}
+
+/* Position of the first fingerprint separator in s, or s.size() if there is none */
+static size_t find_separator(std::string_view s) {
+    size_t pos = 0;
+
+    while (pos < s.size() && !is_separator(s[pos]))
+        pos++;
+
+    return pos;
+}
+
+/*
+ * Split off the next field, which must be terminated by delimiter. A field
+ * may not contain any fingerprint separator nor be empty.
+ */
+static bool next_field(std::string_view &s, char delimiter, std::string_view *field) {
+    size_t pos = find_separator(s);
+
+    if (pos == 0 || pos == s.size() || s[pos] != delimiter)
+        return false;
+
+    *field = s.substr(0, pos);
+    s.remove_prefix(pos + 1);
+    return true;
+}
+
+bool parse_fingerprint(std::string_view fingerprint, fingerprint_info_t *info) {
+    std::string_view s = fingerprint;
+
+    if (!next_field(s, '/', &info->brand) ||
+        !next_field(s, '/', &info->product) ||
+        !next_field(s, ':', &info->device) ||
+        !next_field(s, '/', &info->platform_version) ||
+        !next_field(s, '/', &info->build_id) ||
+        !next_field(s, ':', &info->build_number) ||
+        !next_field(s, '/', &info->build_variant))
+        return false;
+
+    if (s.empty() || find_separator(s) != s.size())
+        return false;
+
+    info->tags = s;
+    return true;
+}
+
+size_t fingerprint_to_description(const fingerprint_info_t &info, char *buf, size_t size) {
+    const std::string_view parts[] = {
+        info.product, "-", info.build_variant,
+        " ", info.platform_version,
+        " ", info.build_id,
+        " ", info.build_number,
+        " ", info.tags,
+    };
+    size_t len = 0;
+
+    for (const auto &part : parts) {
+        if (len + part.size() + 1 > size)
+            return 0;
+        memcpy(buf + len, part.data(), part.size());
+        len += part.size();
+    }
+    buf[len] = '\0';
+
+    return len;
+}
+
+std::string fingerprint_to_description(std::string_view fingerprint) {
+    fingerprint_info_t info;
+    char description[PROP_DESCRIPTION_MAX];
+
+    if (!parse_fingerprint(fingerprint, &info))
+        return "";
+
+    size_t len = fingerprint_to_description(info, description, sizeof(description));
+    return std::string(description, len);
+}
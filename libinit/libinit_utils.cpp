@@ -4,22 +4,59 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#ifdef __BIONIC__
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
+#include <sys/system_properties.h>
+#endif
+#include <cstring>
 #include <vector>
 
 #include <libinit_utils.h>
 
-void property_override(std::string prop, std::string value, bool add) {
-    auto pi = (prop_info *) __system_property_find(prop.c_str());
+#ifdef __BIONIC__
+static int system_property_get(const char *prop, char *value) {
+    return __system_property_get(prop, value);
+}
+
+static void system_property_set(const char *prop, size_t prop_len, const char *value,
+                                size_t value_len, bool add) {
+    auto pi = (prop_info *) __system_property_find(prop);
+
     if (pi != nullptr) {
-        __system_property_update(pi, value.c_str(), value.length());
+        __system_property_update(pi, value, value_len);
     } else if (add) {
-        __system_property_add(prop.c_str(), prop.length(), value.c_str(), value.length());
+        __system_property_add(prop, prop_len, value, value_len);
     }
 }
 
-std::vector<std::string> ro_props_default_source_order = {
+static const property_area_t system_property_area = {
+    system_property_get,
+    system_property_set,
+};
+
+static const property_area_t *current_area = &system_property_area;
+#else
+static const property_area_t *current_area = nullptr;
+#endif
+
+void set_property_area(const property_area_t *area) {
+#ifdef __BIONIC__
+    current_area = area != nullptr ? area : &system_property_area;
+#else
+    current_area = area;
+#endif
+}
+
+int property_get(const char *prop, char *value) {
+    return current_area->get(prop, value);
+}
+
+void property_override(std::string prop, std::string value, bool add) {
+    current_area->set(prop.c_str(), prop.length(), value.c_str(), value.length(), add);
+}
+
+static constexpr std::string_view ro_props_default_source_order[] = {
     "odm.",
     "odm_dlkm.",
     "product.",
@@ -30,46 +67,96 @@ std::vector<std::string> ro_props_default_source_order = {
     "",
 };
 
-void set_ro_build_prop(const std::string &prop, const std::string &value, bool product) {
-    std::string prop_name;
+/*
+ * Copy the concatenation of parts into the arena as a NUL terminated string.
+ * Returns nullptr when the arena is full.
+ */
+const char *property_batch::store(std::initializer_list<std::string_view> parts, size_t *len) {
+    size_t total = 0;
+    for (const auto &part : parts)
+        total += part.size();
+
+    if (arena_used_ + total + 1 > kArenaSize)
+        return nullptr;
+
+    char *out = arena_ + arena_used_;
+    char *p = out;
+    for (const auto &part : parts) {
+        memcpy(p, part.data(), part.size());
+        p += part.size();
+    }
+    *p = '\0';
+
+    arena_used_ += total + 1;
+    *len = total;
+    return out;
+}
+
+/*
+ * Queue a property whose name is the concatenation of prop. Returns false
+ * and leaves the batch untouched when it is full.
+ */
+bool property_batch::push(std::initializer_list<std::string_view> prop, std::string_view value,
+                          bool add) {
+    size_t mark = arena_used_;
+    size_t prop_len, value_len;
+    const char *prop_copy = store(prop, &prop_len);
+    const char *value_copy = prop_copy != nullptr ? store({value}, &value_len) : nullptr;
+
+    if (value_copy == nullptr || num_entries_ == kMaxEntries) {
+        arena_used_ = mark;
+        return false;
+    }
+
+    entries_[num_entries_++] = {prop_copy, prop_len, value_copy, value_len, add};
+    return true;
+}
+
+void property_batch::add(std::string_view prop, std::string_view value, bool add) {
+    if (push({prop}, value, add))
+        return;
+
+    /* Out of room, flush what we have and retry on an empty batch. */
+    commit();
+    if (!push({prop}, value, add))
+        property_override(std::string(prop), std::string(value), add);
+}
+
+void property_batch::add_ro_build_prop(std::string_view prop, std::string_view value, bool product) {
+    auto queue = [&](std::initializer_list<std::string_view> name) {
+        if (!push(name, value, true)) {
+            commit();
+            push(name, value, true);
+        }
+    };
 
     for (const auto &source : ro_props_default_source_order) {
         if (product)
-            prop_name = "ro.product." + source + prop;
+            queue({"ro.product.", source, prop});
         else
-            prop_name = "ro." + source + "build." + prop;
+            queue({"ro.", source, "build.", prop});
+    }
+}
 
-        property_override(prop_name, value, true);
+void property_batch::commit() {
+    for (size_t i = 0; i < num_entries_; i++) {
+        const entry_t &e = entries_[i];
+        current_area->set(e.prop, e.prop_len, e.value, e.value_len, e.add);
     }
+
+    num_entries_ = 0;
+    arena_used_ = 0;
 }
 
-#define FIND_AND_REMOVE(s, delimiter, variable_name) \
-    std::string variable_name = s.substr(0, s.find(delimiter)); \
-    s.erase(0, s.find(delimiter) + delimiter.length());
-
-#define APPEND_STRING(s, to_append) \
-    s.append(" "); \
-    s.append(to_append);
-
-std::string fingerprint_to_description(std::string fingerprint) {
-    std::string delimiter = "/";
-    std::string delimiter2 = ":";
-    std::string build_fingerprint_copy = fingerprint;
-
-    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, brand)
-    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, product)
-    FIND_AND_REMOVE(build_fingerprint_copy, delimiter2, device)
-    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, platform_version)
-    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, build_id)
-    FIND_AND_REMOVE(build_fingerprint_copy, delimiter2, build_number)
-    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, build_variant)
-    std::string build_version_tags = build_fingerprint_copy;
-
-    std::string description = product + "-" + build_variant;
-    APPEND_STRING(description, platform_version)
-    APPEND_STRING(description, build_id)
-    APPEND_STRING(description, build_number)
-    APPEND_STRING(description, build_version_tags)
-
-    return description;
+void set_ro_build_prop(const std::string &prop, const std::string &value, bool product) {
+    std::string name;
+
+    for (const auto &source : ro_props_default_source_order) {
+        name.assign(product ? "ro.product." : "ro.");
+        name.append(source);
+        if (!product)
+            name.append("build.");
+        name.append(prop);
+        current_area->set(name.c_str(), name.length(), value.c_str(), value.length(), true);
+    }
 }
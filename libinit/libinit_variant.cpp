@@ -5,49 +5,56 @@
  */
 
 #include <android-base/logging.h>
-#include <android-base/properties.h>
 #include <libinit_utils.h>
+#include <unistd.h>
 
 #include <libinit_variant.h>
 
-using android::base::GetProperty;
-
 #define HWC_PROP "ro.boot.hwc"
 #define SKU_PROP "ro.boot.product.hardware.sku"
 #define VENDOR_SKU_PROP "ro.boot.product.vendor.sku"
 
-void search_variant(const std::vector<variant_info_t> variants) {
-    std::string hwc_value = GetProperty(HWC_PROP, "");
-    std::string sku_value = GetProperty(SKU_PROP, "");
-    std::string vendor_sku_value = GetProperty(VENDOR_SKU_PROP, "");
-
-    for (const auto& variant : variants) {
-        if ((variant.hwc_value == "" || variant.hwc_value == hwc_value) &&
-            (variant.sku_value == "" || variant.sku_value == sku_value) &&
-            (variant.vendor_sku_value == "" || variant.vendor_sku_value == vendor_sku_value)) {
-            set_variant_props(variant);
-            break;
-        }
-    }
+void search_variant(const variant_info_t *variants, size_t count, property_batch &batch) {
+    char hwc_value[PROP_VALUE_MAX];
+    char sku_value[PROP_VALUE_MAX];
+    char vendor_sku_value[PROP_VALUE_MAX];
+
+    int hwc_len = property_get(HWC_PROP, hwc_value);
+    int sku_len = property_get(SKU_PROP, sku_value);
+    int vendor_sku_len = property_get(VENDOR_SKU_PROP, vendor_sku_value);
+
+    const variant_info_t *variant = find_variant(variants, count,
+                                                 std::string_view(hwc_value, hwc_len),
+                                                 std::string_view(sku_value, sku_len),
+                                                 std::string_view(vendor_sku_value, vendor_sku_len));
+    if (variant != nullptr)
+        set_variant_props(*variant, batch);
 }
 
-void set_variant_props(const variant_info_t variant) {
-    set_ro_build_prop("brand", variant.brand, true);
-    set_ro_build_prop("device", variant.device, true);
-    set_ro_build_prop("marketname", variant.marketname, true);
-    set_ro_build_prop("model", variant.model, true);
-    property_override("vendor.usb.product_string", variant.marketname, true);
+void set_variant_props(const variant_info_t &variant, property_batch &batch) {
+    batch.add_ro_build_prop("brand", variant.brand, true);
+    batch.add_ro_build_prop("device", variant.device, true);
+    batch.add_ro_build_prop("marketname", variant.marketname, true);
+    batch.add_ro_build_prop("model", variant.model, true);
+    batch.add("vendor.usb.product_string", variant.marketname, true);
 
     if (access("/system/bin/recovery", F_OK) != 0) {
-        property_override("bluetooth.device.default_name", variant.marketname, true);
-        set_ro_build_prop("fingerprint", variant.build_fingerprint);
-        property_override("ro.bootimage.build.fingerprint", variant.build_fingerprint);
-
-        property_override("ro.build.description", fingerprint_to_description(variant.build_fingerprint));
+        batch.add("bluetooth.device.default_name", variant.marketname, true);
+        batch.add_ro_build_prop("fingerprint", variant.build_fingerprint);
+        batch.add("ro.bootimage.build.fingerprint", variant.build_fingerprint);
+
+        fingerprint_info_t fingerprint;
+        char description[PROP_DESCRIPTION_MAX];
+
+        if (parse_fingerprint(variant.build_fingerprint, &fingerprint) &&
+            fingerprint_to_description(fingerprint, description, sizeof(description)) > 0)
+            batch.add("ro.build.description", description);
+        else
+            LOG(ERROR) << "Malformed fingerprint " << variant.build_fingerprint;
     }
 
-    property_override("ro.boot.hardware.sku", variant.device);
+    batch.add("ro.boot.hardware.sku", variant.device);
 
     if (variant.nfc)
-        property_override(SKU_PROP, "nfc");
+        batch.add(SKU_PROP, "nfc");
 }
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+#include <libinit_dalvik_heap.h>
+
+#define MB(b) (b * 1024ull * 1024)
+
+static dalvik_heap_info_t compute(uint64_t total_ram_mb, uint64_t zram_percent) {
+    dalvik_heap_info_t dhi;
+    compute_dalvik_heap(MB(total_ram_mb), MB(total_ram_mb) * zram_percent / 100, &dhi);
+    return dhi;
+}
+
+/* Sizes may only grow and the target utilization may only drop with more memory */
+static void expect_not_smaller(const dalvik_heap_info_t &lo, const dalvik_heap_info_t &hi) {
+    EXPECT_GE(hi.heapstartsize, lo.heapstartsize);
+    EXPECT_GE(hi.heapgrowthlimit, lo.heapgrowthlimit);
+    EXPECT_GE(hi.heapsize, lo.heapsize);
+    EXPECT_GE(hi.heapminfree, lo.heapminfree);
+    EXPECT_GE(hi.heapmaxfree, lo.heapmaxfree);
+    EXPECT_LE(hi.heaptargetutilization, lo.heaptargetutilization);
+}
+
+static void expect_consistent(const dalvik_heap_info_t &dhi) {
+    EXPECT_LE(dhi.heapstartsize, dhi.heapgrowthlimit);
+    EXPECT_LE(dhi.heapgrowthlimit, dhi.heapsize);
+    EXPECT_LE(dhi.heapminfree, dhi.heapmaxfree);
+    EXPECT_GT(dhi.heaptargetutilization, 0.0f);
+    EXPECT_LT(dhi.heaptargetutilization, 1.0f);
+}
+
+TEST(DalvikHeapTest, MonotonicInRam) {
+    for (uint64_t zram_percent : {0, 25, 50, 100}) {
+        dalvik_heap_info_t prev = compute(1024, zram_percent);
+
+        for (uint64_t ram_mb = 1024 + 64; ram_mb <= 16384; ram_mb += 64) {
+            SCOPED_TRACE(testing::Message() << ram_mb << " MB RAM, zram " << zram_percent << "%");
+            dalvik_heap_info_t dhi = compute(ram_mb, zram_percent);
+            expect_consistent(dhi);
+            expect_not_smaller(prev, dhi);
+            prev = dhi;
+        }
+    }
+}
+
+TEST(DalvikHeapTest, MonotonicInZram) {
+    for (uint64_t ram_mb = 2048; ram_mb <= 8192; ram_mb += 512) {
+        dalvik_heap_info_t prev = compute(ram_mb, 0);
+
+        for (uint64_t zram_percent = 10; zram_percent <= 200; zram_percent += 10) {
+            SCOPED_TRACE(testing::Message() << ram_mb << " MB RAM, zram " << zram_percent << "%");
+            dalvik_heap_info_t dhi = compute(ram_mb, zram_percent);
+            expect_not_smaller(prev, dhi);
+            prev = dhi;
+        }
+    }
+}
+
+/* The shipped 6 and 8 GB units used to get the same settings */
+TEST(DalvikHeapTest, SixAndEightGigabytesDiffer) {
+    dalvik_heap_info_t six = compute(6144 - 256, 50);
+    dalvik_heap_info_t eight = compute(8192 - 256, 50);
+
+    EXPECT_LT(six.heapgrowthlimit, eight.heapgrowthlimit);
+    EXPECT_LT(six.heapmaxfree, eight.heapmaxfree);
+}
+
+/* From 4 GB up heapminfree stays at the 8m of the AOSP dalvik heap configs */
+TEST(DalvikHeapTest, MinFreeIsKeptFromFourGigabytes) {
+    for (uint64_t ram_mb : {4096, 5120, 6144, 8192, 12288}) {
+        EXPECT_EQ(8192u, compute(ram_mb, 0).heapminfree) << ram_mb << " MB RAM";
+    }
+    EXPECT_LT(compute(3072, 0).heapminfree, 8192u);
+}
+
+TEST(DalvikHeapTest, ClampsOutsideTable) {
+    dalvik_heap_info_t tiny = compute(512, 0);
+    dalvik_heap_info_t low = compute(2048, 0);
+    EXPECT_EQ(low.heapgrowthlimit, tiny.heapgrowthlimit);
+    EXPECT_EQ(low.heapsize, tiny.heapsize);
+
+    dalvik_heap_info_t huge = compute(65536, 50);
+    dalvik_heap_info_t high = compute(8192, 0);
+    EXPECT_EQ(high.heapgrowthlimit, huge.heapgrowthlimit);
+    EXPECT_EQ(high.heapsize, huge.heapsize);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+#include <libinit_utils.h>
+
+#include <string>
+
+static constexpr std::string_view kFingerprint =
+        "Redmi/rosemary_global/rosemary:12/SP1A.210812.016/V14.0.7.0.TKLMIXM:user/release-keys";
+
+/* The substr and erase based implementation parse_fingerprint replaced, kept for comparison */
+#define FIND_AND_REMOVE(s, delimiter, variable_name) \
+    std::string variable_name = s.substr(0, s.find(delimiter)); \
+    s.erase(0, s.find(delimiter) + delimiter.length());
+
+#define APPEND_STRING(s, to_append) \
+    s.append(" "); \
+    s.append(to_append);
+
+static std::string legacy_fingerprint_to_description(std::string fingerprint) {
+    std::string delimiter = "/";
+    std::string delimiter2 = ":";
+    std::string build_fingerprint_copy = fingerprint;
+
+    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, brand)
+    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, product)
+    FIND_AND_REMOVE(build_fingerprint_copy, delimiter2, device)
+    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, platform_version)
+    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, build_id)
+    FIND_AND_REMOVE(build_fingerprint_copy, delimiter2, build_number)
+    FIND_AND_REMOVE(build_fingerprint_copy, delimiter, build_variant)
+    std::string build_version_tags = build_fingerprint_copy;
+
+    std::string description = product + "-" + build_variant;
+    APPEND_STRING(description, platform_version)
+    APPEND_STRING(description, build_id)
+    APPEND_STRING(description, build_number)
+    APPEND_STRING(description, build_version_tags)
+
+    return description;
+}
+
+static void BM_LegacyDescription(benchmark::State &state) {
+    std::string fingerprint(kFingerprint);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(legacy_fingerprint_to_description(fingerprint));
+}
+BENCHMARK(BM_LegacyDescription);
+
+/* What set_variant_props does, parse and describe into a stack buffer */
+static void BM_ParseAndDescribe(benchmark::State &state) {
+    for (auto _ : state) {
+        fingerprint_info_t info;
+        char description[PROP_DESCRIPTION_MAX];
+
+        benchmark::DoNotOptimize(parse_fingerprint(kFingerprint, &info));
+        benchmark::DoNotOptimize(
+                fingerprint_to_description(info, description, sizeof(description)));
+    }
+}
+BENCHMARK(BM_ParseAndDescribe);
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <libinit_utils.h>
+
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Every accepted fingerprint must have eight non-empty fields without
+ * separators, and its description must fit where init puts it.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    std::string_view fingerprint(reinterpret_cast<const char *>(data), size);
+    fingerprint_info_t info;
+
+    if (!parse_fingerprint(fingerprint, &info))
+        return 0;
+
+    for (std::string_view field : {info.brand, info.product, info.device, info.platform_version,
+                                   info.build_id, info.build_number, info.build_variant,
+                                   info.tags}) {
+        if (field.empty() || field.find_first_of("/:") != std::string_view::npos)
+            abort();
+    }
+
+    char description[PROP_DESCRIPTION_MAX];
+    size_t len = fingerprint_to_description(info, description, sizeof(description));
+    if (len >= sizeof(description) || (len > 0 && strlen(description) != len))
+        abort();
+
+    return 0;
+}
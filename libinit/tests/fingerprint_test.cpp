@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+#include <libinit_utils.h>
+
+#include "variants_rosemary.h"
+
+TEST(FingerprintTest, ParsesFields) {
+    fingerprint_info_t info;
+
+    ASSERT_TRUE(parse_fingerprint(
+            "Redmi/rosemary_global/rosemary:12/SP1A.210812.016/V14.0.7.0.TKLMIXM:user/"
+            "release-keys",
+            &info));
+    EXPECT_EQ("Redmi", info.brand);
+    EXPECT_EQ("rosemary_global", info.product);
+    EXPECT_EQ("rosemary", info.device);
+    EXPECT_EQ("12", info.platform_version);
+    EXPECT_EQ("SP1A.210812.016", info.build_id);
+    EXPECT_EQ("V14.0.7.0.TKLMIXM", info.build_number);
+    EXPECT_EQ("user", info.build_variant);
+    EXPECT_EQ("release-keys", info.tags);
+}
+
+TEST(FingerprintTest, DescribesAllVariants) {
+    for (const variant_info_t &variant : variants) {
+        fingerprint_info_t info;
+        ASSERT_TRUE(parse_fingerprint(variant.build_fingerprint, &info))
+                << variant.build_fingerprint;
+
+        std::string expected = std::string(info.product) +
+                "-user 12 SP1A.210812.016 V14.0.7.0.TKLMIXM release-keys";
+        EXPECT_EQ(expected, fingerprint_to_description(variant.build_fingerprint));
+    }
+}
+
+TEST(FingerprintTest, RejectsMalformed) {
+    fingerprint_info_t info;
+
+    for (const char *fingerprint : {
+                 "",
+                 "Redmi",
+                 "Redmi/rosemary_global/rosemary:12/SP1A.210812.016/V14.0.7.0.TKLMIXM:user/",
+                 "Redmi/rosemary_global/rosemary:12/SP1A.210812.016/V14.0.7.0.TKLMIXM:user",
+                 "Redmi//rosemary:12/SP1A.210812.016/V14.0.7.0.TKLMIXM:user/release-keys",
+                 "Redmi/rosemary_global/rosemary/12/SP1A.210812.016/V14.0.7.0.TKLMIXM:user/"
+                 "release-keys",
+                 "Redmi/rosemary_global/rosemary:12/SP1A.210812.016/V14.0.7.0.TKLMIXM:user/"
+                 "release-keys/extra",
+         }) {
+        EXPECT_FALSE(parse_fingerprint(fingerprint, &info)) << fingerprint;
+        EXPECT_EQ("", fingerprint_to_description(fingerprint)) << fingerprint;
+    }
+}
+
+TEST(FingerprintTest, DescriptionMustFitBuffer) {
+    fingerprint_info_t info;
+    ASSERT_TRUE(parse_fingerprint("a/b/c:d/e/f:g/h", &info));
+
+    char buf[16];
+    EXPECT_EQ(11u, fingerprint_to_description(info, buf, 12));
+    EXPECT_STREQ("b-g d e f h", buf);
+    EXPECT_EQ(0u, fingerprint_to_description(info, buf, 11));
+}
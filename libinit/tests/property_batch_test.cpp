@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+#include <libinit_utils.h>
+
+#include <string>
+
+#include "stub_property_area.h"
+
+static const char *const kBuildSources[] = {
+    "odm.", "odm_dlkm.", "product.", "system.", "system_ext.", "vendor.", "vendor_dlkm.", "",
+};
+
+TEST(PropertyBatchTest, NothingIsWrittenBeforeCommit) {
+    stub_property_area area;
+    property_batch batch;
+
+    batch.add("ro.boot.hardware.sku", "rosemary");
+    EXPECT_TRUE(area.props.empty());
+
+    batch.commit();
+    EXPECT_EQ("rosemary", area.props["ro.boot.hardware.sku"]);
+}
+
+TEST(PropertyBatchTest, RoBuildPropGoesToEveryPartition) {
+    stub_property_area area;
+    property_batch batch;
+
+    batch.add_ro_build_prop("fingerprint", "Redmi/rosemary");
+    batch.add_ro_build_prop("model", "M2101K7BNY", true);
+    batch.commit();
+
+    for (const char *source : kBuildSources) {
+        EXPECT_EQ("Redmi/rosemary", area.props[std::string("ro.") + source + "build.fingerprint"])
+                << source;
+        EXPECT_EQ("M2101K7BNY", area.props[std::string("ro.product.") + source + "model"])
+                << source;
+    }
+    EXPECT_EQ(16u, area.adds);
+}
+
+TEST(PropertyBatchTest, ExistingPropertiesAreUpdated) {
+    stub_property_area area;
+    area.props["dalvik.vm.heapsize"] = "256m";
+    property_batch batch;
+
+    batch.add("dalvik.vm.heapsize", "512m");
+    batch.add("dalvik.vm.heapminfree", "8m", false);
+    batch.commit();
+
+    EXPECT_EQ("512m", area.props["dalvik.vm.heapsize"]);
+    EXPECT_EQ(0u, area.props.count("dalvik.vm.heapminfree")) << "add was not set";
+    EXPECT_EQ(1u, area.updates);
+}
+
+/* A full batch commits what it has and carries on, nothing is lost */
+TEST(PropertyBatchTest, FullBatchFlushesItself) {
+    stub_property_area area;
+    property_batch batch;
+    std::string value(200, 'v');
+
+    for (int i = 0; i < 300; i++)
+        batch.add("vendor.test." + std::to_string(i), value);
+    EXPECT_GT(area.adds, 0u);
+
+    batch.commit();
+    EXPECT_EQ(300u, area.adds);
+    EXPECT_EQ(value, area.props["vendor.test.299"]);
+}
+
+TEST(PropertyBatchTest, SetRoBuildPropNeedsNoBatch) {
+    stub_property_area area;
+
+    set_ro_build_prop("brand", "Redmi", true);
+    EXPECT_EQ(8u, area.adds);
+    EXPECT_EQ("Redmi", area.props["ro.product.vendor_dlkm.brand"]);
+    EXPECT_EQ("Redmi", area.props["ro.product.brand"]);
+}
+
+TEST(PropertyBatchTest, PropertiesAreReadFromTheArea) {
+    stub_property_area area;
+    area.props["ro.boot.hwc"] = "GL";
+    char value[PROP_VALUE_MAX];
+
+    EXPECT_EQ(2, property_get("ro.boot.hwc", value));
+    EXPECT_STREQ("GL", value);
+    EXPECT_EQ(0, property_get("ro.boot.product.vendor.sku", value));
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef STUB_PROPERTY_AREA_H
+#define STUB_PROPERTY_AREA_H
+
+#include <libinit_utils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+
+/*
+ * An in-memory property area for the host, installed with set_property_area()
+ * for as long as it lives.
+ */
+class stub_property_area {
+  public:
+    stub_property_area() {
+        instance_ = this;
+        set_property_area(&kArea);
+    }
+
+    ~stub_property_area() {
+        set_property_area(nullptr);
+        instance_ = nullptr;
+    }
+
+    std::map<std::string, std::string> props;
+    unsigned updates = 0;
+    unsigned adds = 0;
+
+  private:
+    static int get(const char *prop, char *value) {
+        auto it = instance_->props.find(prop);
+        if (it == instance_->props.end()) {
+            value[0] = '\0';
+            return 0;
+        }
+        size_t len = std::min(it->second.size(), static_cast<size_t>(PROP_VALUE_MAX - 1));
+        memcpy(value, it->second.data(), len);
+        value[len] = '\0';
+        return len;
+    }
+
+    static void set(const char *prop, size_t prop_len, const char *value, size_t value_len,
+                    bool add) {
+        std::string name(prop, prop_len);
+        auto it = instance_->props.find(name);
+        if (it != instance_->props.end()) {
+            it->second.assign(value, value_len);
+            instance_->updates++;
+        } else if (add) {
+            instance_->props.emplace(std::move(name), std::string(value, value_len));
+            instance_->adds++;
+        }
+    }
+
+    static constexpr property_area_t kArea = {get, set};
+    static inline stub_property_area *instance_ = nullptr;
+};
+
+#endif // STUB_PROPERTY_AREA_H
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <iterator>
+
+#include "variants_rosemary.h"
+
+/* Resolve every variant in turn, the last one walks the whole table */
+static void BM_FindVariant(benchmark::State &state) {
+    const variant_info_t &expected = variants[state.range(0)];
+    std::string_view vendor_sku = expected.vendor_sku_value;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vendor_sku);
+        const variant_info_t *variant =
+                find_variant(variants, std::size(variants), "GL", "nfc", vendor_sku);
+        benchmark::DoNotOptimize(variant);
+    }
+}
+BENCHMARK(BM_FindVariant)->DenseRange(0, std::size(variants) - 1);
+
+static void BM_FindVariantMiss(benchmark::State &state) {
+    std::string_view vendor_sku = "unknown";
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vendor_sku);
+        const variant_info_t *variant =
+                find_variant(variants, std::size(variants), "GL", "nfc", vendor_sku);
+        benchmark::DoNotOptimize(variant);
+    }
+}
+BENCHMARK(BM_FindVariantMiss);
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <iterator>
+
+#include "variants_rosemary.h"
+
+static constexpr const variant_info_t *find(std::string_view vendor_sku,
+                                            std::string_view hwc = "",
+                                            std::string_view sku = "") {
+    return find_variant(variants, std::size(variants), hwc, sku, vendor_sku);
+}
+
+/* The lookup runs at compile time, so the table itself can be checked there */
+static_assert(find("maltose") == &variants[0]);
+static_assert(find("rosemary") == &variants[1]);
+static_assert(find("rosemaryp") == &variants[2]);
+static_assert(find("secret") == &variants[3]);
+static_assert(find("secretr") == &variants[4]);
+static_assert(find("") == nullptr);
+
+TEST(VariantTest, AllVariantsResolve) {
+    for (const variant_info_t &variant : variants) {
+        const variant_info_t *found = find(variant.vendor_sku_value, "GL", "nfc");
+        ASSERT_NE(nullptr, found) << variant.vendor_sku_value;
+        EXPECT_EQ(&variant, found);
+    }
+}
+
+TEST(VariantTest, UnknownSkuHasNoVariant) {
+    EXPECT_EQ(nullptr, find("rosemary_"));
+    EXPECT_EQ(nullptr, find("rose"));
+    EXPECT_EQ(nullptr, find("unknown"));
+}
+
+TEST(VariantTest, FirstMatchWins) {
+    static constexpr variant_info_t table[] = {
+        { .hwc_value = "IN", .vendor_sku_value = "secret", .model = "india" },
+        { .vendor_sku_value = "secret", .model = "global" },
+        { .model = "fallback" },
+    };
+
+    EXPECT_EQ("india", find_variant(table, std::size(table), "IN", "", "secret")->model);
+    EXPECT_EQ("global", find_variant(table, std::size(table), "GL", "", "secret")->model);
+    EXPECT_EQ("fallback", find_variant(table, std::size(table), "IN", "", "maltose")->model);
+}
+
+TEST(VariantTest, NfcFollowsVariant) {
+    EXPECT_FALSE(find("maltose")->nfc);
+    EXPECT_TRUE(find("rosemary")->nfc);
+    EXPECT_TRUE(find("rosemaryp")->nfc);
+    EXPECT_FALSE(find("secret")->nfc);
+    EXPECT_FALSE(find("secretr")->nfc);
+}
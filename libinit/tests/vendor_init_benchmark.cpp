@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "stub_property_area.h"
+#include "vendor_init.h"
+
+/* What the bootloader leaves behind on a global rosemary */
+static void set_boot_props(stub_property_area &area) {
+    area.props.clear();
+    area.props["ro.boot.hwc"] = "GL";
+    area.props["ro.boot.product.hardware.sku"] = "nfc";
+    area.props["ro.boot.product.vendor.sku"] = "rosemary";
+}
+
+/* One boot, every property gets added */
+static void BM_VendorLoadProperties(benchmark::State &state) {
+    stub_property_area area;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        set_boot_props(area);
+        state.ResumeTiming();
+
+        vendor_load_properties();
+    }
+    state.counters["props"] = area.props.size();
+}
+BENCHMARK(BM_VendorLoadProperties)->Unit(benchmark::kMicrosecond);
+
+/* The same properties once they exist, every write is an update */
+static void BM_VendorLoadPropertiesUpdate(benchmark::State &state) {
+    stub_property_area area;
+    set_boot_props(area);
+    vendor_load_properties();
+
+    for (auto _ : state)
+        vendor_load_properties();
+}
+BENCHMARK(BM_VendorLoadPropertiesUpdate)->Unit(benchmark::kMicrosecond);
@@ -18,48 +18,16 @@
 
 #include <android-base/properties.h>
 
-#include <fstream>
+#include <iterator>
 
-#define LCD_LED         "/sys/class/leds/lcd-backlight/"
+#define LEDS_DIR        "/sys/class/leds"
+#define FB_MODES        "/sys/class/graphics/fb0/modes"
 
-#define BRIGHTNESS      "brightness"
-#define MAX_BRIGHTNESS  "max_brightness"
+#define BACKLIGHT_RAMP_PROP "ro.vendor.light.backlight_ramp_ms"
 
-namespace {
-/*
- * Write value to path and close file.
- */
-static void set(std::string path, std::string value) {
-    std::ofstream file(path);
-
-    if (!file.is_open()) {
-        LOG(WARNING) << "failed to write " << value.c_str() << " to " << path.c_str();
-        return;
-    }
-
-    file << value;
-}
-
-static void set(std::string path, int value) {
-    set(path, std::to_string(value));
-}
-
-/*
- * Read max brightness from path and close file.
- */
-static int getMaxBrightness(std::string path) {
-    std::ifstream file(path);
-    int value;
-
-    if (!file.is_open()) {
-        LOG(WARNING) << "failed to read from " << path.c_str();
-        return 0;
-    }
-
-    file >> value;
-    return value;
-}
+using android::base::GetUintProperty;
 
+namespace {
 static uint32_t getBrightness(const HwLightState& state) {
     uint32_t alpha, red, green, blue;
 
@@ -81,25 +49,22 @@ static uint32_t getBrightness(const HwLightState& state) {
     return (77 * red + 150 * green + 29 * blue) >> 8;
 }
 
-static inline uint32_t scaleBrightness(uint32_t brightness, uint32_t maxBrightness) {
-    if (brightness == 0) {
-        return 0;
-    }
-
-    return (brightness - 1) * (maxBrightness - 1) / (0xFF - 1) + 1;
-}
-
-static inline uint32_t getScaledBrightness(const HwLightState& state, uint32_t maxBrightness) {
-    return scaleBrightness(getBrightness(state), maxBrightness);
-}
+/* Notification lights sharing the RGB LED, highest priority first. */
+static const LightType notificationLights[] = {
+    LightType::ATTENTION,
+    LightType::NOTIFICATIONS,
+    LightType::BATTERY,
+};
 
-static void handleBacklight(const HwLightState& state) {
-    uint32_t brightness = getScaledBrightness(state, getMaxBrightness(LCD_LED MAX_BRIGHTNESS));
-    set(LCD_LED BRIGHTNESS, brightness);
+static inline bool isBlinking(const HwLightState& state) {
+    return state.flashMode == FlashMode::TIMED && state.flashOnMs > 0 && state.flashOffMs > 0;
 }
 
 /* Keep sorted in the order of importance. */
 static std::vector<LightType> backends = {
+    LightType::ATTENTION,
+    LightType::NOTIFICATIONS,
+    LightType::BATTERY,
     LightType::BACKLIGHT,
 };
 
@@ -110,20 +75,47 @@ namespace android{
 namespace hardware {
 namespace light {
 
+Lights::Lights()
+    : mWriter(LEDS_DIR,
+              std::chrono::milliseconds(GetUintProperty<uint32_t>(BACKLIGHT_RAMP_PROP, 0)),
+              LightsWriter::readFramePeriod(FB_MODES)) {}
+
 ndk::ScopedAStatus Lights::setLightState(int id, const HwLightState& state) {
     switch(id) {
         case (int) LightType::BACKLIGHT:
-            handleBacklight(state);
-            return ndk::ScopedAStatus::ok();
+            mWriter.setBacklight(getBrightness(state));
+            break;
+        case (int) LightType::ATTENTION:
+        case (int) LightType::NOTIFICATIONS:
+        case (int) LightType::BATTERY:
+            if (!mWriter.hasRgb()) {
+                return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+            }
+            for (size_t i = 0; i < std::size(notificationLights); i++) {
+                if ((int) notificationLights[i] == id) {
+                    mWriter.setLed(static_cast<LedSlot>(i),
+                                   {.color = static_cast<uint32_t>(state.color),
+                                    .blink = isBlinking(state),
+                                    .flashOnMs = static_cast<uint32_t>(state.flashOnMs),
+                                    .flashOffMs = static_cast<uint32_t>(state.flashOffMs)});
+                }
+            }
+            break;
         default:
             return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
     }
+
+    return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Lights::getLights(std::vector<HwLight>* lights) {
     int i = 0;
 
     for (const LightType& backend : backends) {
+        if (backend != LightType::BACKLIGHT && !mWriter.hasRgb()) {
+            continue;
+        }
+
         HwLight hwLight;
         hwLight.id = (int) backend;
         hwLight.type = backend;
@@ -22,6 +22,9 @@
 #include <hardware/lights.h>
 #include <vector>
 
+#include "LightsWriter.h"
+
+using ::aidl::android::hardware::light::FlashMode;
 using ::aidl::android::hardware::light::HwLightState;
 using ::aidl::android::hardware::light::HwLight;
 using ::aidl::android::hardware::light::LightType;
@@ -33,8 +36,14 @@ namespace hardware {
 namespace light {
 
 class Lights : public BnLights {
+  public:
+      Lights();
+
       ndk::ScopedAStatus setLightState(int id, const HwLightState& state) override;
       ndk::ScopedAStatus getLights(std::vector<HwLight>* types) override;
+
+  private:
+      LightsWriter mWriter;
 };
 
 }  // namespace light
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2018-2019 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LightsWriter.h"
+
+#include <android-base/logging.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#define LCD_LED         "/lcd-backlight/"
+#define RED_LED         "/red/"
+#define GREEN_LED       "/green/"
+#define BLUE_LED        "/blue/"
+
+#define BRIGHTNESS      "brightness"
+#define MAX_BRIGHTNESS  "max_brightness"
+#define TRIGGER         "trigger"
+#define DELAY_ON        "delay_on"
+#define DELAY_OFF       "delay_off"
+
+namespace {
+/*
+ * Write value to an already opened sysfs node.
+ */
+static bool set(int fd, uint32_t value) {
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%u", value);
+
+    return pwrite(fd, buf, len, 0) == len;
+}
+
+/*
+ * Write value to path and close file.
+ */
+static void set(std::string path, std::string value) {
+    std::ofstream file(path);
+
+    if (!file.is_open()) {
+        LOG(WARNING) << "failed to write " << value.c_str() << " to " << path.c_str();
+        return;
+    }
+
+    file << value;
+}
+
+static void set(std::string path, uint32_t value) {
+    set(path, std::to_string(value));
+}
+
+/*
+ * Read max brightness from path and close file.
+ */
+static int getMaxBrightness(std::string path) {
+    std::ifstream file(path);
+    int value;
+
+    if (!file.is_open()) {
+        LOG(WARNING) << "failed to read from " << path.c_str();
+        return 0;
+    }
+
+    file >> value;
+    return value;
+}
+
+static inline uint32_t scaleBrightness(uint32_t brightness, uint32_t maxBrightness) {
+    if (brightness == 0) {
+        return 0;
+    }
+
+    return (brightness - 1) * (maxBrightness - 1) / (0xFF - 1) + 1;
+}
+
+/* Refresh rates a panel can plausibly report, anything else is a bogus mode. */
+static constexpr unsigned kMinRefreshHz = 24;
+static constexpr unsigned kMaxRefreshHz = 240;
+
+static constexpr float kRampGamma = 2.2f;
+
+/*
+ * Interpolate between two backlight levels in gamma-corrected space so the
+ * ramp looks linear to the eye instead of rushing through the dark end.
+ */
+static uint32_t interpolateBrightness(uint32_t from, uint32_t to, float t,
+                                      uint32_t maxBrightness) {
+    if (t >= 1.0f || maxBrightness == 0) {
+        return to;
+    }
+
+    float pFrom = powf((float) from / maxBrightness, 1.0f / kRampGamma);
+    float pTo = powf((float) to / maxBrightness, 1.0f / kRampGamma);
+    float p = pFrom + (pTo - pFrom) * t;
+
+    return (uint32_t) lroundf(powf(p, kRampGamma) * maxBrightness);
+}
+
+static const std::string rgbLeds[] = {
+    RED_LED,
+    GREEN_LED,
+    BLUE_LED,
+};
+
+static inline bool isLit(const aidl::android::hardware::light::LedState& state) {
+    return state.color & 0x00ffffff;
+}
+
+}  // anonymous namespace
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace light {
+
+LightsWriter::LightsWriter(const std::string& ledDir, std::chrono::milliseconds rampDuration,
+                           std::chrono::nanoseconds rampFrame)
+    : mLedDir(ledDir),
+      mBacklightFd(open((ledDir + LCD_LED BRIGHTNESS).c_str(), O_WRONLY | O_CLOEXEC)),
+      mMaxBrightness(getMaxBrightness(ledDir + LCD_LED MAX_BRIGHTNESS)),
+      mRampDuration(rampDuration),
+      mRampFrame(rampFrame) {
+    if (mBacklightFd.get() < 0) {
+        PLOG(WARNING) << "failed to open " << ledDir << LCD_LED BRIGHTNESS;
+    }
+
+    /* Only advertise the RGB LED when its nodes are there and writable. */
+    ::android::base::unique_fd redFd(
+            open((ledDir + RED_LED BRIGHTNESS).c_str(), O_WRONLY | O_CLOEXEC));
+    mHasRgb = redFd.get() >= 0;
+    if (!mHasRgb) {
+        PLOG(WARNING) << "failed to open " << ledDir << RED_LED BRIGHTNESS;
+    }
+
+    for (size_t i = 0; mHasRgb && i < std::size(rgbLeds); i++) {
+        mRgbMaxBrightness[i] = getMaxBrightness(mLedDir + rgbLeds[i] + MAX_BRIGHTNESS);
+    }
+
+    mWriterThread = std::thread(&LightsWriter::writerLoop, this);
+}
+
+LightsWriter::~LightsWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mWriterExit = true;
+    }
+    mWriterCv.notify_all();
+
+    if (mWriterThread.joinable()) {
+        mWriterThread.join();
+    }
+}
+
+void LightsWriter::setBacklight(uint32_t brightness) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mBacklightRequest = scaleBrightness(brightness, mMaxBrightness);
+        mBacklightPending = true;
+    }
+    mWriterCv.notify_one();
+}
+
+void LightsWriter::setLed(LedSlot slot, const LedState& state) {
+    if (!mHasRgb) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mLedStates[slot] = state;
+        mRgbPending = true;
+    }
+    mWriterCv.notify_one();
+}
+
+void LightsWriter::flush() {
+    std::unique_lock<std::mutex> lock(mLock);
+    mIdleCv.wait(lock, [this] { return !mWriterBusy && !mBacklightPending && !mRgbPending; });
+}
+
+uint64_t LightsWriter::backlightWrites() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mBacklightWrites;
+}
+
+uint64_t LightsWriter::backlightElided() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mBacklightElided;
+}
+
+std::chrono::nanoseconds LightsWriter::readFramePeriod(const std::string& modesPath) {
+    std::ifstream file(modesPath);
+    std::string mode;
+
+    if (!file.is_open() || !std::getline(file, mode)) {
+        LOG(WARNING) << "failed to read from " << modesPath << ", assuming 60Hz";
+        return kDefaultRampFrame;
+    }
+
+    /* The current mode comes first, its refresh rate follows the last dash. */
+    size_t dash = mode.rfind('-');
+    unsigned refresh = 0;
+    if (dash == std::string::npos || sscanf(mode.c_str() + dash + 1, "%u", &refresh) != 1 ||
+        refresh < kMinRefreshHz || refresh > kMaxRefreshHz) {
+        LOG(WARNING) << "no refresh rate in mode " << mode << ", assuming 60Hz";
+        return kDefaultRampFrame;
+    }
+
+    return std::chrono::nanoseconds(std::chrono::seconds(1)) / refresh;
+}
+
+/*
+ * All sysfs writes happen on this thread. Requests only leave their latest
+ * state behind, so a burst of updates collapses into a single write and a
+ * binder call never waits on the kernel.
+ */
+void LightsWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    auto hasWork = [this] { return mWriterExit || mBacklightPending || mRgbPending; };
+
+    while (true) {
+        if (mRampActive) {
+            mWriterCv.wait_until(lock, mRampNext, hasWork);
+        } else {
+            mWriterCv.wait(lock, hasWork);
+        }
+
+        if (mWriterExit) {
+            break;
+        }
+
+        bool backlightPending = std::exchange(mBacklightPending, false);
+        uint32_t brightness = mBacklightRequest;
+        bool rgbPending = std::exchange(mRgbPending, false);
+
+        /* The RGB LED shows the most important light that is currently lit. */
+        LedState rgbState;
+        for (const LedState& ledState : mLedStates) {
+            if (isLit(ledState)) {
+                rgbState = ledState;
+                break;
+            }
+        }
+        mWriterBusy = true;
+        lock.unlock();
+
+        if (backlightPending) {
+            handleBacklight(brightness);
+        }
+        if (mRampActive && std::chrono::steady_clock::now() >= mRampNext) {
+            stepRamp();
+        }
+        if (rgbPending) {
+            applyRgb(rgbState);
+        }
+
+        lock.lock();
+        mWriterBusy = false;
+        mIdleCv.notify_all();
+    }
+}
+
+void LightsWriter::handleBacklight(uint32_t brightness) {
+    /*
+     * Start a ramp towards the new target, preempting any ramp in flight.
+     * Turning the panel on or off is never ramped.
+     */
+    if (mRampDuration.count() > 0 && brightness != 0 && mBacklightBrightness != 0 &&
+        mBacklightBrightness != UINT32_MAX) {
+        if (mRampActive && mRampTarget == brightness) {
+            return;
+        }
+
+        mRampFrom = mBacklightBrightness;
+        mRampTarget = brightness;
+        mRampStart = std::chrono::steady_clock::now();
+        mRampNext = mRampStart;
+        mRampActive = true;
+        return;
+    }
+
+    mRampActive = false;
+    writeBacklight(brightness);
+}
+
+void LightsWriter::stepRamp() {
+    auto now = std::chrono::steady_clock::now();
+    float t = std::chrono::duration<float>(now - mRampStart) /
+              std::chrono::duration<float>(mRampDuration);
+
+    writeBacklight(interpolateBrightness(mRampFrom, mRampTarget, t, mMaxBrightness));
+
+    if (t >= 1.0f) {
+        mRampActive = false;
+        return;
+    }
+
+    mRampNext = now + mRampFrame;
+}
+
+void LightsWriter::writeBacklight(uint32_t brightness) {
+    /* Drop repeated values, ramps and animations tend to resend them. */
+    if (brightness == mBacklightBrightness) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mBacklightElided++;
+        return;
+    }
+
+    if (!set(mBacklightFd.get(), brightness)) {
+        PLOG(WARNING) << "failed to write " << brightness << " to " << mLedDir
+                      << LCD_LED BRIGHTNESS;
+        mBacklightBrightness = UINT32_MAX;
+        return;
+    }
+
+    mBacklightBrightness = brightness;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mBacklightWrites++;
+}
+
+/*
+ * Blinking is handed to the LED class timer trigger, so the LED keeps
+ * flashing on its own while the AP is suspended.
+ */
+void LightsWriter::applyRgb(const LedState& state) {
+    if (mRgbStateValid && mRgbState.color == state.color && mRgbState.blink == state.blink &&
+        (!state.blink || (mRgbState.flashOnMs == state.flashOnMs &&
+                          mRgbState.flashOffMs == state.flashOffMs))) {
+        return;
+    }
+
+    uint32_t alpha = (state.color >> 24) & 0xFF;
+    uint32_t colors[] = {
+        (state.color >> 16) & 0xFF,
+        (state.color >> 8) & 0xFF,
+        state.color & 0xFF,
+    };
+
+    for (size_t i = 0; i < std::size(rgbLeds); i++) {
+        std::string led = mLedDir + rgbLeds[i];
+        uint32_t color = colors[i];
+
+        /* Scale RGB brightness if Alpha brightness is not 0xFF. */
+        if (alpha != 0xFF && alpha != 0) {
+            color = color * alpha / 0xFF;
+        }
+
+        uint32_t brightness = scaleBrightness(color, mRgbMaxBrightness[i]);
+
+        set(led + TRIGGER, "none");
+        set(led + BRIGHTNESS, brightness);
+
+        if (state.blink && brightness > 0) {
+            set(led + TRIGGER, "timer");
+            set(led + DELAY_ON, state.flashOnMs);
+            set(led + DELAY_OFF, state.flashOffMs);
+        }
+    }
+
+    mRgbState = state;
+    mRgbStateValid = true;
+}
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2018-2019 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace light {
+
+/* Requested state of a light on the RGB LED, color is AARRGGBB */
+struct LedState {
+    uint32_t color = 0;
+    bool blink = false;
+    uint32_t flashOnMs = 0;
+    uint32_t flashOffMs = 0;
+};
+
+/* Notification lights sharing the RGB LED, highest priority first */
+enum LedSlot { LED_ATTENTION, LED_NOTIFICATIONS, LED_BATTERY, LED_SLOT_COUNT };
+
+/*
+ * Owns the LED class nodes and the thread that writes them. Nothing here
+ * depends on binder, so the service and the host tests drive the same code.
+ */
+class LightsWriter {
+  public:
+    /* Ramp steps follow the panel refresh, 60Hz unless the panel says otherwise */
+    static constexpr std::chrono::nanoseconds kDefaultRampFrame{16666667};
+
+    LightsWriter(const std::string& ledDir, std::chrono::milliseconds rampDuration,
+                 std::chrono::nanoseconds rampFrame = kDefaultRampFrame);
+    ~LightsWriter();
+
+    /* Set the backlight from an 8 bit brightness, 0 turns the panel off */
+    void setBacklight(uint32_t brightness);
+    void setLed(LedSlot slot, const LedState& state);
+
+    /* Wait until the writer picked up everything requested so far */
+    void flush();
+
+    /* Whether the RGB LED is there, its nodes are only probed once */
+    bool hasRgb() const { return mHasRgb; }
+
+    uint64_t backlightWrites();
+    uint64_t backlightElided();
+
+    /*
+     * Frame period of the panel from the current mode of a framebuffer modes
+     * node, e.g. "U:1080x2400p-60". Falls back to kDefaultRampFrame when the
+     * node is missing or the driver does not report a refresh rate.
+     */
+    static std::chrono::nanoseconds readFramePeriod(const std::string& modesPath);
+
+  private:
+    void writerLoop();
+    void handleBacklight(uint32_t brightness);
+    void stepRamp();
+    void writeBacklight(uint32_t brightness);
+    void applyRgb(const LedState& state);
+
+    const std::string mLedDir;
+
+    /* Requests from the binder threads, picked up by the writer thread */
+    std::mutex mLock;
+    std::condition_variable mWriterCv;
+    std::condition_variable mIdleCv;
+    uint32_t mBacklightRequest = 0;
+    bool mBacklightPending = false;
+    LedState mLedStates[LED_SLOT_COUNT];
+    bool mRgbPending = false;
+    bool mWriterBusy = false;
+    bool mWriterExit = false;
+
+    /* Everything below is only written by the writer thread */
+    ::android::base::unique_fd mBacklightFd;
+    uint32_t mMaxBrightness;
+    /* Last value written to the backlight, UINT32_MAX if unknown */
+    uint32_t mBacklightBrightness = UINT32_MAX;
+    uint64_t mBacklightWrites = 0;
+    uint64_t mBacklightElided = 0;
+
+    /* Backlight ramp, disabled when mRampDuration is zero */
+    std::chrono::milliseconds mRampDuration;
+    std::chrono::nanoseconds mRampFrame;
+    std::chrono::steady_clock::time_point mRampStart;
+    std::chrono::steady_clock::time_point mRampNext;
+    uint32_t mRampFrom = 0;
+    uint32_t mRampTarget = 0;
+    bool mRampActive = false;
+
+    bool mHasRgb;
+    uint32_t mRgbMaxBrightness[3] = {};
+    LedState mRgbState;
+    bool mRgbStateValid = false;
+
+    std::thread mWriterThread;
+};
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -22,7 +22,9 @@
 using ::aidl::android::hardware::light::Lights;
 
 int main() {
-    ABinderProcess_setThreadPoolMaxThreadCount(0);
+    /* Binder threads only store the new state, a second one serves concurrent clients. */
+    ABinderProcess_setThreadPoolMaxThreadCount(1);
+    ABinderProcess_startThreadPool();
     std::shared_ptr<Lights> lights = ndk::SharedRefBase::make<Lights>();
 
     const std::string instance = std::string() + Lights::descriptor + "/default";
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2018-2019 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LightsWriter.h"
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using ::aidl::android::hardware::light::LED_BATTERY;
+using ::aidl::android::hardware::light::LED_NOTIFICATIONS;
+using ::aidl::android::hardware::light::LightsWriter;
+using ::android::base::WriteStringToFile;
+
+namespace {
+
+/* An LED class directory on tmpfs or the host disk, standing in for sysfs */
+class FakeLeds {
+  public:
+    FakeLeds() {
+        for (const char* led : {"lcd-backlight", "red", "green", "blue"}) {
+            std::string dir = std::string(mDir.path) + "/" + led;
+            mkdir(dir.c_str(), 0700);
+            WriteStringToFile("", dir + "/brightness");
+            WriteStringToFile(led[0] == 'l' ? "2047\n" : "255\n", dir + "/max_brightness");
+        }
+    }
+
+    const char* path() const { return mDir.path; }
+
+  private:
+    TemporaryDir mDir;
+};
+
+/* An auto-brightness ramp driven from the framework, every request a new level */
+void BM_BacklightChanging(benchmark::State& state) {
+    FakeLeds leds;
+    LightsWriter writer(leds.path(), std::chrono::milliseconds(0));
+    uint32_t brightness = 1;
+
+    for (auto _ : state) {
+        writer.setBacklight(brightness);
+        writer.flush();
+        brightness = brightness % 255 + 1;
+    }
+    state.counters["writes"] = writer.backlightWrites();
+}
+BENCHMARK(BM_BacklightChanging);
+
+/* An animation resending the level it is already at */
+void BM_BacklightRepeated(benchmark::State& state) {
+    FakeLeds leds;
+    LightsWriter writer(leds.path(), std::chrono::milliseconds(0));
+
+    for (auto _ : state) {
+        writer.setBacklight(128);
+        writer.flush();
+    }
+    state.counters["writes"] = writer.backlightWrites();
+    state.counters["elided"] = writer.backlightElided();
+}
+BENCHMARK(BM_BacklightRepeated);
+
+constexpr int kCallsPerThread = 1000;
+
+/*
+ * Run every client on its own thread, the way binder threads call into the
+ * service, and time each call. The writer thread meanwhile does the sysfs I/O.
+ */
+std::vector<std::chrono::nanoseconds> runClients(
+        const std::vector<std::function<void(int)>>& clients) {
+    std::mutex lock;
+    std::vector<std::chrono::nanoseconds> latencies;
+    std::vector<std::thread> threads;
+
+    for (const auto& client : clients) {
+        threads.emplace_back([&] {
+            std::vector<std::chrono::nanoseconds> local;
+            local.reserve(kCallsPerThread);
+            for (int i = 0; i < kCallsPerThread; i++) {
+                auto start = std::chrono::steady_clock::now();
+                client(i);
+                local.push_back(std::chrono::steady_clock::now() - start);
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            latencies.insert(latencies.end(), local.begin(), local.end());
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return latencies;
+}
+
+double percentileUs(const std::vector<std::chrono::nanoseconds>& sorted, double p) {
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * p));
+    return std::chrono::duration<double, std::micro>(sorted[index]).count();
+}
+
+/* Auto-brightness and an animation fighting over the backlight while notifications change */
+void BM_MixedClientLatency(benchmark::State& state) {
+    FakeLeds leds;
+    LightsWriter writer(leds.path(), std::chrono::milliseconds(0));
+
+    std::vector<std::function<void(int)>> clients = {
+        [&](int i) { writer.setBacklight(i % 255 + 1); },
+        [&](int i) { writer.setBacklight(255 - i % 255); },
+        [&](int i) { writer.setLed(LED_NOTIFICATIONS, {.color = i % 2 ? 0xff00ff00 : 0}); },
+        [&](int i) { writer.setLed(LED_BATTERY, {.color = 0xffff0000, .blink = i % 2 == 0,
+                                                 .flashOnMs = 500, .flashOffMs = 2000}); },
+    };
+
+    std::vector<std::chrono::nanoseconds> latencies;
+    for (auto _ : state) {
+        auto burst = runClients(clients);
+        latencies.insert(latencies.end(), burst.begin(), burst.end());
+        writer.flush();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    state.counters["p50_us"] = percentileUs(latencies, 0.50);
+    state.counters["p99_us"] = percentileUs(latencies, 0.99);
+    state.counters["max_us"] = percentileUs(latencies, 1.0);
+}
+BENCHMARK(BM_MixedClientLatency)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2018-2019 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LightsWriter.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using ::aidl::android::hardware::light::LED_ATTENTION;
+using ::aidl::android::hardware::light::LED_BATTERY;
+using ::aidl::android::hardware::light::LED_NOTIFICATIONS;
+using ::aidl::android::hardware::light::LedSlot;
+using ::aidl::android::hardware::light::LedState;
+using ::aidl::android::hardware::light::LightsWriter;
+using ::android::base::ReadFileToString;
+using ::android::base::WriteStringToFile;
+
+namespace {
+
+/* A directory standing in for /sys/class/leds */
+class LightsWriterTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        for (const char* led : {"lcd-backlight", "red", "green", "blue"}) {
+            ASSERT_EQ(0, mkdir(path(led).c_str(), 0700));
+            ASSERT_TRUE(WriteStringToFile("", path(led) + "/brightness"));
+        }
+        ASSERT_TRUE(WriteStringToFile("2047\n", path("lcd-backlight/max_brightness")));
+        for (const char* led : {"red", "green", "blue"}) {
+            ASSERT_TRUE(WriteStringToFile("255\n", path(led) + "/max_brightness"));
+        }
+    }
+
+    void start(std::chrono::milliseconds rampDuration = std::chrono::milliseconds(0),
+               std::chrono::nanoseconds rampFrame = LightsWriter::kDefaultRampFrame) {
+        mWriter = std::make_unique<LightsWriter>(mDir.path, rampDuration, rampFrame);
+    }
+
+    std::string path(const std::string& node) { return std::string(mDir.path) + "/" + node; }
+
+    std::string read(const std::string& node) {
+        std::string value;
+        EXPECT_TRUE(ReadFileToString(path(node), &value));
+        return value;
+    }
+
+    void setBacklight(uint32_t brightness) {
+        mWriter->setBacklight(brightness);
+        mWriter->flush();
+    }
+
+    void setLed(LedSlot slot, const LedState& state) {
+        mWriter->setLed(slot, state);
+        mWriter->flush();
+    }
+
+    std::string rgb() {
+        return read("red/brightness") + " " + read("green/brightness") + " " +
+               read("blue/brightness");
+    }
+
+    TemporaryDir mDir;
+    std::unique_ptr<LightsWriter> mWriter;
+};
+
+/*
+ * The backlight fd is written at offset 0 like sysfs expects, so the tests
+ * stick to values of the same width to read back what was written last.
+ */
+TEST_F(LightsWriterTest, BacklightScalesToMaxBrightness) {
+    start();
+    setBacklight(255);
+    EXPECT_EQ("2047", read("lcd-backlight/brightness"));
+    setBacklight(128);
+    EXPECT_EQ("1024", read("lcd-backlight/brightness"));
+}
+
+TEST_F(LightsWriterTest, MaxBrightnessIsReadOnce) {
+    start();
+    ASSERT_TRUE(WriteStringToFile("1023\n", path("lcd-backlight/max_brightness")));
+    setBacklight(255);
+    EXPECT_EQ("2047", read("lcd-backlight/brightness"));
+}
+
+TEST_F(LightsWriterTest, BrightnessFdStaysOpen) {
+    start();
+    ASSERT_EQ(0, rename(path("lcd-backlight/brightness").c_str(),
+                        path("lcd-backlight/brightness.opened").c_str()));
+    ASSERT_TRUE(WriteStringToFile("", path("lcd-backlight/brightness")));
+
+    setBacklight(255);
+    EXPECT_EQ("2047", read("lcd-backlight/brightness.opened"));
+    EXPECT_EQ("", read("lcd-backlight/brightness"));
+}
+
+TEST_F(LightsWriterTest, RepeatedBacklightIsDropped) {
+    start();
+    for (int i = 0; i < 20; i++) {
+        setBacklight(200);
+    }
+    setBacklight(201);
+    setBacklight(201);
+
+    EXPECT_EQ(2u, mWriter->backlightWrites());
+    EXPECT_EQ(20u, mWriter->backlightElided());
+}
+
+/*
+ * Poll the backlight node and log every change with its time since the
+ * start, the ramp writes at most once per panel frame.
+ */
+static std::vector<std::pair<std::chrono::milliseconds, uint32_t>> logBacklight(
+        const std::string& node, std::chrono::milliseconds duration) {
+    using namespace std::chrono;
+
+    std::vector<std::pair<milliseconds, uint32_t>> log;
+    auto start = steady_clock::now();
+    std::string last;
+    while (steady_clock::now() - start < duration) {
+        std::string value;
+        if (ReadFileToString(node, &value) && value != last) {
+            log.emplace_back(duration_cast<milliseconds>(steady_clock::now() - start),
+                             std::stoul(value));
+            last = value;
+        }
+        std::this_thread::sleep_for(microseconds(500));
+    }
+    return log;
+}
+
+TEST_F(LightsWriterTest, RampIsMonotonicAndEndsAtTarget) {
+    start(std::chrono::milliseconds(200));
+    setBacklight(128);
+    ASSERT_EQ("1024", read("lcd-backlight/brightness"));
+
+    mWriter->setBacklight(255);
+    auto log = logBacklight(path("lcd-backlight/brightness"), std::chrono::milliseconds(400));
+
+    ASSERT_FALSE(log.empty());
+    EXPECT_EQ(2047u, log.back().second);
+    EXPECT_GE(log.back().first.count(), 150);
+    /* About one write per 16.7ms frame, a frame or two less on a loaded host */
+    EXPECT_GE(log.size(), 6u);
+    EXPECT_LE(mWriter->backlightWrites(), 1u + 200 / 16 + 2);
+    for (size_t i = 1; i < log.size(); i++) {
+        EXPECT_GT(log[i].second, log[i - 1].second);
+    }
+}
+
+TEST_F(LightsWriterTest, NewTargetPreemptsRamp) {
+    start(std::chrono::milliseconds(200));
+    setBacklight(128);
+
+    mWriter->setBacklight(255);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    mWriter->setBacklight(160);
+    auto log = logBacklight(path("lcd-backlight/brightness"), std::chrono::milliseconds(400));
+
+    ASSERT_FALSE(log.empty());
+    EXPECT_EQ((160u - 1) * 2046 / 254 + 1, log.back().second);
+}
+
+/* A 120Hz panel gets twice the steps of a 60Hz one over the same ramp */
+TEST_F(LightsWriterTest, RampFollowsThePanelFrame) {
+    start(std::chrono::milliseconds(200), std::chrono::nanoseconds(8333333));
+    setBacklight(128);
+
+    mWriter->setBacklight(255);
+    auto log = logBacklight(path("lcd-backlight/brightness"), std::chrono::milliseconds(400));
+
+    ASSERT_FALSE(log.empty());
+    EXPECT_EQ(2047u, log.back().second);
+    EXPECT_GE(mWriter->backlightWrites(), 1u + 200 / 16 + 3);
+    EXPECT_LE(mWriter->backlightWrites(), 1u + 200 / 8 + 2);
+}
+
+TEST_F(LightsWriterTest, FramePeriodIsReadFromTheMode) {
+    auto period = [this](const std::string& modes) {
+        EXPECT_TRUE(WriteStringToFile(modes, path("modes")));
+        return LightsWriter::readFramePeriod(path("modes"));
+    };
+
+    EXPECT_EQ(std::chrono::nanoseconds(16666666), period("U:1080x2400p-60\n"));
+    EXPECT_EQ(std::chrono::nanoseconds(11111111), period("U:1080x2400p-90\nU:1080x2400p-60\n"));
+    EXPECT_EQ(std::chrono::nanoseconds(8333333), period("U:1080x2400p-120\n"));
+
+    /* mtkfb leaves the pixel clock unset on some panels, which reads as 0Hz */
+    EXPECT_EQ(LightsWriter::kDefaultRampFrame, period("U:1080x2400p-0\n"));
+    EXPECT_EQ(LightsWriter::kDefaultRampFrame, period(""));
+    EXPECT_EQ(LightsWriter::kDefaultRampFrame, LightsWriter::readFramePeriod(path("none")));
+}
+
+TEST_F(LightsWriterTest, MostImportantLitLightWins) {
+    start();
+    setLed(LED_BATTERY, {.color = 0xffff0000});
+    EXPECT_EQ("255 0 0", rgb());
+
+    setLed(LED_NOTIFICATIONS, {.color = 0xff00ff00});
+    EXPECT_EQ("0 255 0", rgb());
+
+    setLed(LED_ATTENTION, {.color = 0xff0000ff});
+    EXPECT_EQ("0 0 255", rgb());
+
+    /* Clearing a light falls back to the next one that is still lit */
+    setLed(LED_ATTENTION, {});
+    EXPECT_EQ("0 255 0", rgb());
+    setLed(LED_NOTIFICATIONS, {});
+    EXPECT_EQ("255 0 0", rgb());
+    setLed(LED_BATTERY, {});
+    EXPECT_EQ("0 0 0", rgb());
+}
+
+TEST_F(LightsWriterTest, AlphaScalesLed) {
+    start();
+    setLed(LED_NOTIFICATIONS, {.color = 0x80ff8000});
+    EXPECT_EQ("128 64 0", rgb());
+}
+
+TEST_F(LightsWriterTest, BlinkUsesTimerTrigger) {
+    start();
+    setLed(LED_NOTIFICATIONS,
+           {.color = 0xff00ff00, .blink = true, .flashOnMs = 500, .flashOffMs = 2000});
+
+    EXPECT_EQ("timer", read("green/trigger"));
+    EXPECT_EQ("500", read("green/delay_on"));
+    EXPECT_EQ("2000", read("green/delay_off"));
+    /* An unlit color does not blink */
+    EXPECT_EQ("none", read("red/trigger"));
+
+    setLed(LED_NOTIFICATIONS, {.color = 0xff00ff00});
+    EXPECT_EQ("none", read("green/trigger"));
+    EXPECT_EQ("0 255 0", rgb());
+}
+
+TEST_F(LightsWriterTest, UnchangedLedIsNotRewritten) {
+    start();
+    setLed(LED_NOTIFICATIONS, {.color = 0xff00ff00});
+    ASSERT_TRUE(WriteStringToFile("untouched", path("green/brightness")));
+
+    /* Neither a repeated state nor a lower priority light change what the LED shows */
+    setLed(LED_NOTIFICATIONS, {.color = 0xff00ff00});
+    setLed(LED_BATTERY, {.color = 0xffff0000});
+    EXPECT_EQ("untouched", read("green/brightness"));
+}
+
+TEST_F(LightsWriterTest, RgbNeedsTheRedNode) {
+    start();
+    EXPECT_TRUE(mWriter->hasRgb());
+
+    mWriter.reset();
+    ASSERT_EQ(0, unlink(path("red/brightness").c_str()));
+    start();
+    EXPECT_FALSE(mWriter->hasRgb());
+    setLed(LED_BATTERY, {.color = 0xff00ff00});
+    EXPECT_EQ("", read("green/brightness"));
+}
+
+TEST_F(LightsWriterTest, PanelOnIsNotRamped) {
+    start(std::chrono::milliseconds(200));
+    setBacklight(255);
+    EXPECT_EQ("2047", read("lcd-backlight/brightness"));
+    EXPECT_EQ(1u, mWriter->backlightWrites());
+}
+
+}  // namespace
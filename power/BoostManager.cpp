@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "power.rosemary"
+
+#include "BoostManager.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#define EAS_BOOST       "/proc/perfmgr/boost_ctrl/eas_ctrl/boot_boost"
+#define CPU_FREQ        "/proc/perfmgr/boost_ctrl/cpu_ctrl/boot_freq"
+#define STUNE_BOOST     "/dev/stune/top-app/schedtune.boost"
+
+/* perfmgr cgroup index of top-app */
+#define EAS_TOP_APP     3
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+/*
+ * No boost request is active. perfmgr goes back to the top-app slot of 0 set at
+ * boot completion by init.mt6785.rc, stune to what it held before.
+ */
+static constexpr int kNoBoost = 0;
+static constexpr int kInteractionBoost = 40;
+static constexpr int kLaunchBoost = 100;
+
+/*
+ * Hint sessions this far behind also get the cpu frequency floor. A session
+ * that settles on boost alone asks for well below this, see HintSessionTest.
+ */
+static constexpr int kFreqFloorBoost = 80;
+
+/* Raise the minimum OPP of both clusters, leave the maximum alone. */
+static constexpr char kFreqFloorOn[] = "0 -1 0 -1";
+static constexpr char kFreqFloorOff[] = "-1 -1 -1 -1";
+
+static ::android::base::unique_fd openNode(const std::string& path) {
+    ::android::base::unique_fd fd(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+
+    if (fd.get() < 0) {
+        PLOG(WARNING) << "failed to open " << path;
+    }
+    return fd;
+}
+
+static bool writeNode(int fd, const char* value) {
+    size_t len = strlen(value);
+
+    return fd >= 0 && pwrite(fd, value, len, 0) == static_cast<ssize_t>(len);
+}
+
+/* Current value of a single number node, fallback if it cannot be read */
+static std::string readNode(const std::string& path, const char* fallback) {
+    std::string value;
+
+    if (!::android::base::ReadFileToString(path, &value)) {
+        return fallback;
+    }
+    value = ::android::base::Trim(value);
+    return value.empty() ? fallback : value;
+}
+
+BoostManager& BoostManager::getInstance() {
+    static BoostManager instance("");
+    return instance;
+}
+
+BoostManager::BoostManager(const std::string& root)
+    : mRoot(root),
+      mEasBoostFd(openNode(mRoot + EAS_BOOST)),
+      mStuneBoostFd(openNode(mRoot + STUNE_BOOST)),
+      mFreqFd(openNode(mRoot + CPU_FREQ)),
+      mThread(&BoostManager::threadLoop, this) {}
+
+BoostManager::~BoostManager() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCv.notify_one();
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+bool BoostManager::hasBoostNode() const {
+    return mEasBoostFd.get() >= 0 || mStuneBoostFd.get() >= 0;
+}
+
+void BoostManager::setInteraction(std::chrono::milliseconds duration) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto now = Clock::now();
+
+    mInteractionEnd = std::max(mInteractionEnd, now + duration);
+    applyLocked(now);
+    mCv.notify_one();
+}
+
+void BoostManager::setLaunch(bool enabled) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mLaunch = enabled;
+    applyLocked(Clock::now());
+}
+
+void BoostManager::setSessionBoost(const void* session, int boost, Clock::time_point expiry) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mSessions[session] = {boost, expiry};
+    applyLocked(Clock::now());
+    mCv.notify_one();
+}
+
+void BoostManager::removeSession(const void* session) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mSessions.erase(session)) {
+        applyLocked(Clock::now());
+    }
+}
+
+/*
+ * Expire interaction boosts and stale hint sessions. Requests that are still
+ * active wake the thread up again at their deadline.
+ */
+void BoostManager::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (!mExit) {
+        auto now = Clock::now();
+        applyLocked(now);
+
+        auto next = Clock::time_point::max();
+        if (mInteractionEnd > now) {
+            next = mInteractionEnd;
+        }
+        for (const auto& [session, request] : mSessions) {
+            if (request.first > 0 && request.second > now) {
+                next = std::min(next, request.second);
+            }
+        }
+
+        if (next == Clock::time_point::max()) {
+            mCv.wait(lock);
+        } else {
+            mCv.wait_until(lock, next);
+        }
+    }
+}
+
+void BoostManager::applyLocked(Clock::time_point now) {
+    int boost = kNoBoost;
+    bool freqFloor = mLaunch;
+
+    if (mLaunch) {
+        boost = kLaunchBoost;
+    }
+    if (mInteractionEnd > now) {
+        boost = std::max(boost, kInteractionBoost);
+    }
+    for (const auto& [session, request] : mSessions) {
+        if (request.second > now) {
+            boost = std::max(boost, request.first);
+            freqFloor |= request.first >= kFreqFloorBoost;
+        }
+    }
+
+    /*
+     * Nodes are left to init until the first request asks for something, so
+     * the boot_boost and boot_freq tuning of init.mt6785.rc stays in place.
+     */
+    if (boost != mBoost && (mBoost >= 0 || boost != kNoBoost)) {
+        writeBoost(boost);
+    }
+    if (freqFloor != mFreqFloor && (mFreqFloor >= 0 || freqFloor)) {
+        writeFreqFloor(freqFloor);
+    }
+}
+
+void BoostManager::writeBoost(int boost) {
+    char buf[16];
+
+    /* Remember what init left behind before the first boost replaces it */
+    if (mBoost < 0) {
+        mStuneIdle = readNode(mRoot + STUNE_BOOST, "0");
+    }
+
+    /* perfmgr merges its own slot with the vendor perf service, stune is the fallback */
+    snprintf(buf, sizeof(buf), "%d %d", EAS_TOP_APP, boost);
+    if (!writeNode(mEasBoostFd.get(), buf)) {
+        snprintf(buf, sizeof(buf), "%d", boost);
+        writeNode(mStuneBoostFd.get(), boost == kNoBoost ? mStuneIdle.c_str() : buf);
+    }
+
+    mBoost = boost;
+    mBoostWrites++;
+}
+
+void BoostManager::writeFreqFloor(bool enabled) {
+    if (!writeNode(mFreqFd.get(), enabled ? kFreqFloorOn : kFreqFloorOff)) {
+        mFreqFloor = -1;
+        return;
+    }
+
+    mFreqFloor = enabled;
+}
+
+void BoostManager::dump(int fd) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto now = Clock::now();
+
+    if (mBoost < 0) {
+        dprintf(fd, "Top-app boost: left to init\n");
+    } else {
+        dprintf(fd, "Top-app boost: %d (%" PRIu64 " writes)\n", mBoost, mBoostWrites);
+    }
+    dprintf(fd, "CPU frequency floor: %s\n",
+            mFreqFloor < 0 ? "left to init" : mFreqFloor ? "on" : "off");
+    dprintf(fd, "Launch: %s\n", mLaunch ? "on" : "off");
+    dprintf(fd, "Interaction: %s\n", mInteractionEnd > now ? "on" : "off");
+    dprintf(fd, "Hint sessions:\n");
+    for (const auto& [session, request] : mSessions) {
+        dprintf(fd, "  %p: boost %d%s\n", session, request.first,
+                request.second > now ? "" : " (stale)");
+    }
+}
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+/*
+ * Folds every boost request (interaction, launch and hint sessions) into a
+ * single top-app boost level and applies it to the perfmgr and stune nodes.
+ * Nodes are only written when the aggregated value changes.
+ */
+class BoostManager {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static BoostManager& getInstance();
+
+    /* root is prepended to every procfs and cgroup path, the service uses "" */
+    explicit BoostManager(const std::string& root);
+    ~BoostManager();
+
+    void setInteraction(std::chrono::milliseconds duration);
+    void setLaunch(bool enabled);
+    void setSessionBoost(const void* session, int boost, Clock::time_point expiry);
+    void removeSession(const void* session);
+    bool hasBoostNode() const;
+    void dump(int fd);
+
+  private:
+    void threadLoop();
+    void applyLocked(Clock::time_point now);
+    void writeBoost(int boost);
+    void writeFreqFloor(bool enabled);
+
+    const std::string mRoot;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    Clock::time_point mInteractionEnd;
+    bool mLaunch = false;
+    /* Boost requested by every hint session and when the request goes stale */
+    std::map<const void*, std::pair<int, Clock::time_point>> mSessions;
+    bool mExit = false;
+
+    ::android::base::unique_fd mEasBoostFd;
+    ::android::base::unique_fd mStuneBoostFd;
+    ::android::base::unique_fd mFreqFd;
+
+    /* Last applied values, -1 until the first request or if unknown */
+    int mBoost = -1;
+    int mFreqFloor = -1;
+    /* stune value from before the first boost, restored once idle */
+    std::string mStuneIdle;
+    uint64_t mBoostWrites = 0;
+
+    std::thread mThread;
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
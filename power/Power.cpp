@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "power.rosemary"
+
+#include "Power.h"
+#include "BoostManager.h"
+#include "PowerHintSession.h"
+
+#include <android-base/logging.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+static constexpr std::chrono::milliseconds kInteractionDefault(80);
+static constexpr std::chrono::milliseconds kInteractionMax(5000);
+
+/* Matches the 60Hz panel. */
+static constexpr int64_t kPreferredRateNanos = 16666666;
+
+ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
+    LOG(VERBOSE) << "Power setMode: " << toString(type) << " to: " << enabled;
+
+    switch (type) {
+        case Mode::LAUNCH:
+            BoostManager::getInstance().setLaunch(enabled);
+            break;
+        default:
+            break;
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Power::isModeSupported(Mode type, bool* _aidl_return) {
+    *_aidl_return = type == Mode::LAUNCH && BoostManager::getInstance().hasBoostNode();
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
+    LOG(VERBOSE) << "Power setBoost: " << toString(type) << " duration: " << durationMs;
+
+    switch (type) {
+        case Boost::INTERACTION: {
+            auto duration = durationMs > 0 ? std::chrono::milliseconds(durationMs)
+                                           : kInteractionDefault;
+            BoostManager::getInstance().setInteraction(std::min(duration, kInteractionMax));
+            break;
+        }
+        default:
+            break;
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Power::isBoostSupported(Boost type, bool* _aidl_return) {
+    *_aidl_return = type == Boost::INTERACTION && BoostManager::getInstance().hasBoostNode();
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Power::createHintSession(int32_t tgid, int32_t uid,
+                                            const std::vector<int32_t>& threadIds,
+                                            int64_t durationNanos,
+                                            std::shared_ptr<IPowerHintSession>* _aidl_return) {
+    if (!BoostManager::getInstance().hasBoostNode()) {
+        *_aidl_return = nullptr;
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    if (threadIds.empty() || durationNanos <= 0) {
+        *_aidl_return = nullptr;
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    *_aidl_return = ndk::SharedRefBase::make<PowerHintSession>(tgid, uid, threadIds,
+                                                               durationNanos);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Power::getHintSessionPreferredRate(int64_t* outNanoseconds) {
+    *outNanoseconds = kPreferredRateNanos;
+    return ndk::ScopedAStatus::ok();
+}
+
+binder_status_t Power::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    BoostManager::getInstance().dump(fd);
+    return STATUS_OK;
+}
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
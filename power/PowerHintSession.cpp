@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "power.rosemary"
+
+#include "PowerHintSession.h"
+#include "BoostManager.h"
+
+#include <android-base/logging.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+PowerHintSession::PowerHintSession(int32_t tgid, int32_t uid,
+                                   const std::vector<int32_t>& /* threadIds */,
+                                   int64_t durationNanos)
+    : mTgid(tgid), mUid(uid), mTargetNanos(durationNanos) {
+    LOG(DEBUG) << "hint session for " << mTgid << " (uid " << mUid << "), target "
+               << durationNanos << " ns";
+}
+
+PowerHintSession::~PowerHintSession() {
+    close();
+}
+
+void PowerHintSession::resetController() {
+    mController.reset();
+    mBoost = 0;
+}
+
+ndk::ScopedAStatus PowerHintSession::updateTargetWorkDuration(int64_t targetDurationNanos) {
+    if (targetDurationNanos <= 0) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mTargetNanos = targetDurationNanos;
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
+        const std::vector<WorkDuration>& actualDurations) {
+    if (actualDurations.empty()) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mPaused || mClosed) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+
+    for (const WorkDuration& duration : actualDurations) {
+        mBoost = mController.addFrame(duration.durationNanos, mTargetNanos);
+    }
+
+    BoostManager::getInstance().setSessionBoost(
+            this, mBoost,
+            BoostManager::Clock::now() + WorkDurationController::staleTimeout(mTargetNanos));
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus PowerHintSession::pause() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mClosed) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+
+    mPaused = true;
+    BoostManager::getInstance().removeSession(this);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus PowerHintSession::resume() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mClosed) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+
+    /* Whatever was learned before the pause is likely stale by now. */
+    mPaused = false;
+    resetController();
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus PowerHintSession::close() {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mClosed = true;
+    BoostManager::getInstance().removeSession(this);
+    return ndk::ScopedAStatus::ok();
+}
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
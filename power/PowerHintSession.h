@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/power/BnPowerHintSession.h>
+#include <aidl/android/hardware/power/WorkDuration.h>
+
+#include <mutex>
+#include <vector>
+
+#include "WorkDurationController.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+/*
+ * ADPF hint session. WorkDurationController turns the reported frames into
+ * the top-app boost this session asks BoostManager for.
+ */
+class PowerHintSession : public BnPowerHintSession {
+  public:
+    PowerHintSession(int32_t tgid, int32_t uid, const std::vector<int32_t>& threadIds,
+                     int64_t durationNanos);
+    ~PowerHintSession();
+
+    ndk::ScopedAStatus updateTargetWorkDuration(int64_t targetDurationNanos) override;
+    ndk::ScopedAStatus reportActualWorkDuration(
+            const std::vector<WorkDuration>& actualDurations) override;
+    ndk::ScopedAStatus pause() override;
+    ndk::ScopedAStatus resume() override;
+    ndk::ScopedAStatus close() override;
+
+  private:
+    void resetController();
+
+    const int32_t mTgid;
+    const int32_t mUid;
+
+    std::mutex mLock;
+    int64_t mTargetNanos;
+    WorkDurationController mController;
+    int mBoost = 0;
+    bool mPaused = false;
+    bool mClosed = false;
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
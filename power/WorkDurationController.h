@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+/*
+ * PID controller on the relative miss of every frame a hint session reports.
+ * Its output is the smallest top-app boost that keeps the work on target.
+ */
+class WorkDurationController {
+  public:
+    /*
+     * Controller gains, in boost percent per unit of relative error. The boost
+     * takes effect on the very next frame, so the integral carries the level
+     * and a strong derivative would only make it swing. Misses are corrected
+     * harder than early frames give boost back.
+     */
+    static constexpr float kPOver = 50.0f;
+    static constexpr float kPUnder = 10.0f;
+    static constexpr float kI = 20.0f;
+    static constexpr float kD = 5.0f;
+    static constexpr float kIntegralMin = -1.0f;
+    static constexpr float kIntegralMax = 5.0f;
+
+    /* A session that stops reporting for this many target periods loses its boost. */
+    static constexpr int64_t kStalePeriods = 10;
+    static constexpr std::chrono::milliseconds kMinStale{100};
+
+    /* Feed one reported frame. @return The boost from 0 to 100 it asks for. */
+    int addFrame(int64_t durationNanos, int64_t targetNanos) {
+        float error = static_cast<float>(durationNanos - targetNanos) / targetNanos;
+
+        mIntegral = std::clamp(mIntegral + error, kIntegralMin, kIntegralMax);
+        float output = (error > 0 ? kPOver : kPUnder) * error + kI * mIntegral +
+                       kD * (error - mPrevError);
+        mPrevError = error;
+        return std::clamp(static_cast<int>(std::lround(output)), 0, 100);
+    }
+
+    void reset() {
+        mIntegral = 0.0f;
+        mPrevError = 0.0f;
+    }
+
+    /* @return How long the boost of a session with this target outlives its last report. */
+    static std::chrono::nanoseconds staleTimeout(int64_t targetNanos) {
+        return std::max<std::chrono::nanoseconds>(
+                std::chrono::nanoseconds(targetNanos * kStalePeriods), kMinStale);
+    }
+
+  private:
+    float mIntegral = 0.0f;
+    float mPrevError = 0.0f;
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
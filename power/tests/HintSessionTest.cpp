@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "BoostManager.h"
+#include "WorkDurationController.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using ::aidl::android::hardware::power::impl::BoostManager;
+using ::aidl::android::hardware::power::impl::WorkDurationController;
+using ::android::base::ReadFileToString;
+using ::android::base::WriteStringToFile;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr int64_t kTargetNanos = 16666667;
+constexpr int kFrames = 600;
+
+/* Frames the last second of a ten second trace is judged on */
+constexpr int kSettledFrames = 60;
+
+constexpr char kEasBoost[] = "/proc/perfmgr/boost_ctrl/eas_ctrl/boot_boost";
+constexpr char kCpuFreq[] = "/proc/perfmgr/boost_ctrl/cpu_ctrl/boot_freq";
+constexpr char kStuneBoost[] = "/dev/stune/top-app/schedtune.boost";
+
+/* The perfmgr and stune nodes BoostManager writes, in a fake procfs and cgroup tree */
+class FakeTree {
+  public:
+    explicit FakeTree(bool perfmgr) {
+        std::string dir = mDir.path;
+        for (const char* sub : {"/proc", "/proc/perfmgr", "/proc/perfmgr/boost_ctrl",
+                                "/proc/perfmgr/boost_ctrl/eas_ctrl",
+                                "/proc/perfmgr/boost_ctrl/cpu_ctrl", "/dev", "/dev/stune",
+                                "/dev/stune/top-app"}) {
+            mkdir((dir + sub).c_str(), 0700);
+        }
+        if (perfmgr) {
+            WriteStringToFile("", dir + kEasBoost);
+        }
+        WriteStringToFile("", dir + kCpuFreq);
+        WriteStringToFile("5\n", dir + kStuneBoost);
+    }
+
+    std::string root() const { return mDir.path; }
+
+    /* What was written to a node since the last call, nodes are written at offset 0 */
+    std::string take(const char* node) {
+        std::string path = root() + node;
+        std::string value;
+        ReadFileToString(path, &value);
+        truncate(path.c_str(), 0);
+        return value;
+    }
+
+    /* Pick up the perfmgr writes of one request, the nodes keep whatever was written last */
+    void poll() {
+        for (const char* node : {kEasBoost, kCpuFreq}) {
+            std::string value = take(node);
+            if (!value.empty()) {
+                mLatest[node] = value;
+                mWrites[node]++;
+            }
+        }
+    }
+
+    std::string latest(const char* node) { return mLatest[node]; }
+    int writes(const char* node) { return mWrites[node]; }
+
+  private:
+    TemporaryDir mDir;
+    std::map<std::string, std::string> mLatest;
+    std::map<std::string, int> mWrites;
+};
+
+/*
+ * A render thread whose frames need workNanos at no boost and speed up
+ * linearly to half that at full boost, with some jitter on every frame.
+ */
+class FrameTrace {
+  public:
+    explicit FrameTrace(int64_t workNanos) : mWorkNanos(workNanos) {}
+
+    int64_t next(int boost) {
+        double speedup = 1.0 + boost / 100.0;
+        return static_cast<int64_t>(mWorkNanos * (1.0 + 0.03 * mNoise(mRng)) / speedup);
+    }
+
+  private:
+    const int64_t mWorkNanos;
+    std::mt19937 mRng{1};
+    std::normal_distribution<double> mNoise{0, 1};
+};
+
+struct Settled {
+    int minBoost = 100;
+    int maxBoost = 0;
+    int late = 0;
+};
+
+/*
+ * Drive the controller with a trace, one report per frame like HWUI does. With a manager
+ * every boost is requested for the session, and the tree picks up what it wrote.
+ */
+Settled replay(FrameTrace* trace, WorkDurationController* controller,
+               BoostManager* manager = nullptr, const void* session = nullptr,
+               FakeTree* tree = nullptr) {
+    Settled settled;
+    int boost = 0;
+    for (int i = 0; i < kFrames; i++) {
+        int64_t duration = trace->next(boost);
+        boost = controller->addFrame(duration, kTargetNanos);
+        if (manager) {
+            auto stale = WorkDurationController::staleTimeout(kTargetNanos);
+            manager->setSessionBoost(session, boost, BoostManager::Clock::now() + stale);
+            tree->poll();
+        }
+        if (i >= kFrames - kSettledFrames) {
+            settled.minBoost = std::min(settled.minBoost, boost);
+            settled.maxBoost = std::max(settled.maxBoost, boost);
+            settled.late += duration > kTargetNanos * 105 / 100;
+        }
+    }
+    return settled;
+}
+
+TEST(WorkDurationControllerTest, SettlesJustAboveTheMiss) {
+    /* 20 ms of work for a 60 Hz target needs a boost of about 20 */
+    FrameTrace trace(20000000);
+    WorkDurationController controller;
+    Settled settled = replay(&trace, &controller);
+
+    EXPECT_GE(settled.minBoost, 10);
+    EXPECT_LE(settled.maxBoost, 35);
+    EXPECT_LE(settled.maxBoost - settled.minBoost, 15) << "no settling";
+    EXPECT_LE(settled.late, kSettledFrames / 6);
+}
+
+TEST(WorkDurationControllerTest, EarlyFramesNeedNoBoost) {
+    FrameTrace trace(8000000);
+    WorkDurationController controller;
+    Settled settled = replay(&trace, &controller);
+
+    EXPECT_EQ(0, settled.maxBoost);
+    EXPECT_EQ(0, settled.late);
+}
+
+TEST(WorkDurationControllerTest, HopelessWorkSaturates) {
+    FrameTrace trace(40000000);
+    WorkDurationController controller;
+    Settled settled = replay(&trace, &controller);
+
+    EXPECT_EQ(100, settled.minBoost);
+}
+
+TEST(WorkDurationControllerTest, ResetForgetsTheIntegral) {
+    FrameTrace trace(20000000);
+    WorkDurationController controller;
+    replay(&trace, &controller);
+
+    controller.reset();
+    EXPECT_EQ(0, controller.addFrame(kTargetNanos, kTargetNanos));
+}
+
+TEST(WorkDurationControllerTest, StaleTimeoutFollowsTheTarget) {
+    EXPECT_EQ(166666670ns, WorkDurationController::staleTimeout(kTargetNanos));
+    EXPECT_EQ(100ms, WorkDurationController::staleTimeout(1000000));
+}
+
+class BoostManagerTest : public ::testing::Test {
+  protected:
+    Settled replay(int64_t workNanos) {
+        FrameTrace trace(workNanos);
+        return ::replay(&trace, &mController, &mManager, &mSession, &mTree);
+    }
+
+    FakeTree mTree{true};
+    WorkDurationController mController;
+    BoostManager mManager{mTree.root()};
+    int mSession;
+};
+
+TEST_F(BoostManagerTest, NothingIsWrittenWithoutABoost) {
+    replay(8000000);
+
+    EXPECT_EQ(0, mTree.writes(kEasBoost));
+    EXPECT_EQ(0, mTree.writes(kCpuFreq));
+    EXPECT_EQ("5\n", mTree.take(kStuneBoost));
+}
+
+/*
+ * A session that keeps up with a moderate boost stays below kFreqFloorBoost,
+ * one that is far behind raises the frequency floor as well.
+ */
+TEST_F(BoostManagerTest, OnlySessionsFarBehindRaiseTheFrequencyFloor) {
+    Settled settled = replay(20000000);
+    EXPECT_LT(settled.maxBoost, 80);
+    EXPECT_EQ(0u, mTree.latest(kEasBoost).find("3 ")) << mTree.latest(kEasBoost);
+    EXPECT_EQ("", mTree.latest(kCpuFreq));
+
+    replay(40000000);
+    EXPECT_EQ("3 100", mTree.latest(kEasBoost));
+    EXPECT_EQ("0 -1 0 -1", mTree.latest(kCpuFreq));
+}
+
+TEST_F(BoostManagerTest, StaleSessionLosesItsBoost) {
+    replay(40000000);
+    ASSERT_EQ("3 100", mTree.latest(kEasBoost));
+    ASSERT_EQ("0 -1 0 -1", mTree.latest(kCpuFreq));
+    auto lastReport = BoostManager::Clock::now();
+
+    /* The session stops reporting, the manager thread expires it on its own */
+    int writes = mTree.writes(kEasBoost);
+    while (mTree.writes(kEasBoost) == writes && BoostManager::Clock::now() - lastReport < 5s) {
+        std::this_thread::sleep_for(10ms);
+        mTree.poll();
+    }
+    auto expired = BoostManager::Clock::now() - lastReport;
+
+    EXPECT_EQ("3 0", mTree.latest(kEasBoost));
+    EXPECT_EQ("-1 -1 -1 -1", mTree.latest(kCpuFreq));
+    EXPECT_GE(expired, WorkDurationController::staleTimeout(kTargetNanos));
+}
+
+TEST_F(BoostManagerTest, RemovedSessionLosesItsBoostAtOnce) {
+    replay(40000000);
+
+    mManager.removeSession(&mSession);
+    mTree.poll();
+    EXPECT_EQ("3 0", mTree.latest(kEasBoost));
+    EXPECT_EQ("-1 -1 -1 -1", mTree.latest(kCpuFreq));
+}
+
+/* Without perfmgr the boost goes to stune, which gets its boot value back once idle */
+TEST(BoostManagerStuneTest, StuneIsRestored) {
+    FakeTree tree(false);
+    BoostManager manager(tree.root());
+    int session;
+
+    manager.setSessionBoost(&session, 30, BoostManager::Clock::now() + 1s);
+    EXPECT_EQ("30", tree.take(kStuneBoost));
+
+    manager.removeSession(&session);
+    EXPECT_EQ("5", tree.take(kStuneBoost));
+}
+
+}  // namespace
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * Deadline arithmetic of the HalProxy event loop. Deadlines are absolute times in nanoseconds
+ * on the clock of getTimeNow(), and -1 stands for no deadline.
+ */
+
+/**
+ * @return The earlier of two deadlines.
+ */
+inline int64_t earliestDeadline(int64_t a, int64_t b) {
+    if (a < 0 || b < 0) {
+        return std::max(a, b);
+    }
+    return std::min(a, b);
+}
+
+/**
+ * @return When the pending writes are dropped, -1 if none of them waits for room in the event
+ *     fmq.
+ */
+inline int64_t pendingWriteDeadline(int64_t pendingWriteStartTime, int64_t timeoutNs) {
+    return pendingWriteStartTime < 0 ? -1 : pendingWriteStartTime + timeoutNs;
+}
+
+/**
+ * @return The timeout of an EventFlag wait that has to return by the deadline. EventFlag waits
+ *     forever on a timeout of 0, so a deadline that has already passed still gets the shortest
+ *     timeout there is instead.
+ */
+inline int64_t eventLoopTimeout(int64_t deadline, int64_t now) {
+    return deadline < 0 ? 0 : std::max(deadline - now, INT64_C(1));
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -14,19 +14,38 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_HAL
+
 #include "HalProxy.h"
+#include "EventLoopDeadline.h"
+#include "ReaderWake.h"
+#include "RemoteSubHal.h"
+#include "SoftFifo.h"
 
 #include <android/hardware/sensors/2.0/types.h>
 
 #include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <utils/Trace.h>
 #include "hardware_legacy/power.h"
 
 #include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cinttypes>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <functional>
+#include <sstream>
 #include <thread>
 
 namespace android {
@@ -46,6 +65,51 @@ typedef V2_1::implementation::ISensorsSubHal*(SensorsHalGetSubHalV2_1Func)(uint3
 
 static constexpr int32_t kBitsAfterSubHalIndex = 24;
 
+/*
+ * Async slice of a batch that did not fit in the event fmq, from being queued until it is
+ * committed to the fmq or dropped. Batches leave the queue in order, so the cookies are just
+ * counts of batches queued and batches gone.
+ */
+static constexpr const char* kTracePendingWrite = "HalProxy pending write";
+static constexpr const char* kTracePendingEvents = "HalProxy pending events";
+static constexpr const char* kTraceWakelockRefCount = "HalProxy wakelock refs";
+static constexpr const char* kTraceDroppedEvents = "HalProxy dropped events";
+
+//! debug() argument that starts a new sensor accounting period after the dump.
+static constexpr const char* kResetAccountingArg = "--reset-accounting";
+
+//! Prefix of a hals.conf entry whose subhal runs in its own process, see RemoteSubHal.
+static constexpr const char* kIsolatedSubHalKeyword = "isolated";
+
+static constexpr const char* kEventPriorityProperty = "ro.vendor.sensors.event_priority";
+static constexpr const char* kEventCpusProperty = "ro.vendor.sensors.event_cpus";
+static constexpr const char* kBackgroundCpusProperty = "ro.vendor.sensors.background_cpus";
+
+static constexpr const char* kDefaultEventCpus = "0-7";
+static constexpr const char* kDefaultBackgroundCpus = "0-3";
+
+// The SCHED_FIFO priority is capped by the rtprio rlimit set in the service's init script.
+static constexpr int kDefaultEventPriority = 2;
+static constexpr int kMaxEventPriority = 10;
+
+/**
+ * Bit of the wake lock fmq's event flag word the framework never uses. The proxy sets it to wake up
+ * its own event loop, which otherwise sleeps waiting for WakeLockQueueFlagBits::DATA_WRITTEN.
+ */
+static constexpr uint32_t kEventLoopWakeBit = 1u << 31;
+
+static constexpr const char* kSoftFifoEventsProperty = "ro.vendor.sensors.soft_fifo_events";
+static constexpr uint32_t kDefaultSoftFifoEvents = 300;
+static constexpr uint32_t kMaxSoftFifoEvents = 1000;
+
+/*
+ * Continuous samples may wait for the framework to be woken up for a quarter of the report
+ * latency of their sensor, up to this many milliseconds.
+ */
+static constexpr const char* kMaxWakeDelayProperty = "ro.vendor.sensors.max_wake_delay_ms";
+static constexpr uint32_t kDefaultMaxWakeDelayMs = 5;
+static constexpr uint32_t kMaxMaxWakeDelayMs = 50;
+
 /**
  * Set the subhal index as first byte of sensor handle and return this modified version.
  *
@@ -81,6 +145,49 @@ int64_t msFromNs(int64_t nanos) {
     return nanos / nanosecondsInAMillsecond;
 }
 
+/**
+ * Parse a cpu list in the kernel's format, e.g. "0-3,6".
+ *
+ * @param list The cpu list to parse.
+ * @param set The cpu set to fill.
+ *
+ * @return true if the list is well formed and names at least one cpu.
+ */
+bool parseCpuList(const std::string& list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    for (const std::string& range : android::base::Split(list, ",")) {
+        std::vector<std::string> bounds = android::base::Split(range, "-");
+        unsigned int first, last;
+        if (bounds.size() > 2 ||
+            !android::base::ParseUint(bounds.front(), &first, CPU_SETSIZE - 1u) ||
+            !android::base::ParseUint(bounds.back(), &last, CPU_SETSIZE - 1u) || first > last) {
+            return false;
+        }
+        for (unsigned int cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+/**
+ * Pin the calling thread to the cpus listed in a property.
+ *
+ * @param property The property holding the cpu list.
+ * @param defaultCpus The cpu list used when the property is unset.
+ */
+void setCpuAffinityFromProperty(const char* property, const char* defaultCpus) {
+    std::string cpus = android::base::GetProperty(property, defaultCpus);
+    cpu_set_t set;
+    if (!parseCpuList(cpus, &set)) {
+        ALOGE("Ignoring malformed cpu list '%s' from %s", cpus.c_str(), property);
+        return;
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        ALOGW("Failed to set affinity to cpus %s: %s", cpus.c_str(), strerror(errno));
+    }
+}
+
 bool patchXiaomiPickupSensor(V2_1::SensorInfo& sensor) {
     if (sensor.typeAsString != "xiaomi pick up sensor") {
         return true;
@@ -102,13 +209,16 @@ bool patchXiaomiPickupSensor(V2_1::SensorInfo& sensor) {
 
 HalProxy::HalProxy() {
     const char* kMultiHalConfigFile = "/vendor/etc/sensors/hals.conf";
+    // Keep the main thread, and through inheritance the binder and subhal threads, off the
+    // big cores. Only the event loop thread widens its affinity again.
+    setBackgroundThreadRole(0 /* niceValue */);
     initializeSubHalListFromConfigFile(kMultiHalConfigFile);
     init();
 }
 
 HalProxy::HalProxy(std::vector<ISensorsSubHalV2_0*>& subHalList) {
     for (ISensorsSubHalV2_0* subHal : subHalList) {
-        mSubHalList.push_back(std::make_unique<SubHalWrapperV2_0>(subHal));
+        addSubHal(std::make_shared<SubHalWrapperV2_0>(subHal), subHal);
     }
 
     init();
@@ -117,11 +227,11 @@ HalProxy::HalProxy(std::vector<ISensorsSubHalV2_0*>& subHalList) {
 HalProxy::HalProxy(std::vector<ISensorsSubHalV2_0*>& subHalList,
                    std::vector<ISensorsSubHalV2_1*>& subHalListV2_1) {
     for (ISensorsSubHalV2_0* subHal : subHalList) {
-        mSubHalList.push_back(std::make_unique<SubHalWrapperV2_0>(subHal));
+        addSubHal(std::make_shared<SubHalWrapperV2_0>(subHal), subHal);
     }
 
     for (ISensorsSubHalV2_1* subHal : subHalListV2_1) {
-        mSubHalList.push_back(std::make_unique<SubHalWrapperV2_1>(subHal));
+        addSubHal(std::make_shared<SubHalWrapperV2_1>(subHal), subHal);
     }
 
     init();
@@ -176,8 +286,21 @@ Return<Result> HalProxy::activate(int32_t sensorHandle, bool enabled) {
     if (!isSubHalIndexValid(sensorHandle)) {
         return Result::BAD_VALUE;
     }
-    return getSubHalForSensorHandle(sensorHandle)
-            ->activate(clearSubHalIndex(sensorHandle), enabled);
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        if (!enabled) {
+            flushSoftFifoLocked(sensorHandle);
+        }
+        // The framework expects a sample right after activation, even an unchanged one.
+        resetOnChangeFilterLocked(sensorHandle);
+    }
+    Result result = std::visit(
+            [&](auto* subHal) { return subHal->activate(clearSubHalIndex(sensorHandle), enabled); },
+            getSubHalDispatchForSensorHandle(sensorHandle));
+    if (result == Result::OK) {
+        mAccounting.activate(sensorHandle, enabled, getTimeNow());
+    }
+    return result;
 }
 
 Return<Result> HalProxy::initialize_2_1(
@@ -233,11 +356,22 @@ Return<Result> HalProxy::initializeCommon(
     stopThreads();
     resetSharedWakelock();
 
+    // Events batched for the previous client are dropped along with its event queue.
+    mSoftFifos.reset();
+    mReaderWakes.deadlineNs = -1;
+    mReaderWakes.deferredSinceNs = -1;
+
     // So that the pending write events queue can be cleared safely and when we start threads
     // again we do not get new events until after initialize resets the subhals.
     disableAllSensors();
 
     // Clears the queue if any events were pending write before.
+    if (mSizePendingWriteEventsQueue > 0) {
+        traceDroppedEventsLocked(mSizePendingWriteEventsQueue);
+    }
+    while (mPendingWritesDone < mPendingWritesQueued) {
+        ATRACE_ASYNC_END(kTracePendingWrite, static_cast<int32_t>(mPendingWritesDone++));
+    }
     mPendingWriteEventsQueue = std::queue<std::pair<std::vector<V2_1::Event>, size_t>>();
     mSizePendingWriteEventsQueue = 0;
 
@@ -271,8 +405,7 @@ Return<Result> HalProxy::initializeCommon(
 
     mThreadsRun.store(true);
 
-    mPendingWritesThread = std::thread(startPendingWritesThread, this);
-    mWakelockThread = std::thread(startWakelockThread, this);
+    mEventLoopThread = std::thread(startEventLoopThread, this);
 
     for (size_t i = 0; i < mSubHalList.size(); i++) {
         Result currRes = mSubHalList[i]->initialize(this, this, i);
@@ -293,15 +426,48 @@ Return<Result> HalProxy::batch(int32_t sensorHandle, int64_t samplingPeriodNs,
     if (!isSubHalIndexValid(sensorHandle)) {
         return Result::BAD_VALUE;
     }
-    return getSubHalForSensorHandle(sensorHandle)
-            ->batch(clearSubHalIndex(sensorHandle), samplingPeriodNs, maxReportLatencyNs);
+    auto wakeDelay = mWakeDelaysNs.find(sensorHandle);
+    if (wakeDelay != mWakeDelaysNs.end()) {
+        static const int64_t maxWakeDelayNs =
+                android::base::GetUintProperty(kMaxWakeDelayProperty, kDefaultMaxWakeDelayMs,
+                                               kMaxMaxWakeDelayMs) *
+                INT64_C(1000000);
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        wakeDelay->second = wakeDelayForLatency(maxReportLatencyNs, maxWakeDelayNs);
+    }
+    if (mSoftFifos.fifos().count(sensorHandle) > 0) {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        std::vector<Event> events;
+        // The batching happens here, the subhal has no FIFO to hold the events.
+        maxReportLatencyNs = mSoftFifos.batch(sensorHandle, maxReportLatencyNs, &events);
+        if (!events.empty()) {
+            writeEventsLocked(events, 0 /* numWakeupEvents */);
+        }
+    }
+    Result result = std::visit(
+            [&](auto* subHal) {
+                return subHal->batch(clearSubHalIndex(sensorHandle), samplingPeriodNs,
+                                     maxReportLatencyNs);
+            },
+            getSubHalDispatchForSensorHandle(sensorHandle));
+    if (result == Result::OK) {
+        mAccounting.batch(sensorHandle, samplingPeriodNs, getTimeNow());
+    }
+    return result;
 }
 
 Return<Result> HalProxy::flush(int32_t sensorHandle) {
     if (!isSubHalIndexValid(sensorHandle)) {
         return Result::BAD_VALUE;
     }
-    return getSubHalForSensorHandle(sensorHandle)->flush(clearSubHalIndex(sensorHandle));
+    {
+        // The batched events have to reach the framework ahead of the flush complete event.
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        flushSoftFifoLocked(sensorHandle);
+    }
+    return std::visit(
+            [&](auto* subHal) { return subHal->flush(clearSubHalIndex(sensorHandle)); },
+            getSubHalDispatchForSensorHandle(sensorHandle));
 }
 
 Return<Result> HalProxy::injectSensorData_2_1(const V2_1::Event& event) {
@@ -365,7 +531,7 @@ Return<void> HalProxy::configDirectReport(int32_t sensorHandle, int32_t channelH
     return Return<void>();
 }
 
-Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /*args*/) {
+Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) {
     if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
         ALOGE("%s: missing fd for writing", __FUNCTION__);
         return Void();
@@ -388,10 +554,70 @@ Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&
            << std::endl;
     stream << " Most events seen on pending write events queue: "
            << mMostEventsObservedPendingWriteEventsQueue << std::endl;
+    stream << "  Events dropped: " << mEventsDropped << std::endl;
     if (!mPendingWriteEventsQueue.empty()) {
         stream << "  Size of events list on front of pending writes queue: "
                << mPendingWriteEventsQueue.front().first.size() << std::endl;
     }
+    int eventLoopPriority = mEventLoopPriority.load();
+    if (eventLoopPriority > 0) {
+        stream << "  Event loop thread policy: SCHED_FIFO priority " << eventLoopPriority
+               << std::endl;
+    } else {
+        stream << "  Event loop thread policy: SCHED_OTHER" << std::endl;
+    }
+    WakeupLatency eventLoopLatency;
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        eventLoopLatency = mEventLoopLatency;
+    }
+    stream << "  Event loop thread wakeup latency: ";
+    eventLoopLatency.dump(stream);
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        stream << "  Software FIFOs (" << mSoftFifos.fifos().size() << "):" << std::endl;
+        for (const auto& [sensorHandle, fifo] : mSoftFifos.fifos()) {
+            stream << "    " << mSensors[sensorHandle].name << ": latency "
+                   << msFromNs(fifo.latencyNs) << " ms, " << fifo.count << "/" << fifo.ring.size()
+                   << " events held, " << fifo.eventsBatched << " events batched into "
+                   << fifo.batchesFlushed << " writes" << std::endl;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        mCalibration.dump(stream);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        double seconds = std::max(now - mReaderWakes.sinceNs, INT64_C(1)) / 1e9;
+        stream << "  Framework wakeups: " << mReaderWakes.wakes << " ("
+               << mReaderWakes.wakes / seconds << "/s) for " << mReaderWakes.events
+               << " events (" << mReaderWakes.events / seconds << "/s), "
+               << mReaderWakes.deferredWakes << " deferred by up to "
+               << mReaderWakes.maxDelayNs / 1000 << " us" << std::endl;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        stream << "  On-change filters (" << mOnChangeFilters.size() << "):" << std::endl;
+        for (const auto& [sensorHandle, filter] : mOnChangeFilters) {
+            stream << "    " << mSensors[sensorHandle].name << ": " << filter.eventsSuppressed
+                   << (filter.wakeUp ? " wake-up" : "") << " duplicate events suppressed"
+                   << std::endl;
+        }
+    }
+    {
+        std::vector<std::string> subHalNames;
+        for (auto& subHal : mSubHalList) {
+            subHalNames.push_back(subHal->getName());
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWakelockMutex);
+        mAccounting.dump(stream, subHalNames, now);
+        if (std::find(args.begin(), args.end(), kResetAccountingArg) != args.end()) {
+            mAccounting.reset(now);
+            stream << "  Sensor accounting reset" << std::endl;
+        }
+    }
+    mStatePublisher.dump(stream);
     stream << "  # of non-dynamic sensors across all subhals: " << mSensors.size() << std::endl;
     stream << "  # of dynamic sensors across all subhals: " << mDynamicSensors.size() << std::endl;
     stream << "SubHals (" << mSubHalList.size() << "):" << std::endl;
@@ -454,8 +680,26 @@ void HalProxy::initializeSubHalListFromConfigFile(const char* configFileName) {
     if (!subHalConfigStream) {
         ALOGE("Failed to load subHal config file: %s", configFileName);
     } else {
-        std::string subHalLibraryFile;
-        while (subHalConfigStream >> subHalLibraryFile) {
+        std::string line;
+        while (std::getline(subHalConfigStream, line)) {
+            std::istringstream tokens(line.substr(0, line.find('#')));
+            std::string subHalLibraryFile;
+            if (!(tokens >> subHalLibraryFile)) {
+                continue;
+            }
+            if (subHalLibraryFile == kIsolatedSubHalKeyword) {
+                if (!(tokens >> subHalLibraryFile)) {
+                    ALOGE("Missing library after '%s' in %s", kIsolatedSubHalKeyword,
+                          configFileName);
+                } else {
+                    ALOGV("Hosting SubHal from library %s out of process",
+                          subHalLibraryFile.c_str());
+                    auto subHal = std::make_shared<RemoteSubHal>(subHalLibraryFile);
+                    addSubHal(subHal, subHal.get());
+                }
+                continue;
+            }
+
             void* handle = getHandleForSubHalSharedObject(subHalLibraryFile);
             if (handle == nullptr) {
                 ALOGE("dlopen failed for library: %s", subHalLibraryFile.c_str());
@@ -472,7 +716,7 @@ void HalProxy::initializeSubHalListFromConfigFile(const char* configFileName) {
                               subHalLibraryFile.c_str());
                     } else {
                         ALOGV("Loaded SubHal from library: %s", subHalLibraryFile.c_str());
-                        mSubHalList.push_back(std::make_unique<SubHalWrapperV2_0>(subHal));
+                        addSubHal(std::make_shared<SubHalWrapperV2_0>(subHal), subHal);
                     }
                 } else {
                     SensorsHalGetSubHalV2_1Func* getSubHalV2_1Ptr =
@@ -491,7 +735,7 @@ void HalProxy::initializeSubHalListFromConfigFile(const char* configFileName) {
                                   subHalLibraryFile.c_str());
                         } else {
                             ALOGV("Loaded SubHal from library: %s", subHalLibraryFile.c_str());
-                            mSubHalList.push_back(std::make_unique<SubHalWrapperV2_1>(subHal));
+                            addSubHal(std::make_shared<SubHalWrapperV2_1>(subHal), subHal);
                         }
                     }
                 }
@@ -515,6 +759,12 @@ void HalProxy::initializeSensorList() {
                         continue;
                     }
 
+                    setupSoftFifo(&sensor);
+                    setupOnChangeFilter(sensor);
+                    setupWakeDelay(sensor);
+                    mAccounting.addSensor(sensor, subHalIndex);
+                    mCalibration.addSensor(sensor);
+                    mStatePublisher.addSensor(sensor);
                     mSensors[sensor.sensorHandle] = sensor;
                 }
             }
@@ -547,6 +797,125 @@ void* HalProxy::getHandleForSubHalSharedObject(const std::string& filename) {
 
 void HalProxy::init() {
     initializeSensorList();
+    mCalibration.start();
+    mStatePublisher.start();
+}
+
+void HalProxy::setupSoftFifo(SensorInfo* sensor) {
+    static const uint32_t fifoEvents = android::base::GetUintProperty(
+            kSoftFifoEventsProperty, kDefaultSoftFifoEvents, kMaxSoftFifoEvents);
+
+    if (mSoftFifos.setup(sensor, fifoEvents)) {
+        ALOGV("Batching %s in a software FIFO of %" PRIu32 " events", sensor->name.c_str(),
+              fifoEvents);
+    }
+}
+
+void HalProxy::flushSoftFifoLocked(int32_t sensorHandle) {
+    std::vector<Event> events;
+    mSoftFifos.flush(sensorHandle, &events);
+    if (!events.empty()) {
+        writeEventsLocked(events, 0 /* numWakeupEvents */);
+    }
+}
+
+void HalProxy::flushDueSoftFifosLocked(int64_t now) {
+    std::vector<Event> events;
+    mSoftFifos.flushDue(now, &events);
+    if (!events.empty()) {
+        ATRACE_NAME("HalProxy flush software FIFOs");
+        writeEventsLocked(events, 0 /* numWakeupEvents */);
+    }
+}
+
+void HalProxy::setupWakeDelay(const SensorInfo& sensor) {
+    if (hasWakeDelay(sensor.flags)) {
+        mWakeDelaysNs[sensor.sensorHandle] = 0;
+    }
+}
+
+int64_t HalProxy::wakeDelayLocked(const Event* events, size_t numEvents) const {
+    return readerWakeDelay(mWakeDelaysNs, events, numEvents);
+}
+
+void HalProxy::scheduleReaderWakeLocked(int64_t delayNs) {
+    if (delayNs == 0) {
+        wakeReaderLocked();
+        return;
+    }
+
+    int64_t now = getTimeNow();
+    if (mReaderWakes.deferredSinceNs < 0) {
+        mReaderWakes.deferredSinceNs = now;
+    }
+    int64_t deadline = readerWakeDeadline(mReaderWakes.deadlineNs, now, delayNs);
+    if (deadline != mReaderWakes.deadlineNs) {
+        mReaderWakes.deadlineNs = deadline;
+        wakeEventLoop();
+    }
+}
+
+void HalProxy::wakeReaderLocked() {
+    mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+    mReaderWakes.wakes++;
+    if (mReaderWakes.deferredSinceNs >= 0) {
+        mReaderWakes.deferredWakes++;
+        mReaderWakes.maxDelayNs =
+                std::max(mReaderWakes.maxDelayNs, getTimeNow() - mReaderWakes.deferredSinceNs);
+    }
+    mReaderWakes.deadlineNs = -1;
+    mReaderWakes.deferredSinceNs = -1;
+}
+
+void HalProxy::setupOnChangeFilter(const SensorInfo& sensor) {
+    uint32_t reportingMode =
+            sensor.flags & static_cast<uint32_t>(V1_0::SensorFlagBits::MASK_REPORTING_MODE);
+    // Every pick up is reported as 1, repeating the value is the whole point of the gesture.
+    if (reportingMode != static_cast<uint32_t>(V1_0::SensorFlagBits::ON_CHANGE_MODE) ||
+        sensor.type == V2_1::SensorType::PICK_UP_GESTURE) {
+        return;
+    }
+
+    OnChangeFilter& filter = mOnChangeFilters[sensor.sensorHandle];
+    filter.wakeUp = (sensor.flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) != 0;
+}
+
+size_t HalProxy::filterOnChangeEventsLocked(const std::vector<Event>& events,
+                                            std::vector<Event>* out) {
+    size_t numWakeupEventsSuppressed = 0;
+    out->reserve(events.size());
+    for (const Event& event : events) {
+        auto iter = mOnChangeFilters.find(event.sensorHandle);
+        if (iter == mOnChangeFilters.end() ||
+            event.sensorType == V2_1::SensorType::ADDITIONAL_INFO) {
+            out->push_back(event);
+            continue;
+        }
+        OnChangeFilter& filter = iter->second;
+        if (event.sensorType == V2_1::SensorType::META_DATA) {
+            // Flush complete, the sample after it is reported as is.
+            filter.hasLast = false;
+            out->push_back(event);
+            continue;
+        }
+        // A fixed size compare of the whole payload, which the compiler keeps branch free.
+        if (filter.hasLast && memcmp(&filter.last.u, &event.u, sizeof(event.u)) == 0) {
+            filter.eventsSuppressed++;
+            numWakeupEventsSuppressed += filter.wakeUp;
+            continue;
+        }
+        filter.hasLast = true;
+        filter.last = event;
+        out->push_back(event);
+    }
+    return numWakeupEventsSuppressed;
+}
+
+void HalProxy::resetOnChangeFilterLocked(int32_t sensorHandle) {
+    auto filter = mOnChangeFilters.find(sensorHandle);
+    if (filter != mOnChangeFilters.end()) {
+        filter->second.hasLast = false;
+    }
 }
 
 void HalProxy::stopThreads() {
@@ -557,18 +926,9 @@ void HalProxy::stopThreads() {
         mEventQueue->read(events.data(), numToRead);
         mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ));
     }
-    if (mWakelockQueueFlag != nullptr && mWakeLockQueue != nullptr) {
-        uint32_t kZero = 0;
-        mWakeLockQueue->write(&kZero);
-        mWakelockQueueFlag->wake(static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN));
-    }
-    mWakelockCV.notify_one();
-    mEventQueueWriteCV.notify_one();
-    if (mPendingWritesThread.joinable()) {
-        mPendingWritesThread.join();
-    }
-    if (mWakelockThread.joinable()) {
-        mWakelockThread.join();
+    wakeEventLoop();
+    if (mEventLoopThread.joinable()) {
+        mEventLoopThread.join();
     }
 }
 
@@ -584,79 +944,193 @@ void HalProxy::disableAllSensors() {
     }
 }
 
-void HalProxy::startPendingWritesThread(HalProxy* halProxy) {
-    halProxy->handlePendingWrites();
+void HalProxy::setEventThreadRole() {
+    setCpuAffinityFromProperty(kEventCpusProperty, kDefaultEventCpus);
+
+    int priority = android::base::GetIntProperty(kEventPriorityProperty, kDefaultEventPriority, 0,
+                                                 kMaxEventPriority);
+    if (priority > 0) {
+        struct sched_param param = {.sched_priority = priority};
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            ALOGW("Failed to set SCHED_FIFO priority %d: %s", priority, strerror(errno));
+            priority = 0;
+        }
+    }
+    mEventLoopPriority.store(priority);
+}
+
+void HalProxy::setBackgroundThreadRole(int niceValue) {
+    setCpuAffinityFromProperty(kBackgroundCpusProperty, kDefaultBackgroundCpus);
+
+    if (niceValue != 0 && setpriority(PRIO_PROCESS, gettid(), niceValue) != 0) {
+        ALOGW("Failed to set nice value %d: %s", niceValue, strerror(errno));
+    }
 }
 
-void HalProxy::handlePendingWrites() {
-    // TODO(b/143302327): Find a way to optimize locking strategy maybe using two mutexes instead of
-    // one.
-    std::unique_lock<std::mutex> lock(mEventQueueWriteMutex);
+void HalProxy::WakeupLatency::notified() {
+    if (waiting && notifyTimeNs < 0) {
+        notifyTimeNs = getTimeNow();
+    }
+}
+
+void HalProxy::WakeupLatency::woke() {
+    waiting = false;
+    if (notifyTimeNs < 0) {
+        return;
+    }
+    int64_t latencyNs = getTimeNow() - notifyTimeNs;
+    notifyTimeNs = -1;
+    wakeups++;
+    totalNs += latencyNs;
+    maxNs = std::max(maxNs, latencyNs);
+}
+
+void HalProxy::WakeupLatency::dump(std::ostream& stream) const {
+    if (wakeups == 0) {
+        stream << "no samples" << std::endl;
+        return;
+    }
+    stream << wakeups << " wakeups, avg " << totalNs / static_cast<int64_t>(wakeups) / 1000
+           << " us, max " << maxNs / 1000 << " us" << std::endl;
+}
+
+void HalProxy::startEventLoopThread(HalProxy* halProxy) {
+    pthread_setname_np(pthread_self(), "HalProxyLoop");
+    halProxy->setEventThreadRole();
+    halProxy->handleEvents();
+}
+
+void HalProxy::handleEvents() {
+    bool readWakeLockQueue = true;
+    int64_t pendingWriteStartTime = -1;
     while (mThreadsRun.load()) {
-        mEventQueueWriteCV.wait(
-                lock, [&] { return !mPendingWriteEventsQueue.empty() || !mThreadsRun.load(); });
-        if (mThreadsRun.load()) {
-            std::vector<Event>& pendingWriteEvents = mPendingWriteEventsQueue.front().first;
-            size_t numWakeupEvents = mPendingWriteEventsQueue.front().second;
-            size_t eventQueueSize = mEventQueue->getQuantumCount();
-            size_t numToWrite = std::min(pendingWriteEvents.size(), eventQueueSize);
-            lock.unlock();
-            if (!mEventQueue->writeBlocking(
-                        pendingWriteEvents.data(), numToWrite,
-                        static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
-                        static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
-                        kPendingWriteTimeoutNs, mEventQueueFlag)) {
-                ALOGE("Dropping %zu events after blockingWrite failed.", numToWrite);
-                if (numWakeupEvents > 0) {
-                    if (pendingWriteEvents.size() > eventQueueSize) {
-                        decrementRefCountAndMaybeReleaseWakelock(
-                                countNumWakeupEvents(pendingWriteEvents, eventQueueSize));
-                    } else {
-                        decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
-                    }
-                }
+        int64_t deadline = handleWakeLockQueue(readWakeLockQueue);
+        bool eventQueueFull = false;
+        {
+            std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+            mEventLoopLatency.woke();
+            int64_t now = getTimeNow();
+            flushDueSoftFifosLocked(now);
+            if (writePendingEventsLocked()) {
+                pendingWriteStartTime = -1;
+            } else if (pendingWriteStartTime < 0) {
+                pendingWriteStartTime = now;
+            } else if (now - pendingWriteStartTime >= kPendingWriteTimeoutNs) {
+                dropPendingEventsLocked();
+                pendingWriteStartTime = -1;
+                continue;
             }
-            lock.lock();
-            mSizePendingWriteEventsQueue -= numToWrite;
-            if (pendingWriteEvents.size() > eventQueueSize) {
-                // TODO(b/143302327): Check if this erase operation is too inefficient. It will copy
-                // all the events ahead of it down to fill gap off array at front after the erase.
-                pendingWriteEvents.erase(pendingWriteEvents.begin(),
-                                         pendingWriteEvents.begin() + eventQueueSize);
-            } else {
-                mPendingWriteEventsQueue.pop();
+            eventQueueFull = pendingWriteStartTime >= 0;
+            if (mReaderWakes.deadlineNs >= 0 && mReaderWakes.deadlineNs <= now) {
+                wakeReaderLocked();
             }
+
+            deadline = earliestDeadline(deadline, mSoftFifos.nextDeadline());
+            deadline = earliestDeadline(deadline, mReaderWakes.deadlineNs);
+            deadline = earliestDeadline(
+                    deadline, pendingWriteDeadline(pendingWriteStartTime, kPendingWriteTimeoutNs));
+            mEventLoopLatency.waiting = !eventQueueFull;
+        }
+
+        // A timeout of 0 waits until woken up. Bits set while the loop was busy stay set in the
+        // event flag word, so no wakeup is lost between dropping the lock and waiting.
+        int64_t timeout = eventLoopTimeout(deadline, getTimeNow());
+        uint32_t state = 0;
+        if (eventQueueFull) {
+            // The framework acknowledges wakeup events only after reading them, so waiting for
+            // room in the event fmq does not hold up the wake lock fmq for long.
+            ATRACE_BEGIN("HalProxy wait EVENTS_READ");
+            mEventQueueFlag->wait(static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ), &state,
+                                  timeout);
+            ATRACE_END();
+            readWakeLockQueue = true;
+        } else {
+            mWakelockQueueFlag->wait(
+                    static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN) | kEventLoopWakeBit,
+                    &state, timeout);
+            readWakeLockQueue =
+                    (state & static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN)) != 0;
         }
     }
+    resetSharedWakelock();
 }
 
-void HalProxy::startWakelockThread(HalProxy* halProxy) {
-    halProxy->handleWakelocks();
+void HalProxy::wakeEventLoop() {
+    if (mWakelockQueueFlag != nullptr) {
+        mWakelockQueueFlag->wake(kEventLoopWakeBit);
+    }
 }
 
-void HalProxy::handleWakelocks() {
-    std::unique_lock<std::recursive_mutex> lock(mWakelockMutex);
-    while (mThreadsRun.load()) {
-        mWakelockCV.wait(lock, [&] { return mWakelockRefCount > 0 || !mThreadsRun.load(); });
-        if (mThreadsRun.load()) {
-            int64_t timeLeft;
-            if (sharedWakelockDidTimeout(&timeLeft)) {
-                resetSharedWakelock();
-            } else {
-                uint32_t numWakeLocksProcessed;
-                lock.unlock();
-                bool success = mWakeLockQueue->readBlocking(
-                        &numWakeLocksProcessed, 1, 0,
-                        static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN), timeLeft);
-                lock.lock();
-                if (success) {
-                    decrementRefCountAndMaybeReleaseWakelock(
-                            static_cast<size_t>(numWakeLocksProcessed));
-                }
-            }
+bool HalProxy::writePendingEventsLocked() {
+    while (!mPendingWriteEventsQueue.empty()) {
+        std::vector<Event>& pendingWriteEvents = mPendingWriteEventsQueue.front().first;
+        size_t numToWrite = std::min(pendingWriteEvents.size(), mEventQueue->availableToWrite());
+        if (numToWrite == 0 || !mEventQueue->write(pendingWriteEvents.data(), numToWrite)) {
+            return false;
+        }
+        // The framework fell behind, there is no point in letting it sleep any longer.
+        mReaderWakes.events += numToWrite;
+        wakeReaderLocked();
+        mSizePendingWriteEventsQueue -= numToWrite;
+        if (numToWrite < pendingWriteEvents.size()) {
+            // TODO(b/143302327): Check if this erase operation is too inefficient. It will copy
+            // all the events ahead of it down to fill gap off array at front after the erase.
+            pendingWriteEvents.erase(pendingWriteEvents.begin(),
+                                     pendingWriteEvents.begin() + numToWrite);
+        } else {
+            mPendingWriteEventsQueue.pop();
+            ATRACE_ASYNC_END(kTracePendingWrite, static_cast<int32_t>(mPendingWritesDone++));
         }
+        ATRACE_INT64(kTracePendingEvents, mSizePendingWriteEventsQueue);
     }
-    resetSharedWakelock();
+    return true;
+}
+
+void HalProxy::dropPendingEventsLocked() {
+    std::vector<Event>& pendingWriteEvents = mPendingWriteEventsQueue.front().first;
+    ALOGE("Dropping %zu events after the event queue stayed full.", pendingWriteEvents.size());
+    size_t numWakeupEvents = countNumWakeupEvents(pendingWriteEvents, pendingWriteEvents.size());
+    if (numWakeupEvents > 0) {
+        decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
+    }
+    mSizePendingWriteEventsQueue -= pendingWriteEvents.size();
+    traceDroppedEventsLocked(pendingWriteEvents.size());
+    mPendingWriteEventsQueue.pop();
+    ATRACE_ASYNC_END(kTracePendingWrite, static_cast<int32_t>(mPendingWritesDone++));
+    ATRACE_INT64(kTracePendingEvents, mSizePendingWriteEventsQueue);
+}
+
+void HalProxy::traceDroppedEventsLocked(size_t numEvents) {
+    mEventsDropped += numEvents;
+    ATRACE_INT64(kTraceDroppedEvents, mEventsDropped);
+    if (ATRACE_ENABLED()) {
+        // A zero length slice, so the drop shows up as a marker on the thread that made it.
+        std::string name = android::base::StringPrintf("HalProxy drop %zu events", numEvents);
+        ATRACE_BEGIN(name.c_str());
+        ATRACE_END();
+    }
+}
+
+int64_t HalProxy::handleWakeLockQueue(bool readQueue) {
+    std::lock_guard<std::recursive_mutex> lock(mWakelockMutex);
+    if (readQueue) {
+        // The queue is known to hold data, or the read gives up after a nanosecond.
+        uint32_t numWakeLocksProcessed;
+        while (mWakeLockQueue->readBlocking(
+                &numWakeLocksProcessed, 1, 0,
+                static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN), 1 /* timeOutNanos */)) {
+            decrementRefCountAndMaybeReleaseWakelock(static_cast<size_t>(numWakeLocksProcessed));
+        }
+    }
+    if (mWakelockRefCount == 0) {
+        return -1;
+    }
+    int64_t timeLeft;
+    if (sharedWakelockDidTimeout(&timeLeft)) {
+        resetSharedWakelock();
+        return -1;
+    }
+    return getTimeNow() + timeLeft;
 }
 
 bool HalProxy::sharedWakelockDidTimeout(int64_t* timeLeft) {
@@ -679,18 +1153,57 @@ void HalProxy::resetSharedWakelock() {
 
 void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
                                         V2_0::implementation::ScopedWakelock wakelock) {
-    size_t numToWrite = 0;
+    ATRACE_CALL();
     std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+    std::vector<Event> calibratedEvents;
+    const std::vector<Event>& eventsCalibrated =
+            mCalibration.process(events, &calibratedEvents) ? calibratedEvents : events;
+    // Clients of the state page want every sample, including the ones filtered below.
+    mStatePublisher.publish(eventsCalibrated);
+    std::vector<Event> filteredEvents;
+    if (!mOnChangeFilters.empty()) {
+        // Dropped wake-up events never reach the framework, so they must not hold the wakelock.
+        numWakeupEvents -= filterOnChangeEventsLocked(eventsCalibrated, &filteredEvents);
+        if (filteredEvents.empty()) {
+            return;
+        }
+    }
+    const std::vector<Event>& eventsIn =
+            mOnChangeFilters.empty() ? eventsCalibrated : filteredEvents;
+    mAccounting.eventsPosted(eventsIn);
+
     if (wakelock.isLocked()) {
         incrementRefCountAndMaybeAcquireWakelock(numWakeupEvents);
     }
+    if (mSoftFifos.empty()) {
+        writeEventsLocked(eventsIn, numWakeupEvents);
+        return;
+    }
+
+    // Software FIFO sensors are never wake-up sensors, so numWakeupEvents still holds for the
+    // events written now.
+    std::vector<Event> eventsNow;
+    eventsNow.reserve(eventsIn.size());
+    bool rearmed = mSoftFifos.post(eventsIn, getTimeNow(), &eventsNow);
+    if (!eventsNow.empty()) {
+        writeEventsLocked(eventsNow, numWakeupEvents);
+    }
+    if (rearmed) {
+        wakeEventLoop();
+    }
+}
+
+void HalProxy::writeEventsLocked(const std::vector<Event>& events, size_t numWakeupEvents) {
+    size_t numToWrite = 0;
     if (mPendingWriteEventsQueue.empty()) {
         numToWrite = std::min(events.size(), mEventQueue->availableToWrite());
         if (numToWrite > 0) {
             if (mEventQueue->write(events.data(), numToWrite)) {
                 // TODO(b/143302327): While loop if mEventQueue->avaiableToWrite > 0 to possibly fit
                 // in more writes immediately
-                mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+                mReaderWakes.events += numToWrite;
+                scheduleReaderWakeLocked(
+                        numWakeupEvents > 0 ? 0 : wakeDelayLocked(events.data(), numToWrite));
             } else {
                 numToWrite = 0;
             }
@@ -704,7 +1217,12 @@ void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t
         mSizePendingWriteEventsQueue += numLeft;
         mMostEventsObservedPendingWriteEventsQueue =
                 std::max(mMostEventsObservedPendingWriteEventsQueue, mSizePendingWriteEventsQueue);
-        mEventQueueWriteCV.notify_one();
+        ATRACE_ASYNC_BEGIN(kTracePendingWrite, static_cast<int32_t>(mPendingWritesQueued++));
+        ATRACE_INT64(kTracePendingEvents, mSizePendingWriteEventsQueue);
+        mEventLoopLatency.notified();
+        wakeEventLoop();
+    } else if (numLeft > 0) {
+        traceDroppedEventsLocked(numLeft);
     }
 }
 
@@ -714,10 +1232,13 @@ bool HalProxy::incrementRefCountAndMaybeAcquireWakelock(size_t delta,
     std::lock_guard<std::recursive_mutex> lockGuard(mWakelockMutex);
     if (mWakelockRefCount == 0) {
         acquire_wake_lock(PARTIAL_WAKE_LOCK, kWakelockName);
-        mWakelockCV.notify_one();
+        mAccounting.wakelockAcquired(getTimeNow());
+        // The event loop has to start watching the wakelock timeout.
+        wakeEventLoop();
     }
     mWakelockTimeoutStartTime = getTimeNow();
     mWakelockRefCount += delta;
+    ATRACE_INT64(kTraceWakelockRefCount, mWakelockRefCount);
     if (timeoutStart != nullptr) {
         *timeoutStart = mWakelockTimeoutStartTime;
     }
@@ -735,8 +1256,10 @@ void HalProxy::decrementRefCountAndMaybeReleaseWakelock(size_t delta,
     if (timeoutStart == -1) timeoutStart = mWakelockTimeoutResetTime;
     if (mWakelockRefCount == 0 || timeoutStart < mWakelockTimeoutResetTime) return;
     mWakelockRefCount -= std::min(mWakelockRefCount, delta);
+    ATRACE_INT64(kTraceWakelockRefCount, mWakelockRefCount);
     if (mWakelockRefCount == 0) {
         release_wake_lock(kWakelockName);
+        mAccounting.wakelockReleased(getTimeNow());
     }
 }
 
@@ -755,8 +1278,8 @@ void HalProxy::setDirectChannelFlags(SensorInfo* sensorInfo,
     }
 }
 
-std::shared_ptr<ISubHalWrapperBase> HalProxy::getSubHalForSensorHandle(int32_t sensorHandle) {
-    return mSubHalList[extractSubHalIndex(sensorHandle)];
+ISubHalWrapperBase* HalProxy::getSubHalForSensorHandle(int32_t sensorHandle) {
+    return mSubHalList[extractSubHalIndex(sensorHandle)].get();
 }
 
 bool HalProxy::isSubHalIndexValid(int32_t sensorHandle) {
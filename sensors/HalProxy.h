@@ -0,0 +1,668 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "EventMessageQueueWrapper.h"
+#include "HalProxyCallback.h"
+#include "ISensorsCallbackWrapper.h"
+#include "SensorAccounting.h"
+#include "SensorCalibration.h"
+#include "SensorStatePublisher.h"
+#include "SoftFifo.h"
+#include "SubHalWrapper.h"
+#include "V2_0/ScopedWakelock.h"
+#include "V2_0/SubHal.h"
+#include "V2_1/SubHal.h"
+#include "WakeLockMessageQueueWrapper.h"
+#include "convertV2_1.h"
+
+#include <android/hardware/sensors/2.1/ISensors.h>
+#include <android/hardware/sensors/2.1/types.h>
+#include <fmq/MessageQueue.h>
+#include <hardware_legacy/power.h>
+#include <hidl/MQDescriptor.h>
+#include <hidl/Status.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <variant>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+using ::android::sp;
+using ::android::hardware::EventFlag;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::MessageQueue;
+using ::android::hardware::MQDescriptor;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+
+class RemoteSubHal;
+
+class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
+                 public V2_0::implementation::ISubHalCallback {
+  public:
+    using Event = ::android::hardware::sensors::V2_1::Event;
+    using OperationMode = ::android::hardware::sensors::V1_0::OperationMode;
+    using RateLevel = ::android::hardware::sensors::V1_0::RateLevel;
+    using Result = ::android::hardware::sensors::V1_0::Result;
+    using SensorInfo = ::android::hardware::sensors::V2_1::SensorInfo;
+    using SharedMemInfo = ::android::hardware::sensors::V1_0::SharedMemInfo;
+    using IHalProxyCallbackV2_0 = V2_0::implementation::IHalProxyCallback;
+    using IHalProxyCallbackV2_1 = V2_1::implementation::IHalProxyCallback;
+    using ISensorsSubHalV2_0 = V2_0::implementation::ISensorsSubHal;
+    using ISensorsSubHalV2_1 = V2_1::implementation::ISensorsSubHal;
+    using ISensorsV2_0 = V2_0::ISensors;
+    using ISensorsV2_1 = V2_1::ISensors;
+    using HalProxyCallbackBase = V2_0::implementation::HalProxyCallbackBase;
+
+    explicit HalProxy();
+    // Test only constructor.
+    explicit HalProxy(std::vector<ISensorsSubHalV2_0*>& subHalList);
+    explicit HalProxy(std::vector<ISensorsSubHalV2_0*>& subHalList,
+                      std::vector<ISensorsSubHalV2_1*>& subHalListV2_1);
+    ~HalProxy();
+
+    // Methods from ::android::hardware::sensors::V2_1::ISensors follow.
+    Return<void> getSensorsList_2_1(ISensorsV2_1::getSensorsList_2_1_cb _hidl_cb);
+
+    Return<Result> initialize_2_1(
+            const ::android::hardware::MQDescriptorSync<V2_1::Event>& eventQueueDescriptor,
+            const ::android::hardware::MQDescriptorSync<uint32_t>& wakeLockDescriptor,
+            const sp<V2_1::ISensorsCallback>& sensorsCallback);
+
+    Return<Result> injectSensorData_2_1(const Event& event);
+
+    // Methods from ::android::hardware::sensors::V2_0::ISensors follow.
+    Return<void> getSensorsList(ISensorsV2_0::getSensorsList_cb _hidl_cb);
+
+    Return<Result> setOperationMode(OperationMode mode);
+
+    Return<Result> activate(int32_t sensorHandle, bool enabled);
+
+    Return<Result> initialize(
+            const ::android::hardware::MQDescriptorSync<V1_0::Event>& eventQueueDescriptor,
+            const ::android::hardware::MQDescriptorSync<uint32_t>& wakeLockDescriptor,
+            const sp<V2_0::ISensorsCallback>& sensorsCallback);
+
+    Return<Result> initializeCommon(std::unique_ptr<EventMessageQueueWrapperBase>& eventQueue,
+                                    std::unique_ptr<WakeLockMessageQueueWrapperBase>& wakeLockQueue,
+                                    const sp<ISensorsCallbackWrapperBase>& sensorsCallback);
+
+    Return<Result> batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                         int64_t maxReportLatencyNs);
+
+    Return<Result> flush(int32_t sensorHandle);
+
+    Return<Result> injectSensorData(const V1_0::Event& event);
+
+    Return<void> registerDirectChannel(const SharedMemInfo& mem,
+                                       ISensorsV2_0::registerDirectChannel_cb _hidl_cb);
+
+    Return<Result> unregisterDirectChannel(int32_t channelHandle);
+
+    Return<void> configDirectReport(int32_t sensorHandle, int32_t channelHandle, RateLevel rate,
+                                    ISensorsV2_0::configDirectReport_cb _hidl_cb);
+
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args);
+
+    Return<void> onDynamicSensorsConnected(const hidl_vec<SensorInfo>& dynamicSensorsAdded,
+                                           int32_t subHalIndex) override;
+
+    Return<void> onDynamicSensorsDisconnected(const hidl_vec<int32_t>& dynamicSensorHandlesRemoved,
+                                              int32_t subHalIndex) override;
+
+    void postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
+                                  V2_0::implementation::ScopedWakelock wakelock) override;
+
+    const SensorInfo& getSensorInfo(int32_t sensorHandle) override {
+        return mSensors[sensorHandle];
+    }
+
+    bool areThreadsRunning() override { return mThreadsRun.load(); }
+
+    // Below methods are from IScopedWakelockRefCounter interface
+    bool incrementRefCountAndMaybeAcquireWakelock(size_t delta,
+                                                  int64_t* timeoutStart = nullptr) override;
+
+    void decrementRefCountAndMaybeReleaseWakelock(size_t delta, int64_t timeoutStart = -1) override;
+
+    const std::map<int32_t, SensorInfo>& getSensors() { return mSensors; }
+
+  private:
+    /**
+     * Wakeup latency bookkeeping for the event loop thread, i.e. the time between new pending
+     * writes being signalled and the thread actually running. Only wakeups where the thread was
+     * really asleep are sampled. Guarded by mEventQueueWriteMutex.
+     */
+    struct WakeupLatency {
+        bool waiting = false;
+        int64_t notifyTimeNs = -1;
+        uint64_t wakeups = 0;
+        int64_t totalNs = 0;
+        int64_t maxNs = 0;
+
+        //! Called by the notifier right before waking up the thread.
+        void notified();
+
+        //! Called by the thread right after its wait returned.
+        void woke();
+
+        void dump(std::ostream& stream) const;
+    };
+
+    /**
+     * Last reported sample of an on-change sensor. Samples that repeat it are dropped, except the
+     * first one after the sensor is activated or flushed. Guarded by mEventQueueWriteMutex.
+     */
+    struct OnChangeFilter {
+        bool wakeUp = false;
+        bool hasLast = false;
+        Event last;
+        uint64_t eventsSuppressed = 0;
+    };
+
+    /**
+     * Wakeups of the framework reading the event fmq. A write of nothing but continuous samples of
+     * non-wake-up sensors leaves the framework asleep until the earliest wake deadline of those
+     * sensors, so that the writes of several subhals share one wakeup. Any other write wakes it
+     * at once, together with whatever is still waiting. Guarded by mEventQueueWriteMutex.
+     */
+    struct ReaderWakes {
+        //! When the event loop has to wake up the framework, -1 if nothing is waiting.
+        int64_t deadlineNs = -1;
+        //! When the oldest write still waiting for a wakeup went in, -1 if none is.
+        int64_t deferredSinceNs = -1;
+        int64_t sinceNs = V2_0::implementation::getTimeNow();
+        uint64_t wakes = 0;
+        uint64_t deferredWakes = 0;
+        uint64_t events = 0;
+        int64_t maxDelayNs = 0;
+    };
+
+    using EventMessageQueueV2_1 = MessageQueue<V2_1::Event, kSynchronizedReadWrite>;
+    using EventMessageQueueV2_0 = MessageQueue<V1_0::Event, kSynchronizedReadWrite>;
+    using WakeLockMessageQueue = MessageQueue<uint32_t, kSynchronizedReadWrite>;
+
+    /**
+     * The Event FMQ where sensor events are written
+     */
+    std::unique_ptr<EventMessageQueueWrapperBase> mEventQueue;
+
+    /**
+     * The Wake Lock FMQ that is read to determine when the framework has handled WAKE_UP events
+     */
+    std::unique_ptr<WakeLockMessageQueueWrapperBase> mWakeLockQueue;
+
+    /**
+     * Event Flag to signal to the framework when sensor events are available to be read and to
+     * interrupt event queue blocking write.
+     */
+    EventFlag* mEventQueueFlag = nullptr;
+
+    //! Event Flag to signal internally that the wakelock queue should stop its blocking read.
+    EventFlag* mWakelockQueueFlag = nullptr;
+
+    /**
+     * Callback to the sensors framework to inform it that new sensors have been added or removed.
+     */
+    sp<ISensorsCallbackWrapperBase> mDynamicSensorsCallback;
+
+    /**
+     * SubHal objects that have been saved from vendor dynamic libraries.
+     */
+    std::vector<std::shared_ptr<ISubHalWrapperBase>> mSubHalList;
+
+    /**
+     * The subhal behind every entry of mSubHalList, indexed the same way and fixed once the list
+     * is loaded. activate, batch and flush call the subhal through it directly, without a ref
+     * count on the wrapper or a virtual call into it. The pointers are owned by mSubHalList or
+     * the subhal libraries, which are never unloaded.
+     */
+    using SubHalDispatch = std::variant<ISensorsSubHalV2_0*, ISensorsSubHalV2_1*, RemoteSubHal*>;
+    std::vector<SubHalDispatch> mSubHalDispatch;
+
+    /**
+     * Map of sensor handles to SensorInfo objects that contains the sensor info from subhals as
+     * well as the modified sensor handle for the framework.
+     *
+     * The subhal index is encoded in the first byte of the sensor handle and the remaining
+     * bytes are generated by the subhal to identify the sensor.
+     */
+    std::map<int32_t, SensorInfo> mSensors;
+
+    //! Map of the dynamic sensors that have been added to halproxy.
+    std::map<int32_t, SensorInfo> mDynamicSensors;
+
+    //! The current operation mode for all subhals.
+    OperationMode mCurrentOperationMode = OperationMode::NORMAL;
+
+    //! The single subHal that supports directChannel reporting.
+    std::shared_ptr<ISubHalWrapperBase> mDirectChannelSubHal;
+
+    //! The timeout for each pending write on background thread for events.
+    static const int64_t kPendingWriteTimeoutNs = 5 * INT64_C(1000000000) /* 5 seconds */;
+
+    //! The bit mask used to get the subhal index from a sensor handle.
+    static constexpr int32_t kSensorHandleSubHalIndexMask = 0xFF000000;
+
+    /**
+     * A FIFO queue of pairs of vector of events and the number of wakeup events in that vector
+     * which are waiting to be written to the events fmq in the background thread.
+     */
+    std::queue<std::pair<std::vector<Event>, size_t>> mPendingWriteEventsQueue;
+
+    //! The most events observed on the pending write events queue for debug purposes.
+    size_t mMostEventsObservedPendingWriteEventsQueue = 0;
+
+    //! Batches that entered and left the pending write events queue, the cookies of their traces
+    uint64_t mPendingWritesQueued = 0;
+    uint64_t mPendingWritesDone = 0;
+
+    //! Events that never made it to the event fmq
+    uint64_t mEventsDropped = 0;
+
+    //! The max number of events allowed in the pending write events queue
+    static constexpr size_t kMaxSizePendingWriteEventsQueue = 100000;
+
+    //! The number of events in the pending write events queue
+    size_t mSizePendingWriteEventsQueue = 0;
+
+    /**
+     * The mutex protecting writing to the fmq, the pending events queue, the software FIFOs and
+     * the on-change filters
+     */
+    std::mutex mEventQueueWriteMutex;
+
+    /**
+     * Software FIFOs of the sensors whose subhal has no hardware FIFO. The set of sensors is fixed
+     * by initializeSensorList, so fifos() may be searched without holding mEventQueueWriteMutex.
+     */
+    SoftFifos mSoftFifos;
+
+    //! On-change filters by sensor handle, fixed by initializeSensorList like mSoftFifos.
+    std::map<int32_t, OnChangeFilter> mOnChangeFilters;
+
+    /**
+     * How long the samples of a continuous non-wake-up sensor may wait for the framework to be
+     * woken up, by sensor handle. Derived from the report latency of the last batch call. The set
+     * of sensors is fixed by initializeSensorList, the values are guarded by
+     * mEventQueueWriteMutex.
+     */
+    std::map<int32_t, int64_t> mWakeDelaysNs;
+
+    ReaderWakes mReaderWakes;
+
+    //! Active time, rate, charge and wakelock time of every static sensor.
+    SensorAccounting mAccounting;
+
+    //! Gyroscope bias and magnetometer hard and soft iron, estimated and applied on the event path.
+    SensorCalibration mCalibration;
+
+    //! Latest samples and motion history shared with vendor clients, see SensorStateClient.h.
+    SensorStatePublisher mStatePublisher;
+
+    /**
+     * The thread that writes pending events to the event fmq, flushes software FIFOs and handles
+     * the wakelock ref count and timeout.
+     */
+    std::thread mEventLoopThread;
+
+    //! Wakeup latency of the event loop thread, guarded by mEventQueueWriteMutex.
+    WakeupLatency mEventLoopLatency;
+
+    //! The SCHED_FIFO priority actually applied to the event loop thread, 0 if it runs as CFS.
+    std::atomic_int mEventLoopPriority = 0;
+
+    //! The bool indicating whether to end the threads started in initialize
+    std::atomic_bool mThreadsRun = true;
+
+    //! The mutex protecting access to the dynamic sensors added and removed methods.
+    std::mutex mDynamicSensorsMutex;
+
+    // WakelockRefCount membar vars below
+
+    //! The mutex protecting the wakelock refcount and subsequent wakelock releases and
+    //! acquisitions
+    std::recursive_mutex mWakelockMutex;
+
+    //! The refcount of how many events with wakeup are waiting to be handled by the framework.
+    size_t mWakelockRefCount = 0;
+
+    //! The timestamp of the last time the wakelock was acquired
+    int64_t mWakelockTimeoutStartTime = V2_0::implementation::getTimeNow();
+
+    //! The timestamp of the last time the wakelock timeout was reset
+    int64_t mWakelockTimeoutResetTime = V2_0::implementation::getTimeNow();
+
+    const char* kWakelockName = "SensorsHAL_WAKEUP";
+
+    /**
+     * Initialize the list of SubHal objects in mSubHalList by reading from dynamic libraries
+     * listed in a config file.
+     */
+    void initializeSubHalListFromConfigFile(const char* configFileName);
+
+    /**
+     * Initialize the list of SensorInfo objects in mSensorList by getting sensors from each
+     * subhal.
+     */
+    void initializeSensorList();
+
+    /**
+     * Try using the default include directories as well as the directories defined in
+     * kSubHalShareObjectLocations to get a handle for dlsym for a subhal.
+     *
+     * @param filename The file name to search for.
+     *
+     * @return The handle or nullptr if search failed.
+     */
+    void* getHandleForSubHalSharedObject(const std::string& filename);
+
+    /**
+     * Calls the helper methods that all ctors use.
+     */
+    void init();
+
+    /**
+     * Stops all threads by setting the threads running flag to false and joining to them.
+     */
+    void stopThreads();
+
+    /**
+     * Disable all the sensors observed by the HalProxy.
+     */
+    void disableAllSensors();
+
+    /**
+     * Starts the thread that runs the event loop.
+     *
+     * @param halProxy The HalProxy object pointer.
+     */
+    static void startEventLoopThread(HalProxy* halProxy);
+
+    /**
+     * Give the calling thread the event path role: SCHED_FIFO at ro.vendor.sensors.event_priority
+     * and the CPUs listed in ro.vendor.sensors.event_cpus.
+     */
+    void setEventThreadRole();
+
+    /**
+     * Give the calling thread the background role: a positive nice value and the CPUs listed in
+     * ro.vendor.sensors.background_cpus. Threads created afterwards inherit the affinity.
+     */
+    static void setBackgroundThreadRole(int niceValue);
+
+    /**
+     * Runs the event loop until the threads are stopped. The thread sleeps on the event flag of
+     * the wake lock fmq, or on the one of the event fmq while that is too full for the pending
+     * writes, until the earliest wakelock, pending write or software FIFO deadline.
+     */
+    void handleEvents();
+
+    //! Wake up the event loop so that it picks up new pending writes or deadlines.
+    void wakeEventLoop();
+
+    /**
+     * Write as many pending events to the event fmq as fit. Must be called with
+     * mEventQueueWriteMutex held.
+     *
+     * @return true if the pending write events queue is empty afterwards.
+     */
+    bool writePendingEventsLocked();
+
+    /**
+     * Drop the batch at the front of the pending write events queue after it could not be written
+     * for kPendingWriteTimeoutNs. Must be called with mEventQueueWriteMutex held.
+     */
+    void dropPendingEventsLocked();
+
+    /**
+     * Decrement the wakelock ref count by every count the framework wrote to the wake lock fmq,
+     * and release the shared wakelock if it timed out.
+     *
+     * @param readQueue Whether the wake lock fmq has to be read.
+     *
+     * @return The time the shared wakelock times out, -1 if it is not held.
+     */
+    int64_t handleWakeLockQueue(bool readQueue);
+
+    /**
+     * Write events to the event fmq, or queue them for the event loop if it is full.
+     * Must be called with mEventQueueWriteMutex held.
+     *
+     * @param events The events to write.
+     * @param numWakeupEvents The number of wakeup events among them.
+     */
+    void writeEventsLocked(const std::vector<Event>& events, size_t numWakeupEvents);
+
+    /**
+     * Give a sensor a software FIFO if it is a non-wake-up sensor without a hardware FIFO, and
+     * advertise the FIFO in its SensorInfo.
+     *
+     * @param sensor The sensor that is about to be added to mSensors.
+     */
+    void setupSoftFifo(SensorInfo* sensor);
+
+    //! Write out the events of the software FIFO of sensorHandle, if it has one.
+    void flushSoftFifoLocked(int32_t sensorHandle);
+
+    //! Write out every software FIFO whose deadline has passed.
+    void flushDueSoftFifosLocked(int64_t now);
+
+    //! Give a sensor an entry in mWakeDelaysNs if it is a continuous non-wake-up sensor.
+    void setupWakeDelay(const SensorInfo& sensor);
+
+    /**
+     * @return How long the framework may sleep on events just written to the event fmq, 0 unless
+     *    all of them are samples of sensors in mWakeDelaysNs.
+     */
+    int64_t wakeDelayLocked(const Event* events, size_t numEvents) const;
+
+    //! Wake up the framework now, or have the event loop do it within delayNs.
+    void scheduleReaderWakeLocked(int64_t delayNs);
+
+    //! Wake up the framework for everything written so far.
+    void wakeReaderLocked();
+
+    //! Count events given up on and mark the drop in the trace.
+    void traceDroppedEventsLocked(size_t numEvents);
+
+    //! Give a sensor an OnChangeFilter if it reports on change.
+    void setupOnChangeFilter(const SensorInfo& sensor);
+
+    /**
+     * Copy the events to out, leaving out on-change samples equal to the last one of their
+     * sensor.
+     *
+     * @return The number of wake-up events left out.
+     */
+    size_t filterOnChangeEventsLocked(const std::vector<Event>& events, std::vector<Event>* out);
+
+    //! Let the next sample of sensorHandle through whatever its value.
+    void resetOnChangeFilterLocked(int32_t sensorHandle);
+
+    /**
+     * @param timeLeft The variable that should be set to the timeleft before timeout will occur or
+     * unmodified if timeout occurred.
+     *
+     * @return true if the shared wakelock has been held passed the timeout and should be released
+     */
+    bool sharedWakelockDidTimeout(int64_t* timeLeft);
+
+    /**
+     * Reset all the member variables associated with the wakelock ref count and maybe release
+     * the shared wakelock.
+     */
+    void resetSharedWakelock();
+
+    /**
+     * Clear direct channel flags if the HalProxy has already chosen a subhal as its direct channel
+     * subhal. Set the directChannelSubHal pointer to the subHal passed in if this is the first
+     * direct channel enabled sensor seen.
+     *
+     * @param sensorInfo The SensorInfo object that may be altered to have direct channel support
+     *    disabled.
+     * @param subHal The subhal pointer that the current sensorInfo object came from.
+     */
+    void setDirectChannelFlags(SensorInfo* sensorInfo, std::shared_ptr<ISubHalWrapperBase> subHal);
+
+    //! Add a subhal to mSubHalList and mSubHalDispatch.
+    template <typename SubHal>
+    void addSubHal(std::shared_ptr<ISubHalWrapperBase> wrapper, SubHal* subHal) {
+        mSubHalList.push_back(std::move(wrapper));
+        mSubHalDispatch.emplace_back(subHal);
+    }
+
+    /*
+     * Get the subhal pointer which can be found by indexing into the mSubHalList vector
+     * using the index from the first byte of sensorHandle.
+     *
+     * @param sensorHandle The handle used to identify a sensor in one of the subhals.
+     */
+    ISubHalWrapperBase* getSubHalForSensorHandle(int32_t sensorHandle);
+
+    //! Like getSubHalForSensorHandle, but for calls that skip the wrapper.
+    const SubHalDispatch& getSubHalDispatchForSensorHandle(int32_t sensorHandle) {
+        return mSubHalDispatch[extractSubHalIndex(sensorHandle)];
+    }
+
+    /**
+     * Checks that sensorHandle's subhal index byte is within bounds of mSubHalList.
+     *
+     * @param sensorHandle The sensor handle to check.
+     *
+     * @return true if sensorHandles's subhal index byte is valid.
+     */
+    bool isSubHalIndexValid(int32_t sensorHandle);
+
+    /**
+     * Count the number of wakeup events in the first n events of the vector.
+     *
+     * @param events The vector of Event objects.
+     * @param n The end index not inclusive of events to consider.
+     *
+     * @return The number of wakeup events of the considered events.
+     */
+    size_t countNumWakeupEvents(const std::vector<Event>& events, size_t n);
+
+    /*
+     * Clear out the subhal index bytes from a sensorHandle.
+     *
+     * @param sensorHandle The sensor handle to modify.
+     *
+     * @return The modified version of the sensor handle.
+     */
+    static int32_t clearSubHalIndex(int32_t sensorHandle);
+
+    /**
+     * @param sensorHandle The sensor handle to modify.
+     *
+     * @return true if subHalIndex byte of sensorHandle is zeroed.
+     */
+    static bool subHalIndexIsClear(int32_t sensorHandle);
+};
+
+/**
+ * Since a newer HAL can't masquerade as a older HAL, IHalProxy enables the HalProxy to be compiled
+ * either for HAL 2.0 or HAL 2.1 depending on the build configuration.
+ */
+template <class ISensorsVersion>
+class IHalProxy : public HalProxy, public ISensorsVersion {
+    Return<void> getSensorsList(ISensorsV2_0::getSensorsList_cb _hidl_cb) override {
+        return HalProxy::getSensorsList(_hidl_cb);
+    }
+
+    Return<Result> setOperationMode(OperationMode mode) override {
+        return HalProxy::setOperationMode(mode);
+    }
+
+    Return<Result> activate(int32_t sensorHandle, bool enabled) override {
+        return HalProxy::activate(sensorHandle, enabled);
+    }
+
+    Return<Result> initialize(
+            const ::android::hardware::MQDescriptorSync<V1_0::Event>& eventQueueDescriptor,
+            const ::android::hardware::MQDescriptorSync<uint32_t>& wakeLockDescriptor,
+            const sp<V2_0::ISensorsCallback>& sensorsCallback) override {
+        return HalProxy::initialize(eventQueueDescriptor, wakeLockDescriptor, sensorsCallback);
+    }
+
+    Return<Result> batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                         int64_t maxReportLatencyNs) override {
+        return HalProxy::batch(sensorHandle, samplingPeriodNs, maxReportLatencyNs);
+    }
+
+    Return<Result> flush(int32_t sensorHandle) override { return HalProxy::flush(sensorHandle); }
+
+    Return<Result> injectSensorData(const V1_0::Event& event) override {
+        return HalProxy::injectSensorData(event);
+    }
+
+    Return<void> registerDirectChannel(const SharedMemInfo& mem,
+                                       ISensorsV2_0::registerDirectChannel_cb _hidl_cb) override {
+        return HalProxy::registerDirectChannel(mem, _hidl_cb);
+    }
+
+    Return<Result> unregisterDirectChannel(int32_t channelHandle) override {
+        return HalProxy::unregisterDirectChannel(channelHandle);
+    }
+
+    Return<void> configDirectReport(int32_t sensorHandle, int32_t channelHandle, RateLevel rate,
+                                    ISensorsV2_0::configDirectReport_cb _hidl_cb) override {
+        return HalProxy::configDirectReport(sensorHandle, channelHandle, rate, _hidl_cb);
+    }
+
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override {
+        return HalProxy::debug(fd, args);
+    }
+};
+
+class HalProxyV2_0 : public IHalProxy<V2_0::ISensors> {};
+
+class HalProxyV2_1 : public IHalProxy<V2_1::ISensors> {
+    Return<void> getSensorsList_2_1(ISensorsV2_1::getSensorsList_2_1_cb _hidl_cb) override {
+        return HalProxy::getSensorsList_2_1(_hidl_cb);
+    }
+
+    Return<Result> initialize_2_1(
+            const ::android::hardware::MQDescriptorSync<V2_1::Event>& eventQueueDescriptor,
+            const ::android::hardware::MQDescriptorSync<uint32_t>& wakeLockDescriptor,
+            const sp<V2_1::ISensorsCallback>& sensorsCallback) override {
+        return HalProxy::initialize_2_1(eventQueueDescriptor, wakeLockDescriptor, sensorsCallback);
+    }
+
+    Return<Result> injectSensorData_2_1(const Event& event) override {
+        return HalProxy::injectSensorData_2_1(event);
+    }
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -14,8 +14,12 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_HAL
+
 #include "HalProxyCallback.h"
 
+#include <utils/Trace.h>
+
 #include <cinttypes>
 
 namespace android {
@@ -40,6 +44,7 @@ int32_t setSubHalIndex(int32_t sensorHandle, size_t subHalIndex) {
 
 void HalProxyCallbackBase::postEvents(const std::vector<V2_1::Event>& events,
                                       ScopedWakelock wakelock) {
+    ATRACE_CALL();
     if (events.empty() || !mCallback->areThreadsRunning()) return;
     size_t numWakeupEvents;
     std::vector<V2_1::Event> processedEvents = processEvents(events, &numWakeupEvents);
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+#include "EventLoopDeadline.h"
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * When HalProxy wakes up the framework for events written to the event fmq. Continuous samples
+ * of non-wake-up sensors may wait a little, so that the writes of several subhals share one
+ * wakeup, everything else wakes it at once. Delays are in nanoseconds, deadlines are absolute
+ * and -1 for none like in EventLoopDeadline.h.
+ */
+
+//! The share of the report latency of a sensor its samples may wait for a wakeup.
+constexpr int64_t kWakeDelayLatencyDivisor = 4;
+
+/**
+ * @return Whether the samples of a sensor with these SensorInfo flags may wait for a wakeup.
+ */
+inline bool hasWakeDelay(uint32_t flags) {
+    uint32_t reportingMode =
+            flags & static_cast<uint32_t>(V1_0::SensorFlagBits::MASK_REPORTING_MODE);
+    return reportingMode == static_cast<uint32_t>(V1_0::SensorFlagBits::CONTINUOUS_MODE) &&
+           (flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) == 0;
+}
+
+/**
+ * @return How long the samples of a sensor batched with maxReportLatencyNs may wait for a
+ *     wakeup, never more than maxWakeDelayNs.
+ */
+inline int64_t wakeDelayForLatency(int64_t maxReportLatencyNs, int64_t maxWakeDelayNs) {
+    return std::clamp(maxReportLatencyNs / kWakeDelayLatencyDivisor, INT64_C(0), maxWakeDelayNs);
+}
+
+/**
+ * @return How long the framework may sleep on the events of one write, the shortest delay of
+ *     their sensors in wakeDelaysNs. 0 if any of them is a meta event or comes from a sensor
+ *     without an entry.
+ */
+inline int64_t readerWakeDelay(const std::map<int32_t, int64_t>& wakeDelaysNs,
+                               const V2_1::Event* events, size_t numEvents) {
+    int64_t delayNs = -1;
+    int32_t lastSensorHandle = 0;
+    for (size_t i = 0; i < numEvents && delayNs != 0; i++) {
+        const V2_1::Event& event = events[i];
+        if (event.sensorType == V2_1::SensorType::META_DATA ||
+            event.sensorType == V2_1::SensorType::ADDITIONAL_INFO ||
+            event.sensorType == V2_1::SensorType::DYNAMIC_SENSOR_META) {
+            return 0;
+        }
+        if (delayNs >= 0 && event.sensorHandle == lastSensorHandle) {
+            continue;
+        }
+        auto iter = wakeDelaysNs.find(event.sensorHandle);
+        if (iter == wakeDelaysNs.end()) {
+            return 0;
+        }
+        delayNs = delayNs < 0 ? iter->second : std::min(delayNs, iter->second);
+        lastSensorHandle = event.sensorHandle;
+    }
+    return std::max(delayNs, INT64_C(0));
+}
+
+/**
+ * @return When the framework has to be woken up after a write at now that may wait delayNs,
+ *     given the deadline of the writes still waiting. A wakeup is never pushed back.
+ */
+inline int64_t readerWakeDeadline(int64_t deadline, int64_t now, int64_t delayNs) {
+    return earliestDeadline(deadline, now + delayNs);
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
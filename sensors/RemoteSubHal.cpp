@@ -0,0 +1,473 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "RemoteSubHal.h"
+
+#include "HalProxyCallback.h"
+
+#include <android-base/file.h>
+#include <log/log.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::OperationMode;
+using ::android::hardware::sensors::V1_0::Result;
+using ::android::hardware::sensors::V1_0::SensorFlagBits;
+
+//! A host that takes longer than this to answer is considered hung and killed.
+static constexpr time_t kControlTimeoutS = 5;
+
+static constexpr std::chrono::milliseconds kMinRestartBackoff(250);
+static constexpr std::chrono::milliseconds kMaxRestartBackoff(30000);
+
+//! A host that lived this long resets the backoff.
+static constexpr std::chrono::seconds kStableUptime(60);
+
+RemoteSubHal::RemoteSubHal(const std::string& libraryPath) : mLibraryPath(libraryPath) {
+    mRingFd.reset(memfd_create("sensors-subhal-ring", MFD_CLOEXEC));
+    if (mRingFd.get() < 0 || ftruncate(mRingFd.get(), sizeof(SubHalRing)) != 0) {
+        ALOGE("Failed to create the event ring for %s: %s", mLibraryPath.c_str(), strerror(errno));
+        return;
+    }
+
+    void* ring = mmap(nullptr, sizeof(SubHalRing), PROT_READ | PROT_WRITE, MAP_SHARED,
+                      mRingFd.get(), 0);
+    if (ring == MAP_FAILED) {
+        ALOGE("Failed to map the event ring for %s: %s", mLibraryPath.c_str(), strerror(errno));
+        return;
+    }
+    // Fresh memfd pages are zeroed, which is an empty ring.
+    mRing = static_cast<SubHalRing*>(ring);
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        spawnHostLocked();
+    }
+
+    mReaderThread = std::thread(&RemoteSubHal::readerLoop, this);
+    mMonitorThread = std::thread(&RemoteSubHal::monitorLoop, this);
+}
+
+RemoteSubHal::~RemoteSubHal() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+        if (mPid > 0) {
+            kill(mPid, SIGKILL);
+        }
+    }
+    mExitCv.notify_all();
+    if (mMonitorThread.joinable()) {
+        mMonitorThread.join();
+    }
+
+    if (mRing != nullptr) {
+        // The host is gone, so nothing else writes the index. Moving it makes sure the reader
+        // either sees mExit or fails its futex wait.
+        mRing->writeIndex.fetch_add(1);
+        futexWake(&mRing->writeIndex);
+    }
+    if (mReaderThread.joinable()) {
+        mReaderThread.join();
+    }
+
+    if (mRing != nullptr) {
+        munmap(mRing, sizeof(SubHalRing));
+    }
+}
+
+bool RemoteSubHal::spawnHostLocked() {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        ALOGE("Failed to create the control socket for %s: %s", mLibraryPath.c_str(),
+              strerror(errno));
+        return false;
+    }
+    ::android::base::unique_fd controlFd(sockets[0]);
+    ::android::base::unique_fd hostControlFd(sockets[1]);
+
+    // Keep the fds clear of the numbers the child moves them to, so neither dup2 clobbers the
+    // other and both drop O_CLOEXEC.
+    ::android::base::unique_fd childRingFd(
+            fcntl(mRingFd.get(), F_DUPFD_CLOEXEC, kSubHalHostControlFd + 1));
+    ::android::base::unique_fd childControlFd(
+            fcntl(hostControlFd.get(), F_DUPFD_CLOEXEC, kSubHalHostControlFd + 1));
+    if (childRingFd.get() < 0 || childControlFd.get() < 0) {
+        ALOGE("Failed to duplicate the host fds for %s: %s", mLibraryPath.c_str(),
+              strerror(errno));
+        return false;
+    }
+
+    struct timeval timeout = {kControlTimeoutS, 0};
+    setsockopt(controlFd.get(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    const char* argv[] = {kSubHalHostBinary, mLibraryPath.c_str(), nullptr};
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only async signal safe calls until exec, the proxy is multithreaded. The death signal
+        // follows the forking thread, which is the main or the monitor thread and outlives the
+        // host either way.
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent) {
+            _exit(1);
+        }
+        if (dup2(childRingFd.get(), kSubHalHostRingFd) < 0 ||
+            dup2(childControlFd.get(), kSubHalHostControlFd) < 0) {
+            _exit(1);
+        }
+        execv(argv[0], const_cast<char* const*>(argv));
+        _exit(1);
+    }
+    if (pid < 0) {
+        ALOGE("Failed to fork the host for %s: %s", mLibraryPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    ALOGI("Started host for %s, pid %d", mLibraryPath.c_str(), pid);
+    mPid = pid;
+    mControlFd = std::move(controlFd);
+    return true;
+}
+
+bool RemoteSubHal::replayStateLocked() {
+    if (!mInitialized) {
+        // initialize() has not run yet and will set the host up itself.
+        return true;
+    }
+
+    SubHalHostRequest request = {};
+    Result result = Result::OK;
+
+    request.op = SubHalHostOp::INITIALIZE;
+    if (!callLocked(request, &result) || result != Result::OK) {
+        return false;
+    }
+
+    if (mHasOperationMode) {
+        request.op = SubHalHostOp::SET_OPERATION_MODE;
+        request.value = static_cast<int32_t>(mOperationMode);
+        callLocked(request, &result);
+    }
+
+    for (const auto& [sensorHandle, state] : mSensorStates) {
+        request.sensorHandle = sensorHandle;
+        if (state.batched) {
+            request.op = SubHalHostOp::BATCH;
+            request.samplingPeriodNs = state.samplingPeriodNs;
+            request.maxReportLatencyNs = state.maxReportLatencyNs;
+            callLocked(request, &result);
+        }
+        if (state.enabled) {
+            request.op = SubHalHostOp::ACTIVATE;
+            request.value = 1;
+            callLocked(request, &result);
+        }
+    }
+    return true;
+}
+
+/*
+ * Returns false if the host could not be reached, in which case result is left alone. Calls
+ * that only change state the monitor replays pass in OK, the rest a failure.
+ */
+bool RemoteSubHal::callLocked(const SubHalHostRequest& request, Result* result,
+                              std::vector<SensorInfo>* sensors) {
+    if (mControlFd.get() < 0) {
+        return false;
+    }
+
+    ssize_t written =
+            TEMP_FAILURE_RETRY(send(mControlFd.get(), &request, sizeof(request), MSG_NOSIGNAL));
+    if (written != static_cast<ssize_t>(sizeof(request))) {
+        ALOGE("Failed to send op %u to host %d: %s", static_cast<uint32_t>(request.op), mPid,
+              strerror(errno));
+        return false;
+    }
+
+    SubHalHostResponse response;
+    while (true) {
+        ssize_t n = TEMP_FAILURE_RETRY(recv(mControlFd.get(), &response, sizeof(response), 0));
+        if (n != static_cast<ssize_t>(sizeof(response))) {
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && mPid > 0) {
+                ALOGE("Host %d hung on op %u, killing it", mPid,
+                      static_cast<uint32_t>(request.op));
+                kill(mPid, SIGKILL);
+            }
+            mControlFd.reset();
+            return false;
+        }
+        if (response.isResponse) {
+            *result = response.result;
+            return true;
+        }
+        if (sensors != nullptr) {
+            sensors->push_back(unpackSensorInfo(response.sensor));
+        }
+    }
+}
+
+Result RemoteSubHal::initialize(V2_0::implementation::ISubHalCallback* callback,
+                                V2_0::implementation::IScopedWakelockRefCounter* refCounter,
+                                int32_t subHalIndex) {
+    {
+        std::lock_guard<std::mutex> lock(mCallbackLock);
+        mCallback = new V2_0::implementation::HalProxyCallbackV2_1(callback, refCounter,
+                                                                   subHalIndex);
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    // Subhals come out of initialize with every sensor disabled.
+    mInitialized = true;
+    mSensorStates.clear();
+
+    SubHalHostRequest request = {};
+    request.op = SubHalHostOp::INITIALIZE;
+    Result result = Result::OK;
+    callLocked(request, &result);
+    return result;
+}
+
+Return<void> RemoteSubHal::getSensorsList(ISensors::getSensorsList_2_1_cb _hidl_cb) {
+    std::vector<SensorInfo> sensors;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        SubHalHostRequest request = {};
+        request.op = SubHalHostOp::GET_SENSORS_LIST;
+        Result result = Result::INVALID_OPERATION;
+        if (!callLocked(request, &result, &sensors) || result != Result::OK) {
+            ALOGE("Failed to get the sensors of %s", mLibraryPath.c_str());
+            sensors.clear();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mCallbackLock);
+    mWakeUpSensors.clear();
+    for (auto& sensor : sensors) {
+        sensor.flags &= ~(SensorFlagBits::MASK_DIRECT_REPORT | SensorFlagBits::MASK_DIRECT_CHANNEL);
+        if ((sensor.flags & SensorFlagBits::WAKE_UP) != 0) {
+            mWakeUpSensors.insert(sensor.sensorHandle);
+        }
+    }
+    _hidl_cb(sensors);
+    return Void();
+}
+
+Return<Result> RemoteSubHal::setOperationMode(OperationMode mode) {
+    std::lock_guard<std::mutex> lock(mLock);
+    SubHalHostRequest request = {};
+    request.op = SubHalHostOp::SET_OPERATION_MODE;
+    request.value = static_cast<int32_t>(mode);
+
+    Result result = Result::OK;
+    callLocked(request, &result);
+    if (result == Result::OK) {
+        mHasOperationMode = true;
+        mOperationMode = mode;
+    }
+    return result;
+}
+
+Return<Result> RemoteSubHal::activate(int32_t sensorHandle, bool enabled) {
+    std::lock_guard<std::mutex> lock(mLock);
+    SubHalHostRequest request = {};
+    request.op = SubHalHostOp::ACTIVATE;
+    request.sensorHandle = sensorHandle;
+    request.value = enabled;
+
+    Result result = Result::OK;
+    callLocked(request, &result);
+    if (result == Result::OK) {
+        mSensorStates[sensorHandle].enabled = enabled;
+    }
+    return result;
+}
+
+Return<Result> RemoteSubHal::batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                                   int64_t maxReportLatencyNs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    SubHalHostRequest request = {};
+    request.op = SubHalHostOp::BATCH;
+    request.sensorHandle = sensorHandle;
+    request.samplingPeriodNs = samplingPeriodNs;
+    request.maxReportLatencyNs = maxReportLatencyNs;
+
+    Result result = Result::OK;
+    callLocked(request, &result);
+    if (result == Result::OK) {
+        SensorState& state = mSensorStates[sensorHandle];
+        state.batched = true;
+        state.samplingPeriodNs = samplingPeriodNs;
+        state.maxReportLatencyNs = maxReportLatencyNs;
+    }
+    return result;
+}
+
+Return<Result> RemoteSubHal::flush(int32_t sensorHandle) {
+    std::lock_guard<std::mutex> lock(mLock);
+    SubHalHostRequest request = {};
+    request.op = SubHalHostOp::FLUSH;
+    request.sensorHandle = sensorHandle;
+
+    Result result = Result::INVALID_OPERATION;
+    callLocked(request, &result);
+    return result;
+}
+
+Return<Result> RemoteSubHal::injectSensorData(const Event& event) {
+    std::lock_guard<std::mutex> lock(mLock);
+    SubHalHostRequest request = {};
+    request.op = SubHalHostOp::INJECT_SENSOR_DATA;
+    request.event = event;
+
+    Result result = Result::INVALID_OPERATION;
+    callLocked(request, &result);
+    return result;
+}
+
+Return<void> RemoteSubHal::registerDirectChannel(const V1_0::SharedMemInfo& /* mem */,
+                                                 ISensors::registerDirectChannel_cb _hidl_cb) {
+    _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
+    return Void();
+}
+
+Return<Result> RemoteSubHal::unregisterDirectChannel(int32_t /* channelHandle */) {
+    return Result::INVALID_OPERATION;
+}
+
+Return<void> RemoteSubHal::configDirectReport(int32_t /* sensorHandle */,
+                                              int32_t /* channelHandle */,
+                                              V1_0::RateLevel /* rate */,
+                                              ISensors::configDirectReport_cb _hidl_cb) {
+    _hidl_cb(Result::INVALID_OPERATION, 0 /* reportToken */);
+    return Void();
+}
+
+Return<void> RemoteSubHal::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* args */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+
+    std::ostringstream stream;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        size_t active = std::count_if(mSensorStates.begin(), mSensorStates.end(),
+                                      [](const auto& entry) { return entry.second.enabled; });
+        stream << "    Host pid: " << mPid << ", restarts: " << mRestarts << std::endl;
+        stream << "    Active sensors: " << active << std::endl;
+    }
+    stream << "    Events forwarded: " << mEventsForwarded.load()
+           << ", dropped by the host: " << (mRing != nullptr ? mRing->dropped.load() : 0)
+           << std::endl;
+    android::base::WriteStringToFd(stream.str(), fd->data[0]);
+    return Void();
+}
+
+/*
+ * Hands events from the ring to the proxy the same way an in-process subhal posts them, the
+ * proxy side callback sets the subhal index and takes the wakelock.
+ */
+void RemoteSubHal::readerLoop() {
+    std::vector<Event> events;
+    uint32_t readIndex = mRing->readIndex.load();
+
+    while (true) {
+        // The destructor moves the write index to get the reader out of its wait.
+        uint32_t writeIndex = waitForRingEvents(mRing, readIndex);
+        if (mExit) {
+            break;
+        }
+
+        // Never trust the host with more than a ring worth of events.
+        if (writeIndex - readIndex > SubHalRing::kCapacity) {
+            readIndex = writeIndex - SubHalRing::kCapacity;
+        }
+
+        events.clear();
+        size_t numWakeupEvents = 0;
+        sp<IHalProxyCallback> callback;
+        {
+            std::lock_guard<std::mutex> lock(mCallbackLock);
+            callback = mCallback;
+            for (; readIndex != writeIndex; readIndex++) {
+                const Event& event = mRing->events[readIndex & (SubHalRing::kCapacity - 1)];
+                numWakeupEvents += mWakeUpSensors.count(event.sensorHandle);
+                events.push_back(event);
+            }
+        }
+
+        if (callback != nullptr) {
+            callback->postEvents(events, callback->createScopedWakelock(numWakeupEvents > 0));
+            mEventsForwarded += events.size();
+        }
+
+        // The proxy holds its own wakelock for the events now, let the host drop its one.
+        releaseRingEvents(mRing, readIndex);
+    }
+}
+
+void RemoteSubHal::monitorLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    uint32_t crashes = 0;
+
+    while (!mExit) {
+        pid_t pid = mPid;
+        if (pid > 0) {
+            auto started = std::chrono::steady_clock::now();
+            int status = 0;
+
+            lock.unlock();
+            TEMP_FAILURE_RETRY(waitpid(pid, &status, 0));
+            lock.lock();
+
+            mPid = -1;
+            mControlFd.reset();
+            if (mExit) {
+                break;
+            }
+
+            ALOGE("Host %d for %s died, status 0x%x", pid, mLibraryPath.c_str(), status);
+            if (std::chrono::steady_clock::now() - started > kStableUptime) {
+                crashes = 0;
+            }
+        }
+
+        auto backoff =
+                std::min(kMaxRestartBackoff, kMinRestartBackoff * (1 << std::min(crashes, 7u)));
+        crashes++;
+        if (mExitCv.wait_for(lock, backoff, [this] { return mExit.load(); })) {
+            break;
+        }
+
+        mRestarts++;
+        if (spawnHostLocked() && !replayStateLocked()) {
+            ALOGE("Failed to restore %s in host %d", mLibraryPath.c_str(), mPid);
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
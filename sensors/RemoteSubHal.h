@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "SubHalRing.h"
+#include "SubHalWrapper.h"
+
+#include <android-base/unique_fd.h>
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * A subhal loaded by a helper process instead of the sensors service, so a crash in the vendor
+ * library only costs a restart of the helper. The helper is respawned with backoff and gets the
+ * last operation mode and the batch and activation state of every sensor replayed to it. Events
+ * are forwarded through a shared SubHalRing.
+ *
+ * Dynamic sensors and direct channels are not supported across the process boundary.
+ */
+class RemoteSubHal final : public ISubHalWrapperBase {
+  public:
+    explicit RemoteSubHal(const std::string& libraryPath);
+    ~RemoteSubHal();
+
+    bool supportsNewEvents() override { return true; }
+
+    V1_0::Result initialize(V2_0::implementation::ISubHalCallback* callback,
+                            V2_0::implementation::IScopedWakelockRefCounter* refCounter,
+                            int32_t subHalIndex) override;
+
+    Return<void> getSensorsList(ISensors::getSensorsList_2_1_cb _hidl_cb) override;
+
+    Return<V1_0::Result> setOperationMode(V1_0::OperationMode mode) override;
+
+    Return<V1_0::Result> activate(int32_t sensorHandle, bool enabled) override;
+
+    Return<V1_0::Result> batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                               int64_t maxReportLatencyNs) override;
+
+    Return<V1_0::Result> flush(int32_t sensorHandle) override;
+
+    Return<V1_0::Result> injectSensorData(const Event& event) override;
+
+    Return<void> registerDirectChannel(const V1_0::SharedMemInfo& mem,
+                                       ISensors::registerDirectChannel_cb _hidl_cb) override;
+
+    Return<V1_0::Result> unregisterDirectChannel(int32_t channelHandle) override;
+
+    Return<void> configDirectReport(int32_t sensorHandle, int32_t channelHandle,
+                                    V1_0::RateLevel rate,
+                                    ISensors::configDirectReport_cb _hidl_cb) override;
+
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
+    const std::string getName() override { return "isolated:" + mLibraryPath; }
+
+  private:
+    struct SensorState {
+        bool enabled = false;
+        bool batched = false;
+        int64_t samplingPeriodNs = 0;
+        int64_t maxReportLatencyNs = 0;
+    };
+
+    bool spawnHostLocked();
+    bool replayStateLocked();
+    bool callLocked(const SubHalHostRequest& request, V1_0::Result* result,
+                    std::vector<SensorInfo>* sensors = nullptr);
+
+    void readerLoop();
+    void monitorLoop();
+
+    const std::string mLibraryPath;
+
+    SubHalRing* mRing = nullptr;
+    ::android::base::unique_fd mRingFd;
+
+    /*
+     * Guards the host process and everything replayed to it. Held across control calls, so the
+     * helper sees them in the order the proxy made them.
+     */
+    std::mutex mLock;
+    pid_t mPid = -1;
+    ::android::base::unique_fd mControlFd;
+    bool mInitialized = false;
+    bool mHasOperationMode = false;
+    V1_0::OperationMode mOperationMode = V1_0::OperationMode::NORMAL;
+    std::map<int32_t, SensorState> mSensorStates;
+    uint32_t mRestarts = 0;
+    std::condition_variable mExitCv;
+
+    //! Guards what the reader thread needs, so it never waits behind a control call.
+    std::mutex mCallbackLock;
+    sp<IHalProxyCallback> mCallback;
+    std::set<int32_t> mWakeUpSensors;
+
+    std::atomic<bool> mExit = false;
+    std::atomic<uint64_t> mEventsForwarded = 0;
+    std::thread mReaderThread;
+    std::thread mMonitorThread;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
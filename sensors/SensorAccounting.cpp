@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "SensorAccounting.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+static constexpr double kNsPerS = 1e9;
+static constexpr double kNsPerHour = 3600 * kNsPerS;
+
+void SensorAccounting::addSensor(const SensorInfo& sensor, size_t subHalIndex) {
+    Entry& entry = mEntries[sensor.sensorHandle];
+    entry.name = sensor.name;
+    entry.subHalIndex = subHalIndex;
+    entry.powerMa = sensor.power;
+    entry.wakeUp = (sensor.flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) != 0;
+    entry.samplingPeriodNs = static_cast<int64_t>(sensor.minDelay) * 1000;
+}
+
+void SensorAccounting::integrate(Entry& entry, int64_t now) {
+    int64_t since = entry.activeSinceNs.load(std::memory_order_relaxed);
+    if (since < 0 || now <= since) {
+        return;
+    }
+
+    int64_t activeNs = now - since;
+    int64_t periodNs = entry.samplingPeriodNs.load(std::memory_order_relaxed);
+    entry.activeNs.fetch_add(activeNs, std::memory_order_relaxed);
+    if (periodNs > 0) {
+        entry.requestedMilliSamples.fetch_add(activeNs * 1000 / periodNs,
+                                              std::memory_order_relaxed);
+    }
+    entry.activeSinceNs.store(now, std::memory_order_relaxed);
+}
+
+void SensorAccounting::activate(int32_t sensorHandle, bool enabled, int64_t now) {
+    auto iter = mEntries.find(sensorHandle);
+    if (iter == mEntries.end()) {
+        return;
+    }
+
+    Entry& entry = iter->second;
+    bool active = entry.activeSinceNs.load(std::memory_order_relaxed) >= 0;
+    integrate(entry, now);
+    if (enabled && !active) {
+        entry.activeSinceNs.store(now, std::memory_order_relaxed);
+        entry.activations.fetch_add(1, std::memory_order_relaxed);
+    } else if (!enabled) {
+        entry.activeSinceNs.store(-1, std::memory_order_relaxed);
+    }
+}
+
+void SensorAccounting::batch(int32_t sensorHandle, int64_t samplingPeriodNs, int64_t now) {
+    auto iter = mEntries.find(sensorHandle);
+    if (iter == mEntries.end()) {
+        return;
+    }
+
+    // Time at the old rate is accounted at the old rate.
+    integrate(iter->second, now);
+    iter->second.samplingPeriodNs.store(samplingPeriodNs, std::memory_order_relaxed);
+}
+
+void SensorAccounting::eventsPosted(const std::vector<Event>& events) {
+    size_t i = 0;
+    while (i < events.size()) {
+        int32_t sensorHandle = events[i].sensorHandle;
+        size_t run = 1;
+        while (i + run < events.size() && events[i + run].sensorHandle == sensorHandle) {
+            run++;
+        }
+        i += run;
+
+        auto iter = mEntries.find(sensorHandle);
+        if (iter == mEntries.end()) {
+            continue;
+        }
+        iter->second.events.fetch_add(run, std::memory_order_relaxed);
+        if (iter->second.wakeUp) {
+            iter->second.heldWakeupEvents.fetch_add(run, std::memory_order_relaxed);
+        }
+    }
+}
+
+void SensorAccounting::wakelockAcquired(int64_t now) {
+    mWakelockSinceNs = now;
+}
+
+/*
+ * Splits the time the wakelock was held among the sensors that posted wake-up events while it
+ * was, in proportion to their number of events.
+ */
+void SensorAccounting::wakelockReleased(int64_t now) {
+    if (mWakelockSinceNs < 0) {
+        return;
+    }
+    int64_t heldNs = std::max(now - mWakelockSinceNs, INT64_C(0));
+    mWakelockSinceNs = -1;
+
+    uint64_t totalEvents = 0;
+    for (auto& [sensorHandle, entry] : mEntries) {
+        totalEvents += entry.heldWakeupEvents.load(std::memory_order_relaxed);
+    }
+    if (totalEvents == 0) {
+        mUnattributedWakelockNs.fetch_add(heldNs, std::memory_order_relaxed);
+        return;
+    }
+
+    for (auto& [sensorHandle, entry] : mEntries) {
+        uint64_t events = entry.heldWakeupEvents.exchange(0, std::memory_order_relaxed);
+        if (events > 0) {
+            entry.wakelockNs.fetch_add(heldNs * static_cast<int64_t>(events) /
+                                               static_cast<int64_t>(totalEvents),
+                                       std::memory_order_relaxed);
+        }
+    }
+}
+
+void SensorAccounting::dump(std::ostream& stream, const std::vector<std::string>& subHalNames,
+                            int64_t now) {
+    struct Totals {
+        double chargeMah = 0;
+        int64_t activeNs = 0;
+        int64_t wakelockNs = 0;
+    };
+    std::vector<Totals> subHalTotals(subHalNames.size());
+    std::ios_base::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+
+    stream << "  Sensor accounting, last " << std::fixed << std::setprecision(1)
+           << (now - mResetTimeNs) / kNsPerS << " s (reset with --reset-accounting):"
+           << std::endl;
+    for (auto& [sensorHandle, entry] : mEntries) {
+        // Brings running activations up to now so their time shows up.
+        integrate(entry, now);
+
+        int64_t activeNs = entry.activeNs.load(std::memory_order_relaxed);
+        uint64_t events = entry.events.load(std::memory_order_relaxed);
+        int64_t wakelockNs = entry.wakelockNs.load(std::memory_order_relaxed);
+        if (activeNs == 0 && events == 0) {
+            continue;
+        }
+
+        double activeS = activeNs / kNsPerS;
+        double chargeMah = entry.powerMa * activeNs / kNsPerHour;
+        double requestedHz =
+                activeS > 0 ? entry.requestedMilliSamples.load(std::memory_order_relaxed) /
+                                      1000.0 / activeS
+                            : 0;
+        double deliveredHz = activeS > 0 ? events / activeS : 0;
+
+        stream << "    " << entry.name << ": active " << std::setprecision(1) << activeS
+               << " s in " << entry.activations.load(std::memory_order_relaxed)
+               << " activations, " << requestedHz << " Hz requested, " << deliveredHz
+               << " Hz delivered, " << events << " events, " << std::setprecision(3)
+               << chargeMah << " mAh";
+        if (entry.wakeUp) {
+            stream << ", " << wakelockNs / 1000000 << " ms wakelock";
+        }
+        stream << std::endl;
+
+        if (entry.subHalIndex < subHalTotals.size()) {
+            Totals& totals = subHalTotals[entry.subHalIndex];
+            totals.chargeMah += chargeMah;
+            totals.activeNs += activeNs;
+            totals.wakelockNs += wakelockNs;
+        }
+    }
+
+    for (size_t i = 0; i < subHalTotals.size(); i++) {
+        stream << "    SubHal " << subHalNames[i] << ": " << std::setprecision(1)
+               << subHalTotals[i].activeNs / kNsPerS << " sensor seconds, "
+               << std::setprecision(3) << subHalTotals[i].chargeMah << " mAh, "
+               << subHalTotals[i].wakelockNs / 1000000 << " ms wakelock" << std::endl;
+    }
+    stream << "    Wakelock without wake-up events: "
+           << mUnattributedWakelockNs.load(std::memory_order_relaxed) / 1000000 << " ms"
+           << std::endl;
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+void SensorAccounting::reset(int64_t now) {
+    for (auto& [sensorHandle, entry] : mEntries) {
+        if (entry.activeSinceNs.load(std::memory_order_relaxed) >= 0) {
+            entry.activeSinceNs.store(now, std::memory_order_relaxed);
+        }
+        entry.activeNs.store(0, std::memory_order_relaxed);
+        entry.requestedMilliSamples.store(0, std::memory_order_relaxed);
+        entry.activations.store(0, std::memory_order_relaxed);
+        entry.events.store(0, std::memory_order_relaxed);
+        entry.heldWakeupEvents.store(0, std::memory_order_relaxed);
+        entry.wakelockNs.store(0, std::memory_order_relaxed);
+    }
+    if (mWakelockSinceNs >= 0) {
+        mWakelockSinceNs = now;
+    }
+    mUnattributedWakelockNs.store(0, std::memory_order_relaxed);
+    mResetTimeNs = now;
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * Works out how long each sensor was on, at what rate and how much charge that cost according
+ * to SensorInfo.power, plus how long its wake-up events kept the shared wakelock held. Time is
+ * integrated on activate and batch calls, the event path only bumps a counter per run of
+ * events of the same sensor.
+ *
+ * The sensor set is fixed before the event loop starts. Control calls and debug() arrive on the
+ * single binder thread, the counters are atomic so the event path can bump them without a lock.
+ */
+class SensorAccounting {
+  public:
+    void addSensor(const SensorInfo& sensor, size_t subHalIndex);
+
+    void activate(int32_t sensorHandle, bool enabled, int64_t now);
+    void batch(int32_t sensorHandle, int64_t samplingPeriodNs, int64_t now);
+
+    void eventsPosted(const std::vector<Event>& events);
+
+    //! Called with the wakelock mutex of the proxy held.
+    void wakelockAcquired(int64_t now);
+    void wakelockReleased(int64_t now);
+
+    void dump(std::ostream& stream, const std::vector<std::string>& subHalNames, int64_t now);
+
+    //! Called with the wakelock mutex of the proxy held.
+    void reset(int64_t now);
+
+  private:
+    struct Entry {
+        std::string name;
+        size_t subHalIndex = 0;
+        float powerMa = 0;
+        bool wakeUp = false;
+
+        std::atomic<int64_t> samplingPeriodNs = 0;
+        //! Start of the part of the current activation not integrated yet, -1 while disabled.
+        std::atomic<int64_t> activeSinceNs = -1;
+        std::atomic<int64_t> activeNs = 0;
+        //! Samples the requested rate asks for over activeNs, in thousandths.
+        std::atomic<int64_t> requestedMilliSamples = 0;
+        std::atomic<uint64_t> activations = 0;
+        std::atomic<uint64_t> events = 0;
+        //! Wake-up events posted since the wakelock was last acquired.
+        std::atomic<uint64_t> heldWakeupEvents = 0;
+        std::atomic<int64_t> wakelockNs = 0;
+    };
+
+    static void integrate(Entry& entry, int64_t now);
+
+    std::map<int32_t, Entry> mEntries;
+
+    int64_t mResetTimeNs = 0;
+    int64_t mWakelockSinceNs = -1;
+    std::atomic<int64_t> mUnattributedWakelockNs = 0;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,755 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "SensorCalibration"
+
+#include "SensorCalibration.h"
+
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/unique_fd.h>
+#include <log/log.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * Set on devices whose subhals report raw gyroscope and magnetometer samples. Off by default,
+ * a subhal that calibrates them itself would be corrected twice.
+ */
+static constexpr const char* kCalibrationProperty = "ro.vendor.sensors.calibration";
+static constexpr const char* kCalibrationFile = "/data/vendor/sensor/proxy_calibration";
+static constexpr int kCalibrationFileVersion = 1;
+
+//! Estimates change every few seconds while still, so the checkpoint collects them for a while.
+static constexpr auto kCheckpointInterval = std::chrono::minutes(1);
+
+static constexpr int64_t kWindowNs = 1000000000;
+static constexpr size_t kMinWindowSamples = 20;
+
+static constexpr double kAccelStillVariance = 0.05 * 0.05;  // (m/s^2)^2
+static constexpr double kGyroStillVariance = 0.01 * 0.01;   // (rad/s)^2
+static constexpr float kMaxGyroBias = 0.1f;                  // rad/s
+static constexpr float kGyroBiasBlend = 0.3f;
+
+/*
+ * The fit works on samples scaled to about unit length. Samples closer than kMagMinStepUt to
+ * the last one taken are skipped so that holding the phone still does not drown out the rest of
+ * the ellipsoid, and the sums are halved whenever they hold kMagMaxSamples.
+ */
+static constexpr double kMagScaleUt = 50;
+static constexpr float kMagMinStepUt = 1.5f;
+static constexpr double kMagMaxSamples = 800;
+static constexpr double kMagMinSamples = 150;
+static constexpr size_t kMagFitInterval = 50;
+
+static constexpr float kMinFieldUt = 15;
+static constexpr float kMaxFieldUt = 90;
+static constexpr float kMaxCenterUt = 2000;
+static constexpr double kMaxAxisRatio = 1.5;
+static constexpr double kMaxFitResidual = 0.05;
+
+//! The proxy keeps the index of the subhal of a sensor in the top byte of its handle.
+static constexpr uint32_t kSubHalIndexMask = 0xFF000000;
+
+/**
+ * Solve a x = b by Gaussian elimination with partial pivoting.
+ *
+ * @return false if a is close to singular.
+ */
+template <size_t N>
+static bool solveLinear(double (&a)[N][N], double (&b)[N], double (&x)[N]) {
+    double scale = 0;
+    for (size_t i = 0; i < N; i++) {
+        scale = std::max(scale, std::abs(a[i][i]));
+    }
+    for (size_t col = 0; col < N; col++) {
+        size_t pivot = col;
+        for (size_t row = col + 1; row < N; row++) {
+            if (std::abs(a[row][col]) > std::abs(a[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (std::abs(a[pivot][col]) <= 1e-12 * scale) {
+            return false;
+        }
+        std::swap(a[col], a[pivot]);
+        std::swap(b[col], b[pivot]);
+        for (size_t row = col + 1; row < N; row++) {
+            double factor = a[row][col] / a[col][col];
+            for (size_t k = col; k < N; k++) {
+                a[row][k] -= factor * a[col][k];
+            }
+            b[row] -= factor * b[col];
+        }
+    }
+    for (size_t row = N; row-- > 0;) {
+        double sum = b[row];
+        for (size_t k = row + 1; k < N; k++) {
+            sum -= a[row][k] * x[k];
+        }
+        x[row] = sum / a[row][row];
+    }
+    return true;
+}
+
+/**
+ * Eigen decomposition of a symmetric 3x3 matrix by cyclic Jacobi rotations. a is destroyed, the
+ * eigenvectors end up in the columns of vectors.
+ */
+static void eigenSymmetric3(double (&a)[3][3], double (&values)[3], double (&vectors)[3][3]) {
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            vectors[i][j] = i == j ? 1 : 0;
+        }
+    }
+    for (int sweep = 0; sweep < 50; sweep++) {
+        double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        if (off < 1e-24) {
+            break;
+        }
+        for (size_t p = 0; p < 2; p++) {
+            for (size_t q = p + 1; q < 3; q++) {
+                if (a[p][q] == 0) {
+                    continue;
+                }
+                double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                double t = (theta >= 0 ? 1 : -1) /
+                           (std::abs(theta) + std::sqrt(theta * theta + 1));
+                double c = 1 / std::sqrt(t * t + 1);
+                double s = t * c;
+                for (size_t k = 0; k < 3; k++) {
+                    double kp = a[k][p];
+                    double kq = a[k][q];
+                    a[k][p] = c * kp - s * kq;
+                    a[k][q] = s * kp + c * kq;
+                }
+                for (size_t k = 0; k < 3; k++) {
+                    double pk = a[p][k];
+                    double qk = a[q][k];
+                    a[p][k] = c * pk - s * qk;
+                    a[q][k] = s * pk + c * qk;
+                }
+                for (size_t k = 0; k < 3; k++) {
+                    double kp = vectors[k][p];
+                    double kq = vectors[k][q];
+                    vectors[k][p] = c * kp - s * kq;
+                    vectors[k][q] = s * kp + c * kq;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < 3; i++) {
+        values[i] = a[i][i];
+    }
+}
+
+/**
+ * Write a file so that a crash or power loss leaves either the old or the new content behind.
+ */
+static bool writeFileAtomically(const std::string& path, const std::string& content) {
+    std::string tmpPath = path + ".tmp";
+    ::android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                    0660)));
+    if (fd.get() < 0) {
+        return false;
+    }
+    if (!::android::base::WriteFully(fd.get(), content.data(), content.size()) ||
+        fsync(fd.get()) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    fd.reset();
+    return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+bool SensorCalibration::Window::add(int64_t timestamp, const float* v) {
+    if (startNs >= 0 && (timestamp - startNs >= kWindowNs || timestamp < endNs)) {
+        return true;
+    }
+    if (startNs < 0) {
+        startNs = timestamp;
+    }
+    endNs = timestamp;
+    count++;
+    for (int axis = 0; axis < 3; axis++) {
+        sum[axis] += v[axis];
+        sumSq[axis] += static_cast<double>(v[axis]) * v[axis];
+    }
+    return false;
+}
+
+bool SensorCalibration::Window::still(double maxVariance) const {
+    if (count < kMinWindowSamples || endNs - startNs < kWindowNs / 2) {
+        return false;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        double mean = sum[axis] / count;
+        if (sumSq[axis] / count - mean * mean > maxVariance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SensorCalibration::SensorCalibration()
+    : SensorCalibration(::android::base::GetBoolProperty(kCalibrationProperty, false),
+                        kCalibrationFile) {}
+
+SensorCalibration::SensorCalibration(bool rawSubHalOutput, std::string checkpointPath)
+    : mRawSubHalOutput(rawSubHalOutput), mCheckpointPath(std::move(checkpointPath)) {}
+
+SensorCalibration::~SensorCalibration() {
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mStopped = true;
+    }
+    mStateCv.notify_all();
+    if (mCheckpointThread.joinable()) {
+        mCheckpointThread.join();
+    }
+}
+
+void SensorCalibration::addSensor(const SensorInfo& sensor) {
+    bool wakeUp = (sensor.flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) != 0;
+    switch (sensor.type) {
+        case SensorType::ACCELEROMETER:
+            if (mHasAccel || wakeUp) {
+                return;
+            }
+            mHasAccel = true;
+            break;
+        case SensorType::GYROSCOPE:
+        case SensorType::MAGNETIC_FIELD:
+        case SensorType::GYROSCOPE_UNCALIBRATED:
+        case SensorType::MAGNETIC_FIELD_UNCALIBRATED:
+            break;
+        default:
+            return;
+    }
+
+    Entry& entry = mEntries[sensor.sensorHandle];
+    entry.name = sensor.name;
+    entry.type = sensor.type;
+    entry.wakeUp = wakeUp;
+}
+
+void SensorCalibration::start() {
+    mEnabled = mRawSubHalOutput;
+    if (!mEnabled || mEntries.empty()) {
+        return;
+    }
+    linkUncalibrated();
+    load();
+    mCheckpointThread = std::thread(&SensorCalibration::checkpointLoop, this);
+}
+
+void SensorCalibration::linkUncalibrated() {
+    for (auto& [sensorHandle, entry] : mEntries) {
+        SensorType calibratedType;
+        if (entry.type == SensorType::GYROSCOPE_UNCALIBRATED) {
+            calibratedType = SensorType::GYROSCOPE;
+        } else if (entry.type == SensorType::MAGNETIC_FIELD_UNCALIBRATED) {
+            calibratedType = SensorType::MAGNETIC_FIELD;
+        } else {
+            continue;
+        }
+        // The calibrated sensor of the same subhal that wakes up the same way.
+        for (auto& [calibratedHandle, calibrated] : mEntries) {
+            if (calibrated.type == calibratedType && calibrated.wakeUp == entry.wakeUp &&
+                (static_cast<uint32_t>(calibratedHandle) & kSubHalIndexMask) ==
+                        (static_cast<uint32_t>(sensorHandle) & kSubHalIndexMask)) {
+                entry.calibrated = &calibrated;
+                break;
+            }
+        }
+    }
+}
+
+bool SensorCalibration::process(const std::vector<Event>& events, std::vector<Event>* out) {
+    if (!mEnabled || mEntries.empty()) {
+        return false;
+    }
+
+    bool corrected = false;
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event& event = events[i];
+        auto iter = mEntries.find(event.sensorHandle);
+        // Flush complete and additional info events carry the handle, but no sample.
+        if (iter == mEntries.end() || event.sensorType != iter->second.type) {
+            continue;
+        }
+
+        Entry& entry = iter->second;
+        if (entry.type == SensorType::GYROSCOPE_UNCALIBRATED ||
+            entry.type == SensorType::MAGNETIC_FIELD_UNCALIBRATED) {
+            Uncal uncal = event.u.uncal;
+            if (!correctUncalibrated(entry, &uncal)) {
+                continue;
+            }
+            if (!corrected) {
+                *out = events;
+                corrected = true;
+            }
+            (*out)[i].u.uncal = uncal;
+            continue;
+        }
+
+        const float v[3] = {event.u.vec3.x, event.u.vec3.y, event.u.vec3.z};
+        if (entry.type == SensorType::ACCELEROMETER) {
+            updateAccel(entry, event.timestamp, v);
+            continue;
+        }
+        if (entry.calibratedBySubHal) {
+            continue;
+        }
+        if (entry.type == SensorType::GYROSCOPE) {
+            updateGyro(entry, event.timestamp, v);
+        } else {
+            updateMag(entry, v);
+        }
+        float c[3];
+        if (!correct(entry, v, c)) {
+            continue;
+        }
+
+        if (!corrected) {
+            *out = events;
+            corrected = true;
+        }
+        Event& outEvent = (*out)[i];
+        outEvent.u.vec3.x = c[0];
+        outEvent.u.vec3.y = c[1];
+        outEvent.u.vec3.z = c[2];
+    }
+    return corrected;
+}
+
+bool SensorCalibration::correct(const Entry& entry, const float* v, float* c) {
+    if (entry.type == SensorType::GYROSCOPE) {
+        if (!entry.gyro.hasBias) {
+            return false;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            c[axis] = v[axis] - entry.gyro.bias[axis];
+        }
+        return true;
+    }
+
+    const MagState& mag = entry.mag;
+    if (!mag.hasFit) {
+        return false;
+    }
+    const float d[3] = {v[0] - mag.center[0], v[1] - mag.center[1], v[2] - mag.center[2]};
+    for (int row = 0; row < 3; row++) {
+        c[row] = mag.softIron[row][0] * d[0] + mag.softIron[row][1] * d[1] +
+                 mag.softIron[row][2] * d[2];
+    }
+    return true;
+}
+
+bool SensorCalibration::correctUncalibrated(Entry& entry, Uncal* uncal) {
+    if (entry.calibrated == nullptr || entry.calibrated->calibratedBySubHal) {
+        return false;
+    }
+    Entry& calibrated = *entry.calibrated;
+    if (uncal->x_bias != 0 || uncal->y_bias != 0 || uncal->z_bias != 0) {
+        ALOGW("%s reports a bias, leaving the calibration of %s to its subhal", entry.name.c_str(),
+              calibrated.name.c_str());
+        {
+            std::lock_guard<std::mutex> lock(mStateMutex);
+            calibrated.calibratedBySubHal = true;
+        }
+        // Checkpointed, so the next boot does not correct the samples until this runs again.
+        estimatesChanged();
+        return false;
+    }
+
+    const float v[3] = {uncal->x, uncal->y, uncal->z};
+    float c[3];
+    if (!correct(calibrated, v, c)) {
+        return false;
+    }
+    float u[3] = {v[0], v[1], v[2]};
+    if (calibrated.type == SensorType::MAGNETIC_FIELD) {
+        // Soft iron counts as factory calibration, which applies to uncalibrated samples too.
+        // Only the hard iron offset ends up in the bias.
+        const MagState& mag = calibrated.mag;
+        for (int row = 0; row < 3; row++) {
+            u[row] = mag.softIron[row][0] * v[0] + mag.softIron[row][1] * v[1] +
+                     mag.softIron[row][2] * v[2];
+        }
+    }
+    // The calibrated sample is the uncalibrated one minus the bias.
+    uncal->x = u[0];
+    uncal->y = u[1];
+    uncal->z = u[2];
+    uncal->x_bias = u[0] - c[0];
+    uncal->y_bias = u[1] - c[1];
+    uncal->z_bias = u[2] - c[2];
+    return true;
+}
+
+void SensorCalibration::updateAccel(Entry& entry, int64_t timestamp, const float* v) {
+    if (entry.window.add(timestamp, v)) {
+        if (entry.window.still(kAccelStillVariance)) {
+            mLastStillNs = entry.window.endNs;
+        }
+        entry.window = Window();
+        entry.window.add(timestamp, v);
+    }
+}
+
+void SensorCalibration::updateGyro(Entry& entry, int64_t timestamp, const float* v) {
+    if (!entry.window.add(timestamp, v)) {
+        return;
+    }
+
+    const Window& window = entry.window;
+    // The accelerometer has to have been still during the window too, a steady turn looks
+    // like a still gyroscope.
+    bool still = window.still(kGyroStillVariance) &&
+                 (!mHasAccel || mLastStillNs >= window.startNs);
+    for (int axis = 0; axis < 3 && still; axis++) {
+        still = std::abs(window.mean(axis)) <= kMaxGyroBias;
+    }
+    if (still) {
+        GyroState& gyro = entry.gyro;
+        {
+            std::lock_guard<std::mutex> lock(mStateMutex);
+            for (int axis = 0; axis < 3; axis++) {
+                float mean = window.mean(axis);
+                gyro.bias[axis] += gyro.hasBias ? kGyroBiasBlend * (mean - gyro.bias[axis])
+                                                : mean - gyro.bias[axis];
+            }
+            gyro.hasBias = true;
+            gyro.restWindows++;
+        }
+        estimatesChanged();
+    }
+
+    entry.window = Window();
+    entry.window.add(timestamp, v);
+}
+
+void SensorCalibration::updateMag(Entry& entry, const float* v) {
+    MagState& mag = entry.mag;
+    if (mag.hasLast) {
+        float dx = v[0] - mag.last[0];
+        float dy = v[1] - mag.last[1];
+        float dz = v[2] - mag.last[2];
+        if (dx * dx + dy * dy + dz * dz < kMagMinStepUt * kMagMinStepUt) {
+            return;
+        }
+    }
+    std::copy(v, v + 3, mag.last);
+    mag.hasLast = true;
+
+    double x = v[0] / kMagScaleUt;
+    double y = v[1] / kMagScaleUt;
+    double z = v[2] / kMagScaleUt;
+    // x^T A x + 2 v^T x = 1, with the upper triangle of A and v as unknowns.
+    const double row[9] = {x * x,     y * y,     z * z, 2 * x * y, 2 * x * z,
+                           2 * y * z, 2 * x,     2 * y, 2 * z};
+    for (size_t i = 0; i < 9; i++) {
+        for (size_t j = i; j < 9; j++) {
+            mag.ata[i][j] += row[i] * row[j];
+        }
+        mag.atb[i] += row[i];
+    }
+    mag.count++;
+
+    if (mag.count >= kMagMaxSamples) {
+        for (size_t i = 0; i < 9; i++) {
+            for (size_t j = i; j < 9; j++) {
+                mag.ata[i][j] /= 2;
+            }
+            mag.atb[i] /= 2;
+        }
+        mag.count /= 2;
+    }
+
+    if (++mag.sinceFit >= kMagFitInterval && mag.count >= kMagMinSamples) {
+        mag.sinceFit = 0;
+        if (fitEllipsoid(mag)) {
+            estimatesChanged();
+        } else {
+            mag.rejectedFits++;
+        }
+    }
+}
+
+bool SensorCalibration::fitEllipsoid(MagState& mag) {
+    double ata[9][9];
+    double atb[9];
+    for (size_t i = 0; i < 9; i++) {
+        for (size_t j = 0; j < 9; j++) {
+            ata[i][j] = j >= i ? mag.ata[i][j] : mag.ata[j][i];
+        }
+        atb[i] = mag.atb[i];
+    }
+    double p[9];
+    if (!solveLinear(ata, atb, p)) {
+        return false;
+    }
+
+    // Sum of squared errors of the fit, each sample was to give 1.
+    double error = mag.count;
+    for (size_t i = 0; i < 9; i++) {
+        double ataP = 0;
+        for (size_t j = 0; j < 9; j++) {
+            ataP += (j >= i ? mag.ata[i][j] : mag.ata[j][i]) * p[j];
+        }
+        error += p[i] * ataP - 2 * p[i] * mag.atb[i];
+    }
+
+    double a[3][3] = {{p[0], p[3], p[4]}, {p[3], p[1], p[5]}, {p[4], p[5], p[2]}};
+    double minusV[3] = {-p[6], -p[7], -p[8]};
+    double center[3];
+    double aCopy[3][3];
+    std::copy(&a[0][0], &a[0][0] + 9, &aCopy[0][0]);
+    if (!solveLinear(aCopy, minusV, center)) {
+        return false;
+    }
+
+    // (x - c)^T A (x - c) = k on the ellipsoid. Both A and k are negative when the origin lies
+    // outside of it, as it does with a strong hard iron offset.
+    double k = 1;
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            k += center[i] * a[i][j] * center[j];
+        }
+    }
+    if (std::abs(k) < 1e-9) {
+        return false;
+    }
+    double residual = std::sqrt(std::max(error, 0.0) / mag.count) / std::abs(k);
+
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            a[i][j] /= k;
+        }
+    }
+    double values[3];
+    double vectors[3][3];
+    eigenSymmetric3(a, values, vectors);
+    if (*std::min_element(values, values + 3) <= 0) {
+        return false;
+    }
+
+    double radii[3];
+    for (size_t i = 0; i < 3; i++) {
+        radii[i] = kMagScaleUt / std::sqrt(values[i]);
+    }
+    double fieldUt = std::cbrt(radii[0] * radii[1] * radii[2]);
+    double axisRatio = *std::max_element(radii, radii + 3) / *std::min_element(radii, radii + 3);
+    double centerUt = kMagScaleUt * std::sqrt(center[0] * center[0] + center[1] * center[1] +
+                                              center[2] * center[2]);
+    if (fieldUt < kMinFieldUt || fieldUt > kMaxFieldUt || axisRatio > kMaxAxisRatio ||
+        centerUt > kMaxCenterUt || residual > kMaxFitResidual) {
+        return false;
+    }
+
+    // Map the ellipsoid onto a sphere of its mean radius: fieldUt * sqrt(A / k) / kMagScaleUt.
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    for (size_t i = 0; i < 3; i++) {
+        mag.center[i] = center[i] * kMagScaleUt;
+        for (size_t j = 0; j < 3; j++) {
+            double sum = 0;
+            for (size_t e = 0; e < 3; e++) {
+                sum += vectors[i][e] * std::sqrt(values[e]) * vectors[j][e];
+            }
+            mag.softIron[i][j] = fieldUt * sum / kMagScaleUt;
+        }
+    }
+    mag.fieldUt = fieldUt;
+    mag.residual = residual;
+    mag.hasFit = true;
+    mag.fits++;
+    return true;
+}
+
+void SensorCalibration::estimatesChanged() {
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mDirty = true;
+    }
+    mStateCv.notify_all();
+}
+
+/*
+ * One line per estimate:
+ *   gyro <handle> <bias x> <bias y> <bias z>
+ *   mag <handle> <center x y z> <soft iron row major> <field>
+ *   subhal <handle>
+ */
+std::string SensorCalibration::serializeLocked() const {
+    std::ostringstream stream;
+    stream << std::setprecision(9);
+    stream << "version " << kCalibrationFileVersion << std::endl;
+    for (const auto& [sensorHandle, entry] : mEntries) {
+        if (entry.calibratedBySubHal) {
+            stream << "subhal " << sensorHandle << std::endl;
+        }
+        if (entry.gyro.hasBias) {
+            const float* b = entry.gyro.bias;
+            stream << "gyro " << sensorHandle << " " << b[0] << " " << b[1] << " " << b[2]
+                   << std::endl;
+        }
+        if (entry.mag.hasFit) {
+            const MagState& mag = entry.mag;
+            stream << "mag " << sensorHandle;
+            for (float value : mag.center) {
+                stream << " " << value;
+            }
+            for (const auto& row : mag.softIron) {
+                for (float value : row) {
+                    stream << " " << value;
+                }
+            }
+            stream << " " << mag.fieldUt << std::endl;
+        }
+    }
+    return stream.str();
+}
+
+void SensorCalibration::load() {
+    std::string content;
+    if (!::android::base::ReadFileToString(mCheckpointPath, &content)) {
+        ALOGI("No calibration checkpoint, starting over");
+        return;
+    }
+
+    std::istringstream lines(content);
+    std::string line;
+    int version = 0;
+    while (std::getline(lines, line)) {
+        std::istringstream tokens(line);
+        std::string keyword;
+        int32_t sensorHandle;
+        if (!(tokens >> keyword)) {
+            continue;
+        }
+        if (keyword == "version") {
+            tokens >> version;
+            continue;
+        }
+        if (version != kCalibrationFileVersion || !(tokens >> sensorHandle)) {
+            break;
+        }
+
+        auto iter = mEntries.find(sensorHandle);
+        std::vector<float> values;
+        float value;
+        while (tokens >> value) {
+            if (!std::isfinite(value)) {
+                break;
+            }
+            values.push_back(value);
+        }
+        if (iter == mEntries.end()) {
+            continue;
+        }
+
+        Entry& entry = iter->second;
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        if (keyword == "gyro" && entry.type == SensorType::GYROSCOPE && values.size() == 3) {
+            std::copy(values.begin(), values.end(), entry.gyro.bias);
+            entry.gyro.hasBias = true;
+        } else if (keyword == "mag" && entry.type == SensorType::MAGNETIC_FIELD &&
+                   values.size() == 13) {
+            MagState& mag = entry.mag;
+            std::copy(values.begin(), values.begin() + 3, mag.center);
+            std::copy(values.begin() + 3, values.begin() + 12, &mag.softIron[0][0]);
+            mag.fieldUt = values[12];
+            mag.hasFit = true;
+        } else if (keyword == "subhal" &&
+                   (entry.type == SensorType::GYROSCOPE ||
+                    entry.type == SensorType::MAGNETIC_FIELD) &&
+                   values.empty()) {
+            entry.calibratedBySubHal = true;
+        } else {
+            ALOGW("Ignoring calibration checkpoint line '%s'", line.c_str());
+        }
+    }
+}
+
+void SensorCalibration::checkpointLoop() {
+    std::unique_lock<std::mutex> lock(mStateMutex);
+    while (true) {
+        mStateCv.wait(lock, [this] { return mDirty || mStopped; });
+        if (!mDirty) {
+            return;
+        }
+        mStateCv.wait_for(lock, kCheckpointInterval, [this] { return mStopped; });
+
+        std::string content = serializeLocked();
+        mDirty = false;
+        lock.unlock();
+        bool written = writeFileAtomically(mCheckpointPath, content);
+        if (!written) {
+            ALOGW("Failed to checkpoint the calibration: %s", strerror(errno));
+        }
+        lock.lock();
+        if (written) {
+            mCheckpoints++;
+        }
+    }
+}
+
+void SensorCalibration::dump(std::ostream& stream) const {
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    stream << "  Calibration (" << (mEnabled ? "enabled" : "disabled") << ", " << mCheckpoints
+           << " checkpoints):" << std::endl;
+    for (const auto& [sensorHandle, entry] : mEntries) {
+        if (entry.calibratedBySubHal) {
+            stream << "    " << entry.name << ": calibrated by its subhal" << std::endl;
+        } else if (entry.type == SensorType::GYROSCOPE) {
+            const GyroState& gyro = entry.gyro;
+            stream << "    " << entry.name << ": ";
+            if (gyro.hasBias) {
+                stream << "bias " << gyro.bias[0] << ", " << gyro.bias[1] << ", " << gyro.bias[2]
+                       << " rad/s, ";
+            } else {
+                stream << "no bias, ";
+            }
+            stream << gyro.restWindows << " rest windows" << std::endl;
+        } else if (entry.type == SensorType::MAGNETIC_FIELD) {
+            const MagState& mag = entry.mag;
+            stream << "    " << entry.name << ": ";
+            if (mag.hasFit) {
+                stream << "center " << mag.center[0] << ", " << mag.center[1] << ", "
+                       << mag.center[2] << " uT, field " << mag.fieldUt << " uT, residual "
+                       << mag.residual << ", ";
+            } else {
+                stream << "no fit, ";
+            }
+            stream << mag.fits << " fits, " << mag.rejectedFits << " rejected" << std::endl;
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * Online calibration of the calibrated gyroscope and magnetometer sensors. Gyroscope bias is
+ * the mean rate over windows in which both the gyroscope and the accelerometer were still.
+ * Magnetometer hard and soft iron come from a least squares ellipsoid fit over the normal
+ * equations of the samples, which fade out so the fit follows a changing environment. Both
+ * only keep fixed size sums, never the samples themselves.
+ *
+ * Only raw samples may be corrected, a subhal that calibrates on its own would be corrected
+ * twice. The device declares raw subhal output, and a sensor whose uncalibrated variant reports
+ * a bias of its own is left alone from then on, across reboots too. The uncalibrated variants
+ * get the same correction, so that their samples minus their bias still give the calibrated
+ * samples.
+ *
+ * process() runs on the event path with the event queue write lock of the proxy held. The
+ * estimates are checkpointed to /data/vendor/sensor by a thread of their own, and loaded back
+ * by start() so the corrections apply right after boot.
+ */
+class SensorCalibration {
+  public:
+    //! Calibrate if the device declares raw subhal output, checkpointing to /data/vendor/sensor.
+    SensorCalibration();
+
+    /**
+     * @param rawSubHalOutput Whether the subhals report raw samples, nothing is corrected if not.
+     * @param checkpointPath The file the estimates are checkpointed to.
+     */
+    SensorCalibration(bool rawSubHalOutput, std::string checkpointPath);
+
+    ~SensorCalibration();
+
+    //! Track a sensor if it is calibrated or mirrored here, or needed to detect rest.
+    void addSensor(const SensorInfo& sensor);
+
+    //! Load the last checkpoint and start checkpointing. Called after the sensors were added.
+    void start();
+
+    /**
+     * Update the estimates from events and correct the samples of the calibrated sensors.
+     *
+     * @return true if out holds the corrected events, false if no event needed correcting.
+     */
+    bool process(const std::vector<Event>& events, std::vector<Event>* out);
+
+    void dump(std::ostream& stream) const;
+
+  private:
+    //! Mean and variance of the samples of one sensor over a window of time.
+    struct Window {
+        int64_t startNs = -1;
+        int64_t endNs = -1;
+        size_t count = 0;
+        double sum[3] = {};
+        double sumSq[3] = {};
+
+        //! @return true if the window ended before the sample and has to be evaluated first.
+        bool add(int64_t timestamp, const float* v);
+        bool still(double maxVariance) const;
+        float mean(int axis) const { return sum[axis] / count; }
+    };
+
+    struct GyroState {
+        bool hasBias = false;
+        float bias[3] = {};
+        uint64_t restWindows = 0;
+    };
+
+    struct MagState {
+        //! Normal equations of the quadric fit over samples scaled down by kMagScaleUt.
+        double ata[9][9] = {};
+        double atb[9] = {};
+        double count = 0;
+        size_t sinceFit = 0;
+        bool hasLast = false;
+        float last[3] = {};
+
+        bool hasFit = false;
+        float center[3] = {};
+        float softIron[3][3] = {};
+        float fieldUt = 0;
+        float residual = 0;
+        uint64_t fits = 0;
+        uint64_t rejectedFits = 0;
+    };
+
+    struct Entry {
+        std::string name;
+        SensorType type;
+        bool wakeUp = false;
+        Window window;
+        GyroState gyro;
+        MagState mag;
+
+        //! For an uncalibrated variant, the entry of the calibrated sensor it mirrors.
+        Entry* calibrated = nullptr;
+        //! The subhal turned out to calibrate the sensor itself, the estimates are not applied.
+        bool calibratedBySubHal = false;
+    };
+
+    //! Pair every uncalibrated variant with its calibrated sensor.
+    void linkUncalibrated();
+
+    /**
+     * Correct a sample of a calibrated sensor.
+     *
+     * @return false if there is no correction yet.
+     */
+    static bool correct(const Entry& entry, const float* v, float* c);
+
+    //! Correct an uncalibrated sample the same way as the calibrated one it mirrors.
+    bool correctUncalibrated(Entry& entry, Uncal* uncal);
+
+    void updateAccel(Entry& entry, int64_t timestamp, const float* v);
+    void updateGyro(Entry& entry, int64_t timestamp, const float* v);
+    void updateMag(Entry& entry, const float* v);
+    bool fitEllipsoid(MagState& mag);
+
+    //! Mark the estimates changed, the checkpoint thread writes them out in a while.
+    void estimatesChanged();
+
+    std::string serializeLocked() const;
+    void load();
+    void checkpointLoop();
+
+    const bool mRawSubHalOutput;
+    const std::string mCheckpointPath;
+    bool mEnabled = false;
+
+    //! Tracked sensors by handle. The set is fixed before start().
+    std::map<int32_t, Entry> mEntries;
+
+    //! Whether an accelerometer tells rest, and the end of the last window it was still in.
+    bool mHasAccel = false;
+    int64_t mLastStillNs = -1;
+
+    /**
+     * Guards the corrections and checkpoint state against the checkpoint thread. The event path
+     * only takes it to change the corrections, which happens once per window or fit.
+     */
+    mutable std::mutex mStateMutex;
+    std::condition_variable mStateCv;
+    bool mDirty = false;
+    bool mStopped = false;
+    uint64_t mCheckpoints = 0;
+    std::thread mCheckpointThread;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "SensorStateClient"
+
+#include "SensorStateClient.h"
+
+#include <android-base/unique_fd.h>
+#include <cutils/sockets.h>
+#include <log/log.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace state {
+
+static ::android::base::unique_fd receivePageFd(int socketFd) {
+    char byte;
+    struct iovec iov = {&byte, sizeof(byte)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (TEMP_FAILURE_RETRY(recvmsg(socketFd, &msg, MSG_CMSG_CLOEXEC)) <= 0) {
+        return {};
+    }
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return {};
+    }
+
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+    return ::android::base::unique_fd(fd);
+}
+
+std::unique_ptr<SensorStateClient> SensorStateClient::connect() {
+    ::android::base::unique_fd socketFd(socket_local_client(
+            kSocketName, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_SEQPACKET));
+    if (socketFd.get() < 0) {
+        ALOGE("Failed to connect to %s: %s", kSocketName, strerror(errno));
+        return nullptr;
+    }
+
+    ::android::base::unique_fd pageFd = receivePageFd(socketFd.get());
+    struct stat st;
+    if (pageFd.get() < 0 || fstat(pageFd.get(), &st) != 0 ||
+        st.st_size < static_cast<off_t>(sizeof(Page))) {
+        ALOGE("Did not receive a valid state page");
+        return nullptr;
+    }
+
+    void* page = mmap(nullptr, sizeof(Page), PROT_READ, MAP_SHARED, pageFd.get(), 0);
+    if (page == MAP_FAILED) {
+        ALOGE("Failed to map the state page: %s", strerror(errno));
+        return nullptr;
+    }
+
+    const Page* statePage = static_cast<const Page*>(page);
+    if (statePage->magic != kMagic || statePage->version != kVersion ||
+        statePage->numSlots > kMaxSlots || statePage->historyCapacity != kHistoryCapacity) {
+        ALOGE("Unsupported state page version %u", statePage->version);
+        munmap(page, sizeof(Page));
+        return nullptr;
+    }
+
+    return std::unique_ptr<SensorStateClient>(new SensorStateClient(statePage));
+}
+
+SensorStateClient::~SensorStateClient() {
+    munmap(const_cast<Page*>(mPage), sizeof(Page));
+}
+
+bool SensorStateClient::getLatest(int32_t sensorType, Sample* out) const {
+    int slot = -1;
+    for (uint32_t i = 0; i < mPage->numSlots; i++) {
+        const SlotInfo& info = mPage->slotInfo[i];
+        if (info.sensorType == sensorType && (slot < 0 || !info.wakeUp)) {
+            slot = i;
+            if (!info.wakeUp) {
+                break;
+            }
+        }
+    }
+
+    return slot >= 0 && readRecord(mPage->slots[slot], out);
+}
+
+/*
+ * Walks the history back from the newest entry. Entries of one sensor are in timestamp order,
+ * so the walk ends at the first one of sensorType before startNs, or where the writer has
+ * lapped the reader.
+ */
+size_t SensorStateClient::getHistory(int32_t sensorType, int64_t startNs, int64_t endNs,
+                                     std::vector<Sample>* out) const {
+    size_t first = out->size();
+    uint32_t next = mPage->historyNext.load(std::memory_order_acquire);
+    uint32_t count = std::min<uint32_t>(next, kHistoryCapacity);
+
+    for (uint32_t i = 1; i <= count; i++) {
+        uint32_t position = next - i;
+        uint32_t recordPosition;
+        Sample sample;
+        if (!readRecord(mPage->history[position & (kHistoryCapacity - 1)], &sample,
+                        &recordPosition) ||
+            recordPosition != position) {
+            break;
+        }
+        if (sample.sensorType != sensorType || sample.timestamp > endNs) {
+            continue;
+        }
+        if (sample.timestamp < startNs) {
+            break;
+        }
+        out->push_back(sample);
+    }
+
+    std::reverse(out->begin() + first, out->end());
+    return out->size() - first;
+}
+
+}  // namespace state
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "SensorStatePublisher"
+
+#include "SensorStatePublisher.h"
+
+#include <cutils/sockets.h>
+#include <log/log.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+using state::kHistoryCapacity;
+using state::kMaxSlots;
+using state::Page;
+
+static bool keepsHistory(SensorType type) {
+    switch (type) {
+        case SensorType::ACCELEROMETER:
+        case SensorType::ACCELEROMETER_UNCALIBRATED:
+        case SensorType::GYROSCOPE:
+        case SensorType::GYROSCOPE_UNCALIBRATED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+SensorStatePublisher::SensorStatePublisher() {
+    mFd.reset(memfd_create("sensors-state", MFD_CLOEXEC));
+    if (mFd.get() < 0 || ftruncate(mFd.get(), sizeof(Page)) != 0) {
+        ALOGE("Failed to create the state page: %s", strerror(errno));
+        mFd.reset();
+        return;
+    }
+
+    void* page = mmap(nullptr, sizeof(Page), PROT_READ | PROT_WRITE, MAP_SHARED, mFd.get(), 0);
+    if (page == MAP_FAILED) {
+        ALOGE("Failed to map the state page: %s", strerror(errno));
+        mFd.reset();
+        return;
+    }
+
+    // Clients get an fd opened read only, so they cannot map the page writable.
+    std::string path = "/proc/self/fd/" + std::to_string(mFd.get());
+    mReadOnlyFd.reset(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (mReadOnlyFd.get() < 0) {
+        ALOGE("Failed to reopen the state page read only: %s", strerror(errno));
+        munmap(page, sizeof(Page));
+        mFd.reset();
+        return;
+    }
+
+    // Fresh memfd pages are zeroed, which marks every record as never written.
+    mPage = static_cast<Page*>(page);
+    mPage->magic = state::kMagic;
+    mPage->version = state::kVersion;
+    mPage->historyCapacity = kHistoryCapacity;
+}
+
+SensorStatePublisher::~SensorStatePublisher() {
+    if (mSocketFd.get() >= 0) {
+        shutdown(mSocketFd.get(), SHUT_RDWR);
+    }
+    if (mServerThread.joinable()) {
+        mServerThread.join();
+    }
+    if (mPage != nullptr) {
+        munmap(mPage, sizeof(Page));
+    }
+}
+
+void SensorStatePublisher::addSensor(const SensorInfo& sensor) {
+    if (mPage == nullptr) {
+        return;
+    }
+    if (mPage->numSlots == kMaxSlots) {
+        ALOGW("No state slot left for %s", sensor.name.c_str());
+        return;
+    }
+
+    bool wakeUp = (sensor.flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) != 0;
+    int slot = mPage->numSlots++;
+    mPage->slotInfo[slot] = {sensor.sensorHandle, static_cast<int32_t>(sensor.type), wakeUp};
+    mTargets[sensor.sensorHandle] = {slot, !wakeUp && keepsHistory(sensor.type)};
+}
+
+void SensorStatePublisher::start() {
+    if (mPage == nullptr) {
+        return;
+    }
+
+    mSocketFd.reset(android_get_control_socket(state::kSocketName));
+    if (mSocketFd.get() < 0 || listen(mSocketFd.get(), 4) != 0) {
+        ALOGW("Not publishing sensor state, no %s socket", state::kSocketName);
+        mSocketFd.reset();
+        return;
+    }
+    mServerThread = std::thread(&SensorStatePublisher::serverLoop, this);
+}
+
+void SensorStatePublisher::serverLoop() {
+    while (true) {
+        ::android::base::unique_fd client(
+                TEMP_FAILURE_RETRY(accept4(mSocketFd.get(), nullptr, nullptr, SOCK_CLOEXEC)));
+        if (client.get() < 0) {
+            if (errno == EINVAL) {
+                // The socket was shut down by the destructor.
+                return;
+            }
+            ALOGW("Failed to accept a state client: %s", strerror(errno));
+            continue;
+        }
+
+        char byte = 0;
+        struct iovec iov = {&byte, sizeof(byte)};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        int fd = mReadOnlyFd.get();
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+        if (TEMP_FAILURE_RETRY(sendmsg(client.get(), &msg, MSG_NOSIGNAL)) < 0) {
+            ALOGW("Failed to send the state page: %s", strerror(errno));
+        } else {
+            mClientsServed++;
+        }
+    }
+}
+
+void SensorStatePublisher::publish(const std::vector<Event>& events) {
+    if (mPage == nullptr) {
+        return;
+    }
+
+    uint32_t historyNext = mPage->historyNext.load(std::memory_order_relaxed);
+    for (const Event& event : events) {
+        auto it = mTargets.find(event.sensorHandle);
+        if (it == mTargets.end() || event.sensorType == SensorType::META_DATA ||
+            event.sensorType == SensorType::ADDITIONAL_INFO) {
+            continue;
+        }
+
+        const Target& target = it->second;
+        const float* data = event.u.data.data();
+        state::writeRecord(mPage->slots[target.slot], event.sensorHandle,
+                           static_cast<int32_t>(event.sensorType), 0, event.timestamp, data);
+        if (target.history) {
+            state::writeRecord(mPage->history[historyNext & (kHistoryCapacity - 1)],
+                               event.sensorHandle, static_cast<int32_t>(event.sensorType),
+                               historyNext, event.timestamp, data);
+            historyNext++;
+        }
+    }
+    mPage->historyNext.store(historyNext, std::memory_order_release);
+}
+
+void SensorStatePublisher::dump(std::ostream& stream) const {
+    if (mPage == nullptr) {
+        stream << "  Sensor state: not published" << std::endl;
+        return;
+    }
+    stream << "  Sensor state: " << mPage->numSlots << " slots, "
+           << mPage->historyNext.load(std::memory_order_relaxed) << " history samples, "
+           << mClientsServed << " clients served" << std::endl;
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
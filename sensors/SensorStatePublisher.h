@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "SensorStateLayout.h"
+
+#include <android-base/unique_fd.h>
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <atomic>
+#include <map>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * Writes the latest sample of every sensor and a history of motion samples to a shared page
+ * and hands read only fds of it to whoever connects to the sensors_state init socket.
+ */
+class SensorStatePublisher {
+  public:
+    SensorStatePublisher();
+    ~SensorStatePublisher();
+
+    //! Give a sensor a slot. Only called before start().
+    void addSensor(const SensorInfo& sensor);
+
+    void start();
+
+    //! Called by one thread at a time, the proxy holds its event queue write lock.
+    void publish(const std::vector<Event>& events);
+
+    void dump(std::ostream& stream) const;
+
+  private:
+    struct Target {
+        int slot;
+        bool history;
+    };
+
+    void serverLoop();
+
+    state::Page* mPage = nullptr;
+    ::android::base::unique_fd mFd;
+    ::android::base::unique_fd mReadOnlyFd;
+    ::android::base::unique_fd mSocketFd;
+
+    std::map<int32_t, Target> mTargets;
+
+    std::atomic<uint64_t> mClientsServed = 0;
+    std::thread mServerThread;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
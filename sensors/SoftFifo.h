@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "EventLoopDeadline.h"
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * Software FIFOs HalProxy keeps for the non-wake-up sensors whose subhal has no hardware FIFO.
+ * Times are in nanoseconds on the clock of getTimeNow() and passed in by the caller, deadlines
+ * are absolute and -1 for none like in EventLoopDeadline.h. Not thread safe, HalProxy holds
+ * mEventQueueWriteMutex around every call.
+ */
+
+/**
+ * @return Whether a sensor with these SensorInfo flags and hardware FIFO size gets a software
+ *     FIFO.
+ */
+inline bool needsSoftFifo(uint32_t flags, uint32_t fifoMaxEventCount) {
+    uint32_t reportingMode =
+            flags & static_cast<uint32_t>(V1_0::SensorFlagBits::MASK_REPORTING_MODE);
+    return fifoMaxEventCount == 0 &&
+           (flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) == 0 &&
+           (reportingMode == static_cast<uint32_t>(V1_0::SensorFlagBits::CONTINUOUS_MODE) ||
+            reportingMode == static_cast<uint32_t>(V1_0::SensorFlagBits::ON_CHANGE_MODE));
+}
+
+/**
+ * The events of one sensor, held in a ring allocated up front until the requested report
+ * latency runs out, the ring fills up or the sensor is flushed or disabled.
+ */
+struct SoftFifo {
+    std::vector<V2_1::Event> ring;
+    size_t head = 0;
+    size_t count = 0;
+    int64_t latencyNs = 0;
+    int64_t deadlineNs = -1;
+    uint64_t eventsBatched = 0;
+    uint64_t batchesFlushed = 0;
+
+    //! Append the held events to out, oldest first, and empty the ring.
+    void drain(std::vector<V2_1::Event>* out) {
+        for (size_t i = 0; i < count; i++) {
+            out->push_back(ring[(head + i) % ring.size()]);
+        }
+        head = 0;
+        count = 0;
+        deadlineNs = -1;
+        batchesFlushed++;
+    }
+};
+
+/**
+ * The software FIFOs by sensor handle. The set of sensors is fixed once the sensor list is
+ * built, so the map itself never changes after setup().
+ */
+class SoftFifos {
+  public:
+    /**
+     * Give a sensor a software FIFO of fifoEvents events if it needs one, and advertise the FIFO
+     * in its SensorInfo.
+     *
+     * @return Whether the sensor got a FIFO.
+     */
+    bool setup(SensorInfo* sensor, uint32_t fifoEvents) {
+        if (fifoEvents == 0 || !needsSoftFifo(sensor->flags, sensor->fifoMaxEventCount)) {
+            return false;
+        }
+        mFifos[sensor->sensorHandle].ring.resize(fifoEvents);
+        sensor->fifoReservedEventCount = fifoEvents;
+        sensor->fifoMaxEventCount = fifoEvents;
+        return true;
+    }
+
+    bool empty() const { return mFifos.empty(); }
+    const std::map<int32_t, SoftFifo>& fifos() const { return mFifos; }
+
+    //! Drop every held event, they went with the event queue of the previous client.
+    void reset() {
+        for (auto& [sensorHandle, fifo] : mFifos) {
+            fifo.head = 0;
+            fifo.count = 0;
+            fifo.deadlineNs = -1;
+        }
+    }
+
+    /**
+     * Take over the report latency of a batch() call. The events batched at the old latency are
+     * appended to out first.
+     *
+     * @return The report latency to pass on to the subhal, 0 for a sensor with a software FIFO
+     *     since its subhal has nowhere to hold the events.
+     */
+    int64_t batch(int32_t sensorHandle, int64_t maxReportLatencyNs,
+                  std::vector<V2_1::Event>* out) {
+        auto iter = mFifos.find(sensorHandle);
+        if (iter == mFifos.end()) {
+            return maxReportLatencyNs;
+        }
+        flush(sensorHandle, out);
+        iter->second.latencyNs = std::max(maxReportLatencyNs, INT64_C(0));
+        return 0;
+    }
+
+    /**
+     * Append the held events of a sensor to out. Called before a flush is forwarded to the
+     * subhal, so the flush complete event still arrives after them, and before it is disabled.
+     */
+    void flush(int32_t sensorHandle, std::vector<V2_1::Event>* out) {
+        auto iter = mFifos.find(sensorHandle);
+        if (iter != mFifos.end() && iter->second.count > 0) {
+            iter->second.drain(out);
+        }
+    }
+
+    /**
+     * Hold the events of the sensors with a software FIFO and a report latency, and append the
+     * events that have to be written at now to out, in order. Meta data events write out the
+     * events held for their sensor ahead of them.
+     *
+     * @return Whether an empty FIFO took an event and armed a new deadline.
+     */
+    bool post(const std::vector<V2_1::Event>& events, int64_t now,
+              std::vector<V2_1::Event>* out) {
+        bool rearmed = false;
+        for (const V2_1::Event& event : events) {
+            auto iter = mFifos.find(event.sensorHandle);
+            if (iter == mFifos.end()) {
+                out->push_back(event);
+                continue;
+            }
+            SoftFifo& fifo = iter->second;
+            if (fifo.latencyNs == 0 || event.sensorType == V2_1::SensorType::META_DATA ||
+                event.sensorType == V2_1::SensorType::ADDITIONAL_INFO) {
+                if (fifo.count > 0) {
+                    fifo.drain(out);
+                }
+                out->push_back(event);
+                continue;
+            }
+            if (fifo.count == 0) {
+                fifo.deadlineNs = now + fifo.latencyNs;
+                rearmed = true;
+            }
+            fifo.ring[(fifo.head + fifo.count) % fifo.ring.size()] = event;
+            fifo.count++;
+            fifo.eventsBatched++;
+            if (fifo.count == fifo.ring.size() || fifo.deadlineNs <= now) {
+                fifo.drain(out);
+            }
+        }
+        return rearmed;
+    }
+
+    //! Append the events of every FIFO whose deadline has passed at now to out.
+    void flushDue(int64_t now, std::vector<V2_1::Event>* out) {
+        for (auto& [sensorHandle, fifo] : mFifos) {
+            if (fifo.count > 0 && fifo.deadlineNs <= now) {
+                fifo.drain(out);
+            }
+        }
+    }
+
+    //! @return The earliest deadline among the FIFOs, -1 if none of them holds events.
+    int64_t nextDeadline() const {
+        int64_t deadline = -1;
+        for (const auto& [sensorHandle, fifo] : mFifos) {
+            if (fifo.count > 0) {
+                deadline = earliestDeadline(deadline, fifo.deadlineNs);
+            }
+        }
+        return deadline;
+    }
+
+  private:
+    std::map<int32_t, SoftFifo> mFifos;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "HalProxyCallback.h"
+#include "SubHalRing.h"
+#include "SubHalWrapper.h"
+#include "V2_0/ScopedWakelock.h"
+#include "V2_0/SubHal.h"
+#include "V2_1/SubHal.h"
+
+#include <hardware_legacy/power.h>
+#include <hidl/HidlTransportSupport.h>
+#include <log/log.h>
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::OperationMode;
+using ::android::hardware::sensors::V1_0::Result;
+using ::android::hardware::sensors::V2_0::implementation::getTimeNow;
+using ::android::hardware::sensors::V2_0::implementation::ScopedWakelock;
+
+typedef V2_0::implementation::ISensorsSubHal*(SensorsHalGetSubHalFunc)(uint32_t*);
+typedef V2_1::implementation::ISensorsSubHal*(SensorsHalGetSubHalV2_1Func)(uint32_t*);
+
+static constexpr const char* kHostWakelockName = "SensorsHAL_HOST";
+
+//! The longest the host keeps the device awake waiting for the proxy to pick up wake-up events.
+static constexpr std::chrono::milliseconds kAckTimeout(1000);
+
+/*
+ * Runs one subhal for RemoteSubHal in the sensors service. The subhal posts into the shared
+ * ring instead of the event FMQ, and a wake-up event keeps this process awake until the proxy
+ * has read it and taken its own wakelock.
+ */
+class SubHalHost : public V2_0::implementation::IScopedWakelockRefCounter,
+                   public V2_0::implementation::ISubHalCallback {
+  public:
+    SubHalHost(SubHalRing* ring, std::shared_ptr<ISubHalWrapperBase> subHal)
+        : mRing(ring), mSubHal(subHal) {
+        mSubHal->getSensorsList([&](const auto& list) {
+            for (const SensorInfo& sensor : list) {
+                mSensors[sensor.sensorHandle] = sensor;
+            }
+        });
+        mAckThread = std::thread(&SubHalHost::ackLoop, this);
+    }
+
+    //! Serves the proxy until it closes the control socket.
+    int run(int controlFd) {
+        SubHalHostRequest request;
+
+        while (true) {
+            ssize_t n = TEMP_FAILURE_RETRY(recv(controlFd, &request, sizeof(request), 0));
+            if (n == 0) {
+                return 0;
+            }
+            if (n != static_cast<ssize_t>(sizeof(request))) {
+                ALOGE("Failed to read a request: %s", n < 0 ? strerror(errno) : "short read");
+                return 1;
+            }
+
+            SubHalHostResponse response = {};
+            response.isResponse = 1;
+            response.result = handleRequest(controlFd, request);
+            if (TEMP_FAILURE_RETRY(send(controlFd, &response, sizeof(response), MSG_NOSIGNAL)) <
+                0) {
+                ALOGE("Failed to answer the proxy: %s", strerror(errno));
+                return 1;
+            }
+        }
+    }
+
+    void postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
+                                  ScopedWakelock /* wakelock */) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (writeRingEvents(mRing, events.data(), events.size()) == 0) {
+            return;
+        }
+
+        if (numWakeupEvents > 0) {
+            mAckIndex = mRing->writeIndex.load(std::memory_order_relaxed);
+            mAckPending = true;
+            updateWakelockLocked();
+            mAckCv.notify_one();
+        }
+    }
+
+    const SensorInfo& getSensorInfo(int32_t sensorHandle) override {
+        static const SensorInfo kUnknownSensor = {};
+        auto it = mSensors.find(sensorHandle);
+        return it != mSensors.end() ? it->second : kUnknownSensor;
+    }
+
+    bool areThreadsRunning() override { return true; }
+
+    Return<void> onDynamicSensorsConnected(const hidl_vec<SensorInfo>& /* dynamicSensorsAdded */,
+                                           int32_t /* subHalIndex */) override {
+        ALOGE("Dynamic sensors are not supported in an isolated subhal");
+        return Void();
+    }
+
+    Return<void> onDynamicSensorsDisconnected(
+            const hidl_vec<int32_t>& /* dynamicSensorHandlesRemoved */,
+            int32_t /* subHalIndex */) override {
+        return Void();
+    }
+
+    bool incrementRefCountAndMaybeAcquireWakelock(size_t delta, int64_t* timeoutStart) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mRefCount += delta;
+        updateWakelockLocked();
+        if (timeoutStart != nullptr) {
+            *timeoutStart = getTimeNow();
+        }
+        return true;
+    }
+
+    void decrementRefCountAndMaybeReleaseWakelock(size_t delta,
+                                                  int64_t /* timeoutStart */) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mRefCount -= std::min(mRefCount, delta);
+        updateWakelockLocked();
+    }
+
+  private:
+    Result handleRequest(int controlFd, const SubHalHostRequest& request) {
+        switch (request.op) {
+            case SubHalHostOp::GET_SENSORS_LIST:
+                for (const auto& [sensorHandle, sensor] : mSensors) {
+                    SubHalHostResponse packet = {};
+                    packet.sensor = packSensorInfo(sensor);
+                    if (TEMP_FAILURE_RETRY(send(controlFd, &packet, sizeof(packet),
+                                                MSG_NOSIGNAL)) < 0) {
+                        return Result::INVALID_OPERATION;
+                    }
+                }
+                return Result::OK;
+            case SubHalHostOp::INITIALIZE:
+                return mSubHal->initialize(this, this, 0 /* subHalIndex */);
+            case SubHalHostOp::SET_OPERATION_MODE:
+                return mSubHal->setOperationMode(static_cast<OperationMode>(request.value));
+            case SubHalHostOp::ACTIVATE:
+                return mSubHal->activate(request.sensorHandle, request.value != 0);
+            case SubHalHostOp::BATCH:
+                return mSubHal->batch(request.sensorHandle, request.samplingPeriodNs,
+                                      request.maxReportLatencyNs);
+            case SubHalHostOp::FLUSH:
+                return mSubHal->flush(request.sensorHandle);
+            case SubHalHostOp::INJECT_SENSOR_DATA:
+                return mSubHal->injectSensorData(request.event);
+        }
+        return Result::BAD_VALUE;
+    }
+
+    void updateWakelockLocked() {
+        bool hold = mRefCount > 0 || mAckPending;
+        if (hold == mWakelockHeld) {
+            return;
+        }
+
+        if (hold) {
+            acquire_wake_lock(PARTIAL_WAKE_LOCK, kHostWakelockName);
+        } else {
+            release_wake_lock(kHostWakelockName);
+        }
+        mWakelockHeld = hold;
+    }
+
+    void ackLoop() {
+        std::unique_lock<std::mutex> lock(mLock);
+
+        while (true) {
+            mAckCv.wait(lock, [this] { return mAckPending; });
+            uint32_t target = mAckIndex;
+            lock.unlock();
+
+            auto deadline = std::chrono::steady_clock::now() + kAckTimeout;
+            mRing->writerWaiting.store(1);
+            while (true) {
+                uint32_t readIndex = mRing->readIndex.load();
+                auto now = std::chrono::steady_clock::now();
+                if (static_cast<int32_t>(readIndex - target) >= 0 || now >= deadline) {
+                    break;
+                }
+                futexWait(&mRing->readIndex, readIndex,
+                          std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now)
+                                  .count());
+            }
+            mRing->writerWaiting.store(0);
+
+            lock.lock();
+            if (mAckIndex == target) {
+                mAckPending = false;
+                updateWakelockLocked();
+            }
+        }
+    }
+
+    SubHalRing* mRing;
+    std::shared_ptr<ISubHalWrapperBase> mSubHal;
+
+    //! Filled once before the subhal is initialized, read only afterwards.
+    std::map<int32_t, SensorInfo> mSensors;
+
+    //! Guards the write side of the ring and the wakelock.
+    std::mutex mLock;
+    size_t mRefCount = 0;
+    bool mWakelockHeld = false;
+    bool mAckPending = false;
+    uint32_t mAckIndex = 0;
+    std::condition_variable mAckCv;
+    std::thread mAckThread;
+};
+
+static std::shared_ptr<ISubHalWrapperBase> loadSubHal(const char* libraryPath) {
+    void* handle = dlopen(libraryPath, RTLD_NOW);
+    if (handle == nullptr) {
+        ALOGE("dlopen failed for library: %s", libraryPath);
+        return nullptr;
+    }
+
+    auto getSubHal = reinterpret_cast<SensorsHalGetSubHalFunc*>(
+            dlsym(handle, "sensorsHalGetSubHal"));
+    if (getSubHal != nullptr) {
+        uint32_t version;
+        V2_0::implementation::ISensorsSubHal* subHal = getSubHal(&version);
+        if (version != SUB_HAL_2_0_VERSION) {
+            ALOGE("SubHal version was not 2.0 for library: %s", libraryPath);
+            return nullptr;
+        }
+        return std::make_shared<SubHalWrapperV2_0>(subHal);
+    }
+
+    auto getSubHalV2_1 = reinterpret_cast<SensorsHalGetSubHalV2_1Func*>(
+            dlsym(handle, "sensorsHalGetSubHal_2_1"));
+    if (getSubHalV2_1 == nullptr) {
+        ALOGE("Failed to locate sensorsHalGetSubHal function for library: %s", libraryPath);
+        return nullptr;
+    }
+    uint32_t version;
+    V2_1::implementation::ISensorsSubHal* subHal = getSubHalV2_1(&version);
+    if (version != SUB_HAL_2_1_VERSION) {
+        ALOGE("SubHal version was not 2.1 for library: %s", libraryPath);
+        return nullptr;
+    }
+    return std::make_shared<SubHalWrapperV2_1>(subHal);
+}
+
+static SubHalRing* mapRing(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SubHalRing))) {
+        ALOGE("Invalid event ring");
+        return nullptr;
+    }
+
+    void* ring = mmap(nullptr, sizeof(SubHalRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        ALOGE("Failed to map the event ring: %s", strerror(errno));
+        return nullptr;
+    }
+    return static_cast<SubHalRing*>(ring);
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+using android::hardware::configureRpcThreadpool;
+using android::hardware::sensors::V2_1::implementation::kSubHalHostControlFd;
+using android::hardware::sensors::V2_1::implementation::kSubHalHostRingFd;
+using android::hardware::sensors::V2_1::implementation::loadSubHal;
+using android::hardware::sensors::V2_1::implementation::mapRing;
+using android::hardware::sensors::V2_1::implementation::SubHalHost;
+using android::hardware::sensors::V2_1::implementation::SubHalRing;
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        ALOGE("Usage: %s <subhal library>", argv[0]);
+        return 1;
+    }
+
+    // Subhals may talk to other HALs, give them a binder thread of their own.
+    configureRpcThreadpool(1, false /* callerWillJoin */);
+
+    SubHalRing* ring = mapRing(kSubHalHostRingFd);
+    auto subHal = loadSubHal(argv[1]);
+    if (ring == nullptr || subHal == nullptr) {
+        return 1;
+    }
+
+    android::sp<SubHalHost> host = new SubHalHost(ring, subHal);
+    int status = host->run(kSubHalHostControlFd);
+
+    // The subhal threads are still running, skip the destructors.
+    _exit(status);
+}
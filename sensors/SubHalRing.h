@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/*
+ * Shared between the sensors service and the processes hosting isolated subhals, see
+ * hals.conf. Control calls go over a SOCK_SEQPACKET socket pair, one request and one response
+ * packet per call. Events go the other way through SubHalRing, which lives in a memfd mapped by
+ * both processes, so the data path has no binder or socket in it.
+ */
+
+//! The fds the host process finds its ring and control socket at.
+static constexpr int kSubHalHostRingFd = 3;
+static constexpr int kSubHalHostControlFd = 4;
+
+static constexpr const char* kSubHalHostBinary =
+        "/vendor/bin/hw/android.hardware.sensors@2.1-subhal-host.rosemary";
+
+static_assert(std::is_trivially_copyable<Event>::value, "events are copied through shared memory");
+
+/*
+ * Single producer, single consumer ring of subhal events. The host writes events with the
+ * sensor handles of the subhal, i.e. before the subhal index is set, and the proxy reads them.
+ * Both indices only ever increase and double as shared futex words.
+ */
+struct SubHalRing {
+    static constexpr uint32_t kCapacity = 1024;
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "capacity must be a power of two");
+
+    std::atomic<uint32_t> writeIndex;
+    std::atomic<uint32_t> readIndex;
+
+    //! Set by a side before it sleeps on the other side's index.
+    std::atomic<uint32_t> readerWaiting;
+    std::atomic<uint32_t> writerWaiting;
+
+    //! Events the host dropped because the ring was full.
+    std::atomic<uint64_t> dropped;
+
+    Event events[kCapacity];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "futex words must be lock free");
+
+inline int futexWait(std::atomic<uint32_t>* word, uint32_t expected, int64_t timeoutNs = -1) {
+    struct timespec timeout;
+    if (timeoutNs >= 0) {
+        timeout.tv_sec = timeoutNs / 1000000000;
+        timeout.tv_nsec = timeoutNs % 1000000000;
+    }
+    // Not FUTEX_PRIVATE_FLAG, the word is shared between processes.
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+                   timeoutNs >= 0 ? &timeout : nullptr, nullptr, 0);
+}
+
+inline void futexWake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr,
+            0);
+}
+
+/*
+ * The host's side of the ring. Copies as many events as there is room for, counts the rest as
+ * dropped and wakes up the proxy if it sleeps. Returns the number of events written.
+ */
+inline size_t writeRingEvents(SubHalRing* ring, const Event* events, size_t numEvents) {
+    uint32_t writeIndex = ring->writeIndex.load(std::memory_order_relaxed);
+    uint32_t readIndex = ring->readIndex.load(std::memory_order_acquire);
+    size_t count = std::min<size_t>(SubHalRing::kCapacity - (writeIndex - readIndex), numEvents);
+
+    for (size_t i = 0; i < count; i++) {
+        ring->events[(writeIndex + i) & (SubHalRing::kCapacity - 1)] = events[i];
+    }
+    if (count < numEvents) {
+        ring->dropped.fetch_add(numEvents - count);
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    ring->writeIndex.store(writeIndex + count);
+    if (ring->readerWaiting.load()) {
+        futexWake(&ring->writeIndex);
+    }
+    return count;
+}
+
+/*
+ * The proxy's side of the ring. Sleeps until the write index moves away from readIndex and
+ * returns it. A misbehaving host may have moved it by more than the capacity.
+ */
+inline uint32_t waitForRingEvents(SubHalRing* ring, uint32_t readIndex) {
+    uint32_t writeIndex = ring->writeIndex.load(std::memory_order_acquire);
+    while (writeIndex == readIndex) {
+        ring->readerWaiting.store(1);
+        if (ring->writeIndex.load() == readIndex) {
+            futexWait(&ring->writeIndex, readIndex);
+        }
+        ring->readerWaiting.store(0);
+        writeIndex = ring->writeIndex.load(std::memory_order_acquire);
+    }
+    return writeIndex;
+}
+
+//! Hand the slots up to readIndex back to the host, waking it up if it waits for room.
+inline void releaseRingEvents(SubHalRing* ring, uint32_t readIndex) {
+    ring->readIndex.store(readIndex);
+    if (ring->writerWaiting.load()) {
+        futexWake(&ring->readIndex);
+    }
+}
+
+enum class SubHalHostOp : uint32_t {
+    GET_SENSORS_LIST,
+    INITIALIZE,
+    SET_OPERATION_MODE,
+    ACTIVATE,
+    BATCH,
+    FLUSH,
+    INJECT_SENSOR_DATA,
+};
+
+struct SubHalHostRequest {
+    SubHalHostOp op;
+    int32_t sensorHandle;
+    int32_t value;
+    int64_t samplingPeriodNs;
+    int64_t maxReportLatencyNs;
+    Event event;
+};
+
+//! GET_SENSORS_LIST is answered with one of these per sensor, then a response.
+struct SubHalHostSensor {
+    int32_t sensorHandle;
+    int32_t type;
+    int32_t version;
+    float maxRange;
+    float resolution;
+    float power;
+    int32_t minDelay;
+    uint32_t fifoReservedEventCount;
+    uint32_t fifoMaxEventCount;
+    int32_t maxDelay;
+    uint32_t flags;
+    char name[64];
+    char vendor[64];
+    char typeAsString[64];
+    char requiredPermission[64];
+};
+
+struct SubHalHostResponse {
+    // Zero for a sensor packet that precedes the response.
+    uint32_t isResponse;
+    V1_0::Result result;
+    SubHalHostSensor sensor;
+};
+
+inline void copyString(char (&out)[64], const std::string& in) {
+    strlcpy(out, in.c_str(), sizeof(out));
+}
+
+inline SubHalHostSensor packSensorInfo(const SensorInfo& in) {
+    SubHalHostSensor out = {};
+    out.sensorHandle = in.sensorHandle;
+    out.type = static_cast<int32_t>(in.type);
+    out.version = in.version;
+    out.maxRange = in.maxRange;
+    out.resolution = in.resolution;
+    out.power = in.power;
+    out.minDelay = in.minDelay;
+    out.fifoReservedEventCount = in.fifoReservedEventCount;
+    out.fifoMaxEventCount = in.fifoMaxEventCount;
+    out.maxDelay = in.maxDelay;
+    out.flags = in.flags;
+    copyString(out.name, in.name);
+    copyString(out.vendor, in.vendor);
+    copyString(out.typeAsString, in.typeAsString);
+    copyString(out.requiredPermission, in.requiredPermission);
+    return out;
+}
+
+inline SensorInfo unpackSensorInfo(const SubHalHostSensor& in) {
+    SensorInfo out;
+    out.sensorHandle = in.sensorHandle;
+    out.type = static_cast<SensorType>(in.type);
+    out.version = in.version;
+    out.maxRange = in.maxRange;
+    out.resolution = in.resolution;
+    out.power = in.power;
+    out.minDelay = in.minDelay;
+    out.fifoReservedEventCount = in.fifoReservedEventCount;
+    out.fifoMaxEventCount = in.fifoMaxEventCount;
+    out.maxDelay = in.maxDelay;
+    out.flags = in.flags;
+    out.name = std::string(in.name, strnlen(in.name, sizeof(in.name)));
+    out.vendor = std::string(in.vendor, strnlen(in.vendor, sizeof(in.vendor)));
+    out.typeAsString =
+            std::string(in.typeAsString, strnlen(in.typeAsString, sizeof(in.typeAsString)));
+    out.requiredPermission = std::string(
+            in.requiredPermission, strnlen(in.requiredPermission, sizeof(in.requiredPermission)));
+    return out;
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "SensorStateLayout.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace state {
+
+/*
+ * Read only view of the sensor state the sensors service publishes, for vendor processes that
+ * need the latest sample of a sensor or a window of recent motion samples without going through
+ * the framework. Reads never block the service and may be called from any thread.
+ *
+ * Sensors are looked up by type, the non wake-up sensor of a type is preferred. Only the
+ * accelerometer and gyroscope, calibrated or not, are kept in the history.
+ */
+class SensorStateClient {
+  public:
+    //! @return nullptr if the service does not publish its state.
+    static std::unique_ptr<SensorStateClient> connect();
+
+    ~SensorStateClient();
+
+    //! @return false if the sensor does not exist or has not reported since the service started.
+    bool getLatest(int32_t sensorType, Sample* out) const;
+
+    /**
+     * Append the history samples of sensorType with startNs <= timestamp <= endNs to out, oldest
+     * first.
+     *
+     * @return The number of samples appended.
+     */
+    size_t getHistory(int32_t sensorType, int64_t startNs, int64_t endNs,
+                      std::vector<Sample>* out) const;
+
+  private:
+    explicit SensorStateClient(const Page* page) : mPage(page) {}
+
+    const Page* mPage;
+};
+
+}  // namespace state
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
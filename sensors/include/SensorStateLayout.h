@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace state {
+
+/*
+ * Layout of the page the sensors service publishes the latest sample of every sensor in, see
+ * SensorStateClient.h. Only fixed width 32 bit words are shared, so 32 and 64 bit clients agree
+ * on the layout and every load is a plain one even on a read only mapping.
+ */
+
+//! The init socket handing out read only fds of the page.
+static constexpr const char* kSocketName = "sensors_state";
+
+static constexpr uint32_t kMagic = 0x53535450;  // "SSTP"
+static constexpr uint32_t kVersion = 1;
+
+static constexpr size_t kMaxSlots = 64;
+static constexpr size_t kSlotWords = 16;
+
+//! Accelerometer and gyroscope history, uncalibrated samples need six words.
+static constexpr size_t kHistoryCapacity = 2048;
+static constexpr size_t kHistoryWords = 6;
+
+static_assert((kHistoryCapacity & (kHistoryCapacity - 1)) == 0, "must be a power of two");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "words must be lock free");
+
+/*
+ * One sample behind a seqlock. The writer makes seq odd, stores the fields and makes it even
+ * again, a reader retries until it saw the same even seq on both sides of its copy. A seq of 0
+ * means nothing was written yet.
+ */
+template <size_t N>
+struct Record {
+    std::atomic<uint32_t> seq;
+    std::atomic<int32_t> sensorHandle;
+    std::atomic<int32_t> sensorType;
+    //! Index of a history entry among all entries ever written, unused in slots.
+    std::atomic<uint32_t> position;
+    std::atomic<uint32_t> timestampLow;
+    std::atomic<uint32_t> timestampHigh;
+    std::atomic<uint32_t> data[N];
+};
+
+//! Which sensor a slot belongs to, fixed before the page is handed out.
+struct SlotInfo {
+    int32_t sensorHandle;
+    int32_t sensorType;
+    uint32_t wakeUp;
+};
+
+struct Page {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t historyCapacity;
+
+    SlotInfo slotInfo[kMaxSlots];
+    Record<kSlotWords> slots[kMaxSlots];
+
+    //! Number of history entries ever written, the next one goes to historyNext % capacity.
+    std::atomic<uint32_t> historyNext;
+    Record<kHistoryWords> history[kHistoryCapacity];
+};
+
+struct Sample {
+    int32_t sensorHandle;
+    int32_t sensorType;
+    int64_t timestamp;
+    float data[kSlotWords];
+};
+
+template <size_t N>
+inline void writeRecord(Record<N>& record, int32_t sensorHandle, int32_t sensorType,
+                        uint32_t position, int64_t timestamp, const float* data) {
+    uint32_t seq = record.seq.load(std::memory_order_relaxed);
+    record.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    record.sensorHandle.store(sensorHandle, std::memory_order_relaxed);
+    record.sensorType.store(sensorType, std::memory_order_relaxed);
+    record.position.store(position, std::memory_order_relaxed);
+    record.timestampLow.store(static_cast<uint32_t>(timestamp), std::memory_order_relaxed);
+    record.timestampHigh.store(static_cast<uint32_t>(static_cast<uint64_t>(timestamp) >> 32),
+                               std::memory_order_relaxed);
+    for (size_t i = 0; i < N; i++) {
+        uint32_t word;
+        memcpy(&word, &data[i], sizeof(word));
+        record.data[i].store(word, std::memory_order_relaxed);
+    }
+
+    // Skip 0 on wrap around, it stands for a record that was never written.
+    record.seq.store(seq + 2 == 0 ? 2 : seq + 2, std::memory_order_release);
+}
+
+//! @return false if the record was never written or kept changing under the reader.
+template <size_t N>
+inline bool readRecord(const Record<N>& record, Sample* out, uint32_t* position = nullptr) {
+    static constexpr int kMaxAttempts = 64;
+
+    for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
+        uint32_t seq = record.seq.load(std::memory_order_acquire);
+        if (seq == 0) {
+            return false;
+        }
+        if (seq & 1) {
+            continue;
+        }
+
+        Sample sample = {};
+        sample.sensorHandle = record.sensorHandle.load(std::memory_order_relaxed);
+        sample.sensorType = record.sensorType.load(std::memory_order_relaxed);
+        uint32_t recordPosition = record.position.load(std::memory_order_relaxed);
+        uint64_t low = record.timestampLow.load(std::memory_order_relaxed);
+        uint64_t high = record.timestampHigh.load(std::memory_order_relaxed);
+        sample.timestamp = static_cast<int64_t>(high << 32 | low);
+        for (size_t i = 0; i < N; i++) {
+            uint32_t word = record.data[i].load(std::memory_order_relaxed);
+            memcpy(&sample.data[i], &word, sizeof(word));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.seq.load(std::memory_order_relaxed) == seq) {
+            *out = sample;
+            if (position != nullptr) {
+                *position = recordPosition;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace state
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
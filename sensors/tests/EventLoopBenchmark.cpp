@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "EventLoopDeadline.h"
+
+#include <benchmark/benchmark.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+using ::android::hardware::sensors::V2_1::implementation::earliestDeadline;
+using ::android::hardware::sensors::V2_1::implementation::eventLoopTimeout;
+
+namespace {
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+int64_t threadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+/*
+ * The futex word of an EventFlag, waited on with FUTEX_WAIT_BITSET against an absolute
+ * CLOCK_MONOTONIC time the same way libfmq does. Bits stay set until a wait consumes them.
+ */
+class FlagWord {
+  public:
+    void wake(uint32_t bits) {
+        uint32_t old = mWord.fetch_or(bits);
+        if ((old & bits) != bits) {
+            syscall(SYS_futex, &mWord, FUTEX_WAKE_BITSET, INT_MAX, nullptr, nullptr, bits);
+        }
+    }
+
+    uint32_t wait(uint32_t mask, int64_t timeoutNs) {
+        struct timespec deadline;
+        if (timeoutNs > 0) {
+            int64_t ns = nowNs() + timeoutNs;
+            deadline.tv_sec = ns / 1000000000;
+            deadline.tv_nsec = ns % 1000000000;
+        }
+        while (true) {
+            uint32_t word = mWord.load();
+            if (word & mask) {
+                mWord.fetch_and(~(word & mask));
+                return word & mask;
+            }
+            if (syscall(SYS_futex, &mWord, FUTEX_WAIT_BITSET, word,
+                        timeoutNs > 0 ? &deadline : nullptr, nullptr, mask) < 0 &&
+                errno == ETIMEDOUT) {
+                return 0;
+            }
+        }
+    }
+
+  private:
+    std::atomic<uint32_t> mWord = 0;
+};
+
+constexpr uint32_t kWakeBit = 1u << 31;
+constexpr uint32_t kDataWrittenBit = 1u << 0;
+
+/*
+ * The skeleton of HalProxy::handleEvents: one thread sleeping on the wake lock fmq's flag until
+ * the earliest deadline, here a single software FIFO that batches events for its report latency.
+ */
+class EventLoop {
+  public:
+    explicit EventLoop(int64_t latencyNs) : mLatencyNs(latencyNs) {
+        mThread = std::thread([this] { run(); });
+    }
+
+    ~EventLoop() {
+        mRun = false;
+        mFlag.wake(kWakeBit);
+        mThread.join();
+    }
+
+    /* An event from a subhal, the first one of a batch arms the FIFO deadline */
+    void post() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mBatched++;
+        if (mFifoDeadline < 0) {
+            mFifoDeadline = nowNs() + mLatencyNs;
+            mFlag.wake(kWakeBit);
+        }
+    }
+
+    /* The framework acknowledging a wake-up event */
+    void ackWakeLock() { mFlag.wake(kDataWrittenBit); }
+
+    uint64_t wakeups() const { return mWakeups.load(); }
+    uint64_t flushes() const { return mFlushes.load(); }
+    int64_t cpuNs() const { return mCpuNs.load(); }
+
+  private:
+    void run() {
+        while (mRun) {
+            int64_t deadline = -1;
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                int64_t now = nowNs();
+                if (mFifoDeadline >= 0 && mFifoDeadline <= now) {
+                    mBatched = 0;
+                    mFifoDeadline = -1;
+                    mFlushes++;
+                }
+                deadline = earliestDeadline(deadline, mFifoDeadline);
+            }
+            mFlag.wait(kDataWrittenBit | kWakeBit, eventLoopTimeout(deadline, nowNs()));
+            mWakeups++;
+            mCpuNs = threadCpuNs();
+        }
+    }
+
+    const int64_t mLatencyNs;
+    FlagWord mFlag;
+    std::mutex mLock;
+    int64_t mFifoDeadline = -1;
+    uint64_t mBatched = 0;
+    std::atomic_bool mRun = true;
+    std::atomic<uint64_t> mWakeups = 0;
+    std::atomic<uint64_t> mFlushes = 0;
+    std::atomic<int64_t> mCpuNs = 0;
+    std::thread mThread;
+};
+
+constexpr auto kPeriod = std::chrono::milliseconds(200);
+constexpr int64_t kBatchLatencyNs = 20 * INT64_C(1000000);
+
+void reportLoop(benchmark::State& state, const EventLoop& loop, uint64_t wakeups0,
+                int64_t cpuNs0) {
+    state.counters["wakeups_per_s"] =
+            benchmark::Counter(loop.wakeups() - wakeups0, benchmark::Counter::kIsRate);
+    state.counters["loop_cpu_us_per_s"] = benchmark::Counter(
+            (loop.cpuNs() - cpuNs0) / 1000.0, benchmark::Counter::kIsRate);
+    state.counters["flushes"] = loop.flushes();
+}
+
+/* Nothing enabled, the loop should not wake up at all */
+void BM_EventLoopIdle(benchmark::State& state) {
+    EventLoop loop(kBatchLatencyNs);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    uint64_t wakeups0 = loop.wakeups();
+    int64_t cpuNs0 = loop.cpuNs();
+
+    for (auto _ : state) {
+        std::this_thread::sleep_for(kPeriod);
+    }
+    reportLoop(state, loop, wakeups0, cpuNs0);
+}
+BENCHMARK(BM_EventLoopIdle)->UseRealTime()->Unit(benchmark::kMillisecond)->Iterations(5);
+
+/*
+ * Sensors streaming at the given rate into the batching FIFO, with a wake-up event
+ * acknowledged every 100 samples. The loop wakes for the FIFO deadlines, not per sample.
+ */
+void BM_EventLoopLoad(benchmark::State& state) {
+    EventLoop loop(kBatchLatencyNs);
+    const auto interval = std::chrono::nanoseconds(1000000000 / state.range(0));
+    uint64_t wakeups0 = loop.wakeups();
+    int64_t cpuNs0 = loop.cpuNs();
+
+    for (auto _ : state) {
+        auto end = std::chrono::steady_clock::now() + kPeriod;
+        auto next = std::chrono::steady_clock::now();
+        for (int i = 0; next < end; i++) {
+            loop.post();
+            if (i % 100 == 99) {
+                loop.ackWakeLock();
+            }
+            next += interval;
+            std::this_thread::sleep_until(next);
+        }
+    }
+    reportLoop(state, loop, wakeups0, cpuNs0);
+}
+BENCHMARK(BM_EventLoopLoad)
+        ->Arg(200)
+        ->Arg(1000)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond)
+        ->Iterations(5);
+
+}  // namespace
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "EventLoopDeadline.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+
+using ::android::hardware::sensors::V2_1::implementation::earliestDeadline;
+using ::android::hardware::sensors::V2_1::implementation::eventLoopTimeout;
+using ::android::hardware::sensors::V2_1::implementation::pendingWriteDeadline;
+
+namespace {
+
+constexpr int64_t kSecond = INT64_C(1000000000);
+
+TEST(EventLoopDeadlineTest, NoDeadlineLosesToAnyDeadline) {
+    EXPECT_EQ(-1, earliestDeadline(-1, -1));
+    EXPECT_EQ(5, earliestDeadline(-1, 5));
+    EXPECT_EQ(5, earliestDeadline(5, -1));
+    EXPECT_EQ(0, earliestDeadline(0, -1));
+}
+
+TEST(EventLoopDeadlineTest, EarlierDeadlineWins) {
+    EXPECT_EQ(3, earliestDeadline(3, 7));
+    EXPECT_EQ(3, earliestDeadline(7, 3));
+    EXPECT_EQ(4, earliestDeadline(4, 4));
+}
+
+/* The loop folds in the wakelock, software FIFO, reader wake and pending write deadlines */
+TEST(EventLoopDeadlineTest, FoldIgnoresOrder) {
+    const int64_t deadlines[] = {-1, 40 * kSecond, -1, 12 * kSecond, 30 * kSecond};
+    int64_t forward = -1;
+    for (int64_t deadline : deadlines) {
+        forward = earliestDeadline(forward, deadline);
+    }
+    int64_t backward = -1;
+    for (auto it = std::rbegin(deadlines); it != std::rend(deadlines); ++it) {
+        backward = earliestDeadline(backward, *it);
+    }
+    EXPECT_EQ(12 * kSecond, forward);
+    EXPECT_EQ(forward, backward);
+}
+
+TEST(EventLoopDeadlineTest, PendingWritesOnlyTimeOutWhileWaiting) {
+    EXPECT_EQ(-1, pendingWriteDeadline(-1, 5 * kSecond));
+    EXPECT_EQ(7 * kSecond, pendingWriteDeadline(2 * kSecond, 5 * kSecond));
+    /* Queue full from the very first tick of the clock */
+    EXPECT_EQ(5 * kSecond, pendingWriteDeadline(0, 5 * kSecond));
+}
+
+TEST(EventLoopDeadlineTest, NoDeadlineWaitsForever) {
+    EXPECT_EQ(0, eventLoopTimeout(-1, 0));
+    EXPECT_EQ(0, eventLoopTimeout(-1, 100 * kSecond));
+}
+
+TEST(EventLoopDeadlineTest, TimeoutRunsUntilDeadline) {
+    EXPECT_EQ(kSecond, eventLoopTimeout(3 * kSecond, 2 * kSecond));
+    EXPECT_EQ(1, eventLoopTimeout(2 * kSecond + 1, 2 * kSecond));
+}
+
+/*
+ * A deadline that passed while the loop was busy must not turn into a timeout of 0, EventFlag
+ * would then sleep until the next unrelated wakeup.
+ */
+TEST(EventLoopDeadlineTest, PassedDeadlineNeverWaitsForever) {
+    for (int64_t now : {kSecond, kSecond + 1, 100 * kSecond}) {
+        EXPECT_EQ(1, eventLoopTimeout(kSecond, now)) << "now " << now;
+    }
+    EXPECT_EQ(1, eventLoopTimeout(0, kSecond));
+}
+
+}  // namespace
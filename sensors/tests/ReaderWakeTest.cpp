@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ReaderWake.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V2_1::Event;
+using ::android::hardware::sensors::V2_1::SensorType;
+using ::android::hardware::sensors::V2_1::implementation::hasWakeDelay;
+using ::android::hardware::sensors::V2_1::implementation::readerWakeDeadline;
+using ::android::hardware::sensors::V2_1::implementation::readerWakeDelay;
+using ::android::hardware::sensors::V2_1::implementation::wakeDelayForLatency;
+
+namespace {
+
+constexpr int64_t kMs = INT64_C(1000000);
+constexpr int64_t kMaxWakeDelayNs = 5 * kMs;
+
+constexpr int32_t kAccelHandle = 1;
+constexpr int32_t kGyroHandle = 2;
+constexpr int32_t kMagHandle = 3;
+constexpr int32_t kLightHandle = 4;
+
+Event makeEvent(int32_t sensorHandle, SensorType sensorType) {
+    Event event = {};
+    event.sensorHandle = sensorHandle;
+    event.sensorType = sensorType;
+    return event;
+}
+
+uint32_t flags(SensorFlagBits reportingMode, bool wakeUp = false) {
+    return static_cast<uint32_t>(reportingMode) |
+           (wakeUp ? static_cast<uint32_t>(SensorFlagBits::WAKE_UP) : 0);
+}
+
+TEST(ReaderWakeTest, OnlyContinuousNonWakeUpSensorsWait) {
+    EXPECT_TRUE(hasWakeDelay(flags(SensorFlagBits::CONTINUOUS_MODE)));
+    EXPECT_FALSE(hasWakeDelay(flags(SensorFlagBits::CONTINUOUS_MODE, true)));
+    EXPECT_FALSE(hasWakeDelay(flags(SensorFlagBits::ON_CHANGE_MODE)));
+    EXPECT_FALSE(hasWakeDelay(flags(SensorFlagBits::ONE_SHOT_MODE)));
+    EXPECT_FALSE(hasWakeDelay(flags(SensorFlagBits::SPECIAL_REPORTING_MODE)));
+}
+
+TEST(ReaderWakeTest, DelayIsAQuarterOfTheLatencyUpToTheMax) {
+    EXPECT_EQ(0, wakeDelayForLatency(0, kMaxWakeDelayNs));
+    EXPECT_EQ(0, wakeDelayForLatency(-1, kMaxWakeDelayNs));
+    EXPECT_EQ(2 * kMs, wakeDelayForLatency(8 * kMs, kMaxWakeDelayNs));
+    EXPECT_EQ(kMaxWakeDelayNs, wakeDelayForLatency(20 * kMs, kMaxWakeDelayNs));
+    EXPECT_EQ(kMaxWakeDelayNs, wakeDelayForLatency(INT64_MAX, kMaxWakeDelayNs));
+    EXPECT_EQ(0, wakeDelayForLatency(200 * kMs, 0));
+}
+
+class ReaderWakeDelayTest : public ::testing::Test {
+  protected:
+    std::map<int32_t, int64_t> mWakeDelaysNs = {
+            {kAccelHandle, 5 * kMs},
+            {kGyroHandle, 2 * kMs},
+            {kMagHandle, 5 * kMs},
+    };
+};
+
+TEST_F(ReaderWakeDelayTest, SamplesWaitForTheirSensor) {
+    Event events[] = {makeEvent(kAccelHandle, SensorType::ACCELEROMETER),
+                      makeEvent(kAccelHandle, SensorType::ACCELEROMETER)};
+    EXPECT_EQ(5 * kMs, readerWakeDelay(mWakeDelaysNs, events, 2));
+}
+
+TEST_F(ReaderWakeDelayTest, MixedWriteWaitsForTheShortestDelay) {
+    Event events[] = {makeEvent(kAccelHandle, SensorType::ACCELEROMETER),
+                      makeEvent(kGyroHandle, SensorType::GYROSCOPE),
+                      makeEvent(kMagHandle, SensorType::MAGNETIC_FIELD)};
+    EXPECT_EQ(2 * kMs, readerWakeDelay(mWakeDelaysNs, events, 3));
+}
+
+TEST_F(ReaderWakeDelayTest, OtherEventsWakeAtOnce) {
+    for (const Event& other : {makeEvent(kLightHandle, SensorType::LIGHT),
+                               makeEvent(0, SensorType::META_DATA),
+                               makeEvent(kAccelHandle, SensorType::ADDITIONAL_INFO),
+                               makeEvent(0, SensorType::DYNAMIC_SENSOR_META)}) {
+        Event events[] = {makeEvent(kAccelHandle, SensorType::ACCELEROMETER), other,
+                          makeEvent(kMagHandle, SensorType::MAGNETIC_FIELD)};
+        EXPECT_EQ(0, readerWakeDelay(mWakeDelaysNs, events, 3))
+                << "sensor type " << static_cast<int32_t>(other.sensorType);
+    }
+}
+
+TEST_F(ReaderWakeDelayTest, StreamingSensorWakesAtOnce) {
+    mWakeDelaysNs[kAccelHandle] = 0;
+    Event events[] = {makeEvent(kAccelHandle, SensorType::ACCELEROMETER),
+                      makeEvent(kMagHandle, SensorType::MAGNETIC_FIELD)};
+    EXPECT_EQ(0, readerWakeDelay(mWakeDelaysNs, events, 2));
+}
+
+TEST(ReaderWakeTest, DeadlineIsNeverPushedBack) {
+    EXPECT_EQ(15 * kMs, readerWakeDeadline(-1, 10 * kMs, 5 * kMs));
+    EXPECT_EQ(12 * kMs, readerWakeDeadline(12 * kMs, 10 * kMs, 5 * kMs));
+    EXPECT_EQ(13 * kMs, readerWakeDeadline(15 * kMs, 11 * kMs, 2 * kMs));
+}
+
+/*
+ * Three subhals writing samples with jittered periods, driven through the scheduling of
+ * HalProxy::scheduleReaderWakeLocked and the event loop, which wakes the framework once the
+ * deadline passes. No sample may wait longer than the delay of its sensor, and the writes have
+ * to share wakeups.
+ */
+TEST(ReaderWakeTest, AddedLatencyIsBounded) {
+    struct Stream {
+        int32_t sensorHandle;
+        SensorType sensorType;
+        int64_t periodNs;
+        int64_t maxReportLatencyNs;
+        int64_t nextNs;
+    };
+    std::vector<Stream> streams = {
+            {kAccelHandle, SensorType::ACCELEROMETER, 5 * kMs, 20 * kMs, 0},
+            {kGyroHandle, SensorType::GYROSCOPE, 2500000, 40 * kMs, 300000},
+            {kMagHandle, SensorType::MAGNETIC_FIELD, 10 * kMs, 12 * kMs, 700000},
+    };
+    std::map<int32_t, int64_t> wakeDelaysNs;
+    for (const Stream& stream : streams) {
+        wakeDelaysNs[stream.sensorHandle] =
+                wakeDelayForLatency(stream.maxReportLatencyNs, kMaxWakeDelayNs);
+    }
+
+    struct Waiting {
+        int64_t writtenNs;
+        int32_t sensorHandle;
+    };
+    std::vector<Waiting> waiting;
+    int64_t deadline = -1;
+    int writes = 0;
+    int wakes = 0;
+    auto wake = [&](int64_t now) {
+        for (const Waiting& write : waiting) {
+            ASSERT_LE(now - write.writtenNs, wakeDelaysNs[write.sensorHandle])
+                    << "sample of sensor " << write.sensorHandle << " written at "
+                    << write.writtenNs;
+        }
+        waiting.clear();
+        deadline = -1;
+        wakes++;
+    };
+
+    constexpr int64_t kEndNs = 10000 * kMs;
+    uint32_t jitter = 1;
+    while (true) {
+        auto stream = std::min_element(streams.begin(), streams.end(),
+                                       [](const Stream& a, const Stream& b) {
+                                           return a.nextNs < b.nextNs;
+                                       });
+        int64_t now = stream->nextNs;
+        if (now > kEndNs) {
+            break;
+        }
+        if (deadline >= 0 && deadline <= now) {
+            wake(deadline);
+        }
+
+        Event event = makeEvent(stream->sensorHandle, stream->sensorType);
+        int64_t delayNs = readerWakeDelay(wakeDelaysNs, &event, 1);
+        waiting.push_back({now, stream->sensorHandle});
+        if (delayNs == 0) {
+            wake(now);
+        } else {
+            deadline = readerWakeDeadline(deadline, now, delayNs);
+        }
+        writes++;
+
+        jitter = jitter * 1103515245 + 12345;
+        stream->nextNs += stream->periodNs - stream->periodNs / 10 +
+                          static_cast<int64_t>(jitter) % (stream->periodNs / 5);
+    }
+    if (deadline >= 0) {
+        wake(deadline);
+    }
+
+    EXPECT_GT(writes, 1000);
+    EXPECT_LT(wakes, writes / 3) << wakes << " wakeups for " << writes << " writes";
+}
+
+}  // namespace
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "SensorCalibration.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using ::android::hardware::sensors::V2_1::Event;
+using ::android::hardware::sensors::V2_1::SensorInfo;
+using ::android::hardware::sensors::V2_1::SensorType;
+using ::android::hardware::sensors::V2_1::Uncal;
+using ::android::hardware::sensors::V2_1::implementation::SensorCalibration;
+
+namespace {
+
+constexpr int32_t kAccelHandle = 1;
+constexpr int32_t kGyroHandle = 2;
+constexpr int32_t kMagHandle = 3;
+constexpr int32_t kGyroUncalHandle = 4;
+constexpr int32_t kMagUncalHandle = 5;
+
+constexpr int64_t kPeriodNs = 5000000;
+constexpr int kTraceSeconds = 60;
+
+/* Ground truth of the synthetic traces */
+constexpr float kGyroBias[3] = {0.02f, -0.013f, 0.007f};
+constexpr float kHardIronUt[3] = {35, -20, 60};
+constexpr double kSoftIron[3][3] = {{1.2, 0.1, 0}, {0.1, 0.9, 0.05}, {0, 0.05, 1.0}};
+constexpr double kFieldUt = 45;
+
+SensorInfo makeSensor(int32_t sensorHandle, const std::string& name, SensorType type) {
+    SensorInfo sensor = {};
+    sensor.sensorHandle = sensorHandle;
+    sensor.name = name;
+    sensor.type = type;
+    return sensor;
+}
+
+Event makeEvent(int64_t timestamp, int32_t sensorHandle, SensorType sensorType, const float* v) {
+    Event event = {};
+    event.timestamp = timestamp;
+    event.sensorHandle = sensorHandle;
+    event.sensorType = sensorType;
+    event.u.vec3 = {v[0], v[1], v[2], {}};
+    return event;
+}
+
+Event makeUncalEvent(const Event& event, int32_t sensorHandle, SensorType sensorType) {
+    Event uncal = event;
+    uncal.sensorHandle = sensorHandle;
+    uncal.sensorType = sensorType;
+    uncal.u.uncal = {event.u.vec3.x, event.u.vec3.y, event.u.vec3.z, 0, 0, 0};
+    return uncal;
+}
+
+/*
+ * A phone alternating between lying still and being turned around every five seconds, sampled
+ * at 200 Hz. The gyroscope has a constant bias, the magnetometer sees the field through hard
+ * and soft iron while its direction sweeps over the sphere.
+ */
+class Trace {
+  public:
+    /* The raw samples of the next period */
+    std::vector<Event> next() {
+        mStep++;
+        mTimestamp += kPeriodNs;
+        bool moving = (mStep / 1000) % 2 == 1;
+
+        float accel[3] = {0.01f * mNoise(mRng), 0.01f * mNoise(mRng),
+                          9.81f + 0.01f * mNoise(mRng)};
+        float gyro[3];
+        for (int axis = 0; axis < 3; axis++) {
+            gyro[axis] = kGyroBias[axis] + 0.003f * mNoise(mRng);
+        }
+        if (moving) {
+            accel[0] += 2 * mNoise(mRng);
+            gyro[0] += 0.5f;
+        }
+
+        double field[3];
+        fieldAt(mStep, field);
+        float mag[3];
+        for (int row = 0; row < 3; row++) {
+            mag[row] = kHardIronUt[row] + kSoftIron[row][0] * field[0] +
+                       kSoftIron[row][1] * field[1] + kSoftIron[row][2] * field[2] +
+                       0.3f * mNoise(mRng);
+        }
+
+        return {makeEvent(mTimestamp, kAccelHandle, SensorType::ACCELEROMETER, accel),
+                makeEvent(mTimestamp, kGyroHandle, SensorType::GYROSCOPE, gyro),
+                makeEvent(mTimestamp, kMagHandle, SensorType::MAGNETIC_FIELD, mag)};
+    }
+
+    /* A raw magnetometer sample of a field in the direction of the given step */
+    Event magSample(int step) {
+        double field[3];
+        fieldAt(step, field);
+        float mag[3];
+        for (int row = 0; row < 3; row++) {
+            mag[row] = kHardIronUt[row] + kSoftIron[row][0] * field[0] +
+                       kSoftIron[row][1] * field[1] + kSoftIron[row][2] * field[2];
+        }
+        return makeEvent(mTimestamp, kMagHandle, SensorType::MAGNETIC_FIELD, mag);
+    }
+
+    int64_t timestamp() const { return mTimestamp; }
+
+  private:
+    static void fieldAt(int step, double* field) {
+        double theta = step * 0.013;
+        double phi = step * 0.0071;
+        field[0] = kFieldUt * std::sin(theta) * std::cos(phi);
+        field[1] = kFieldUt * std::sin(theta) * std::sin(phi);
+        field[2] = kFieldUt * std::cos(theta);
+    }
+
+    std::mt19937 mRng{1};
+    std::normal_distribution<float> mNoise{0, 1};
+    int mStep = 0;
+    int64_t mTimestamp = 0;
+};
+
+class SensorCalibrationTest : public ::testing::Test {
+  protected:
+    void SetUp() override { mCalibration = makeCalibration(true); }
+
+    std::unique_ptr<SensorCalibration> makeCalibration(bool rawSubHalOutput) {
+        auto calibration = std::make_unique<SensorCalibration>(
+                rawSubHalOutput, std::string(mCheckpointDir.path) + "/proxy_calibration");
+        calibration->addSensor(makeSensor(kAccelHandle, "accel", SensorType::ACCELEROMETER));
+        calibration->addSensor(makeSensor(kGyroHandle, "gyro", SensorType::GYROSCOPE));
+        calibration->addSensor(makeSensor(kMagHandle, "mag", SensorType::MAGNETIC_FIELD));
+        calibration->addSensor(makeSensor(kGyroUncalHandle, "gyro uncal",
+                                          SensorType::GYROSCOPE_UNCALIBRATED));
+        calibration->addSensor(makeSensor(kMagUncalHandle, "mag uncal",
+                                          SensorType::MAGNETIC_FIELD_UNCALIBRATED));
+        calibration->start();
+        return calibration;
+    }
+
+    /* Run the trace through the calibration for a while */
+    void replay(int seconds) {
+        std::vector<Event> out;
+        for (int i = 0; i < seconds * 200; i++) {
+            mCalibration->process(mTrace.next(), &out);
+        }
+    }
+
+    /* The samples of a still phone, and what the calibration made of them */
+    std::vector<Event> stillSamples(std::vector<Event>* out) {
+        const float still[3] = {kGyroBias[0], kGyroBias[1], kGyroBias[2]};
+        Event gyro = makeEvent(mTrace.timestamp(), kGyroHandle, SensorType::GYROSCOPE, still);
+        Event mag = mTrace.magSample(0);
+        std::vector<Event> events = {
+                gyro, makeUncalEvent(gyro, kGyroUncalHandle, SensorType::GYROSCOPE_UNCALIBRATED),
+                mag, makeUncalEvent(mag, kMagUncalHandle, SensorType::MAGNETIC_FIELD_UNCALIBRATED)};
+        if (!mCalibration->process(events, out)) {
+            *out = events;
+        }
+        return events;
+    }
+
+    TemporaryDir mCheckpointDir;
+    Trace mTrace;
+    std::unique_ptr<SensorCalibration> mCalibration;
+};
+
+TEST_F(SensorCalibrationTest, GyroBiasIsRemoved) {
+    replay(kTraceSeconds);
+
+    std::vector<Event> out;
+    stillSamples(&out);
+    EXPECT_NEAR(0, out[0].u.vec3.x, 1e-3);
+    EXPECT_NEAR(0, out[0].u.vec3.y, 1e-3);
+    EXPECT_NEAR(0, out[0].u.vec3.z, 1e-3);
+}
+
+TEST_F(SensorCalibrationTest, MagnetometerIsMappedOntoASphere) {
+    replay(kTraceSeconds);
+
+    double minUt = INFINITY;
+    double maxUt = 0;
+    for (int step = 0; step < 1000; step += 7) {
+        std::vector<Event> events = {mTrace.magSample(step)};
+        std::vector<Event> out;
+        ASSERT_TRUE(mCalibration->process(events, &out)) << "no fit";
+        const auto& v = out[0].u.vec3;
+        double fieldUt = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+        minUt = std::min(minUt, fieldUt);
+        maxUt = std::max(maxUt, fieldUt);
+    }
+    /* The raw samples range from about 0.9 to 1.2 times the field around the hard iron */
+    EXPECT_LT(maxUt / minUt, 1.03) << minUt << " to " << maxUt << " uT";
+    EXPECT_NEAR(kFieldUt, (minUt + maxUt) / 2, 0.1 * kFieldUt);
+}
+
+/* What CTS Verifier checks of the uncalibrated sensors */
+TEST_F(SensorCalibrationTest, UncalibratedMinusBiasIsCalibrated) {
+    replay(kTraceSeconds);
+
+    std::vector<Event> out;
+    std::vector<Event> events = stillSamples(&out);
+    for (int i : {1, 3}) {
+        const auto& calibrated = out[i - 1].u.vec3;
+        const Uncal& uncal = out[i].u.uncal;
+        EXPECT_NEAR(calibrated.x, uncal.x - uncal.x_bias, 1e-4) << "sensor " << i;
+        EXPECT_NEAR(calibrated.y, uncal.y - uncal.y_bias, 1e-4) << "sensor " << i;
+        EXPECT_NEAR(calibrated.z, uncal.z - uncal.z_bias, 1e-4) << "sensor " << i;
+    }
+
+    /* The gyroscope keeps its uncalibrated rate and reports the bias that was removed */
+    const Uncal& gyro = out[1].u.uncal;
+    EXPECT_EQ(events[1].u.uncal.x, gyro.x);
+    EXPECT_NEAR(kGyroBias[0], gyro.x_bias, 1e-3);
+    EXPECT_NEAR(kGyroBias[1], gyro.y_bias, 1e-3);
+    EXPECT_NEAR(kGyroBias[2], gyro.z_bias, 1e-3);
+}
+
+TEST_F(SensorCalibrationTest, NothingIsCorrectedUnlessSubHalOutputIsRaw) {
+    mCalibration = makeCalibration(false);
+    std::vector<Event> out;
+    for (int i = 0; i < kTraceSeconds * 200; i++) {
+        ASSERT_FALSE(mCalibration->process(mTrace.next(), &out));
+    }
+}
+
+TEST_F(SensorCalibrationTest, SubHalBiasStopsTheCorrection) {
+    replay(kTraceSeconds);
+
+    const float rate[3] = {0.1f, 0.2f, 0.3f};
+    Event gyro = makeEvent(mTrace.timestamp(), kGyroHandle, SensorType::GYROSCOPE, rate);
+    Event uncal = makeUncalEvent(gyro, kGyroUncalHandle, SensorType::GYROSCOPE_UNCALIBRATED);
+    uncal.u.uncal.y_bias = 0.01f;
+
+    std::vector<Event> out;
+    EXPECT_FALSE(mCalibration->process({uncal}, &out));
+    EXPECT_FALSE(mCalibration->process({gyro, uncal}, &out));
+
+    /* The magnetometer still gets corrected */
+    EXPECT_TRUE(mCalibration->process({mTrace.magSample(0)}, &out));
+}
+
+/* A sensor its subhal calibrates is not corrected after a reboot, even before the check runs */
+TEST_F(SensorCalibrationTest, CheckpointRemembersSubHalCalibration) {
+    replay(kTraceSeconds);
+    const float rate[3] = {0.1f, 0.2f, 0.3f};
+    Event gyro = makeEvent(mTrace.timestamp(), kGyroHandle, SensorType::GYROSCOPE, rate);
+    Event uncal = makeUncalEvent(gyro, kGyroUncalHandle, SensorType::GYROSCOPE_UNCALIBRATED);
+    uncal.u.uncal.y_bias = 0.01f;
+    std::vector<Event> out;
+    mCalibration->process({uncal}, &out);
+
+    mCalibration.reset();
+    mCalibration = makeCalibration(true);
+
+    EXPECT_FALSE(mCalibration->process({gyro}, &out)) << "the loaded bias was applied";
+    EXPECT_TRUE(mCalibration->process({mTrace.magSample(0)}, &out));
+}
+
+/* The estimates of one boot apply from the first sample of the next */
+TEST_F(SensorCalibrationTest, CheckpointRestoresTheCorrections) {
+    replay(kTraceSeconds);
+    std::vector<Event> before;
+    stillSamples(&before);
+
+    /* Stopping writes out the checkpoint */
+    mCalibration.reset();
+    mCalibration = makeCalibration(true);
+
+    std::vector<Event> after;
+    stillSamples(&after);
+    for (size_t i = 0; i < before.size(); i++) {
+        size_t values = i % 2 == 0 ? 3 : 6;
+        for (size_t k = 0; k < values; k++) {
+            EXPECT_NEAR(before[i].u.data[k], after[i].u.data[k], 1e-5)
+                    << "sensor " << i << ", value " << k;
+        }
+    }
+}
+
+}  // namespace
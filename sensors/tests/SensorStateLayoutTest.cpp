@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "SensorStateLayout.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using ::android::hardware::sensors::state::kHistoryWords;
+using ::android::hardware::sensors::state::kSlotWords;
+using ::android::hardware::sensors::state::readRecord;
+using ::android::hardware::sensors::state::Record;
+using ::android::hardware::sensors::state::Sample;
+using ::android::hardware::sensors::state::writeRecord;
+
+namespace {
+
+constexpr auto kStressDuration = std::chrono::milliseconds(300);
+constexpr int kReaders = 4;
+
+/*
+ * Every field of the n-th write is derived from n, so a sample mixing two writes shows up as
+ * fields that disagree. The timestamp puts n in both halves to catch a torn 64 bit value.
+ */
+template <size_t N>
+void writeNth(Record<N>& record, uint32_t n) {
+    float data[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = static_cast<float>((n + i) & 0xffffff);
+    }
+    int64_t timestamp = static_cast<int64_t>(static_cast<uint64_t>(n) << 32 | n);
+    writeRecord(record, static_cast<int32_t>(n), static_cast<int32_t>(n ^ 0x5a5a5a5a), n,
+                timestamp, data);
+}
+
+template <size_t N>
+::testing::AssertionResult isConsistent(const Sample& sample, uint32_t position) {
+    uint32_t n = position;
+    if (sample.sensorHandle != static_cast<int32_t>(n) ||
+        sample.sensorType != static_cast<int32_t>(n ^ 0x5a5a5a5a) ||
+        sample.timestamp != static_cast<int64_t>(static_cast<uint64_t>(n) << 32 | n)) {
+        return ::testing::AssertionFailure()
+               << "torn header of write " << n << ": handle " << sample.sensorHandle
+               << ", timestamp " << sample.timestamp;
+    }
+    for (size_t i = 0; i < N; i++) {
+        if (sample.data[i] != static_cast<float>((n + i) & 0xffffff)) {
+            return ::testing::AssertionFailure()
+                   << "torn data[" << i << "] of write " << n << ": " << sample.data[i];
+        }
+    }
+    return ::testing::AssertionSuccess();
+}
+
+template <typename T>
+class SensorStateLayoutTest : public ::testing::Test {
+  protected:
+    /* Value initialized like a fresh memfd page */
+    std::unique_ptr<T> mRecord = std::make_unique<T>();
+};
+
+using RecordTypes = ::testing::Types<Record<kSlotWords>, Record<kHistoryWords>>;
+TYPED_TEST_SUITE(SensorStateLayoutTest, RecordTypes);
+
+template <typename T>
+constexpr size_t wordsOf() {
+    return sizeof(T{}.data) / sizeof(T{}.data[0]);
+}
+
+TYPED_TEST(SensorStateLayoutTest, NeverWrittenRecordIsNotRead) {
+    Sample sample;
+    EXPECT_FALSE(readRecord(*this->mRecord, &sample));
+}
+
+TYPED_TEST(SensorStateLayoutTest, WriteIsReadBack) {
+    constexpr size_t N = wordsOf<TypeParam>();
+    Sample sample;
+    uint32_t position = 0;
+
+    writeNth(*this->mRecord, 7);
+    ASSERT_TRUE(readRecord(*this->mRecord, &sample, &position));
+    EXPECT_EQ(7u, position);
+    EXPECT_TRUE(isConsistent<N>(sample, position));
+
+    writeNth(*this->mRecord, 0xfffffff0);
+    ASSERT_TRUE(readRecord(*this->mRecord, &sample, &position));
+    EXPECT_TRUE(isConsistent<N>(sample, position));
+}
+
+TYPED_TEST(SensorStateLayoutTest, RecordBeingWrittenIsNotRead) {
+    writeNth(*this->mRecord, 1);
+    this->mRecord->seq.fetch_add(1);
+
+    Sample sample;
+    EXPECT_FALSE(readRecord(*this->mRecord, &sample));
+}
+
+TYPED_TEST(SensorStateLayoutTest, SequenceSkipsZeroOnWrap) {
+    this->mRecord->seq.store(UINT32_MAX - 1);
+    writeNth(*this->mRecord, 1);
+
+    EXPECT_EQ(2u, this->mRecord->seq.load());
+    Sample sample;
+    EXPECT_TRUE(readRecord(*this->mRecord, &sample));
+}
+
+/*
+ * One writer rewriting the record as fast as it can while several readers copy it. Every copy
+ * a reader accepts must come from a single write, and later copies from later writes.
+ */
+TYPED_TEST(SensorStateLayoutTest, ConcurrentReadsAreNeverTorn) {
+    constexpr size_t N = wordsOf<TypeParam>();
+    TypeParam& record = *this->mRecord;
+    std::atomic_bool run = true;
+    std::atomic<uint64_t> reads = 0;
+    std::atomic<uint64_t> retries = 0;
+
+    std::thread writer([&] {
+        for (uint32_t n = 1; run.load(std::memory_order_relaxed); n++) {
+            writeNth(record, n);
+        }
+    });
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < kReaders; r++) {
+        readers.emplace_back([&] {
+            uint32_t lastPosition = 0;
+            while (run.load(std::memory_order_relaxed)) {
+                Sample sample;
+                uint32_t position;
+                if (!readRecord(record, &sample, &position)) {
+                    retries++;
+                    continue;
+                }
+                ASSERT_TRUE(isConsistent<N>(sample, position));
+                ASSERT_GE(position, lastPosition);
+                lastPosition = position;
+                reads++;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(kStressDuration);
+    run = false;
+    writer.join();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    EXPECT_GT(reads.load(), 0u) << retries.load() << " reads gave up";
+}
+
+}  // namespace
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "SoftFifo.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V2_1::Event;
+using ::android::hardware::sensors::V2_1::SensorInfo;
+using ::android::hardware::sensors::V2_1::SensorType;
+using ::android::hardware::sensors::V2_1::implementation::needsSoftFifo;
+using ::android::hardware::sensors::V2_1::implementation::SoftFifos;
+
+namespace {
+
+constexpr int64_t kMs = INT64_C(1000000);
+constexpr uint32_t kFifoEvents = 4;
+
+constexpr int32_t kAccelHandle = 1;
+constexpr int32_t kLightHandle = 2;
+constexpr int32_t kProxHandle = 3;
+
+Event makeEvent(int32_t sensorHandle, SensorType sensorType, int64_t timestamp = 0) {
+    Event event = {};
+    event.timestamp = timestamp;
+    event.sensorHandle = sensorHandle;
+    event.sensorType = sensorType;
+    return event;
+}
+
+SensorInfo makeSensor(int32_t sensorHandle, uint32_t flags, uint32_t fifoMaxEventCount = 0) {
+    SensorInfo sensor = {};
+    sensor.sensorHandle = sensorHandle;
+    sensor.flags = flags;
+    sensor.fifoMaxEventCount = fifoMaxEventCount;
+    return sensor;
+}
+
+uint32_t flags(SensorFlagBits reportingMode, bool wakeUp = false) {
+    return static_cast<uint32_t>(reportingMode) |
+           (wakeUp ? static_cast<uint32_t>(SensorFlagBits::WAKE_UP) : 0);
+}
+
+/*
+ * A subhal without hardware FIFOs. It records the latency it is batched with and answers a
+ * flush with a flush complete event through the proxy, the way a real subhal calls back.
+ */
+class FakeSubHal {
+  public:
+    explicit FakeSubHal(std::function<void(const std::vector<Event>&)> postEvents)
+        : mPostEvents(std::move(postEvents)) {}
+
+    void batch(int32_t, int64_t maxReportLatencyNs) { latencyNs = maxReportLatencyNs; }
+    void flush(int32_t sensorHandle) {
+        mPostEvents({makeEvent(sensorHandle, SensorType::META_DATA)});
+    }
+    void activate(int32_t, bool enabled) { active = enabled; }
+
+    int64_t latencyNs = -1;
+    bool active = false;
+
+  private:
+    std::function<void(const std::vector<Event>&)> mPostEvents;
+};
+
+/*
+ * The calls HalProxy makes into its software FIFOs, on a simulated clock. Whatever HalProxy
+ * would write to the event fmq ends up in written.
+ */
+class SoftFifoTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        SensorInfo accel = makeSensor(kAccelHandle, flags(SensorFlagBits::CONTINUOUS_MODE));
+        SensorInfo light = makeSensor(kLightHandle, flags(SensorFlagBits::ON_CHANGE_MODE));
+        SensorInfo prox = makeSensor(kProxHandle, flags(SensorFlagBits::ON_CHANGE_MODE, true));
+        ASSERT_TRUE(mFifos.setup(&accel, kFifoEvents));
+        ASSERT_TRUE(mFifos.setup(&light, kFifoEvents));
+        ASSERT_FALSE(mFifos.setup(&prox, kFifoEvents));
+        EXPECT_EQ(kFifoEvents, accel.fifoMaxEventCount);
+        EXPECT_EQ(kFifoEvents, accel.fifoReservedEventCount);
+    }
+
+    void batch(int32_t sensorHandle, int64_t maxReportLatencyNs) {
+        std::vector<Event> events;
+        int64_t latencyNs = mFifos.batch(sensorHandle, maxReportLatencyNs, &events);
+        write(events);
+        mSubHal.batch(sensorHandle, latencyNs);
+    }
+
+    void flush(int32_t sensorHandle) {
+        std::vector<Event> events;
+        mFifos.flush(sensorHandle, &events);
+        write(events);
+        mSubHal.flush(sensorHandle);
+    }
+
+    void disable(int32_t sensorHandle) {
+        std::vector<Event> events;
+        mFifos.flush(sensorHandle, &events);
+        write(events);
+        mSubHal.activate(sensorHandle, false);
+    }
+
+    //! postEventsToMessageQueue
+    void post(const std::vector<Event>& events) {
+        std::vector<Event> eventsNow;
+        rearmed |= mFifos.post(events, now, &eventsNow);
+        write(eventsNow);
+    }
+
+    //! One pass of the event loop at now. @return The deadline the loop sleeps until.
+    int64_t runEventLoop() {
+        std::vector<Event> events;
+        mFifos.flushDue(now, &events);
+        write(events);
+        return mFifos.nextDeadline();
+    }
+
+    //! One sample of a sensor at now.
+    void sample(int32_t sensorHandle, SensorType sensorType) {
+        post({makeEvent(sensorHandle, sensorType, now)});
+    }
+
+    void write(const std::vector<Event>& events) {
+        written.insert(written.end(), events.begin(), events.end());
+    }
+
+    int64_t now = 1000 * kMs;
+    bool rearmed = false;
+    std::vector<Event> written;
+    SoftFifos mFifos;
+    FakeSubHal mSubHal{[this](const std::vector<Event>& events) { post(events); }};
+};
+
+TEST(SoftFifoEligibilityTest, OnlyNonWakeUpSensorsWithoutAFifo) {
+    EXPECT_TRUE(needsSoftFifo(flags(SensorFlagBits::CONTINUOUS_MODE), 0));
+    EXPECT_TRUE(needsSoftFifo(flags(SensorFlagBits::ON_CHANGE_MODE), 0));
+    EXPECT_FALSE(needsSoftFifo(flags(SensorFlagBits::CONTINUOUS_MODE), 100));
+    EXPECT_FALSE(needsSoftFifo(flags(SensorFlagBits::CONTINUOUS_MODE, true), 0));
+    EXPECT_FALSE(needsSoftFifo(flags(SensorFlagBits::ONE_SHOT_MODE), 0));
+    EXPECT_FALSE(needsSoftFifo(flags(SensorFlagBits::SPECIAL_REPORTING_MODE), 0));
+}
+
+TEST(SoftFifoEligibilityTest, ZeroEventsTurnsTheFeatureOff) {
+    SoftFifos fifos;
+    SensorInfo accel = makeSensor(kAccelHandle, flags(SensorFlagBits::CONTINUOUS_MODE));
+    EXPECT_FALSE(fifos.setup(&accel, 0));
+    EXPECT_TRUE(fifos.empty());
+    EXPECT_EQ(0u, accel.fifoMaxEventCount);
+}
+
+TEST_F(SoftFifoTest, SubHalIsBatchedWithoutLatency) {
+    batch(kAccelHandle, 100 * kMs);
+    EXPECT_EQ(0, mSubHal.latencyNs);
+
+    batch(kProxHandle, 100 * kMs);
+    EXPECT_EQ(100 * kMs, mSubHal.latencyNs) << "sensors without a software FIFO keep theirs";
+}
+
+TEST_F(SoftFifoTest, EventsPassStraightThroughWithoutLatency) {
+    batch(kAccelHandle, 0);
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+    EXPECT_EQ(1u, written.size());
+    EXPECT_FALSE(rearmed);
+    EXPECT_EQ(-1, runEventLoop());
+}
+
+TEST_F(SoftFifoTest, EventsAreHeldUntilTheLatencyExpires) {
+    batch(kAccelHandle, 100 * kMs);
+    int64_t start = now;
+    for (int i = 0; i < 3; i++) {
+        sample(kAccelHandle, SensorType::ACCELEROMETER);
+        now += 20 * kMs;
+    }
+    EXPECT_TRUE(written.empty());
+    EXPECT_TRUE(rearmed) << "the event loop has to pick up the new deadline";
+
+    /* The deadline runs from the first event held, not the last */
+    EXPECT_EQ(start + 100 * kMs, runEventLoop());
+    now = start + 100 * kMs - 1;
+    runEventLoop();
+    EXPECT_TRUE(written.empty());
+
+    now = start + 100 * kMs;
+    EXPECT_EQ(-1, runEventLoop());
+    ASSERT_EQ(3u, written.size());
+    for (size_t i = 0; i < written.size(); i++) {
+        EXPECT_EQ(start + static_cast<int64_t>(i) * 20 * kMs, written[i].timestamp);
+    }
+}
+
+TEST_F(SoftFifoTest, LateEventGoesOutWithItsBatch) {
+    batch(kAccelHandle, 100 * kMs);
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+
+    /* The event loop overslept, the next event already finds the deadline passed */
+    now += 150 * kMs;
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+    EXPECT_EQ(2u, written.size());
+    EXPECT_EQ(-1, runEventLoop());
+}
+
+TEST_F(SoftFifoTest, FullRingIsWrittenAtOnce) {
+    batch(kAccelHandle, 10000 * kMs);
+    for (uint32_t i = 0; i < kFifoEvents - 1; i++) {
+        sample(kAccelHandle, SensorType::ACCELEROMETER);
+        now += kMs;
+    }
+    EXPECT_TRUE(written.empty());
+
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+    EXPECT_EQ(kFifoEvents, written.size());
+    EXPECT_EQ(-1, runEventLoop());
+
+    /* The ring starts over after a drain */
+    written.clear();
+    rearmed = false;
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+    EXPECT_TRUE(written.empty());
+    EXPECT_TRUE(rearmed);
+    EXPECT_EQ(1u, mFifos.fifos().at(kAccelHandle).count);
+}
+
+TEST_F(SoftFifoTest, FlushCompleteArrivesLast) {
+    batch(kAccelHandle, 100 * kMs);
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+    now += kMs;
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+
+    flush(kAccelHandle);
+    ASSERT_EQ(3u, written.size());
+    EXPECT_EQ(SensorType::ACCELEROMETER, written[0].sensorType);
+    EXPECT_EQ(SensorType::ACCELEROMETER, written[1].sensorType);
+    EXPECT_EQ(SensorType::META_DATA, written[2].sensorType);
+    EXPECT_EQ(-1, runEventLoop());
+}
+
+/* A meta event that did not come through flush() still writes the batch ahead of it */
+TEST_F(SoftFifoTest, MetaEventWritesTheBatchFirst) {
+    batch(kAccelHandle, 100 * kMs);
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+    sample(kLightHandle, SensorType::LIGHT);
+
+    ASSERT_EQ(1u, written.size()) << "the light sensor was never batched";
+    EXPECT_EQ(SensorType::LIGHT, written[0].sensorType);
+
+    post({makeEvent(kAccelHandle, SensorType::META_DATA)});
+    ASSERT_EQ(3u, written.size());
+    EXPECT_EQ(SensorType::ACCELEROMETER, written[1].sensorType);
+    EXPECT_EQ(SensorType::META_DATA, written[2].sensorType);
+    EXPECT_EQ(-1, mFifos.nextDeadline());
+}
+
+TEST_F(SoftFifoTest, DisableWritesTheBatch) {
+    batch(kAccelHandle, 100 * kMs);
+    mSubHal.activate(kAccelHandle, true);
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+
+    disable(kAccelHandle);
+    EXPECT_EQ(1u, written.size());
+    EXPECT_FALSE(mSubHal.active);
+    EXPECT_EQ(-1, runEventLoop());
+}
+
+TEST_F(SoftFifoTest, RebatchWritesEventsHeldAtTheOldLatency) {
+    batch(kAccelHandle, 100 * kMs);
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+
+    batch(kAccelHandle, 0);
+    EXPECT_EQ(1u, written.size());
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+    EXPECT_EQ(2u, written.size());
+}
+
+TEST_F(SoftFifoTest, EarliestDeadlineWins) {
+    batch(kAccelHandle, 100 * kMs);
+    batch(kLightHandle, 50 * kMs);
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+    now += 10 * kMs;
+    sample(kLightHandle, SensorType::LIGHT);
+    EXPECT_EQ(now + 50 * kMs, runEventLoop());
+
+    now += 50 * kMs;
+    EXPECT_EQ(now + 40 * kMs, runEventLoop());
+    ASSERT_EQ(1u, written.size());
+    EXPECT_EQ(SensorType::LIGHT, written[0].sensorType);
+}
+
+TEST_F(SoftFifoTest, ResetDropsHeldEvents) {
+    batch(kAccelHandle, 100 * kMs);
+    sample(kAccelHandle, SensorType::ACCELEROMETER);
+
+    mFifos.reset();
+    EXPECT_EQ(-1, runEventLoop());
+    flush(kAccelHandle);
+    ASSERT_EQ(1u, written.size());
+    EXPECT_EQ(SensorType::META_DATA, written[0].sensorType);
+}
+
+}  // namespace
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android/hardware/sensors/2.1/types.h>
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <variant>
+#include <vector>
+
+using ::android::hardware::sensors::V1_0::Result;
+
+namespace {
+
+constexpr int32_t kSubHalIndexShift = 24;
+constexpr int32_t kSensorHandleMask = 0x00FFFFFF;
+constexpr int kSensorsPerSubHal = 8;
+
+/* The control half of the ISensorsSubHal interfaces, pure virtual like the HIDL ones */
+class SubHalV2_0 {
+  public:
+    virtual ~SubHalV2_0() = default;
+    virtual Result activate(int32_t sensorHandle, bool enabled) = 0;
+    virtual Result batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                         int64_t maxReportLatencyNs) = 0;
+    virtual Result flush(int32_t sensorHandle) = 0;
+};
+
+class SubHalV2_1 {
+  public:
+    virtual ~SubHalV2_1() = default;
+    virtual Result activate(int32_t sensorHandle, bool enabled) = 0;
+    virtual Result batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                         int64_t maxReportLatencyNs) = 0;
+    virtual Result flush(int32_t sensorHandle) = 0;
+};
+
+/* A subhal that only checks the handle, so the call itself is all that is measured */
+template <typename Interface>
+class FakeSubHal : public Interface {
+  public:
+    Result activate(int32_t sensorHandle, bool /* enabled */) override {
+        return check(sensorHandle);
+    }
+    Result batch(int32_t sensorHandle, int64_t /* samplingPeriodNs */,
+                 int64_t /* maxReportLatencyNs */) override {
+        return check(sensorHandle);
+    }
+    Result flush(int32_t sensorHandle) override { return check(sensorHandle); }
+
+  private:
+    static Result check(int32_t sensorHandle) {
+        return sensorHandle < kSensorsPerSubHal ? Result::OK : Result::BAD_VALUE;
+    }
+};
+
+/* Stands in for RemoteSubHal, which is called directly and not through an interface */
+class FakeRemoteSubHal final {
+  public:
+    Result activate(int32_t sensorHandle, bool enabled) {
+        return mSubHal.activate(sensorHandle, enabled);
+    }
+    Result batch(int32_t sensorHandle, int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
+        return mSubHal.batch(sensorHandle, samplingPeriodNs, maxReportLatencyNs);
+    }
+    Result flush(int32_t sensorHandle) { return mSubHal.flush(sensorHandle); }
+
+  private:
+    FakeSubHal<SubHalV2_1> mSubHal;
+};
+
+/* ISubHalWrapperBase and the wrappers around each subhal version */
+class SubHalWrapperBase {
+  public:
+    virtual ~SubHalWrapperBase() = default;
+    virtual Result activate(int32_t sensorHandle, bool enabled) = 0;
+    virtual Result batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                         int64_t maxReportLatencyNs) = 0;
+    virtual Result flush(int32_t sensorHandle) = 0;
+};
+
+template <typename SubHal>
+class SubHalWrapper : public SubHalWrapperBase {
+  public:
+    explicit SubHalWrapper(SubHal* subHal) : mSubHal(subHal) {}
+    Result activate(int32_t sensorHandle, bool enabled) override {
+        return mSubHal->activate(sensorHandle, enabled);
+    }
+    Result batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                 int64_t maxReportLatencyNs) override {
+        return mSubHal->batch(sensorHandle, samplingPeriodNs, maxReportLatencyNs);
+    }
+    Result flush(int32_t sensorHandle) override { return mSubHal->flush(sensorHandle); }
+
+  private:
+    SubHal* mSubHal;
+};
+
+/*
+ * The subhals of a proxy, reached both ways HalProxy has used: a shared_ptr to the wrapper
+ * copied out of mSubHalList, and the variant table visited by activate, batch and flush now.
+ */
+class SubHals {
+  public:
+    using Dispatch = std::variant<SubHalV2_0*, SubHalV2_1*, FakeRemoteSubHal*>;
+
+    SubHals() {
+        add(&mV2_0, &mV2_0);
+        add(&mV2_1, &mV2_1);
+        add(&mRemote, &mRemote);
+    }
+
+    std::shared_ptr<SubHalWrapperBase> wrapperFor(int32_t sensorHandle) {
+        return mWrappers[static_cast<uint32_t>(sensorHandle) >> kSubHalIndexShift];
+    }
+
+    const Dispatch& dispatchFor(int32_t sensorHandle) const {
+        return mDispatch[static_cast<uint32_t>(sensorHandle) >> kSubHalIndexShift];
+    }
+
+    /* Sensor handles spread over all subhals, as the framework sees them */
+    std::vector<int32_t> handles() const {
+        std::vector<int32_t> handles;
+        for (int32_t i = 0; i < kSensorsPerSubHal; i++) {
+            for (size_t subHal = 0; subHal < mDispatch.size(); subHal++) {
+                handles.push_back(static_cast<int32_t>(subHal << kSubHalIndexShift) | i);
+            }
+        }
+        return handles;
+    }
+
+  private:
+    template <typename SubHal, typename Interface>
+    void add(SubHal* subHal, Interface* interface) {
+        mWrappers.push_back(std::make_shared<SubHalWrapper<SubHal>>(subHal));
+        mDispatch.emplace_back(interface);
+    }
+
+    FakeSubHal<SubHalV2_0> mV2_0;
+    FakeSubHal<SubHalV2_1> mV2_1;
+    FakeRemoteSubHal mRemote;
+    std::vector<std::shared_ptr<SubHalWrapperBase>> mWrappers;
+    std::vector<Dispatch> mDispatch;
+};
+
+SubHals gSubHals;
+
+/* The wrapper is copied per call, every thread bumps the same ref counts */
+struct WrapperDispatch {
+    static Result activate(int32_t sensorHandle, bool enabled) {
+        return gSubHals.wrapperFor(sensorHandle)->activate(sensorHandle & kSensorHandleMask,
+                                                            enabled);
+    }
+    static Result batch(int32_t sensorHandle, int64_t samplingPeriodNs) {
+        return gSubHals.wrapperFor(sensorHandle)
+                ->batch(sensorHandle & kSensorHandleMask, samplingPeriodNs, 0);
+    }
+    static Result flush(int32_t sensorHandle) {
+        return gSubHals.wrapperFor(sensorHandle)->flush(sensorHandle & kSensorHandleMask);
+    }
+};
+
+struct VariantDispatch {
+    static Result activate(int32_t sensorHandle, bool enabled) {
+        return std::visit(
+                [&](auto* subHal) {
+                    return subHal->activate(sensorHandle & kSensorHandleMask, enabled);
+                },
+                gSubHals.dispatchFor(sensorHandle));
+    }
+    static Result batch(int32_t sensorHandle, int64_t samplingPeriodNs) {
+        return std::visit(
+                [&](auto* subHal) {
+                    return subHal->batch(sensorHandle & kSensorHandleMask, samplingPeriodNs, 0);
+                },
+                gSubHals.dispatchFor(sensorHandle));
+    }
+    static Result flush(int32_t sensorHandle) {
+        return std::visit(
+                [&](auto* subHal) { return subHal->flush(sensorHandle & kSensorHandleMask); },
+                gSubHals.dispatchFor(sensorHandle));
+    }
+};
+
+/*
+ * Every thread churns through the sensors of all subhals the way apps registering and
+ * unregistering listeners make the framework do: enable, set the rate, flush and disable.
+ * Reports control calls per second across the threads.
+ */
+template <typename Dispatch>
+void BM_ControlCallChurn(benchmark::State& state) {
+    const std::vector<int32_t> handles = gSubHals.handles();
+    int64_t calls = 0;
+    size_t next = state.thread_index();
+    for (auto _ : state) {
+        int32_t sensorHandle = handles[next++ % handles.size()];
+        benchmark::DoNotOptimize(Dispatch::activate(sensorHandle, true));
+        benchmark::DoNotOptimize(Dispatch::batch(sensorHandle, 20000000));
+        benchmark::DoNotOptimize(Dispatch::flush(sensorHandle));
+        benchmark::DoNotOptimize(Dispatch::activate(sensorHandle, false));
+        calls += 4;
+    }
+    state.counters["calls_per_s"] = benchmark::Counter(calls, benchmark::Counter::kIsRate);
+}
+BENCHMARK_TEMPLATE(BM_ControlCallChurn, WrapperDispatch)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ControlCallChurn, VariantDispatch)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "SubHalRing.h"
+
+#include <benchmark/benchmark.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using ::android::hardware::sensors::V2_1::Event;
+using ::android::hardware::sensors::V2_1::SensorType;
+using ::android::hardware::sensors::V2_1::implementation::releaseRingEvents;
+using ::android::hardware::sensors::V2_1::implementation::SubHalRing;
+using ::android::hardware::sensors::V2_1::implementation::waitForRingEvents;
+using ::android::hardware::sensors::V2_1::implementation::writeRingEvents;
+
+namespace {
+
+constexpr int kEventsPerRun = 500;
+
+/* CLOCK_MONOTONIC is shared between the processes, event timestamps come from it */
+int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+/*
+ * A subhal streaming one accelerometer sample per period, each stamped with the time it was
+ * posted. It hands events to whatever stands in for the proxy callback.
+ */
+void runFakeSubHal(std::chrono::microseconds period, int numEvents,
+                   const std::function<void(const Event&)>& postEvent) {
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < numEvents; i++) {
+        next += period;
+        std::this_thread::sleep_until(next);
+
+        Event event = {};
+        event.sensorHandle = 1;
+        event.sensorType = SensorType::ACCELEROMETER;
+        event.u.vec3 = {0.0f, 0.0f, 9.81f, {}};
+        event.timestamp = nowNs();
+        postEvent(event);
+    }
+}
+
+/* What the proxy does with each event, under the lock postEventsToMessageQueue takes */
+class FakeProxy {
+  public:
+    void postEvents(const Event* events, size_t numEvents) {
+        std::lock_guard<std::mutex> lock(mLock);
+        int64_t now = nowNs();
+        for (size_t i = 0; i < numEvents; i++) {
+            mLatencies.push_back(now - events[i].timestamp);
+        }
+    }
+
+    void report(benchmark::State& state) {
+        std::sort(mLatencies.begin(), mLatencies.end());
+        auto percentileUs = [this](double p) {
+            size_t index = std::min(mLatencies.size() - 1,
+                                    static_cast<size_t>(mLatencies.size() * p));
+            return mLatencies[index] / 1000.0;
+        };
+        state.counters["p50_us"] = percentileUs(0.50);
+        state.counters["p99_us"] = percentileUs(0.99);
+        state.counters["max_us"] = percentileUs(1.0);
+    }
+
+  private:
+    std::mutex mLock;
+    std::vector<int64_t> mLatencies;
+};
+
+/* A subhal loaded into the service, its thread calls straight into the proxy */
+void BM_InProcessSubHal(benchmark::State& state) {
+    FakeProxy proxy;
+    for (auto _ : state) {
+        runFakeSubHal(std::chrono::microseconds(state.range(0)), kEventsPerRun,
+                      [&](const Event& event) { proxy.postEvents(&event, 1); });
+    }
+    proxy.report(state);
+}
+BENCHMARK(BM_InProcessSubHal)
+        ->Arg(1000)
+        ->Arg(5000)
+        ->Unit(benchmark::kMillisecond)
+        ->Iterations(3);
+
+/*
+ * An isolated subhal. The fake subhal runs in a forked host process and writes to a ring in a
+ * shared memfd. The benchmark thread forwards them to the proxy like RemoteSubHal::readerLoop.
+ */
+void BM_IsolatedSubHal(benchmark::State& state) {
+    int fd = memfd_create("sensors-subhal-ring", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, sizeof(SubHalRing)) != 0) {
+        state.SkipWithError("memfd_create failed");
+        return;
+    }
+    auto* ring = static_cast<SubHalRing*>(
+            mmap(nullptr, sizeof(SubHalRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    close(fd);
+    if (ring == MAP_FAILED) {
+        state.SkipWithError("mmap failed");
+        return;
+    }
+
+    FakeProxy proxy;
+    for (auto _ : state) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            runFakeSubHal(std::chrono::microseconds(state.range(0)), kEventsPerRun,
+                          [&](const Event& event) { writeRingEvents(ring, &event, 1); });
+            _exit(0);
+        }
+
+        uint32_t readIndex = ring->readIndex.load();
+        std::vector<Event> events;
+        for (int received = 0; received < kEventsPerRun;) {
+            uint32_t writeIndex = waitForRingEvents(ring, readIndex);
+            events.clear();
+            for (; readIndex != writeIndex; readIndex++) {
+                events.push_back(ring->events[readIndex & (SubHalRing::kCapacity - 1)]);
+            }
+            proxy.postEvents(events.data(), events.size());
+            releaseRingEvents(ring, readIndex);
+            received += events.size();
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    proxy.report(state);
+    state.counters["dropped"] = ring->dropped.load();
+    munmap(ring, sizeof(SubHalRing));
+}
+BENCHMARK(BM_IsolatedSubHal)
+        ->Arg(1000)
+        ->Arg(5000)
+        ->Unit(benchmark::kMillisecond)
+        ->Iterations(3);
+
+}  // namespace
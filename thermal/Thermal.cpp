@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "thermal.rosemary"
+
+#include "Thermal.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+
+#define THERMAL_CONFIG "/vendor/etc/thermal_info_config.json"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+static ndk::ScopedAStatus initError() {
+    return ndk::ScopedAStatus::fromExceptionCodeWithMessage(EX_ILLEGAL_STATE,
+                                                            "ThermalHAL not initialized properly.");
+}
+
+Thermal::Thermal()
+    : mHelper(THERMAL_CONFIG,
+              std::bind(&Thermal::sendThrottlingChange, this, std::placeholders::_1)) {}
+
+ndk::ScopedAStatus Thermal::getTemperatures(std::vector<Temperature>* _aidl_return) {
+    return getTemperatures(false, TemperatureType::UNKNOWN, _aidl_return);
+}
+
+ndk::ScopedAStatus Thermal::getTemperaturesWithType(TemperatureType type,
+                                                    std::vector<Temperature>* _aidl_return) {
+    return getTemperatures(true, type, _aidl_return);
+}
+
+ndk::ScopedAStatus Thermal::getTemperatures(bool filterType, TemperatureType type,
+                                            std::vector<Temperature>* _aidl_return) {
+    if (!mHelper.isInitialized()) {
+        return initError();
+    }
+
+    if (!mHelper.fillTemperatures(filterType, type, _aidl_return)) {
+        return ndk::ScopedAStatus::fromExceptionCodeWithMessage(EX_ILLEGAL_STATE,
+                                                                "Failed to read temperatures.");
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Thermal::getTemperatureThresholds(
+        std::vector<TemperatureThreshold>* _aidl_return) {
+    if (!mHelper.isInitialized()) {
+        return initError();
+    }
+
+    mHelper.fillThresholds(false, TemperatureType::UNKNOWN, _aidl_return);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Thermal::getTemperatureThresholdsWithType(
+        TemperatureType type, std::vector<TemperatureThreshold>* _aidl_return) {
+    if (!mHelper.isInitialized()) {
+        return initError();
+    }
+
+    mHelper.fillThresholds(true, type, _aidl_return);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Thermal::getCoolingDevices(std::vector<CoolingDevice>* _aidl_return) {
+    return getCoolingDevices(false, CoolingType::CPU, _aidl_return);
+}
+
+ndk::ScopedAStatus Thermal::getCoolingDevicesWithType(CoolingType type,
+                                                      std::vector<CoolingDevice>* _aidl_return) {
+    return getCoolingDevices(true, type, _aidl_return);
+}
+
+ndk::ScopedAStatus Thermal::getCoolingDevices(bool filterType, CoolingType type,
+                                              std::vector<CoolingDevice>* _aidl_return) {
+    if (!mHelper.isInitialized()) {
+        return initError();
+    }
+
+    if (!mHelper.fillCoolingDevices(filterType, type, _aidl_return)) {
+        return ndk::ScopedAStatus::fromExceptionCodeWithMessage(EX_ILLEGAL_STATE,
+                                                                "Failed to read cooling devices.");
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Thermal::registerThermalChangedCallback(
+        const std::shared_ptr<IThermalChangedCallback>& callback) {
+    return registerCallback(callback, false, TemperatureType::UNKNOWN);
+}
+
+ndk::ScopedAStatus Thermal::registerThermalChangedCallbackWithType(
+        const std::shared_ptr<IThermalChangedCallback>& callback, TemperatureType type) {
+    return registerCallback(callback, true, type);
+}
+
+ndk::ScopedAStatus Thermal::registerCallback(
+        const std::shared_ptr<IThermalChangedCallback>& callback, bool filterType,
+        TemperatureType type) {
+    if (callback == nullptr) {
+        return ndk::ScopedAStatus::fromExceptionCodeWithMessage(EX_ILLEGAL_ARGUMENT,
+                                                                "Invalid nullptr callback");
+    }
+    if (!mHelper.isInitialized()) {
+        return initError();
+    }
+
+    std::lock_guard<std::mutex> lock(mCallbackLock);
+    if (std::any_of(mCallbacks.begin(), mCallbacks.end(), [&](const CallbackSetting& c) {
+            return c.callback->asBinder() == callback->asBinder();
+        })) {
+        return ndk::ScopedAStatus::fromExceptionCodeWithMessage(EX_ILLEGAL_ARGUMENT,
+                                                                "Callback already registered");
+    }
+    mCallbacks.push_back({callback, filterType, type});
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Thermal::unregisterThermalChangedCallback(
+        const std::shared_ptr<IThermalChangedCallback>& callback) {
+    if (callback == nullptr) {
+        return ndk::ScopedAStatus::fromExceptionCodeWithMessage(EX_ILLEGAL_ARGUMENT,
+                                                                "Invalid nullptr callback");
+    }
+
+    std::lock_guard<std::mutex> lock(mCallbackLock);
+    auto it = std::find_if(mCallbacks.begin(), mCallbacks.end(), [&](const CallbackSetting& c) {
+        return c.callback->asBinder() == callback->asBinder();
+    });
+    if (it == mCallbacks.end()) {
+        return ndk::ScopedAStatus::fromExceptionCodeWithMessage(EX_ILLEGAL_ARGUMENT,
+                                                                "Callback wasn't registered");
+    }
+    mCallbacks.erase(it);
+    return ndk::ScopedAStatus::ok();
+}
+
+/*
+ * Called from the watcher thread as soon as a severity change has been read.
+ * The callbacks are oneway, so a slow client cannot hold up the watcher.
+ */
+void Thermal::sendThrottlingChange(const Temperature& temperature) {
+    std::lock_guard<std::mutex> lock(mCallbackLock);
+
+    mCallbacks.erase(std::remove_if(mCallbacks.begin(), mCallbacks.end(),
+                                    [&](const CallbackSetting& c) {
+                                        if (c.filterType && c.type != temperature.type) {
+                                            return false;
+                                        }
+                                        ndk::ScopedAStatus status =
+                                                c.callback->notifyThrottling(temperature);
+                                        return status.getStatus() == STATUS_DEAD_OBJECT;
+                                    }),
+                     mCallbacks.end());
+}
+
+binder_status_t Thermal::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    mHelper.dump(fd);
+
+    std::lock_guard<std::mutex> lock(mCallbackLock);
+    dprintf(fd, "Callbacks: %zu\n", mCallbacks.size());
+    return STATUS_OK;
+}
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
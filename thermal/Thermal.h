@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/thermal/BnThermal.h>
+
+#include <mutex>
+#include <vector>
+
+#include "ThermalHelper.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+struct CallbackSetting {
+    std::shared_ptr<IThermalChangedCallback> callback;
+    bool filterType;
+    TemperatureType type;
+};
+
+class Thermal : public BnThermal {
+  public:
+    Thermal();
+
+    ndk::ScopedAStatus getCoolingDevices(std::vector<CoolingDevice>* _aidl_return) override;
+    ndk::ScopedAStatus getCoolingDevicesWithType(CoolingType type,
+                                                 std::vector<CoolingDevice>* _aidl_return) override;
+    ndk::ScopedAStatus getTemperatures(std::vector<Temperature>* _aidl_return) override;
+    ndk::ScopedAStatus getTemperaturesWithType(TemperatureType type,
+                                               std::vector<Temperature>* _aidl_return) override;
+    ndk::ScopedAStatus getTemperatureThresholds(
+            std::vector<TemperatureThreshold>* _aidl_return) override;
+    ndk::ScopedAStatus getTemperatureThresholdsWithType(
+            TemperatureType type, std::vector<TemperatureThreshold>* _aidl_return) override;
+    ndk::ScopedAStatus registerThermalChangedCallback(
+            const std::shared_ptr<IThermalChangedCallback>& callback) override;
+    ndk::ScopedAStatus registerThermalChangedCallbackWithType(
+            const std::shared_ptr<IThermalChangedCallback>& callback,
+            TemperatureType type) override;
+    ndk::ScopedAStatus unregisterThermalChangedCallback(
+            const std::shared_ptr<IThermalChangedCallback>& callback) override;
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+  private:
+    ndk::ScopedAStatus getTemperatures(bool filterType, TemperatureType type,
+                                       std::vector<Temperature>* _aidl_return);
+    ndk::ScopedAStatus getCoolingDevices(bool filterType, CoolingType type,
+                                         std::vector<CoolingDevice>* _aidl_return);
+    ndk::ScopedAStatus registerCallback(const std::shared_ptr<IThermalChangedCallback>& callback,
+                                        bool filterType, TemperatureType type);
+    void sendThrottlingChange(const Temperature& temperature);
+
+    std::mutex mCallbackLock;
+    std::vector<CallbackSetting> mCallbacks;
+
+    /* Last member, so the watcher stops before the callbacks go away */
+    ThermalHelper mHelper;
+};
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "thermal.rosemary"
+
+#include "ThermalHelper.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android/binder_enums.h>
+#include <cutils/uevent.h>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstring>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+using ::android::base::ReadFileToString;
+using ::android::base::unique_fd;
+
+static constexpr size_t kUeventBufferSize = 64 * 1024;
+
+template <typename T>
+static bool parseEnum(const std::string& name, T* out) {
+    for (T value : ndk::enum_range<T>()) {
+        if (toString(value) == name) {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isThermalUevent(const char* msg, size_t len) {
+    for (const char* cp = msg; cp < msg + len; cp += strlen(cp) + 1) {
+        if (!strcmp(cp, "SUBSYSTEM=thermal")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ThermalHelper::ThermalHelper(const char* configPath, const NotifyCallback& notify)
+    : mNotify(notify) {
+    if (!parseConfig(configPath) || !mZones.openZones()) {
+        LOG(ERROR) << "thermal HAL is not initialized";
+        return;
+    }
+
+    mUeventFd.reset(uevent_open_socket(kUeventBufferSize, true));
+    if (mUeventFd.get() < 0) {
+        PLOG(WARNING) << "failed to open uevent socket, polling only";
+    } else {
+        fcntl(mUeventFd.get(), F_SETFL, O_NONBLOCK);
+    }
+
+    mTimerFd.reset(timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK | TFD_CLOEXEC));
+    mExitFd.reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (mTimerFd.get() < 0 || mExitFd.get() < 0) {
+        PLOG(ERROR) << "failed to create watcher fds";
+        return;
+    }
+
+    mInitialized = true;
+    mWatcherThread = std::thread(&ThermalHelper::watcherLoop, this);
+}
+
+ThermalHelper::~ThermalHelper() {
+    if (mWatcherThread.joinable()) {
+        uint64_t one = 1;
+        write(mExitFd.get(), &one, sizeof(one));
+        mWatcherThread.join();
+    }
+}
+
+/*
+ * Sensors and cooling devices are kept by mZones, only their AIDL types are
+ * resolved here.
+ */
+bool ThermalHelper::parseConfig(const char* configPath) {
+    std::string json;
+    if (!ReadFileToString(configPath, &json)) {
+        PLOG(ERROR) << "failed to read " << configPath;
+        return false;
+    }
+
+    if (!mZones.parseConfig(json)) {
+        LOG(ERROR) << "failed to load " << configPath;
+        return false;
+    }
+
+    for (const ZoneSensor& sensor : mZones.sensors()) {
+        TemperatureType type;
+        if (!parseEnum(sensor.type, &type)) {
+            LOG(ERROR) << "sensor " << sensor.name << " has unknown type " << sensor.type;
+            return false;
+        }
+        mSensorTypes.push_back(type);
+    }
+
+    for (const ZoneCoolingDevice& device : mZones.coolingDevices()) {
+        CoolingType type;
+        if (!parseEnum(device.type, &type)) {
+            LOG(ERROR) << "cooling device " << device.name << " has unknown type "
+                       << device.type;
+            return false;
+        }
+        mCoolingTypes.push_back(type);
+    }
+
+    return true;
+}
+
+static Temperature toTemperature(const ZoneSensor& sensor, TemperatureType type, float value,
+                                 size_t severity) {
+    return {.type = type,
+            .name = sensor.name,
+            .value = value,
+            .throttlingStatus = static_cast<ThrottlingSeverity>(severity)};
+}
+
+/*
+ * Read every zone once, report severity changes and work out how soon the
+ * zones have to be looked at again.
+ */
+std::chrono::milliseconds ThermalHelper::update() {
+    std::vector<float> raw;
+    mZones.readZones(&raw);
+
+    std::vector<Temperature> changed;
+    std::chrono::milliseconds interval;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::vector<size_t> changedSensors;
+        interval = mZones.update(raw, &changedSensors);
+        for (size_t i : changedSensors) {
+            const ZoneSensor& sensor = mZones.sensors()[i];
+            changed.push_back(toTemperature(sensor, mSensorTypes[i], sensor.value,
+                                            sensor.severity));
+        }
+    }
+
+    for (const Temperature& temperature : changed) {
+        LOG(INFO) << temperature.name << " at " << temperature.value << " now "
+                  << toString(temperature.throttlingStatus);
+        mNotify(temperature);
+    }
+
+    return interval;
+}
+
+void ThermalHelper::armTimer(std::chrono::milliseconds interval) {
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = interval.count() / 1000;
+    spec.it_value.tv_nsec = (interval.count() % 1000) * 1000000;
+
+    if (timerfd_settime(mTimerFd.get(), 0, &spec, nullptr) != 0) {
+        PLOG(ERROR) << "failed to arm poll timer";
+    }
+    mPollIntervalMs = interval.count();
+}
+
+/*
+ * Thermal uevents (trip point crossings) trigger an immediate pass, the
+ * timer covers zones that never send one.
+ */
+void ThermalHelper::watcherLoop() {
+    unique_fd epollFd(epoll_create1(EPOLL_CLOEXEC));
+
+    for (int fd : {mUeventFd.get(), mTimerFd.get(), mExitFd.get()}) {
+        if (fd < 0) {
+            continue;
+        }
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd.get(), EPOLL_CTL_ADD, fd, &ev) != 0) {
+            PLOG(ERROR) << "failed to watch fd " << fd;
+            return;
+        }
+    }
+
+    armTimer(update());
+
+    while (true) {
+        struct epoll_event events[3];
+        int n = TEMP_FAILURE_RETRY(epoll_wait(epollFd.get(), events, std::size(events), -1));
+        if (n < 0) {
+            PLOG(ERROR) << "epoll_wait failed";
+            return;
+        }
+
+        bool rescan = false;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == mExitFd.get()) {
+                return;
+            } else if (fd == mUeventFd.get()) {
+                char msg[2048];
+                ssize_t len;
+                while ((len = uevent_kernel_multicast_recv(fd, msg, sizeof(msg) - 1)) > 0) {
+                    msg[len] = '\0';
+                    if (isThermalUevent(msg, len)) {
+                        mUevents++;
+                        rescan = true;
+                    }
+                }
+            } else if (fd == mTimerFd.get()) {
+                uint64_t expirations;
+                read(fd, &expirations, sizeof(expirations));
+                mPolls++;
+                rescan = true;
+            }
+        }
+
+        if (rescan) {
+            armTimer(update());
+        }
+    }
+}
+
+bool ThermalHelper::fillTemperatures(bool filterType, TemperatureType type,
+                                     std::vector<Temperature>* out) {
+    std::vector<float> raw;
+    if (!mZones.readZones(&raw)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    const std::vector<ZoneSensor>& sensors = mZones.sensors();
+    for (size_t i = 0; i < sensors.size(); i++) {
+        if (filterType && mSensorTypes[i] != type) {
+            continue;
+        }
+
+        float value = raw[sensors[i].zone] * sensors[i].multiplier;
+        out->push_back(toTemperature(sensors[i], mSensorTypes[i], value,
+                                     ThermalZones::computeSeverity(sensors[i], value)));
+    }
+    return true;
+}
+
+void ThermalHelper::fillThresholds(bool filterType, TemperatureType type,
+                                   std::vector<TemperatureThreshold>* out) const {
+    const std::vector<ZoneSensor>& sensors = mZones.sensors();
+    for (size_t i = 0; i < sensors.size(); i++) {
+        if (filterType && mSensorTypes[i] != type) {
+            continue;
+        }
+
+        out->push_back({.type = mSensorTypes[i],
+                        .name = sensors[i].name,
+                        .hotThrottlingThresholds = {sensors[i].hotThresholds.begin(),
+                                                    sensors[i].hotThresholds.end()},
+                        .coldThrottlingThresholds = std::vector<float>(kThrottlingSeverityCount,
+                                                                       NAN),
+                        .vrThrottlingThreshold = sensors[i].vrThreshold});
+    }
+}
+
+bool ThermalHelper::fillCoolingDevices(bool filterType, CoolingType type,
+                                       std::vector<CoolingDevice>* out) {
+    const std::vector<ZoneCoolingDevice>& devices = mZones.coolingDevices();
+    for (size_t i = 0; i < devices.size(); i++) {
+        if ((filterType && mCoolingTypes[i] != type) || devices[i].curStateFd.get() < 0) {
+            continue;
+        }
+
+        int64_t state;
+        if (!mZones.readCoolingDevice(devices[i], &state)) {
+            return false;
+        }
+
+        out->push_back({.type = mCoolingTypes[i], .name = devices[i].name, .value = state});
+    }
+    return true;
+}
+
+void ThermalHelper::dump(int fd) {
+    dprintf(fd, "Thermal HAL %s\n", mInitialized ? "initialized" : "not initialized");
+    dprintf(fd, "Watcher: %" PRIu64 " uevents, %" PRIu64 " polls, next poll in %" PRId64 " ms\n",
+            mUevents.load(), mPolls.load(), mPollIntervalMs.load());
+
+    std::lock_guard<std::mutex> lock(mLock);
+    dprintf(fd, "Sensors:\n");
+    for (const ZoneSensor& sensor : mZones.sensors()) {
+        dprintf(fd, "  %s (%s, zone %s): %.1f, %s\n", sensor.name.c_str(), sensor.type.c_str(),
+                mZones.zones()[sensor.zone].type.c_str(), sensor.value,
+                toString(static_cast<ThrottlingSeverity>(sensor.severity)).c_str());
+    }
+}
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
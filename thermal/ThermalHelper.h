@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/thermal/CoolingDevice.h>
+#include <aidl/android/hardware/thermal/Temperature.h>
+#include <aidl/android/hardware/thermal/TemperatureThreshold.h>
+#include <android-base/unique_fd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ThermalZones.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+/*
+ * Holds the sensor table parsed from thermal_info_config.json and watches the
+ * thermal zones behind it. Severity changes are reported through the notify
+ * callback from the watcher thread, right after the zone has been read.
+ */
+class ThermalHelper {
+  public:
+    using NotifyCallback = std::function<void(const Temperature&)>;
+
+    ThermalHelper(const char* configPath, const NotifyCallback& notify);
+    ~ThermalHelper();
+
+    bool isInitialized() const { return mInitialized; }
+
+    bool fillTemperatures(bool filterType, TemperatureType type, std::vector<Temperature>* out);
+    void fillThresholds(bool filterType, TemperatureType type,
+                        std::vector<TemperatureThreshold>* out) const;
+    bool fillCoolingDevices(bool filterType, CoolingType type, std::vector<CoolingDevice>* out);
+
+    void dump(int fd);
+
+  private:
+    bool parseConfig(const char* configPath);
+    void watcherLoop();
+    void armTimer(std::chrono::milliseconds interval);
+    std::chrono::milliseconds update();
+
+    NotifyCallback mNotify;
+    bool mInitialized = false;
+
+    /* The AIDL types of the sensors and cooling devices of mZones, in the same order */
+    std::vector<TemperatureType> mSensorTypes;
+    std::vector<CoolingType> mCoolingTypes;
+
+    /* Guards the sensor state in mZones, its nodes are read without it */
+    std::mutex mLock;
+    ThermalZones mZones;
+
+    ::android::base::unique_fd mUeventFd;
+    ::android::base::unique_fd mTimerFd;
+    ::android::base::unique_fd mExitFd;
+    std::atomic<int64_t> mPollIntervalMs = 0;
+    std::atomic<uint64_t> mUevents = 0;
+    std::atomic<uint64_t> mPolls = 0;
+    std::thread mWatcherThread;
+};
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "thermal.rosemary"
+
+#include "ThermalZones.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <json/reader.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+
+#define ZONE_PREFIX     "thermal_zone"
+#define COOLING_PREFIX  "cooling_device"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+using ::android::base::ReadFileToString;
+using ::android::base::StartsWith;
+using ::android::base::Trim;
+using ::android::base::unique_fd;
+
+/* A severity is only left once the temperature dropped this far below it. */
+static constexpr float kHotHysteresis = 1.0f;
+
+/*
+ * Zones are polled sooner the closer they get to a threshold, assuming they
+ * never heat up faster than a degree per second. Far from every threshold the
+ * thermal uevents alone are relied on.
+ */
+static constexpr float kPollMsPerDegree = 1000.0f;
+static constexpr std::chrono::milliseconds kMinPollInterval(500);
+static constexpr std::chrono::milliseconds kMaxPollInterval(10000);
+
+/*
+ * Thresholds are either numbers or strings such as "NAN" and "85.0".
+ */
+static float parseThreshold(const Json::Value& value) {
+    if (value.isNumeric()) {
+        return value.asFloat();
+    }
+    if (value.isString()) {
+        return strtof(value.asCString(), nullptr);
+    }
+    return NAN;
+}
+
+static bool readNode(int fd, char* buf, size_t size) {
+    ssize_t len = TEMP_FAILURE_RETRY(pread(fd, buf, size - 1, 0));
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+    return true;
+}
+
+ThermalZones::ThermalZones(const std::string& thermalDir) : mThermalDir(thermalDir) {}
+
+/*
+ * Sensors sharing a thermal zone point to the same zone entry.
+ */
+bool ThermalZones::parseConfig(const std::string& json) {
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    if (!reader->parse(json.data(), json.data() + json.size(), &root, &errors)) {
+        LOG(ERROR) << "failed to parse thermal config: " << errors;
+        return false;
+    }
+
+    for (const Json::Value& sensor : root["Sensors"]) {
+        ZoneSensor info;
+        info.name = sensor["Name"].asString();
+        info.type = sensor["Type"].asString();
+
+        std::string zoneName = sensor.get("ZoneName", info.name).asString();
+        auto zone = std::find_if(mZones.begin(), mZones.end(),
+                                 [&](const ThermalZone& z) { return z.type == zoneName; });
+        info.zone = zone - mZones.begin();
+        if (zone == mZones.end()) {
+            mZones.push_back({zoneName, unique_fd()});
+        }
+
+        const Json::Value& hot = sensor["HotThreshold"];
+        if (hot.size() != kThrottlingSeverityCount) {
+            LOG(ERROR) << "sensor " << info.name << " needs " << kThrottlingSeverityCount
+                       << " hot thresholds";
+            return false;
+        }
+        for (Json::ArrayIndex i = 0; i < kThrottlingSeverityCount; i++) {
+            info.hotThresholds[i] = parseThreshold(hot[i]);
+        }
+
+        info.vrThreshold = parseThreshold(sensor["VrThreshold"]);
+        info.multiplier = sensor.get("Multiplier", 1.0).asFloat();
+        mSensors.push_back(std::move(info));
+    }
+
+    for (const Json::Value& device : root["CoolingDevices"]) {
+        mCoolingDevices.push_back(
+                {device["Name"].asString(), device["Type"].asString(), unique_fd()});
+    }
+
+    LOG(INFO) << "loaded " << mSensors.size() << " sensors on " << mZones.size()
+              << " zones and " << mCoolingDevices.size() << " cooling devices";
+    return !mSensors.empty();
+}
+
+/*
+ * Map the type of every <prefix>N directory under the thermal class to its path.
+ */
+std::vector<std::pair<std::string, std::string>> ThermalZones::scanThermalClass(
+        const char* prefix) const {
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(mThermalDir.c_str()), closedir);
+
+    if (!dir) {
+        PLOG(ERROR) << "failed to open " << mThermalDir;
+        return entries;
+    }
+
+    while (struct dirent* entry = readdir(dir.get())) {
+        if (!StartsWith(entry->d_name, prefix)) {
+            continue;
+        }
+
+        std::string path = mThermalDir + entry->d_name + "/";
+        std::string type;
+        if (ReadFileToString(path + "type", &type)) {
+            entries.emplace_back(Trim(type), path);
+        }
+    }
+
+    return entries;
+}
+
+/*
+ * Every later read is a single pread.
+ */
+bool ThermalZones::openZones() {
+    auto zones = scanThermalClass(ZONE_PREFIX);
+    for (ThermalZone& zone : mZones) {
+        auto entry = std::find_if(zones.begin(), zones.end(),
+                                  [&](const auto& e) { return e.first == zone.type; });
+        if (entry == zones.end()) {
+            LOG(ERROR) << "no thermal zone of type " << zone.type;
+            return false;
+        }
+        zone.tempFd.reset(open((entry->second + "temp").c_str(), O_RDONLY | O_CLOEXEC));
+        if (zone.tempFd.get() < 0) {
+            PLOG(ERROR) << "failed to open " << entry->second << "temp";
+            return false;
+        }
+    }
+
+    auto devices = scanThermalClass(COOLING_PREFIX);
+    for (ZoneCoolingDevice& device : mCoolingDevices) {
+        auto entry = std::find_if(devices.begin(), devices.end(),
+                                  [&](const auto& e) { return e.first == device.name; });
+        if (entry == devices.end()) {
+            LOG(WARNING) << "no cooling device named " << device.name;
+            continue;
+        }
+        device.curStateFd.reset(open((entry->second + "cur_state").c_str(), O_RDONLY | O_CLOEXEC));
+    }
+
+    return true;
+}
+
+bool ThermalZones::readZone(size_t zone, float* raw) const {
+    char buf[32];
+    if (!readNode(mZones[zone].tempFd.get(), buf, sizeof(buf))) {
+        PLOG(ERROR) << "failed to read zone " << mZones[zone].type;
+        return false;
+    }
+
+    *raw = strtof(buf, nullptr);
+    return true;
+}
+
+bool ThermalZones::readZones(std::vector<float>* raw) const {
+    bool ok = true;
+    raw->assign(mZones.size(), NAN);
+    for (size_t i = 0; i < mZones.size(); i++) {
+        ok &= readZone(i, &(*raw)[i]);
+    }
+    return ok;
+}
+
+bool ThermalZones::readCoolingDevice(const ZoneCoolingDevice& device, int64_t* state) const {
+    char buf[32];
+    if (!readNode(device.curStateFd.get(), buf, sizeof(buf))) {
+        PLOG(ERROR) << "failed to read cooling device " << device.name;
+        return false;
+    }
+
+    *state = strtoll(buf, nullptr, 10);
+    return true;
+}
+
+size_t ThermalZones::computeSeverity(const ZoneSensor& sensor, float value) {
+    size_t level = 0;
+    for (size_t i = kThrottlingSeverityCount - 1; i > 0; i--) {
+        if (!std::isnan(sensor.hotThresholds[i]) && value >= sensor.hotThresholds[i]) {
+            level = i;
+            break;
+        }
+    }
+
+    if (level < sensor.severity && value > sensor.hotThresholds[sensor.severity] - kHotHysteresis) {
+        level = sensor.severity;
+    }
+
+    return level;
+}
+
+std::chrono::milliseconds ThermalZones::pollInterval(float margin) {
+    auto interval = std::chrono::milliseconds(
+            std::isinf(margin) ? kMaxPollInterval.count()
+                               : static_cast<int64_t>(std::max(margin, 0.0f) * kPollMsPerDegree));
+    return std::clamp(interval, kMinPollInterval, kMaxPollInterval);
+}
+
+/*
+ * The interval follows the sensor closest to its next severity change, either
+ * the next threshold up or the hysteresis edge of the current one.
+ */
+std::chrono::milliseconds ThermalZones::update(const std::vector<float>& raw,
+                                               std::vector<size_t>* changed) {
+    float margin = INFINITY;
+    for (size_t s = 0; s < mSensors.size(); s++) {
+        ZoneSensor& sensor = mSensors[s];
+        if (std::isnan(raw[sensor.zone])) {
+            continue;
+        }
+
+        sensor.value = raw[sensor.zone] * sensor.multiplier;
+        size_t severity = computeSeverity(sensor, sensor.value);
+        if (severity != sensor.severity) {
+            sensor.severity = severity;
+            changed->push_back(s);
+        }
+
+        for (size_t i = severity + 1; i < kThrottlingSeverityCount; i++) {
+            if (!std::isnan(sensor.hotThresholds[i])) {
+                margin = std::min(margin, sensor.hotThresholds[i] - sensor.value);
+                break;
+            }
+        }
+        if (severity > 0) {
+            margin = std::min(margin,
+                              sensor.value - (sensor.hotThresholds[severity] - kHotHysteresis));
+        }
+    }
+
+    return pollInterval(margin);
+}
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+// NONE through SHUTDOWN, the order of HotThreshold in the config
+static constexpr size_t kThrottlingSeverityCount = 7;
+
+// A thermal zone, read once per pass even if several sensors map to it
+struct ThermalZone {
+    std::string type;
+    ::android::base::unique_fd tempFd;
+};
+
+struct ZoneSensor {
+    std::string name;
+    /* TemperatureType as spelled in the config */
+    std::string type;
+    size_t zone;
+    float multiplier;
+    std::array<float, kThrottlingSeverityCount> hotThresholds;
+    float vrThreshold;
+
+    /* Last reading and reported severity level, 0 (NONE) to SHUTDOWN */
+    float value = NAN;
+    size_t severity = 0;
+};
+
+struct ZoneCoolingDevice {
+    std::string name;
+    /* CoolingType as spelled in the config */
+    std::string type;
+    ::android::base::unique_fd curStateFd;
+};
+
+/*
+ * The sensor table of thermal_info_config.json on top of the thermal class in
+ * sysfs, without any binder or AIDL types so the host tests can drive it
+ * against a fake tree. Not thread safe, ThermalHelper serializes the calls.
+ */
+class ThermalZones {
+  public:
+    /* thermalDir is the thermal class directory, with a trailing slash */
+    explicit ThermalZones(const std::string& thermalDir = "/sys/class/thermal/");
+
+    /* Flatten the config into the sensor and cooling device tables */
+    bool parseConfig(const std::string& json);
+
+    /* Resolve zone and cooling device names to sysfs and keep the nodes open */
+    bool openZones();
+
+    bool readZone(size_t zone, float* raw) const;
+    /* Every zone once, NAN for the ones that failed. @return Whether all could be read. */
+    bool readZones(std::vector<float>* raw) const;
+    bool readCoolingDevice(const ZoneCoolingDevice& device, int64_t* state) const;
+
+    /*
+     * Apply one reading of every zone to the sensors. The indices of the
+     * sensors whose severity changed are appended to changed.
+     *
+     * @return How soon the zones have to be read again.
+     */
+    std::chrono::milliseconds update(const std::vector<float>& raw, std::vector<size_t>* changed);
+
+    /* @return The severity level of a sensor at value, given the level it is at. */
+    static size_t computeSeverity(const ZoneSensor& sensor, float value);
+
+    /* @return The poll interval for a sensor that is margin degrees from a severity change. */
+    static std::chrono::milliseconds pollInterval(float margin);
+
+    const std::vector<ThermalZone>& zones() const { return mZones; }
+    const std::vector<ZoneSensor>& sensors() const { return mSensors; }
+    const std::vector<ZoneCoolingDevice>& coolingDevices() const { return mCoolingDevices; }
+
+  private:
+    std::vector<std::pair<std::string, std::string>> scanThermalClass(const char* prefix) const;
+
+    const std::string mThermalDir;
+
+    std::vector<ThermalZone> mZones;
+    std::vector<ZoneSensor> mSensors;
+    std::vector<ZoneCoolingDevice> mCoolingDevices;
+};
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
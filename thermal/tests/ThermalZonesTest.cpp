@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ThermalZones.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+using ::android::base::WriteStringToFile;
+using ::aidl::android::hardware::thermal::implementation::ThermalZones;
+using ::aidl::android::hardware::thermal::implementation::ZoneSensor;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/* Severity levels, the order of HotThreshold */
+constexpr size_t kNone = 0;
+constexpr size_t kModerate = 3;
+constexpr size_t kSevere = 4;
+constexpr size_t kShutdown = 6;
+
+/* The CPU and skin entries of thermal_info_config.json, CPU and GPU share a zone */
+constexpr char kConfig[] = R"({
+  "Sensors": [
+    {
+      "Name": "CPU",
+      "Type": "CPU",
+      "ZoneName": "mtktscpu",
+      "HotThreshold": ["NAN", "NAN", "NAN", 85, 90, 100, 117],
+      "VrThreshold": "85.0",
+      "Multiplier": 0.001
+    },
+    {
+      "Name": "GPU",
+      "Type": "GPU",
+      "ZoneName": "mtktscpu",
+      "HotThreshold": ["NAN", "NAN", "NAN", 85, 90, 100, 117],
+      "VrThreshold": "85.0",
+      "Multiplier": 0.001
+    },
+    {
+      "Name": "mtktsAP",
+      "Type": "SKIN",
+      "HotThreshold": ["NAN", "NAN", "NAN", "50.0", 70, 80, 90],
+      "VrThreshold": "NAN",
+      "Multiplier": 0.001
+    }
+  ],
+  "CoolingDevices": [
+    {
+      "Name": "cpu0",
+      "Type": "CPU"
+    }
+  ]
+})";
+
+/* A directory standing in for /sys/class/thermal */
+class ThermalZonesTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        addNode("thermal_zone0", "mtktsbattery", "temp", "30000\n");
+        addNode("thermal_zone3", "mtktscpu", "temp", "45000\n");
+        addNode("thermal_zone7", "mtktsAP", "temp", "35000\n");
+        addNode("cooling_device2", "cpu0", "cur_state", "2\n");
+
+        ASSERT_TRUE(mZones.parseConfig(kConfig));
+        ASSERT_TRUE(mZones.openZones());
+    }
+
+    std::string path(const std::string& node) { return std::string(mDir.path) + "/" + node; }
+
+    void addNode(const std::string& dir, const std::string& type, const std::string& node,
+                 const std::string& value) {
+        ASSERT_EQ(0, mkdir(path(dir).c_str(), 0700));
+        ASSERT_TRUE(WriteStringToFile(type + "\n", path(dir + "/type")));
+        ASSERT_TRUE(WriteStringToFile(value, path(dir + "/" + node)));
+    }
+
+    /* Set the zones in degrees and run a pass over them */
+    std::chrono::milliseconds update(float cpu, float skin = 35) {
+        EXPECT_TRUE(WriteStringToFile(std::to_string(std::lround(cpu * 1000)) + "\n",
+                                      path("thermal_zone3/temp")));
+        EXPECT_TRUE(WriteStringToFile(std::to_string(std::lround(skin * 1000)) + "\n",
+                                      path("thermal_zone7/temp")));
+        std::vector<float> raw;
+        EXPECT_TRUE(mZones.readZones(&raw));
+        mChanged.clear();
+        return mZones.update(raw, &mChanged);
+    }
+
+    const ZoneSensor& cpu() { return mZones.sensors()[0]; }
+    const ZoneSensor& skin() { return mZones.sensors()[2]; }
+
+    TemporaryDir mDir;
+    ThermalZones mZones{std::string(mDir.path) + "/"};
+    std::vector<size_t> mChanged;
+};
+
+TEST_F(ThermalZonesTest, ConfigIsFlattened) {
+    ASSERT_EQ(3u, mZones.sensors().size());
+    ASSERT_EQ(2u, mZones.zones().size()) << "sensors sharing a zone read it once";
+    EXPECT_EQ(mZones.sensors()[0].zone, mZones.sensors()[1].zone);
+    EXPECT_EQ("mtktsAP", mZones.zones()[skin().zone].type) << "ZoneName defaults to Name";
+
+    EXPECT_EQ("SKIN", skin().type);
+    EXPECT_TRUE(std::isnan(skin().hotThresholds[kModerate - 1]));
+    EXPECT_EQ(50.0f, skin().hotThresholds[kModerate]) << "string thresholds are parsed";
+    EXPECT_EQ(85.0f, cpu().vrThreshold);
+    EXPECT_TRUE(std::isnan(skin().vrThreshold));
+}
+
+TEST_F(ThermalZonesTest, BrokenConfigIsRejected) {
+    ThermalZones zones(path(""));
+    EXPECT_FALSE(zones.parseConfig("{"));
+    EXPECT_FALSE(zones.parseConfig(R"({"Sensors": [{"Name": "CPU", "HotThreshold": [1, 2]}]})"));
+    EXPECT_FALSE(zones.parseConfig(R"({"Sensors": []})"));
+}
+
+TEST_F(ThermalZonesTest, MissingZoneFailsToOpen) {
+    ThermalZones zones(path(""));
+    ASSERT_TRUE(zones.parseConfig(R"({"Sensors": [{"Name": "mtktsabb", "Type": "CPU",
+            "HotThreshold": ["NAN", "NAN", "NAN", 85, 90, 100, 117]}]})"));
+    EXPECT_FALSE(zones.openZones());
+}
+
+TEST_F(ThermalZonesTest, MultiplierScalesTheReading) {
+    update(45.5f, 36);
+    EXPECT_FLOAT_EQ(45.5f, cpu().value);
+    EXPECT_FLOAT_EQ(45.5f, mZones.sensors()[1].value);
+    EXPECT_FLOAT_EQ(36.0f, skin().value);
+    EXPECT_TRUE(mChanged.empty());
+}
+
+TEST_F(ThermalZonesTest, TripPointsRaiseTheSeverity) {
+    update(84.9f);
+    EXPECT_EQ(kNone, cpu().severity);
+    EXPECT_TRUE(mChanged.empty());
+
+    update(85);
+    EXPECT_EQ(kModerate, cpu().severity);
+    EXPECT_EQ((std::vector<size_t>{0, 1}), mChanged) << "both sensors on the zone change";
+
+    update(95);
+    EXPECT_EQ(kSevere, cpu().severity);
+
+    /* Skipping levels goes straight to the highest one crossed */
+    update(120, 55);
+    EXPECT_EQ(kShutdown, cpu().severity);
+    EXPECT_EQ(kModerate, skin().severity);
+    EXPECT_EQ((std::vector<size_t>{0, 1, 2}), mChanged);
+}
+
+TEST_F(ThermalZonesTest, SeverityIsOnlyLeftPastTheHysteresis) {
+    update(90.5f);
+    ASSERT_EQ(kSevere, cpu().severity);
+
+    update(89.2f);
+    EXPECT_EQ(kSevere, cpu().severity);
+    EXPECT_TRUE(mChanged.empty());
+
+    update(88.9f);
+    EXPECT_EQ(kModerate, cpu().severity);
+
+    update(84.5f);
+    EXPECT_EQ(kModerate, cpu().severity);
+
+    update(83.9f);
+    EXPECT_EQ(kNone, cpu().severity);
+    EXPECT_EQ((std::vector<size_t>{0, 1}), mChanged);
+
+    /* A query does not move the reported severity */
+    EXPECT_EQ(kNone, ThermalZones::computeSeverity(cpu(), 84.5f));
+}
+
+TEST_F(ThermalZonesTest, PollIntervalFollowsTheClosestMargin) {
+    /* Far from every threshold the uevents have to do */
+    EXPECT_EQ(10000ms, update(45));
+
+    /* The skin is 4 degrees from its first threshold, readings are in millidegrees */
+    EXPECT_NEAR(4000, update(45, 46).count(), 1);
+    EXPECT_NEAR(2500, update(82.5f, 46).count(), 1);
+
+    /* Within half a degree polling does not get any faster */
+    EXPECT_EQ(500ms, update(84.8f));
+
+    /* Once throttling, the hysteresis edge below counts as well */
+    EXPECT_NEAR(1500, update(85.5f).count(), 1);
+    EXPECT_EQ(500ms, update(84.2f));
+    EXPECT_EQ(kModerate, cpu().severity);
+}
+
+TEST(ThermalZonesPollIntervalTest, IntervalIsClamped) {
+    EXPECT_EQ(500ms, ThermalZones::pollInterval(-3));
+    EXPECT_EQ(500ms, ThermalZones::pollInterval(0.1f));
+    EXPECT_EQ(750ms, ThermalZones::pollInterval(0.75f));
+    EXPECT_EQ(10000ms, ThermalZones::pollInterval(10));
+    EXPECT_EQ(10000ms, ThermalZones::pollInterval(INFINITY));
+}
+
+TEST_F(ThermalZonesTest, CoolingDeviceStateIsRead) {
+    ASSERT_EQ(1u, mZones.coolingDevices().size());
+    int64_t state = -1;
+    ASSERT_TRUE(mZones.readCoolingDevice(mZones.coolingDevices()[0], &state));
+    EXPECT_EQ(2, state);
+}
+
+}  // namespace
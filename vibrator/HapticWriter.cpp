@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ * Copyright (C) 2022 StatiX
+ * SPDX-License-Identifer: Apache-2.0
+ */
+
+#define LOG_TAG "vibrator.rosemary"
+
+#include "vibrator-impl/HapticWriter.h"
+
+#include <android-base/logging.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <utility>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+static int32_t amplitudeToGain(float amplitude) {
+    return static_cast<int32_t>(std::lround(amplitude * GAIN_MAX));
+}
+
+HapticWriter::HapticWriter(const std::string& nodeDir)
+    : mHasGain(access((nodeDir + "/gain").c_str(), W_OK) == 0),
+      mActivate{nodeDir + "/activate"},
+      mDuration{nodeDir + "/duration"},
+      mIndex{nodeDir + "/index"},
+      mGain{nodeDir + "/gain"},
+      mWriterThread(&HapticWriter::writerLoop, this) {}
+
+HapticWriter::~HapticWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mRequestLock);
+        mWriterExit = true;
+    }
+    mWriterCv.notify_one();
+
+    if (mWriterThread.joinable()) {
+        mWriterThread.join();
+    }
+}
+
+/*
+ * Queue a command for the writer thread and return without waiting for the
+ * driver. A command that has not been picked up yet is superseded, only the
+ * latest request matters to the motor.
+ */
+void HapticWriter::submit(const HapticCommand& command) {
+    {
+        std::lock_guard<std::mutex> lock(mRequestLock);
+        if (mCommand.type != HapticCommand::Type::NONE) {
+            mSuperseded++;
+        }
+        mCommand = command;
+        /* The command carries its own amplitude, older gain requests are moot */
+        mAmplitudePending = false;
+    }
+    mWriterCv.notify_one();
+}
+
+void HapticWriter::setAmplitude(float amplitude) {
+    {
+        std::lock_guard<std::mutex> lock(mRequestLock);
+        mAmplitude = amplitude;
+        mAmplitudePending = true;
+    }
+    mWriterCv.notify_one();
+}
+
+float HapticWriter::amplitude() {
+    std::lock_guard<std::mutex> lock(mRequestLock);
+    return mAmplitude;
+}
+
+void HapticWriter::flush() {
+    std::unique_lock<std::mutex> lock(mRequestLock);
+    mIdleCv.wait(lock, [this] {
+        return !mWriterBusy && !mAmplitudePending && mCommand.type == HapticCommand::Type::NONE;
+    });
+}
+
+/*
+ * All sysfs I/O happens here, so a slow driver write never holds up a binder
+ * thread. Between commands the loop also paces the PWM pulses.
+ */
+void HapticWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(mRequestLock);
+    auto hasWork = [this] {
+        return mWriterExit || mAmplitudePending || mCommand.type != HapticCommand::Type::NONE;
+    };
+
+    while (true) {
+        if (mPwmRunning) {
+            mWriterCv.wait_until(lock, mPwmNext, hasWork);
+        } else {
+            mWriterCv.wait(lock, hasWork);
+        }
+
+        if (mWriterExit) {
+            break;
+        }
+
+        HapticCommand command = std::exchange(mCommand, HapticCommand());
+        bool amplitudePending = std::exchange(mAmplitudePending, false);
+        float amplitude = mAmplitude;
+        mWriterBusy = true;
+        lock.unlock();
+
+        {
+            std::lock_guard<std::mutex> nodeLock(mNodeLock);
+            if (amplitudePending) {
+                /* A running PWM cycle picks the new amplitude up on its next period */
+                if (mHasGain) {
+                    writeNode(mGain, amplitudeToGain(amplitude));
+                } else {
+                    mPwmAmplitude = amplitude;
+                }
+            }
+            if (command.type != HapticCommand::Type::NONE) {
+                execute(command);
+            } else if (mPwmRunning && std::chrono::steady_clock::now() >= mPwmNext) {
+                pwmPulse();
+            }
+        }
+
+        lock.lock();
+        mWriterBusy = false;
+        mIdleCv.notify_all();
+    }
+}
+
+void HapticWriter::execute(const HapticCommand& command) {
+    mPwmRunning = false;
+
+    if (command.type == HapticCommand::Type::OFF) {
+        /*
+         * Reset index before triggering another set of haptics. activate is
+         * cleared even if that fails, a stale index must not keep the motor on.
+         */
+        writeNode(mIndex, 0);
+        writeNode(mActivate, 0);
+        return;
+    }
+
+    if (!writeNode(mIndex, command.index)) {
+        return;
+    }
+
+    if (mHasGain) {
+        if (!writeNode(mGain, amplitudeToGain(command.amplitude))) {
+            return;
+        }
+    } else if (command.amplitude < 1.0f) {
+        mPwmNext = std::chrono::steady_clock::now();
+        mPwmEnd = mPwmNext + std::chrono::milliseconds(command.timeoutMs);
+        mPwmAmplitude = command.amplitude;
+        mPwmRunning = true;
+        pwmPulse();
+        return;
+    }
+
+    if (writeNode(mDuration, command.timeoutMs) && writeNode(mActivate, 1)) {
+        /* The driver drops activate by itself once the duration expires */
+        mActivate.valid = false;
+    }
+}
+
+/*
+ * Without a gain node the motor is pulsed for a fraction of every PWM period
+ * matching the requested amplitude. Each pulse is timed by the driver itself,
+ * so only the start of every period has to be scheduled from here.
+ */
+void HapticWriter::pwmPulse() {
+    using namespace std::chrono;
+
+    if (mPwmNext >= mPwmEnd) {
+        mPwmRunning = false;
+        return;
+    }
+
+    int32_t remainingMs = duration_cast<milliseconds>(mPwmEnd - mPwmNext).count();
+    int32_t pulseMs = std::max<int32_t>(1, std::lround(PWM_PERIOD_MS * mPwmAmplitude));
+
+    if (!writeNode(mDuration, std::max(1, std::min(pulseMs, remainingMs))) ||
+        !writeNode(mActivate, 1)) {
+        mPwmRunning = false;
+        return;
+    }
+    mActivate.valid = false;
+    mPwmPulses++;
+
+    mPwmNext += milliseconds(PWM_PERIOD_MS);
+}
+
+/*
+ * Write value to a driver node unless it already holds it. The shadow value is
+ * dropped on failure so the next request always reaches the kernel again.
+ */
+bool HapticWriter::writeNode(HapticNodeState& node, int32_t value) {
+    if (node.valid && node.value == value) {
+        node.elided++;
+        return true;
+    }
+
+    std::ofstream file(node.path);
+    file << value;
+    file.close();
+
+    if (file.fail()) {
+        LOG(ERROR) << "Failed to write " << value << " to " << node.path;
+        node.valid = false;
+        node.errors++;
+        return false;
+    }
+
+    node.valid = true;
+    node.value = value;
+    node.written++;
+    return true;
+}
+
+std::vector<HapticNodeState> HapticWriter::nodeStates() {
+    std::lock_guard<std::mutex> lock(mNodeLock);
+    return {mActivate, mDuration, mIndex, mGain};
+}
+
+void HapticWriter::dump(int fd) {
+    {
+        std::lock_guard<std::mutex> lock(mRequestLock);
+        dprintf(fd, "Vibrator amplitude: %.2f (%s)\n", mAmplitude,
+                mHasGain ? "driver gain" : "duty-cycling");
+        dprintf(fd, "Vibrator superseded commands: %" PRIu64 "\n", mSuperseded);
+    }
+
+    std::lock_guard<std::mutex> lock(mNodeLock);
+    dprintf(fd, "Vibrator PWM pulses: %" PRIu64 "\n", mPwmPulses);
+
+    dprintf(fd, "Vibrator node writes:\n");
+    for (const HapticNodeState* node : {&mActivate, &mDuration, &mIndex, &mGain}) {
+        dprintf(fd, "  %s: written=%" PRIu64 " elided=%" PRIu64 " errors=%" PRIu64 "\n",
+                node->path.c_str(), node->written, node->elided, node->errors);
+    }
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
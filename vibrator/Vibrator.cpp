@@ -9,47 +9,58 @@
 #include "vibrator-impl/Vibrator.h"
 
 #include <android-base/logging.h>
-#include <fstream>
+
+#include <algorithm>
+#include <cmath>
 
 namespace aidl {
 namespace android {
 namespace hardware {
 namespace vibrator {
 
-template <typename T>
-static void write_haptic_node(const std::string& path, const T& value) {
-    std::ofstream file(path);
-    file << value;
- }
+static float strengthToAmplitude(EffectStrength strength) {
+    switch (strength) {
+        case EffectStrength::LIGHT:
+            return 0.5f;
+        case EffectStrength::MEDIUM:
+            return 0.75f;
+        default:
+            return 1.0f;
+    }
+}
+
+Vibrator::Vibrator() {
+    LOG(INFO) << "Vibrator amplitude control through "
+              << (mWriter.hasGain() ? "driver gain" : "duty-cycling");
+}
 
 ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
     LOG(INFO) << "Vibrator reporting capabilities";
-    *_aidl_return = 0;
+    *_aidl_return = IVibrator::CAP_AMPLITUDE_CONTROL;
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::off() {
     LOG(INFO) << "Vibrator off";
-    /* Reset index before triggering another set of haptics */
-    write_haptic_node(index_node, 0);
-    write_haptic_node(activate_node, 0);
+    mWriter.submit({.type = HapticCommand::Type::OFF});
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::on(int32_t timeoutMs,
                                 const std::shared_ptr<IVibratorCallback>& callback) {
     LOG(INFO) << "Vibrator on for timeoutMs: " << timeoutMs;
-    write_haptic_node(duration_node, timeoutMs);
-    write_haptic_node(activate_node, 1);
+    float amplitude = mWriter.amplitude();
+    mWriter.submit({.type = HapticCommand::Type::VIBRATE, .timeoutMs = timeoutMs,
+                    .amplitude = amplitude});
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::perform(Effect effect, EffectStrength strength,
                                      const std::shared_ptr<IVibratorCallback>& callback,
                                      int32_t* _aidl_return) {
-    ndk::ScopedAStatus status;
     uint32_t index = 0;
     uint32_t timeMs = 0;
+    float amplitude = strengthToAmplitude(strength);
 
     LOG(INFO) << "Vibrator perform";
 
@@ -93,15 +104,19 @@ ndk::ScopedAStatus Vibrator::perform(Effect effect, EffectStrength strength,
             return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
     }
 
-    /* Setup effect index */
-    write_haptic_node(index_node, index);
-
-    status = on(timeMs, nullptr);
-    if (!status.isOk()) {
-        return status;
-    } else {
-        *_aidl_return = timeMs;
+    /*
+     * Firmware waveforms cannot be duty-cycled, so without a gain node
+     * weaker strengths cut the waveform short instead.
+     */
+    if (!mWriter.hasGain()) {
+        timeMs = std::max(WAVEFORM_TICK_EFFECT_MS,
+                          static_cast<uint32_t>(std::lround(timeMs * amplitude)));
+        amplitude = 1.0f;
     }
+
+    mWriter.submit({.type = HapticCommand::Type::VIBRATE, .index = static_cast<int32_t>(index),
+                    .timeoutMs = static_cast<int32_t>(timeMs), .amplitude = amplitude});
+    *_aidl_return = timeMs;
     return ndk::ScopedAStatus::ok();
 }
 
@@ -121,7 +136,13 @@ ndk::ScopedAStatus Vibrator::getSupportedEffects(std::vector<Effect> *_aidl_retu
 }
 
 ndk::ScopedAStatus Vibrator::setAmplitude(float amplitude) {
-    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    if (amplitude <= 0.0f || amplitude > 1.0f) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    LOG(INFO) << "Vibrator amplitude set to " << amplitude;
+    mWriter.setAmplitude(amplitude);
+    return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::setExternalControl(bool enabled) {
@@ -199,6 +220,11 @@ ndk::ScopedAStatus Vibrator::composePwle(const std::vector<PrimitivePwle> &compo
     return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
 }
 
+binder_status_t Vibrator::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    mWriter.dump(fd);
+    return STATUS_OK;
+}
+
 }  // namespace vibrator
 }  // namespace hardware
 }  // namespace android
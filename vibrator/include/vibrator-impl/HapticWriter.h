@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ * Copyright (C) 2022 StatiX
+ * SPDX-License-Identifer: Apache-2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+// Driver Nodes
+static constexpr char aw8622_dir[] = "/sys/devices/platform/aw8622";
+
+// Full scale of the driver gain node, when present
+static constexpr int32_t GAIN_MAX = 255;
+
+// Period used to emulate amplitude by duty-cycling activate when there is no gain node
+static constexpr uint32_t PWM_PERIOD_MS = 20;
+
+// Last value written to a driver node, used to skip redundant sysfs writes
+struct HapticNodeState {
+    std::string path;
+    bool valid = false;
+    int32_t value = 0;
+
+    uint64_t written = 0;
+    uint64_t elided = 0;
+    uint64_t errors = 0;
+};
+
+// Request handed from the binder threads to the writer thread, a newer one replaces a queued one
+struct HapticCommand {
+    enum class Type { NONE, OFF, VIBRATE };
+
+    Type type = Type::NONE;
+    int32_t index = 0;
+    int32_t timeoutMs = 0;
+    float amplitude = 1.0f;
+};
+
+/*
+ * Owns the aw8622 nodes and the thread that writes them. Nothing here depends on
+ * binder, so the service and the host tests drive the same code.
+ */
+class HapticWriter {
+  public:
+    explicit HapticWriter(const std::string& nodeDir = aw8622_dir);
+    ~HapticWriter();
+
+    bool hasGain() const { return mHasGain; }
+
+    // Queue a command, replacing one that was not picked up yet
+    void submit(const HapticCommand& command);
+
+    // Set the amplitude of later commands and of a running PWM cycle
+    void setAmplitude(float amplitude);
+    float amplitude();
+
+    // Wait until the writer handled everything queued so far
+    void flush();
+
+    std::vector<HapticNodeState> nodeStates();
+    void dump(int fd);
+
+  private:
+    void writerLoop();
+    void execute(const HapticCommand& command);
+    void pwmPulse();
+    bool writeNode(HapticNodeState& node, int32_t value);
+
+    const bool mHasGain;
+
+    /* Mailbox between the binder threads and the writer thread */
+    std::mutex mRequestLock;
+    std::condition_variable mWriterCv;
+    std::condition_variable mIdleCv;
+    HapticCommand mCommand;
+    float mAmplitude = 1.0f;
+    bool mAmplitudePending = false;
+    bool mWriterBusy = false;
+    bool mWriterExit = false;
+    uint64_t mSuperseded = 0;
+
+    /* Driver state, only touched by the writer thread and dump() */
+    std::mutex mNodeLock;
+    HapticNodeState mActivate;
+    HapticNodeState mDuration;
+    HapticNodeState mIndex;
+    HapticNodeState mGain;
+
+    bool mPwmRunning = false;
+    float mPwmAmplitude = 1.0f;
+    std::chrono::steady_clock::time_point mPwmNext;
+    std::chrono::steady_clock::time_point mPwmEnd;
+    uint64_t mPwmPulses = 0;
+
+    std::thread mWriterThread;
+};
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -18,16 +18,13 @@
 
 #include <aidl/android/hardware/vibrator/BnVibrator.h>
 
+#include "vibrator-impl/HapticWriter.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
 namespace vibrator {
 
-// Driver Nodes
-static constexpr char activate_node[] = "/sys/devices/platform/aw8622/activate";
-static constexpr char duration_node[] = "/sys/devices/platform/aw8622/duration";
-static constexpr char index_node[] = "/sys/devices/platform/aw8622/index";
-
 // Define durations for waveforms
 static constexpr uint32_t WAVEFORM_TICK_EFFECT_MS = 10;
 static constexpr uint32_t WAVEFORM_TEXTURE_TICK_EFFECT_MS = 20;
@@ -46,6 +43,10 @@ static constexpr uint32_t WAVEFORM_DOUBLE_CLICK_EFFECT_INDEX = 6;
 static constexpr uint32_t WAVEFORM_THUD_EFFECT_INDEX = 7;
 
 class Vibrator : public BnVibrator {
+  public:
+    Vibrator();
+
+  private:
     ndk::ScopedAStatus getCapabilities(int32_t* _aidl_return) override;
     ndk::ScopedAStatus off() override;
     ndk::ScopedAStatus on(int32_t timeoutMs,
@@ -76,6 +77,9 @@ class Vibrator : public BnVibrator {
     ndk::ScopedAStatus getSupportedBraking(std::vector<Braking>* supported) override;
     ndk::ScopedAStatus composePwle(const std::vector<PrimitivePwle> &composite,
                                    const std::shared_ptr<IVibratorCallback> &callback) override;
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+    HapticWriter mWriter;
 };
 
 }  // namespace vibrator
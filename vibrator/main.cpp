@@ -13,7 +13,13 @@
 using aidl::android::hardware::vibrator::Vibrator;
 
 int main() {
-    ABinderProcess_setThreadPoolMaxThreadCount(0);
+    /*
+     * Sysfs I/O runs on the service's writer thread, so binder threads only
+     * queue requests. One extra thread keeps a dump or a slow client from
+     * stalling the next request.
+     */
+    ABinderProcess_setThreadPoolMaxThreadCount(1);
+    ABinderProcess_startThreadPool();
 
     // make a default vibrator service
     auto vib = ndk::SharedRefBase::make<Vibrator>();
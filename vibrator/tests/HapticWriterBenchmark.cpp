@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ * Copyright (C) 2022 StatiX
+ * SPDX-License-Identifer: Apache-2.0
+ */
+
+#include "vibrator-impl/HapticWriter.h"
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using ::aidl::android::hardware::vibrator::HapticCommand;
+using ::aidl::android::hardware::vibrator::HapticWriter;
+using ::android::base::WriteStringToFile;
+
+namespace {
+
+constexpr int kCallsPerThread = 1000;
+
+/*
+ * Run every client on its own thread, the way binder threads call into the
+ * service, and time each call. The writer thread meanwhile does the sysfs I/O.
+ */
+std::vector<std::chrono::nanoseconds> runClients(
+        const std::vector<std::function<void(int)>>& clients) {
+    std::mutex lock;
+    std::vector<std::chrono::nanoseconds> latencies;
+    std::vector<std::thread> threads;
+
+    for (const auto& client : clients) {
+        threads.emplace_back([&] {
+            std::vector<std::chrono::nanoseconds> local;
+            local.reserve(kCallsPerThread);
+            for (int i = 0; i < kCallsPerThread; i++) {
+                auto start = std::chrono::steady_clock::now();
+                client(i);
+                local.push_back(std::chrono::steady_clock::now() - start);
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            latencies.insert(latencies.end(), local.begin(), local.end());
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return latencies;
+}
+
+double percentileUs(const std::vector<std::chrono::nanoseconds>& sorted, double p) {
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * p));
+    return std::chrono::duration<double, std::micro>(sorted[index]).count();
+}
+
+/* Typing ticks from two clients while a third changes the amplitude and a fourth stops */
+void BM_MixedClientLatency(benchmark::State& state) {
+    TemporaryDir dir;
+    for (const char* node : {"activate", "duration", "index", "gain"}) {
+        WriteStringToFile("", std::string(dir.path) + "/" + node);
+    }
+    HapticWriter writer(dir.path);
+
+    const HapticCommand tick = {.type = HapticCommand::Type::VIBRATE, .index = 1, .timeoutMs = 10};
+    const HapticCommand click = {.type = HapticCommand::Type::VIBRATE, .index = 2, .timeoutMs = 15};
+    std::vector<std::function<void(int)>> clients = {
+        [&](int) { writer.submit(tick); },
+        [&](int) { writer.submit(click); },
+        [&](int i) { writer.setAmplitude(i % 2 ? 0.5f : 1.0f); },
+        [&](int) { writer.submit({.type = HapticCommand::Type::OFF}); },
+    };
+
+    std::vector<std::chrono::nanoseconds> latencies;
+    for (auto _ : state) {
+        auto burst = runClients(clients);
+        latencies.insert(latencies.end(), burst.begin(), burst.end());
+        writer.flush();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    state.counters["p50_us"] = percentileUs(latencies, 0.50);
+    state.counters["p99_us"] = percentileUs(latencies, 0.99);
+    state.counters["max_us"] = percentileUs(latencies, 1.0);
+}
+BENCHMARK(BM_MixedClientLatency)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
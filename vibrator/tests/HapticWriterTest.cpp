@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ * Copyright (C) 2022 StatiX
+ * SPDX-License-Identifer: Apache-2.0
+ */
+
+#include "vibrator-impl/HapticWriter.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using ::aidl::android::hardware::vibrator::HapticCommand;
+using ::aidl::android::hardware::vibrator::HapticNodeState;
+using ::aidl::android::hardware::vibrator::HapticWriter;
+using ::aidl::android::hardware::vibrator::PWM_PERIOD_MS;
+using ::android::base::ReadFileToString;
+using ::android::base::WriteStringToFile;
+
+namespace {
+
+enum Node { ACTIVATE, DURATION, INDEX, GAIN };
+
+/* A directory standing in for /sys/devices/platform/aw8622 */
+class HapticWriterTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        for (const char* node : {"activate", "duration", "index", "gain"}) {
+            ASSERT_TRUE(WriteStringToFile("", path(node)));
+        }
+        mWriter = std::make_unique<HapticWriter>(mDir.path);
+    }
+
+    std::string path(const std::string& node) { return std::string(mDir.path) + "/" + node; }
+
+    std::string read(const std::string& node) {
+        std::string value;
+        EXPECT_TRUE(ReadFileToString(path(node), &value));
+        return value;
+    }
+
+    // Make writes to node fail the way a sysfs node rejecting them would
+    void breakNode(const std::string& node) {
+        ASSERT_EQ(0, unlink(path(node).c_str()));
+        ASSERT_EQ(0, mkdir(path(node).c_str(), 0700));
+    }
+
+    void fixNode(const std::string& node) {
+        ASSERT_EQ(0, rmdir(path(node).c_str()));
+        ASSERT_TRUE(WriteStringToFile("", path(node)));
+    }
+
+    void run(const HapticCommand& command) {
+        mWriter->submit(command);
+        mWriter->flush();
+    }
+
+    HapticNodeState state(Node node) { return mWriter->nodeStates()[node]; }
+
+    TemporaryDir mDir;
+    std::unique_ptr<HapticWriter> mWriter;
+};
+
+const HapticCommand kTick = {
+        .type = HapticCommand::Type::VIBRATE, .index = 1, .timeoutMs = 10, .amplitude = 1.0f};
+const HapticCommand kOff = {.type = HapticCommand::Type::OFF};
+
+/* Same driver without the gain node, amplitude is emulated by duty-cycling activate */
+class HapticWriterPwmTest : public HapticWriterTest {
+  protected:
+    void SetUp() override {
+        HapticWriterTest::SetUp();
+        mWriter.reset();
+        ASSERT_EQ(0, unlink(path("gain").c_str()));
+        mWriter = std::make_unique<HapticWriter>(mDir.path);
+    }
+
+    // Wait for the PWM cycle to end, each pulse is one write of activate
+    uint64_t waitForPulses(uint64_t expected) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (state(ACTIVATE).written < expected && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        /* Give a pulse past the end of the cycle the chance to show up */
+        std::this_thread::sleep_for(std::chrono::milliseconds(3 * PWM_PERIOD_MS));
+        return state(ACTIVATE).written;
+    }
+};
+
+TEST_F(HapticWriterTest, TypingBurstOnlyWritesActivate) {
+    constexpr uint64_t kKeys = 50;
+    for (uint64_t i = 0; i < kKeys; i++) {
+        run(kTick);
+    }
+
+    EXPECT_EQ("1", read("activate"));
+    EXPECT_EQ("10", read("duration"));
+    EXPECT_EQ("1", read("index"));
+    EXPECT_EQ("255", read("gain"));
+
+    /* The driver drops activate on its own, so every key press has to write it */
+    EXPECT_EQ(kKeys, state(ACTIVATE).written);
+    EXPECT_EQ(0u, state(ACTIVATE).elided);
+    for (Node node : {DURATION, INDEX, GAIN}) {
+        EXPECT_EQ(1u, state(node).written);
+        EXPECT_EQ(kKeys - 1, state(node).elided);
+        EXPECT_EQ(0u, state(node).errors);
+    }
+}
+
+TEST_F(HapticWriterTest, ElidedWriteLeavesNodeAlone) {
+    run(kTick);
+    ASSERT_TRUE(WriteStringToFile("stale", path("duration")));
+    run(kTick);
+    EXPECT_EQ("stale", read("duration"));
+}
+
+TEST_F(HapticWriterTest, WriteErrorDropsShadow) {
+    run(kTick);
+
+    breakNode("index");
+    run({.type = HapticCommand::Type::VIBRATE, .index = 2, .timeoutMs = 10});
+    EXPECT_EQ(1u, state(INDEX).errors);
+    EXPECT_FALSE(state(INDEX).valid);
+
+    /* The old value is unknown to the driver now and must be written again */
+    fixNode("index");
+    run(kTick);
+    EXPECT_EQ("1", read("index"));
+    EXPECT_EQ(2u, state(INDEX).written);
+}
+
+TEST_F(HapticWriterTest, OffClearsActivateWhenIndexFails) {
+    run(kTick);
+    ASSERT_EQ("1", read("activate"));
+
+    breakNode("index");
+    run(kOff);
+    EXPECT_EQ("0", read("activate"));
+}
+
+TEST_F(HapticWriterTest, RestartStartsWithoutShadow) {
+    run(kTick);
+    run(kOff);
+
+    ASSERT_TRUE(WriteStringToFile("", path("index")));
+    mWriter = std::make_unique<HapticWriter>(mDir.path);
+    run(kOff);
+    EXPECT_EQ("0", read("index"));
+    EXPECT_EQ(1u, state(INDEX).written);
+}
+
+TEST_F(HapticWriterTest, GainFollowsAmplitude) {
+    ASSERT_TRUE(mWriter->hasGain());
+
+    run({.type = HapticCommand::Type::VIBRATE, .index = 1, .timeoutMs = 30, .amplitude = 0.5f});
+    EXPECT_EQ("128", read("gain"));
+    EXPECT_EQ("30", read("duration"));
+    EXPECT_EQ("1", read("activate"));
+
+    mWriter->setAmplitude(0.75f);
+    mWriter->flush();
+    EXPECT_EQ("191", read("gain"));
+    EXPECT_EQ(0.75f, mWriter->amplitude());
+}
+
+TEST_F(HapticWriterPwmTest, FullAmplitudeIsOnePulse) {
+    ASSERT_FALSE(mWriter->hasGain());
+
+    run({.type = HapticCommand::Type::VIBRATE, .timeoutMs = 100, .amplitude = 1.0f});
+    EXPECT_EQ("100", read("duration"));
+    EXPECT_EQ(1u, waitForPulses(1));
+}
+
+TEST_F(HapticWriterPwmTest, HalfAmplitudePulsesEveryPeriod) {
+    constexpr int32_t kTimeoutMs = 5 * PWM_PERIOD_MS;
+
+    run({.type = HapticCommand::Type::VIBRATE, .timeoutMs = kTimeoutMs, .amplitude = 0.5f});
+    EXPECT_EQ(5u, waitForPulses(5));
+    EXPECT_EQ(std::to_string(PWM_PERIOD_MS / 2), read("duration"));
+    EXPECT_FALSE(mWriter->hasGain());
+}
+
+TEST_F(HapticWriterPwmTest, AmplitudeChangeReachesRunningCycle) {
+    run({.type = HapticCommand::Type::VIBRATE, .timeoutMs = 10 * PWM_PERIOD_MS,
+         .amplitude = 0.5f});
+    mWriter->setAmplitude(0.25f);
+    mWriter->flush();
+
+    EXPECT_EQ(10u, waitForPulses(10));
+    EXPECT_EQ(std::to_string(PWM_PERIOD_MS / 4), read("duration"));
+}
+
+TEST_F(HapticWriterPwmTest, OffStopsPulses) {
+    run({.type = HapticCommand::Type::VIBRATE, .timeoutMs = 10 * PWM_PERIOD_MS,
+         .amplitude = 0.5f});
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (state(ACTIVATE).written < 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    uint64_t pulses = state(ACTIVATE).written;
+    ASSERT_GE(pulses, 2u) << "the cycle never got going";
+
+    run(kOff);
+    uint64_t stopped = state(ACTIVATE).written;
+    EXPECT_EQ("0", read("activate"));
+    /* The off command writes activate once, a pulse may still slip in ahead of it */
+    EXPECT_GE(stopped, pulses + 1);
+    EXPECT_LE(stopped, pulses + 2);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * PWM_PERIOD_MS));
+    EXPECT_EQ("0", read("activate"));
+    EXPECT_EQ(stopped, state(ACTIVATE).written) << "pulses went on after off";
+}
+
+}  // namespace
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "zramd"
+
+#include "ZramManager.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/properties.h>
+#include <android-base/strings.h>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#define PSI_MEMORY          "/proc/pressure/memory"
+#define SWAPPINESS          "/proc/sys/vm/swappiness"
+#define ZRAM_SYSFS          "/sys/block/zram0/"
+
+namespace android {
+namespace zram {
+
+using ::android::base::GetIntProperty;
+using ::android::base::ParseInt;
+using ::android::base::ReadFileToString;
+using ::android::base::Trim;
+using ::android::base::unique_fd;
+
+/* Same windows as the lmkd medium and critical levels, reported a bit earlier. */
+static constexpr char kSomeTrigger[] = "some 100000 1000000";
+static constexpr char kFullTrigger[] = "full 70000 1000000";
+
+/* Pressure has to stay away this long before swappiness is relaxed. */
+static constexpr std::chrono::seconds kCalmPeriod(30);
+
+/*
+ * Kernels before 5.8 cap swappiness at 100 and reject anything above it, the
+ * pressure value falls back to that cap when the first write is refused.
+ */
+static constexpr int kSwappinessCap = 100;
+static constexpr int kSwappinessMax = 200;
+
+static constexpr uint64_t kPagesPerMb = 1024 * 1024 / 4096;
+
+static unique_fd openNode(const std::string& path) {
+    unique_fd fd(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+
+    if (fd.get() < 0) {
+        PLOG(WARNING) << "failed to open " << path;
+    }
+    return fd;
+}
+
+static bool writeNode(int fd, const std::string& value) {
+    return fd >= 0 && pwrite(fd, value.c_str(), value.size(), 0) ==
+                              static_cast<ssize_t>(value.size());
+}
+
+ZramManager::ZramManager(const std::string& root)
+    : mRoot(root),
+      mSwappinessPressure(GetIntProperty("ro.vendor.zram.swappiness_pressure", kSwappinessMax,
+                                         0, kSwappinessMax)),
+      mWritebackInterval(GetIntProperty("ro.vendor.zram.writeback_interval_s", 600, 60, 86400)),
+      mWritebackLimitPages(GetIntProperty("ro.vendor.zram.writeback_limit_mb", 64, 1, 512) *
+                           kPagesPerMb) {}
+
+bool ZramManager::init() {
+    mEpollFd.reset(epoll_create1(EPOLL_CLOEXEC));
+    if (mEpollFd.get() < 0) {
+        PLOG(ERROR) << "failed to create epoll fd";
+        return false;
+    }
+
+    if (!addTrigger(kSomeTrigger, Pressure::SOME) || !addTrigger(kFullTrigger, Pressure::FULL)) {
+        return false;
+    }
+
+    return initNodes();
+}
+
+bool ZramManager::initNodes() {
+    mSwappinessFd = openNode(mRoot + SWAPPINESS);
+
+    /*
+     * Calm defaults to whatever init left behind, the rc files already tune
+     * it for zram. Nothing is written until the first pressure event.
+     */
+    std::string swappiness;
+    if (ReadFileToString(mRoot + SWAPPINESS, &swappiness) &&
+        ParseInt(Trim(swappiness), &mSwappiness, 0, kSwappinessMax)) {
+        mSwappinessCalm = mSwappiness;
+    }
+    mSwappinessCalm = GetIntProperty("ro.vendor.zram.swappiness_calm", mSwappinessCalm, 0,
+                                     kSwappinessMax);
+
+    /* The loop device is only attached when zram_backingdev_size is honoured. */
+    std::string backingDev;
+    if (ReadFileToString(mRoot + ZRAM_SYSFS "backing_dev", &backingDev) &&
+        Trim(backingDev) != "none") {
+        mWritebackFd = openNode(mRoot + ZRAM_SYSFS "writeback");
+        mWritebackLimitFd = openNode(mRoot + ZRAM_SYSFS "writeback_limit");
+        mWritebackLimitEnableFd = openNode(mRoot + ZRAM_SYSFS "writeback_limit_enable");
+        mWriteback = mWritebackFd.get() >= 0;
+    }
+    LOG(INFO) << "zram writeback " << (mWriteback ? "enabled" : "unavailable");
+
+    return true;
+}
+
+bool ZramManager::addTrigger(const char* trigger, Pressure level) {
+    unique_fd fd(open((mRoot + PSI_MEMORY).c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC));
+    if (fd.get() < 0) {
+        PLOG(ERROR) << "failed to open " PSI_MEMORY;
+        return false;
+    }
+
+    /* The trigger string has to go out with its terminating NUL. */
+    if (write(fd.get(), trigger, strlen(trigger) + 1) < 0) {
+        PLOG(ERROR) << "failed to register PSI trigger \"" << trigger << "\"";
+        return false;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLPRI;
+    event.data.u32 = mTriggers.size();
+    if (epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, fd.get(), &event) < 0) {
+        PLOG(ERROR) << "failed to watch PSI trigger \"" << trigger << "\"";
+        return false;
+    }
+
+    mTriggers.push_back({level, std::move(fd)});
+    return true;
+}
+
+void ZramManager::run() {
+    struct epoll_event events[2];
+
+    while (true) {
+        int n = epoll_wait(mEpollFd.get(), events, 2, calmTimeoutMs(Clock::now()));
+        if (n < 0) {
+            if (errno != EINTR) {
+                PLOG(ERROR) << "epoll_wait failed";
+                return;
+            }
+            continue;
+        }
+
+        auto now = Clock::now();
+        if (n == 0) {
+            onCalm();
+            continue;
+        }
+
+        Pressure level = Pressure::NONE;
+        for (int i = 0; i < n; i++) {
+            if (events[i].events & EPOLLERR) {
+                LOG(ERROR) << "PSI trigger " << events[i].data.u32 << " went away";
+                return;
+            }
+            level = std::max(level, mTriggers[events[i].data.u32].level);
+        }
+        onPressure(level, now);
+    }
+}
+
+/* Only wake up on a timeout while there is a pressure state to leave. */
+int ZramManager::calmTimeoutMs(Clock::time_point now) const {
+    if (mPressure == Pressure::NONE) {
+        return -1;
+    }
+    auto calm = mLastPressure + kCalmPeriod - now;
+    return std::max<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(calm).count(),
+                             0);
+}
+
+void ZramManager::onPressure(Pressure level, Clock::time_point now) {
+    if (level > mPressure) {
+        LOG(INFO) << "memory pressure " << (level == Pressure::FULL ? "full" : "some");
+    }
+    mPressure = std::max(mPressure, level);
+    mLastPressure = now;
+
+    /* Rather swap out cached apps than drop the page cache of the foreground one. */
+    setSwappiness(mSwappinessPressure);
+
+    if (mWriteback && (!mHasWrittenBack || now - mLastWriteback >= mWritebackInterval)) {
+        writebackIdle(now);
+    }
+}
+
+void ZramManager::onCalm() {
+    LOG(INFO) << "memory pressure gone";
+    mPressure = Pressure::NONE;
+    setSwappiness(mSwappinessCalm);
+}
+
+void ZramManager::setSwappiness(int value) {
+    if (value == mSwappiness) {
+        return;
+    }
+
+    if (!writeNode(mSwappinessFd.get(), std::to_string(value))) {
+        if (mSwappinessFd.get() >= 0 && errno == EINVAL && value > kSwappinessCap) {
+            LOG(INFO) << "swappiness " << value << " not supported, using " << kSwappinessCap;
+            mSwappinessPressure = std::min(mSwappinessPressure, kSwappinessCap);
+            mSwappinessCalm = std::min(mSwappinessCalm, kSwappinessCap);
+            setSwappiness(kSwappinessCap);
+            return;
+        }
+        PLOG(WARNING) << "failed to set swappiness to " << value;
+        return;
+    }
+    mSwappiness = value;
+}
+
+/*
+ * Writes back the pages the framework marked idle that were not touched since.
+ * The limit only bounds this pass and is lifted again afterwards, so that the
+ * periodic writeback of the framework is not cut short by it.
+ */
+void ZramManager::writebackIdle(Clock::time_point now) {
+    bool limited = writeNode(mWritebackLimitEnableFd.get(), "1") &&
+                   writeNode(mWritebackLimitFd.get(), std::to_string(mWritebackLimitPages));
+    if (!limited) {
+        PLOG(WARNING) << "failed to set the zram writeback limit";
+    }
+
+    if (!writeNode(mWritebackFd.get(), "idle")) {
+        PLOG(WARNING) << "failed to write back idle zram pages";
+    } else {
+        mWritebacks++;
+        LOG(INFO) << "wrote back idle zram pages (pass " << mWritebacks << ")";
+    }
+
+    if (!writeNode(mWritebackLimitEnableFd.get(), "0")) {
+        PLOG(WARNING) << "failed to lift the zram writeback limit";
+    }
+    mHasWrittenBack = true;
+    mLastWriteback = now;
+}
+
+}  // namespace zram
+}  // namespace android
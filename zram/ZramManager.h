@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace zram {
+
+using Clock = std::chrono::steady_clock;
+
+/*
+ * Reacts to PSI memory pressure on the zram swap set up by fstab.mt6785.
+ * Swappiness is raised while memory is under pressure and dropped back once
+ * it has been calm for a while. Under pressure, pages that stayed idle since
+ * the framework's ZramWriteback job last marked them are written back to the
+ * backing device. The idle epoch belongs to that job, zramd never marks pages.
+ */
+class ZramManager {
+  public:
+    enum class Pressure { NONE, SOME, FULL };
+
+    /*
+     * root is prepended to every /proc and /sys path, so that the host tests
+     * can run against a fake tree.
+     */
+    explicit ZramManager(const std::string& root = "");
+
+    bool init();
+    void run();
+
+    /* Open the swappiness and zram nodes, init() does this before registering the triggers. */
+    bool initNodes();
+
+    /* @return How long run() may wait for the next trigger in ms, -1 for ever. */
+    int calmTimeoutMs(Clock::time_point now) const;
+
+    void onPressure(Pressure level, Clock::time_point now);
+    void onCalm();
+
+    uint64_t writebacks() const { return mWritebacks; }
+
+  private:
+    struct Trigger {
+        Pressure level;
+        ::android::base::unique_fd fd;
+    };
+
+    bool addTrigger(const char* trigger, Pressure level);
+    void setSwappiness(int value);
+    void writebackIdle(Clock::time_point now);
+
+    const std::string mRoot;
+
+    int mSwappinessCalm = 100;
+    int mSwappinessPressure;
+    std::chrono::seconds mWritebackInterval;
+    uint64_t mWritebackLimitPages;
+
+    ::android::base::unique_fd mEpollFd;
+    std::vector<Trigger> mTriggers;
+
+    ::android::base::unique_fd mSwappinessFd;
+    ::android::base::unique_fd mWritebackFd;
+    ::android::base::unique_fd mWritebackLimitFd;
+    ::android::base::unique_fd mWritebackLimitEnableFd;
+    bool mWriteback = false;
+
+    int mSwappiness = -1;
+    Pressure mPressure = Pressure::NONE;
+    Clock::time_point mLastPressure;
+    bool mHasWrittenBack = false;
+    Clock::time_point mLastWriteback;
+
+    uint64_t mWritebacks = 0;
+};
+
+}  // namespace zram
+}  // namespace android
@@ -0,0 +1,21 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cstdlib>
+
+#include "ZramManager.h"
+
+using ::android::zram::ZramManager;
+
+int main() {
+    ZramManager manager;
+    if (!manager.init()) {
+        return EXIT_FAILURE;
+    }
+
+    manager.run();
+    return EXIT_FAILURE;  // should not reach
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ZramManager.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using ::android::base::ReadFileToString;
+using ::android::base::WriteStringToFile;
+using ::android::zram::Clock;
+using ::android::zram::ZramManager;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+using Pressure = ZramManager::Pressure;
+
+/* The PSI, swappiness and zram nodes zramd touches, in a fake /proc and /sys */
+class FakeTree {
+  public:
+    explicit FakeTree(const std::string& backingDev) {
+        for (const char* dir : {"/proc", "/proc/pressure", "/proc/sys", "/proc/sys/vm", "/sys",
+                                "/sys/block", "/sys/block/zram0"}) {
+            mkdir((root() + dir).c_str(), 0700);
+        }
+        WriteStringToFile("", root() + "/proc/pressure/memory");
+        WriteStringToFile("60\n", root() + "/proc/sys/vm/swappiness");
+        WriteStringToFile(backingDev + "\n", root() + "/sys/block/zram0/backing_dev");
+        for (const char* node : {"writeback", "writeback_limit", "writeback_limit_enable"}) {
+            WriteStringToFile("", root() + "/sys/block/zram0/" + node);
+        }
+    }
+
+    std::string root() const { return mDir.path; }
+
+    /* What was written to a node since the last call, nodes are written at offset 0 */
+    std::string take(const std::string& node) {
+        std::string path = root() + node;
+        std::string value;
+        ReadFileToString(path, &value);
+        truncate(path.c_str(), 0);
+        return value;
+    }
+
+  private:
+    TemporaryDir mDir;
+};
+
+class ZramManagerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        ASSERT_TRUE(mManager.initNodes());
+        mStart = Clock::now();
+    }
+
+    /*
+     * Replays PSI trigger events at the given offsets, waking up for the calm
+     * timeout in between like run() does.
+     */
+    void replay(const std::vector<std::pair<std::chrono::milliseconds, Pressure>>& trace) {
+        for (const auto& [offset, level] : trace) {
+            advanceTo(mStart + offset);
+            mManager.onPressure(level, mStart + offset);
+        }
+    }
+
+    void advanceTo(Clock::time_point time) {
+        while (true) {
+            int timeoutMs = mManager.calmTimeoutMs(mNow);
+            if (timeoutMs < 0 || mNow + std::chrono::milliseconds(timeoutMs) > time) {
+                break;
+            }
+            mNow += std::chrono::milliseconds(timeoutMs);
+            mManager.onCalm();
+            mCalms++;
+        }
+        mNow = time;
+    }
+
+    std::string swappiness() { return mTree.take("/proc/sys/vm/swappiness"); }
+
+    FakeTree mTree{"/dev/block/loop42"};
+    ZramManager mManager{mTree.root()};
+    Clock::time_point mStart;
+    Clock::time_point mNow = Clock::now();
+    int mCalms = 0;
+};
+
+TEST_F(ZramManagerTest, NothingIsWrittenBeforePressure) {
+    EXPECT_EQ("60\n", swappiness());
+    EXPECT_EQ(-1, mManager.calmTimeoutMs(Clock::now()));
+    EXPECT_EQ("", mTree.take("/sys/block/zram0/writeback"));
+}
+
+TEST_F(ZramManagerTest, PressureRaisesSwappinessUntilCalm) {
+    swappiness();
+    replay({{0ms, Pressure::SOME}});
+    EXPECT_EQ("200", swappiness());
+    EXPECT_EQ(30000, mManager.calmTimeoutMs(mStart));
+
+    /* Each event restarts the calm period */
+    replay({{20s, Pressure::FULL}, {45s, Pressure::SOME}});
+    EXPECT_EQ(0, mCalms);
+    EXPECT_EQ("", swappiness()) << "unchanged swappiness is written again";
+
+    advanceTo(mStart + 75s);
+    EXPECT_EQ(1, mCalms);
+    EXPECT_EQ("60", swappiness());
+    EXPECT_EQ(-1, mManager.calmTimeoutMs(mStart + 75s));
+}
+
+TEST_F(ZramManagerTest, WritebackIsBoundedAndRateLimited) {
+    replay({{0ms, Pressure::SOME}});
+    EXPECT_EQ(1u, mManager.writebacks());
+    EXPECT_EQ("idle", mTree.take("/sys/block/zram0/writeback"));
+    EXPECT_EQ(std::to_string(64 * 256), mTree.take("/sys/block/zram0/writeback_limit"));
+    /* The limit is lifted again for the framework's own writeback */
+    EXPECT_EQ("0", mTree.take("/sys/block/zram0/writeback_limit_enable"));
+
+    /* A pressure storm within the interval does not write back again */
+    std::vector<std::pair<std::chrono::milliseconds, Pressure>> storm;
+    for (auto offset = 1s; offset < 600s; offset += 7s) {
+        storm.push_back({offset, offset.count() % 2 ? Pressure::SOME : Pressure::FULL});
+    }
+    replay(storm);
+    EXPECT_EQ(1u, mManager.writebacks());
+    EXPECT_EQ("", mTree.take("/sys/block/zram0/writeback"));
+
+    replay({{600s, Pressure::SOME}});
+    EXPECT_EQ(2u, mManager.writebacks());
+    EXPECT_EQ("idle", mTree.take("/sys/block/zram0/writeback"));
+}
+
+/*
+ * A cold app launch, a few calm minutes, then a game streaming assets: the
+ * swappiness follows the pressure and the writeback never runs more often
+ * than the interval allows.
+ */
+TEST_F(ZramManagerTest, PressureTrace) {
+    swappiness();
+    replay({{0ms, Pressure::SOME}, {400ms, Pressure::FULL}, {1500ms, Pressure::SOME}});
+    EXPECT_EQ("200", swappiness());
+
+    advanceTo(mStart + 200s);
+    EXPECT_EQ(1, mCalms);
+    EXPECT_EQ("60", swappiness());
+
+    replay({{200s, Pressure::SOME}});
+    EXPECT_EQ("200", swappiness());
+    EXPECT_EQ(1u, mManager.writebacks()) << "written back within the interval";
+
+    std::vector<std::pair<std::chrono::milliseconds, Pressure>> game;
+    for (auto offset = 300s; offset < 900s; offset += 2s) {
+        game.push_back({offset, Pressure::SOME});
+    }
+    replay(game);
+    EXPECT_EQ(2, mCalms);
+    EXPECT_EQ("200", swappiness());
+    EXPECT_EQ(2u, mManager.writebacks());
+
+    advanceTo(mStart + 1000s);
+    EXPECT_EQ(3, mCalms);
+    EXPECT_EQ("60", swappiness());
+}
+
+TEST(ZramManagerNoBackingDevTest, NothingIsWrittenBack) {
+    FakeTree tree("none");
+    ZramManager manager(tree.root());
+    ASSERT_TRUE(manager.initNodes());
+
+    manager.onPressure(Pressure::FULL, Clock::now());
+    EXPECT_EQ(0u, manager.writebacks());
+    EXPECT_EQ("", tree.take("/sys/block/zram0/writeback"));
+    EXPECT_EQ("200", tree.take("/proc/sys/vm/swappiness"));
+}
+
+}  // namespace